@@ -76,10 +76,16 @@ set(SUNSHINE_TARGET_FILES
         "${CMAKE_SOURCE_DIR}/src/file_handler.h"
         "${CMAKE_SOURCE_DIR}/src/globals.cpp"
         "${CMAKE_SOURCE_DIR}/src/globals.h"
+        "${CMAKE_SOURCE_DIR}/src/log_writer.cpp"
+        "${CMAKE_SOURCE_DIR}/src/log_writer.h"
         "${CMAKE_SOURCE_DIR}/src/logging.cpp"
         "${CMAKE_SOURCE_DIR}/src/logging.h"
+        "${CMAKE_SOURCE_DIR}/src/loopback.cpp"
+        "${CMAKE_SOURCE_DIR}/src/loopback.h"
         "${CMAKE_SOURCE_DIR}/src/main.cpp"
         "${CMAKE_SOURCE_DIR}/src/main.h"
+        "${CMAKE_SOURCE_DIR}/src/metrics.cpp"
+        "${CMAKE_SOURCE_DIR}/src/metrics.h"
         "${CMAKE_SOURCE_DIR}/src/crypto.cpp"
         "${CMAKE_SOURCE_DIR}/src/crypto.h"
         "${CMAKE_SOURCE_DIR}/src/nvhttp.cpp"
@@ -107,12 +113,18 @@ set(SUNSHINE_TARGET_FILES
         "${CMAKE_SOURCE_DIR}/src/process.h"
         "${CMAKE_SOURCE_DIR}/src/network.cpp"
         "${CMAKE_SOURCE_DIR}/src/network.h"
+        "${CMAKE_SOURCE_DIR}/src/pacing.cpp"
+        "${CMAKE_SOURCE_DIR}/src/pacing.h"
         "${CMAKE_SOURCE_DIR}/src/move_by_copy.h"
+        "${CMAKE_SOURCE_DIR}/src/startup.cpp"
+        "${CMAKE_SOURCE_DIR}/src/startup.h"
         "${CMAKE_SOURCE_DIR}/src/system_tray.cpp"
         "${CMAKE_SOURCE_DIR}/src/system_tray.h"
         "${CMAKE_SOURCE_DIR}/src/task_pool.h"
         "${CMAKE_SOURCE_DIR}/src/thread_pool.h"
         "${CMAKE_SOURCE_DIR}/src/thread_safe.h"
+        "${CMAKE_SOURCE_DIR}/src/tracing.cpp"
+        "${CMAKE_SOURCE_DIR}/src/tracing.h"
         "${CMAKE_SOURCE_DIR}/src/sync.h"
         "${CMAKE_SOURCE_DIR}/src/round_robin.h"
         "${CMAKE_SOURCE_DIR}/src/stat_trackers.h"
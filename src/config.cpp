@@ -3,6 +3,7 @@
  * @brief Definitions for the configuration of Sunshine.
  */
 #include <algorithm>
+#include <cstdio>
 #include <filesystem>
 #include <fstream>
 #include <functional>
@@ -336,10 +337,16 @@ namespace config {
 
     1,  // min_fps_factor
     2,  // min_threads
+    false,  // shared_encoder
+    {},  // simulcast_ladder
+    false,  // simulcast_resolution_switching
+    true,  // prewarm_encoder
     {
       "superfast"s,  // preset
       "zerolatency"s,  // tune
       11,  // superfast
+      false,  // pipeline
+      0,  // intra_refresh
     },  // software
 
     {},  // nv
@@ -381,6 +388,19 @@ namespace config {
       false,  // strict_rc_buffer
     },  // vaapi
 
+    {
+      "gradient"s,  // pattern
+      {},  // file
+      0,  // width
+      0,  // height
+      0,  // framerate
+    },  // synthetic
+
+    {
+      0,  // spin
+      false,  // phase_offset
+    },  // capture_pacing
+
     {},  // capture
     {},  // encoder
     {},  // adapter_name
@@ -400,6 +420,10 @@ namespace config {
 
     20,  // fecPercentage
 
+    false,  // kernel_pacing
+    1000,  // pacing_burst
+    1000,  // pacing_link_capacity
+
     ENCRYPTION_MODE_NEVER,  // lan_encryption_mode
     ENCRYPTION_MODE_OPPORTUNISTIC,  // wan_encryption_mode
   };
@@ -454,6 +478,7 @@ namespace config {
     47989,  // Base port number
     "ipv4",  // Address family
     platf::appdata().string() + "/sunshine.log",  // log file
+    32,  // log_max_size
     false,  // notify_pre_releases
     {},  // prep commands
   };
@@ -858,7 +883,10 @@ namespace config {
       auto undo_cmd = prep_cmd.get_optional<std::string>("undo"s);
       auto elevated = prep_cmd.get_optional<bool>("elevated"s);
 
-      input.emplace_back(do_cmd.value_or(""), undo_cmd.value_or(""), elevated.value_or(false));
+      auto &cmd = input.emplace_back(do_cmd.value_or(""), undo_cmd.value_or(""), elevated.value_or(false));
+      cmd.group = prep_cmd.get<std::string>("group"s, "");
+      cmd.background = prep_cmd.get<bool>("background"s, false);
+      cmd.timeout = std::chrono::seconds { std::max(prep_cmd.get<int>("timeout"s, 0), 0) };
     }
   }
 
@@ -917,6 +945,27 @@ namespace config {
     }
   }
 
+  void
+  list_simulcast_rung_f(std::unordered_map<std::string, std::string> &vars, const std::string &name, std::vector<video_t::simulcast_rung_t> &input) {
+    std::vector<std::string> list;
+    list_string_f(vars, name, list);
+
+    for (auto &el : list) {
+      video_t::simulcast_rung_t rung;
+      if (std::sscanf(el.c_str(), "%dx%dx%d:%d", &rung.width, &rung.height, &rung.framerate, &rung.bitrate) != 4 ||
+          rung.width <= 0 || rung.height <= 0 || rung.framerate <= 0 || rung.bitrate <= 0) {
+        std::cout << "Warning: Ignoring invalid simulcast rung ["sv << el << "], expected WIDTHxHEIGHTxFPS:KBPS"sv << std::endl;
+        continue;
+      }
+
+      input.emplace_back(rung);
+    }
+
+    std::sort(std::begin(input), std::end(input), [](const auto &a, const auto &b) {
+      return a.bitrate > b.bitrate;
+    });
+  }
+
   int
   apply_flags(const char *line) {
     int ret = 0;
@@ -968,6 +1017,10 @@ namespace config {
 
     int_f(vars, "qp", video.qp);
     int_f(vars, "min_threads", video.min_threads);
+    bool_f(vars, "shared_encoder", video.shared_encoder);
+    list_simulcast_rung_f(vars, "simulcast_ladder", video.simulcast_ladder);
+    bool_f(vars, "simulcast_resolution_switching", video.simulcast_resolution_switching);
+    bool_f(vars, "prewarm_encoder", video.prewarm_encoder);
     int_between_f(vars, "hevc_mode", video.hevc_mode, { 0, 3 });
     int_between_f(vars, "av1_mode", video.av1_mode, { 0, 3 });
     string_f(vars, "sw_preset", video.sw.sw_preset);
@@ -975,6 +1028,8 @@ namespace config {
       video.sw.svtav1_preset = sw::svtav1_preset_from_view(video.sw.sw_preset);
     }
     string_f(vars, "sw_tune", video.sw.sw_tune);
+    bool_f(vars, "sw_pipeline", video.sw.pipeline);
+    int_between_f(vars, "sw_intra_refresh", video.sw.intra_refresh, { 0, 600 });
 
     int_between_f(vars, "nvenc_preset", video.nv.quality_preset, { 1, 7 });
     int_between_f(vars, "nvenc_vbv_increase", video.nv.vbv_percentage_increase, { 0, 400 });
@@ -1035,6 +1090,21 @@ namespace config {
 
     bool_f(vars, "vaapi_strict_rc_buffer", video.vaapi.strict_rc_buffer);
 
+    string_restricted_f(vars, "synthetic_pattern", video.synthetic.pattern, { "gradient"sv, "scroll"sv, "noise"sv, "desktop"sv });
+    string_f(vars, "synthetic_file", video.synthetic.file);
+    std::string synthetic_resolution;
+    string_f(vars, "synthetic_resolution", synthetic_resolution);
+    if (!synthetic_resolution.empty() &&
+        (std::sscanf(synthetic_resolution.c_str(), "%dx%d", &video.synthetic.width, &video.synthetic.height) != 2 ||
+          video.synthetic.width <= 0 || video.synthetic.height <= 0)) {
+      std::cout << "Warning: Ignoring invalid synthetic_resolution ["sv << synthetic_resolution << "], expected WIDTHxHEIGHT"sv << std::endl;
+      video.synthetic.width = 0;
+      video.synthetic.height = 0;
+    }
+    int_between_f(vars, "synthetic_fps", video.synthetic.framerate, { 0, 1000 });
+    int_between_f(vars, "capture_spin", video.capture_pacing.spin, { 0, 5000 });
+    bool_f(vars, "capture_phase_offset", video.capture_pacing.phase_offset);
+
     string_f(vars, "capture", video.capture);
     string_f(vars, "encoder", video.encoder);
     string_f(vars, "adapter_name", video.adapter_name);
@@ -1045,6 +1115,7 @@ namespace config {
     path_f(vars, "cert", nvhttp.cert);
     string_f(vars, "sunshine_name", nvhttp.sunshine_name);
     path_f(vars, "log_path", config::sunshine.log_file);
+    int_between_f(vars, "log_max_size", config::sunshine.log_max_size, { 0, 4096 });
     path_f(vars, "file_state", nvhttp.file_state);
 
     // Must be run after "file_state"
@@ -1071,6 +1142,9 @@ namespace config {
 
     path_f(vars, "file_apps", stream.file_apps);
     int_between_f(vars, "fec_percentage", stream.fec_percentage, { 1, 255 });
+    bool_f(vars, "kernel_pacing", stream.kernel_pacing);
+    int_between_f(vars, "pacing_burst", stream.pacing_burst, { 100, 10000 });
+    int_between_f(vars, "pacing_link_capacity", stream.pacing_link_capacity, { 1, 400000 });
 
     map_int_int_f(vars, "keybindings"s, input.keybindings);
 
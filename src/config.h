@@ -23,10 +23,23 @@ namespace config {
 
     int min_fps_factor;  // Minimum fps target, determines minimum frame time
     int min_threads;  // Minimum number of threads/slices for CPU encoding
+    bool shared_encoder;  // Encode once for all sessions with identical stream configs
+
+    struct simulcast_rung_t {
+      int width;
+      int height;
+      int framerate;
+      int bitrate;  // Video bitrate in kilobits (1000 bits)
+    };
+    std::vector<simulcast_rung_t> simulcast_ladder;  // Shared encodes sessions are assigned to, from the highest to the lowest quality
+    bool simulcast_resolution_switching;  // Let simulcast rungs change the resolution and framerate negotiated by the client
+    bool prewarm_encoder;  // Open the display and encoder when an app is launched, before the client negotiates the stream
     struct {
       std::string sw_preset;
       std::string sw_tune;
       std::optional<int> svtav1_preset;
+      bool pipeline;  // Convert the next frame on another thread while the current one is encoded
+      int intra_refresh;  // Frames per intra refresh wave used instead of IDR frames to recover from packet loss, 0 to disable
     } sw;
 
     nvenc::nvenc_config nv;
@@ -75,6 +88,19 @@ namespace config {
       bool strict_rc_buffer;
     } vaapi;
 
+    struct {
+      std::string pattern;  // Content generated by the synthetic display: gradient, scroll, noise or desktop
+      std::string file;  // Raw BGRA frames replayed instead of the pattern
+      int width;  // 0 to use the stream resolution
+      int height;
+      int framerate;  // 0 to use the stream framerate
+    } synthetic;
+
+    struct {
+      int spin;  // Microseconds to spin before each capture instead of sleeping, 0 to only sleep
+      bool phase_offset;  // Start capturing early by the usual capture time, so frames are ready on time
+    } capture_pacing;
+
     std::string capture;
     std::string encoder;
     std::string adapter_name;
@@ -98,6 +124,10 @@ namespace config {
 
     int fec_percentage;
 
+    bool kernel_pacing;  // Let the kernel pace video packets with SO_TXTIME instead of sleeping between batches
+    int pacing_burst;  // Highest video pacing rate as a percentage of the client's bitrate
+    int pacing_link_capacity;  // Bandwidth of the network interface shared by all sessions in Mbps
+
     // Video encryption settings for LAN and WAN streams
     int lan_encryption_mode;
     int wan_encryption_mode;
@@ -174,6 +204,10 @@ namespace config {
     std::string do_cmd;
     std::string undo_cmd;
     bool elevated;
+
+    std::string group;  ///< Consecutive commands of the same group run at the same time
+    bool background = false;  ///< Start the next command without waiting for this one to exit
+    std::chrono::seconds timeout {};  ///< Terminate the command if it runs longer, 0 for no limit
   };
   struct sunshine_t {
     std::string locale;
@@ -197,6 +231,7 @@ namespace config {
     std::string address_family;
 
     std::string log_file;
+    int log_max_size;  ///< Log file size in MiB after which it is rotated, 0 disables rotation
     bool notify_pre_releases;
     std::vector<prep_cmd_t> prep_cmds;
   };
@@ -33,13 +33,18 @@
 #include "httpcommon.h"
 
 #include "logging.h"
+#include "loopback.h"
+#include "metrics.h"
 #include "network.h"
 #include "nvhttp.h"
 #include "platform/common.h"
 #include "rtsp.h"
+#include "startup.h"
+#include "tracing.h"
 #include "utility.h"
 #include "uuid.h"
 #include "version.h"
+#include <charconv>
 #include <cstdlib>
 #include <jwt-cpp/jwt.h>
 #include <regex>
@@ -395,10 +400,148 @@ namespace confighttp {
     response->write(content, headers);
   }
 
+  /**
+   * @brief Maximum number of bytes returned by a single ranged request to `/api/logs`.
+   */
+  constexpr std::uintmax_t LOG_CHUNK_MAX = 4 * 1024 * 1024;
+
+  /**
+   * @brief How often a follow request to `/api/logs` checks the log file for new data.
+   */
+  constexpr auto LOG_FOLLOW_POLL_INTERVAL = 250ms;
+
+  /**
+   * @brief Upper bound for the `timeout` query parameter of a follow request to `/api/logs`.
+   */
+  constexpr auto LOG_FOLLOW_MAX_TIMEOUT = 60s;
+
+  /**
+   * @brief Upper bound for the `duration` query parameter of `/api/trace`.
+   */
+  constexpr auto TRACE_MAX_DURATION = 60s;
+
+  /**
+   * @brief Upper bound for the `duration` query parameter of `/api/loopback`.
+   */
+  constexpr auto LOOPBACK_MAX_DURATION = 600s;
+
+  /**
+   * @brief Parse an unsigned decimal number.
+   * @param view The string to parse.
+   * @return The number, or `std::nullopt` if `view` is not entirely a number.
+   */
+  std::optional<std::uintmax_t>
+  parse_uint(const std::string_view &view) {
+    std::uintmax_t value;
+    auto [ptr, ec] = std::from_chars(view.data(), view.data() + view.size(), value);
+    if (view.empty() || ec != std::errc {} || ptr != view.data() + view.size()) {
+      return std::nullopt;
+    }
+
+    return value;
+  }
+
+  /**
+   * @brief Parse a single `bytes` range of a `Range` header.
+   * @param header The value of the `Range` header.
+   * @param size The current size of the resource.
+   * @return The half-open range `[begin, end)`, or `std::nullopt` if the header is malformed or unsatisfiable.
+   */
+  std::optional<std::pair<std::uintmax_t, std::uintmax_t>>
+  parse_byte_range(std::string_view header, std::uintmax_t size) {
+    constexpr auto prefix = "bytes="sv;
+    if (!header.starts_with(prefix) || header.find(',') != std::string_view::npos) {
+      return std::nullopt;
+    }
+    header.remove_prefix(prefix.size());
+
+    auto dash = header.find('-');
+    if (dash == std::string_view::npos) {
+      return std::nullopt;
+    }
+
+    auto first = header.substr(0, dash);
+    auto last = header.substr(dash + 1);
+
+    // "bytes=-N" requests the last N bytes
+    if (first.empty()) {
+      auto suffix = parse_uint(last);
+      if (!suffix || *suffix == 0 || size == 0) {
+        return std::nullopt;
+      }
+
+      return std::pair { size - std::min(*suffix, size), size };
+    }
+
+    auto begin = parse_uint(first);
+    if (!begin || *begin >= size) {
+      return std::nullopt;
+    }
+
+    // "bytes=N-" requests everything from N on
+    if (last.empty()) {
+      return std::pair { *begin, size };
+    }
+
+    auto end = parse_uint(last);
+    if (!end || *end < *begin) {
+      return std::nullopt;
+    }
+
+    return std::pair { *begin, std::min(*end + 1, size) };
+  }
+
+  /**
+   * @brief Send the log file starting at the given offset.
+   * @param response The HTTP response object.
+   * @param offset The offset the client has already read up to.
+   * @param deadline If the log has no data past `offset`, wait for new data until this point in time.
+   */
+  void
+  send_log_from_offset(resp_https_t response, std::uintmax_t offset, std::chrono::steady_clock::time_point deadline) {
+    std::error_code ec;
+    auto size = fs::file_size(config::sunshine.log_file, ec);
+    if (ec) {
+      size = 0;
+    }
+
+    // The file shrinking below the offset means it was rotated, so start over from the beginning of the new file
+    bool rotated = offset > size;
+    if (rotated) {
+      offset = 0;
+    }
+
+    if (offset == size && std::chrono::steady_clock::now() < deadline) {
+      task_pool.pushDelayed(send_log_from_offset, LOG_FOLLOW_POLL_INTERVAL, response, offset, deadline);
+      return;
+    }
+
+    auto content = file_handler::read_file_range(config::sunshine.log_file.c_str(), offset, LOG_CHUNK_MAX);
+
+    SimpleWeb::CaseInsensitiveMultimap headers;
+    headers.emplace("Content-Type", "text/plain");
+    headers.emplace("X-Log-Size", std::to_string(size));
+    headers.emplace("X-Log-Offset", std::to_string(offset));
+    headers.emplace("X-Log-Next-Offset", std::to_string(offset + content.size()));
+    headers.emplace("X-Log-Rotated", rotated ? "true" : "false");
+    response->write(SimpleWeb::StatusCode::success_ok, content, headers);
+  }
+
   /**
    * @brief Get the logs from the log file.
    * @param response The HTTP response object.
    * @param request The HTTP request object.
+   *
+   * Without parameters the whole log file is returned. A part of the log can be requested instead,
+   * either with a standard `Range: bytes=...` header or with the following query parameters:
+   * - `tail=N` returns the last N bytes of the log.
+   * - `offset=N` returns the log starting at byte N.
+   * - `follow=true` combined with `offset` holds the request open until new data is
+   *   written past the offset or `timeout` seconds (default 30, maximum 60) have passed.
+   *
+   * Responses to query parameter requests carry `X-Log-Offset`, `X-Log-Next-Offset` and `X-Log-Size` headers.
+   * `X-Log-Rotated: true` signals that the log was rotated and the content starts from the beginning of the new file.
+   * At most 4 MiB are returned by a single ranged request.
    */
   void
   getLogs(resp_https_t response, req_https_t request) {
@@ -406,12 +549,341 @@ namespace confighttp {
 
     print_req(request);
 
-    std::string content = file_handler::read_file(config::sunshine.log_file.c_str());
+    std::error_code ec;
+    auto size = fs::file_size(config::sunshine.log_file, ec);
+    if (ec) {
+      size = 0;
+    }
+
+    auto range_header = request->header.find("Range");
+    if (range_header != request->header.end()) {
+      SimpleWeb::CaseInsensitiveMultimap headers;
+      headers.emplace("Content-Type", "text/plain");
+      headers.emplace("Accept-Ranges", "bytes");
+
+      auto range = parse_byte_range(range_header->second, size);
+      if (!range) {
+        headers.emplace("Content-Range", "bytes */" + std::to_string(size));
+        response->write(SimpleWeb::StatusCode::client_error_range_not_satisfiable, headers);
+        return;
+      }
+
+      auto [begin, end] = *range;
+      auto content = file_handler::read_file_range(config::sunshine.log_file.c_str(), begin, std::min(end - begin, LOG_CHUNK_MAX));
+      if (content.empty()) {
+        headers.emplace("Content-Range", "bytes */" + std::to_string(size));
+        response->write(SimpleWeb::StatusCode::client_error_range_not_satisfiable, headers);
+        return;
+      }
+
+      headers.emplace("Content-Range", "bytes " + std::to_string(begin) + "-" + std::to_string(begin + content.size() - 1) + "/" + std::to_string(size));
+      response->write(SimpleWeb::StatusCode::success_partial_content, content, headers);
+      return;
+    }
+
+    auto args = request->parse_query_string();
+    auto tail = args.find("tail");
+    auto offset = args.find("offset");
+
+    if (tail != args.end() || offset != args.end()) {
+      std::uintmax_t begin = 0;
+      if (offset != args.end()) {
+        begin = parse_uint(offset->second).value_or(0);
+      }
+      else {
+        begin = size - std::min(parse_uint(tail->second).value_or(0), size);
+      }
+
+      auto deadline = std::chrono::steady_clock::now();
+      auto follow = args.find("follow");
+      if (follow != args.end() && (follow->second == "true" || follow->second == "1")) {
+        std::chrono::seconds timeout = 30s;
+        auto timeout_arg = args.find("timeout");
+        if (timeout_arg != args.end()) {
+          timeout = std::chrono::seconds { parse_uint(timeout_arg->second).value_or(timeout.count()) };
+        }
+
+        deadline += std::min<std::chrono::seconds>(timeout, LOG_FOLLOW_MAX_TIMEOUT);
+      }
+
+      send_log_from_offset(response, begin, deadline);
+      return;
+    }
+
+    std::string content = file_handler::read_file_range(config::sunshine.log_file.c_str(), 0, size);
     SimpleWeb::CaseInsensitiveMultimap headers;
     headers.emplace("Content-Type", "text/plain");
+    headers.emplace("Accept-Ranges", "bytes");
     response->write(SimpleWeb::StatusCode::success_ok, content, headers);
   }
 
+  /**
+   * @brief Get the streaming pipeline metrics in the Prometheus text exposition format.
+   * @param response The HTTP response object.
+   * @param request The HTTP request object.
+   *
+   * Per-session series carry a `session` label and are removed when the session ends.
+   */
+  void
+  getMetrics(resp_https_t response, req_https_t request) {
+    if (!authenticate(response, request)) return;
+
+    SimpleWeb::CaseInsensitiveMultimap headers;
+    headers.emplace("Content-Type", "text/plain; version=0.0.4");
+    response->write(SimpleWeb::StatusCode::success_ok, metrics::serialize(), headers);
+  }
+
+  /**
+   * @brief Get the initialization progress of the host's components.
+   * @param response The HTTP response object.
+   * @param request The HTTP request object.
+   *
+   * `ready` is true once the components needed to stream have finished initializing.
+   * Until then, `/launch` and `/resume` answer that the host is warming up.
+   * @code{.json}
+   * {
+   *   "ready": false,
+   *   "components": [
+   *     {
+   *       "name": "usbip",
+   *       "state": "running",
+   *       "dependencies": ["ssh"],
+   *       "started_ms": 35,
+   *       "duration_ms": 1200
+   *     }
+   *   ]
+   * }
+   * @endcode
+   */
+  void
+  getStartup(resp_https_t response, req_https_t request) {
+    if (!authenticate(response, request)) return;
+
+    print_req(request);
+
+    pt::ptree outputTree;
+    outputTree.put("ready", startup::ready_to_stream());
+
+    pt::ptree components;
+    for (auto &component : startup::host().components()) {
+      pt::ptree node;
+      node.put("name", component.name);
+      node.put("state", std::string { startup::to_string(component.state) });
+
+      pt::ptree dependencies;
+      for (auto &dependency : component.dependencies) {
+        pt::ptree dependency_node;
+        dependency_node.put("", dependency);
+        dependencies.push_back(std::make_pair("", dependency_node));
+      }
+      node.add_child("dependencies", dependencies);
+
+      node.put("started_ms", component.started.count());
+      node.put("duration_ms", component.duration.count());
+      components.push_back(std::make_pair("", node));
+    }
+    outputTree.add_child("components", components);
+
+    std::ostringstream data;
+    pt::write_json(data, outputTree);
+    response->write(data.str());
+  }
+
+  /**
+   * @brief Start recording a per-frame pipeline trace.
+   * @param response The HTTP response object.
+   * @param request The HTTP request object.
+   *
+   * The `duration` query parameter sets how many seconds to record for, it defaults to 5 and is capped at 60.
+   * Any previously recorded trace is discarded.
+   */
+  void
+  startTrace(resp_https_t response, req_https_t request) {
+    if (!authenticate(response, request)) return;
+
+    print_req(request);
+
+    std::chrono::seconds duration = 5s;
+    auto args = request->parse_query_string();
+    auto duration_arg = args.find("duration");
+    if (duration_arg != args.end()) {
+      duration = std::chrono::seconds { parse_uint(duration_arg->second).value_or(duration.count()) };
+    }
+    duration = std::clamp<std::chrono::seconds>(duration, 1s, TRACE_MAX_DURATION);
+
+    tracing::start(duration);
+
+    pt::ptree outputTree;
+    outputTree.put("status", true);
+    outputTree.put("duration", duration.count());
+
+    std::ostringstream data;
+    pt::write_json(data, outputTree);
+    response->write(data.str());
+  }
+
+  /**
+   * @brief Get the last recorded pipeline trace in the Chrome trace event format.
+   * @param response The HTTP response object.
+   * @param request The HTTP request object.
+   *
+   * The trace can be loaded in `chrome://tracing` or https://ui.perfetto.dev.
+   * Spans carry the frame index in their `args`, so a single frame can be followed from capture to the network.
+   */
+  void
+  getTrace(resp_https_t response, req_https_t request) {
+    if (!authenticate(response, request)) return;
+
+    print_req(request);
+
+    SimpleWeb::CaseInsensitiveMultimap headers;
+    headers.emplace("Content-Type", "application/json");
+    headers.emplace("Content-Disposition", "attachment; filename=\"sunshine-trace.json\"");
+    response->write(SimpleWeb::StatusCode::success_ok, tracing::dump(), headers);
+  }
+
+  /**
+   * @brief Start a loopback streaming session to benchmark the pipeline on this host.
+   * @param response The HTTP response object.
+   * @param request The HTTP request object.
+   *
+   * The session runs in the background, its progress and results are returned by `GET /api/loopback`.
+   * Only one loopback session can run at a time. All query parameters are optional:
+   * | Parameter  | Description                                              | Default |
+   * |------------|----------------------------------------------------------|---------|
+   * | duration   | How many seconds to stream for, capped at 600            | 10      |
+   * | width      | Requested width                                          | 1920    |
+   * | height     | Requested height                                         | 1080    |
+   * | fps        | Requested framerate                                      | 60      |
+   * | bitrate    | Requested bitrate in Kbps                                | 20000   |
+   * | packetsize | Video packet size                                        | 1392    |
+   * | format     | 0 for H.264, 1 for HEVC, 2 for AV1                       | 0       |
+   * | slices     | Slices per frame                                         | 1       |
+   * | encrypt    | 1 to encrypt video and audio                             | 1       |
+   * | loss       | Percentage of received packets to drop, e.g. `0.5`       | 0       |
+   * | jitter     | Maximum random delay added to each packet, in ms         | 0       |
+   * | seed       | Seed of the loss and jitter injector                     | 1       |
+   */
+  void
+  startLoopback(resp_https_t response, req_https_t request) {
+    if (!authenticate(response, request)) return;
+
+    print_req(request);
+
+    loopback::options_t options;
+    auto args = request->parse_query_string();
+    auto get_uint = [&](const std::string &name, auto &value) {
+      auto arg = args.find(name);
+      if (arg != args.end()) {
+        value = parse_uint(arg->second).value_or(value);
+      }
+    };
+
+    auto duration = (std::uintmax_t) options.duration.count();
+    auto jitter = (std::uintmax_t) options.jitter.count();
+    auto encrypt = (std::uintmax_t) options.encrypt;
+    get_uint("duration", duration);
+    get_uint("width", options.width);
+    get_uint("height", options.height);
+    get_uint("fps", options.framerate);
+    get_uint("bitrate", options.bitrate);
+    get_uint("packetsize", options.packet_size);
+    get_uint("format", options.video_format);
+    get_uint("slices", options.slices);
+    get_uint("encrypt", encrypt);
+    get_uint("jitter", jitter);
+    get_uint("seed", options.seed);
+
+    options.duration = std::clamp<std::chrono::seconds>(std::chrono::seconds { duration }, 1s, LOOPBACK_MAX_DURATION);
+    options.jitter = std::chrono::milliseconds { jitter };
+    options.encrypt = encrypt != 0;
+
+    auto loss_arg = args.find("loss");
+    if (loss_arg != args.end()) {
+      auto &loss = loss_arg->second;
+      std::from_chars(loss.data(), loss.data() + loss.size(), options.loss);
+      options.loss = std::clamp(options.loss, 0.0, 100.0);
+    }
+
+    pt::ptree outputTree;
+    if (loopback::start(options)) {
+      outputTree.put("status", false);
+      outputTree.put("error", "A loopback session is already running");
+    }
+    else {
+      outputTree.put("status", true);
+      outputTree.put("duration", options.duration.count());
+    }
+
+    std::ostringstream data;
+    pt::write_json(data, outputTree);
+    response->write(data.str());
+  }
+
+  /**
+   * @brief Get the report of the current or the last loopback session.
+   * @param response The HTTP response object.
+   * @param request The HTTP request object.
+   *
+   * While the session runs, `running` is true and the report is updated every second.
+   * - `goodput_mbps` counts the payload of complete frames only.
+   * - `frame_latency_ms` goes from the first packet of a frame until it could be reassembled.
+   * - `host_latency_ms` is the frame processing latency reported by the host in the frame header.
+   * - `fec_overhead` is the number of parity shards sent per data shard.
+   */
+  void
+  getLoopback(resp_https_t response, req_https_t request) {
+    if (!authenticate(response, request)) return;
+
+    print_req(request);
+
+    pt::ptree outputTree;
+    auto report = loopback::report();
+    if (!report) {
+      outputTree.put("status", false);
+      outputTree.put("error", "No loopback session was started");
+    }
+    else {
+      auto put_latency = [&](const std::string &name, const loopback::latency_t &latency) {
+        outputTree.put(name + ".p50", latency.p50);
+        outputTree.put(name + ".p95", latency.p95);
+        outputTree.put(name + ".p99", latency.p99);
+        outputTree.put(name + ".max", latency.max);
+      };
+
+      outputTree.put("status", report->error.empty());
+      outputTree.put("running", report->running);
+      if (!report->error.empty()) {
+        outputTree.put("error", report->error);
+      }
+      outputTree.put("options.duration", report->options.duration.count());
+      outputTree.put("options.loss", report->options.loss);
+      outputTree.put("options.jitter", report->options.jitter.count());
+      outputTree.put("options.encrypt", report->options.encrypt);
+      outputTree.put("seconds", report->seconds);
+      outputTree.put("video.frames_complete", report->frames_complete);
+      outputTree.put("video.frames_recovered", report->frames_recovered);
+      outputTree.put("video.frames_lost", report->frames_lost);
+      outputTree.put("video.packets", report->video_packets);
+      outputTree.put("video.packets_dropped", report->video_packets_dropped);
+      outputTree.put("video.decrypt_errors", report->video_decrypt_errors);
+      outputTree.put("video.bytes", report->video_bytes);
+      outputTree.put("video.goodput_mbps", report->goodput_mbps);
+      outputTree.put("video.fec_overhead", report->fec_overhead);
+      put_latency("video.frame_latency_ms", report->frame_latency);
+      put_latency("video.host_latency_ms", report->host_latency);
+      outputTree.put("audio.packets", report->audio_packets);
+      outputTree.put("audio.packets_dropped", report->audio_packets_dropped);
+      outputTree.put("audio.recovered", report->audio_recovered);
+      outputTree.put("audio.lost", report->audio_lost);
+      outputTree.put("audio.decrypt_errors", report->audio_decrypt_errors);
+    }
+
+    std::ostringstream data;
+    pt::write_json(data, outputTree);
+    response->write(data.str());
+  }
+
   /**
    * @brief Save an application. If the application already exists, it will be updated, otherwise it will be added.
    * @param response The HTTP response object.
@@ -1037,6 +1509,12 @@ namespace confighttp {
     server.resource["^/api/pin$"]["POST"] = savePin;
     server.resource["^/api/apps$"]["GET"] = getApps;
     server.resource["^/api/logs$"]["GET"] = getLogs;
+    server.resource["^/metrics$"]["GET"] = getMetrics;
+    server.resource["^/api/startup$"]["GET"] = getStartup;
+    server.resource["^/api/trace$"]["GET"] = getTrace;
+    server.resource["^/api/trace$"]["POST"] = startTrace;
+    server.resource["^/api/loopback$"]["GET"] = getLoopback;
+    server.resource["^/api/loopback$"]["POST"] = startLoopback;
     server.resource["^/api/apps$"]["POST"] = saveApp;
     server.resource["^/api/config$"]["GET"] = getConfig;
     server.resource["^/api/config$"]["POST"] = saveConfig;
@@ -175,6 +175,16 @@ namespace crypto {
        */
       int
       encrypt(const std::string_view &plaintext, std::uint8_t *cipher, aes_t *iv);
+
+      /**
+       * @brief Decrypts the ciphertext using AES CBC mode.
+       * @param cipher The ciphertext, a multiple of the block size.
+       * @param plaintext The buffer where the resulting plaintext will be written.
+       * @param iv The initialization vector that was used for the encryption.
+       * @return 0 on success, -1 if the ciphertext or its padding is invalid.
+       */
+      int
+      decrypt(const std::string_view &cipher, std::vector<std::uint8_t> &plaintext, aes_t *iv);
     };
   }  // namespace cipher
 }  // namespace crypto
@@ -4,6 +4,7 @@
  */
 
 // standard includes
+#include <algorithm>
 #include <filesystem>
 #include <fstream>
 
@@ -66,6 +67,28 @@ get_self_path() {
     return std::string { (std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>() };
   }
 
+  std::string
+  read_file_range(const char *path, std::uintmax_t offset, std::size_t length) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+      BOOST_LOG(debug) << "Missing file: " << path;
+      return {};
+    }
+
+    in.seekg(0, std::ios::end);
+    std::uintmax_t size = in.tellg();
+    if (offset >= size) {
+      return {};
+    }
+
+    std::string content(std::min<std::uintmax_t>(length, size - offset), '\0');
+    in.seekg(offset);
+    in.read(content.data(), content.size());
+    content.resize(in.gcount());
+
+    return content;
+  }
+
   int
   write_file(const char *path, const std::string_view &contents) {
     std::ofstream out(path);
@@ -4,6 +4,7 @@
  */
 #pragma once
 
+#include <cstdint>
 #include <string>
 
 /**
@@ -43,6 +44,19 @@ namespace file_handler {
   std::string
   read_file(const char *path);
 
+  /**
+   * @brief Read a byte range of a file to string.
+   * @param path The path of the file.
+   * @param offset The byte offset to start reading from.
+   * @param length The maximum number of bytes to read.
+   * @return The contents of the range, shorter than `length` if the end of the file is reached.
+   * @examples
+   * std::string tail = read_file_range("path/to/file", 1024, 512);
+   * @examples_end
+   */
+  std::string
+  read_file_range(const char *path, std::uintmax_t offset, std::size_t length);
+
   /**
    * @brief Writes a file.
    * @param path The path of the file.
@@ -0,0 +1,159 @@
+/**
+ * @file src/log_writer.cpp
+ * @brief Definitions for the batched log writer.
+ */
+// standard includes
+#include <filesystem>
+#include <iostream>
+#include <utility>
+
+// lib includes
+#include <boost/log/attributes/value_extraction.hpp>
+
+// local includes
+#include "log_writer.h"
+#include "logging.h"
+
+using namespace std::literals;
+
+namespace logging {
+  log_writer_t::log_writer_t(options_t options):
+      options { std::move(options) },
+      file { this->options.file, std::ios::out | std::ios::trunc } {
+    queue.reserve(this->options.max_queue);
+    thread = std::thread { &log_writer_t::run, this };
+  }
+
+  log_writer_t::~log_writer_t() {
+    {
+      std::lock_guard lg { queue_mutex };
+      stop = true;
+    }
+    queue_cv.notify_one();
+    thread.join();
+  }
+
+  void
+  log_writer_t::consume(const boost::log::record_view &rec) {
+    auto severity = boost::log::extract<int>("Severity", rec);
+    bool is_urgent = severity && severity.get() >= options.flush_severity;
+
+    {
+      std::lock_guard lg { queue_mutex };
+      if (queue.size() >= options.max_queue) {
+        dropped_total.fetch_add(1, std::memory_order_relaxed);
+        if (!first_drop) {
+          first_drop = std::chrono::system_clock::now();
+        }
+        return;
+      }
+
+      queue.push_back(rec);
+      ++queued_seq;
+      urgent = urgent || is_urgent;
+    }
+
+    if (is_urgent) {
+      queue_cv.notify_one();
+    }
+  }
+
+  void
+  log_writer_t::flush() {
+    std::unique_lock ul { queue_mutex };
+    auto target = queued_seq;
+    urgent = true;
+    queue_cv.notify_one();
+    written_cv.wait(ul, [&]() { return written_seq >= target || stop; });
+  }
+
+  std::uint64_t
+  log_writer_t::dropped() const {
+    return dropped_total.load(std::memory_order_relaxed);
+  }
+
+  void
+  log_writer_t::run() {
+    std::vector<boost::log::record_view> batch;
+    batch.reserve(options.max_queue);
+
+    std::string buffer;
+    boost::log::formatting_ostream os { buffer };
+
+    std::unique_lock ul { queue_mutex };
+    while (true) {
+      queue_cv.wait_for(ul, options.flush_interval, [&]() { return stop || urgent; });
+
+      batch.swap(queue);
+      auto batch_seq = queued_seq;
+      auto done = stop;
+      urgent = false;
+      auto dropped_now = dropped();
+      auto drop_time = std::exchange(first_drop, std::nullopt);
+      ul.unlock();
+
+      for (auto &rec : batch) {
+        if (options.formatter) {
+          options.formatter(rec, os);
+        }
+        os << '\n';
+      }
+      batch.clear();
+
+      // The notice goes straight into the batch: logging it through the core from this thread
+      // would re-enter the sink while flush() holds the sink's lock waiting on this thread.
+      if (drop_time) {
+        if (options.formatter) {
+          format_prefix(3, *drop_time, os);  // warning
+        }
+        os << "Dropped "sv << dropped_now - dropped_reported << " log records because the log queue was full\n"sv;
+        dropped_reported = dropped_now;
+      }
+      os.flush();
+
+      if (!buffer.empty()) {
+        write(buffer);
+        buffer.clear();
+      }
+
+      ul.lock();
+      written_seq = batch_seq;
+      written_cv.notify_all();
+
+      if (done && queue.empty()) {
+        break;
+      }
+    }
+  }
+
+  void
+  log_writer_t::write(const std::string &buffer) {
+    if (options.console) {
+      std::cout.write(buffer.data(), buffer.size());
+      std::cout.flush();
+    }
+
+    if (!file.is_open()) {
+      return;
+    }
+
+    file.write(buffer.data(), buffer.size());
+    file.flush();
+    file_size += buffer.size();
+
+    if (options.max_size && file_size >= options.max_size) {
+      rotate();
+    }
+  }
+
+  void
+  log_writer_t::rotate() {
+    file.close();
+
+    std::error_code ec;
+    std::filesystem::rename(options.file, options.file + ".1", ec);
+
+    file.open(options.file, std::ios::out | std::ios::trunc);
+    file_size = 0;
+  }
+}  // namespace logging
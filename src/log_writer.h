@@ -0,0 +1,104 @@
+/**
+ * @file src/log_writer.h
+ * @brief Declarations for the batched log writer.
+ */
+#pragma once
+
+// standard includes
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// lib includes
+#include <boost/log/core/record_view.hpp>
+#include <boost/log/sinks/basic_sink_backend.hpp>
+#include <boost/log/sinks/frontend_requirements.hpp>
+#include <boost/log/utility/formatting_ostream.hpp>
+
+namespace logging {
+  /**
+   * @brief A Boost.Log sink backend that never blocks the logging thread on I/O.
+   *
+   * Records are queued and written in batches by a background thread, which flushes
+   * on a timer or as soon as a record of at least `flush_severity` is queued.
+   * The queue is bounded: once full, new records are dropped and counted instead of stalling the caller.
+   * The log file is rotated to `<file>.1` once it reaches `max_size`.
+   */
+  class log_writer_t: public boost::log::sinks::basic_sink_backend<
+                        boost::log::sinks::combine_requirements<
+                          boost::log::sinks::concurrent_feeding,
+                          boost::log::sinks::flushing>::type> {
+  public:
+    using formatter_t = void (*)(const boost::log::record_view &, boost::log::formatting_ostream &);
+
+    struct options_t {
+      std::string file;  ///< The log file to write to
+      std::uintmax_t max_size = 0;  ///< Size in bytes after which the log file is rotated, 0 disables rotation
+      bool console = false;  ///< Also write records to stdout
+      formatter_t formatter = nullptr;  ///< Formats a record, called on the writer thread
+      std::size_t max_queue = 8192;  ///< Maximum number of queued records before new ones are dropped
+      std::chrono::milliseconds flush_interval = std::chrono::milliseconds(100);  ///< Maximum time a record is held before being written
+      int flush_severity = 4;  ///< Records of at least this severity are written immediately
+    };
+
+    explicit log_writer_t(options_t options);
+    ~log_writer_t();
+
+    /**
+     * @brief Queue a record, dropping it if the queue is full.
+     * @param rec The record to write.
+     */
+    void
+    consume(const boost::log::record_view &rec);
+
+    /**
+     * @brief Wait until all records queued so far are written to the log.
+     */
+    void
+    flush();
+
+    /**
+     * @brief Get the number of records dropped because the queue was full.
+     * @return The total number of dropped records.
+     */
+    std::uint64_t
+    dropped() const;
+
+  private:
+    void
+    run();
+
+    void
+    write(const std::string &buffer);
+
+    void
+    rotate();
+
+    options_t options;
+
+    std::mutex queue_mutex;
+    std::condition_variable queue_cv;
+    std::condition_variable written_cv;
+    std::vector<boost::log::record_view> queue;
+    std::uint64_t queued_seq = 0;
+    std::uint64_t written_seq = 0;
+    bool urgent = false;
+    bool stop = false;
+
+    std::atomic<std::uint64_t> dropped_total = 0;
+    std::uint64_t dropped_reported = 0;
+    std::optional<std::chrono::system_clock::time_point> first_drop;  ///< When the first record not reported yet was dropped
+
+    std::ofstream file;
+    std::uintmax_t file_size = 0;
+
+    std::thread thread;
+  };
+}  // namespace logging
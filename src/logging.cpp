@@ -3,14 +3,13 @@
  * @brief Definitions for logging related functions.
  */
 // standard includes
-#include <fstream>
 #include <iomanip>
 #include <iostream>
 
 // lib includes
-#include <boost/core/null_deleter.hpp>
 #include <boost/format.hpp>
 #include <boost/log/attributes/clock.hpp>
+#include <boost/log/attributes/function.hpp>
 #include <boost/log/common.hpp>
 #include <boost/log/expressions.hpp>
 #include <boost/log/sinks.hpp>
@@ -18,6 +17,7 @@
 #include <display_device/logging.h>
 
 // local includes
+#include "log_writer.h"
 #include "logging.h"
 
 extern "C" {
@@ -28,7 +28,9 @@ using namespace std::literals;
 
 namespace bl = boost::log;
 
-boost::shared_ptr<boost::log::sinks::asynchronous_sink<boost::log::sinks::text_ostream_backend>> sink;
+using log_sink = bl::sinks::synchronous_sink<logging::log_writer_t>;
+
+boost::shared_ptr<log_sink> sink;
 
 bl::sources::severity_logger<int> verbose(0);  // Dominating output
 bl::sources::severity_logger<int> debug(1);  // Follow what is happening
@@ -58,9 +60,19 @@ namespace logging {
   formatter(const boost::log::record_view &view, boost::log::formatting_ostream &os) {
     constexpr const char *message = "Message";
     constexpr const char *severity = "Severity";
+    constexpr const char *time_stamp = "TimeStamp";
 
     auto log_level = view.attribute_values()[severity].extract<int>().get();
 
+    // Records are formatted on the writer thread, possibly long after they were made
+    auto time = view.attribute_values()[time_stamp].extract<std::chrono::system_clock::time_point>();
+
+    format_prefix(log_level, time ? time.get() : std::chrono::system_clock::now(), os);
+    os << view.attribute_values()[message].extract<std::string>();
+  }
+
+  void
+  format_prefix(int log_level, std::chrono::system_clock::time_point time, boost::log::formatting_ostream &os) {
     std::string_view log_type;
     switch (log_level) {
       case 0:
@@ -88,19 +100,18 @@ namespace logging {
 #endif
     };
 
-    auto now = std::chrono::system_clock::now();
     auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-      now - std::chrono::time_point_cast<std::chrono::seconds>(now));
+      time - std::chrono::time_point_cast<std::chrono::seconds>(time));
 
-    auto t = std::chrono::system_clock::to_time_t(now);
+    auto t = std::chrono::system_clock::to_time_t(time);
     auto lt = *std::localtime(&t);
 
     os << "["sv << std::put_time(&lt, "%Y-%m-%d %H:%M:%S.") << boost::format("%03u") % ms.count() << "]: "sv
-       << log_type << view.attribute_values()[message].extract<std::string>();
+       << log_type;
   }
 
   [[nodiscard]] std::unique_ptr<deinit_t>
-  init(int min_log_level, const std::string &log_file) {
+  init(int min_log_level, const std::string &log_file, std::uintmax_t max_size) {
     if (sink) {
       // Deinitialize the logging system before reinitializing it. This can probably only ever be hit in tests.
       deinit();
@@ -109,19 +120,21 @@ namespace logging {
     setup_av_logging(min_log_level);
     setup_libdisplaydevice_logging(min_log_level);
 
-    sink = boost::make_shared<text_sink>();
+    // The time is taken when the record is made, the writer thread formats it later
+    bl::core::get()->add_global_attribute("TimeStamp", bl::attributes::make_function(&std::chrono::system_clock::now));
 
+    logging::log_writer_t::options_t options;
+    options.file = log_file;
+    options.max_size = max_size;
+    options.formatter = &formatter;
 #ifndef SUNSHINE_TESTS
-    boost::shared_ptr<std::ostream> stream { &std::cout, boost::null_deleter() };
-    sink->locked_backend()->add_stream(stream);
+    options.console = true;
 #endif
-    sink->locked_backend()->add_stream(boost::make_shared<std::ofstream>(log_file));
-    sink->set_filter(severity >= min_log_level);
-    sink->set_formatter(&formatter);
 
-    // Flush after each log record to ensure log file contents on disk isn't stale.
-    // This is particularly important when running from a Windows service.
-    sink->locked_backend()->auto_flush(true);
+    // Records are formatted and written in batches on the writer thread, which flushes every 100ms
+    // and immediately on errors, so the log file on disk doesn't go stale when running as a Windows service.
+    sink = boost::make_shared<log_sink>(boost::make_shared<logging::log_writer_t>(std::move(options)));
+    sink->set_filter(severity >= min_log_level);
 
     bl::core::get()->add_sink(sink);
     return std::make_unique<deinit_t>();
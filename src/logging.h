@@ -4,12 +4,13 @@
  */
 #pragma once
 
+// standard includes
+#include <chrono>
+
 // lib includes
 #include <boost/log/common.hpp>
 #include <boost/log/sinks.hpp>
 
-using text_sink = boost::log::sinks::asynchronous_sink<boost::log::sinks::text_ostream_backend>;
-
 extern boost::log::sources::severity_logger<int> verbose;
 extern boost::log::sources::severity_logger<int> debug;
 extern boost::log::sources::severity_logger<int> info;
@@ -21,6 +22,7 @@ extern boost::log::sources::severity_logger<int> tests;
 #endif
 
 #include "config.h"
+#include "metrics.h"
 #include "stat_trackers.h"
 
 /**
@@ -47,17 +49,27 @@ namespace logging {
   void
   formatter(const boost::log::record_view &view, boost::log::formatting_ostream &os);
 
+  /**
+   * @brief Write the timestamp and severity that start every log line.
+   * @param log_level The severity of the line.
+   * @param time When the line was logged.
+   * @param os The stream to write to.
+   */
+  void
+  format_prefix(int log_level, std::chrono::system_clock::time_point time, boost::log::formatting_ostream &os);
+
   /**
    * @brief Initialize the logging system.
    * @param min_log_level The minimum log level to output.
    * @param log_file The log file to write to.
+   * @param max_size The size in bytes after which the log file is rotated to `log_file.1`, 0 disables rotation.
    * @return An object that will deinitialize the logging system when it goes out of scope.
    * @examples
-   * log_init(2, "sunshine.log");
+   * log_init(2, "sunshine.log", 32 * 1024 * 1024);
    * @examples_end
    */
   [[nodiscard]] std::unique_ptr<deinit_t>
-  init(int min_log_level, const std::string &log_file);
+  init(int min_log_level, const std::string &log_file, std::uintmax_t max_size = 0);
 
   /**
    * @brief Setup AV logging.
@@ -158,8 +170,80 @@ namespace logging {
     stat_trackers::min_max_avg_tracker<T> tracker;
   };
 
+  /**
+   * @brief A helper class for tracking and logging the distribution of numerical values across a period of time
+   * @examples
+   * percentile_periodic_logger<int> logger(debug, "Test time value", "ms", 5s);
+   * logger.collect_and_log(1);
+   * // ...
+   * logger.collect_and_log(2);
+   * // after 5 seconds
+   * logger.collect_and_log(3);
+   * // In the log:
+   * // [2024:01:01:12:00:00]: Debug: Test time value (min/max/avg/p50/p95/p99/p99.9): 1ms/3ms/2.00ms/2ms/3ms/3ms/3ms
+   * @examples_end
+   */
+  template <typename T>
+  class percentile_periodic_logger {
+  public:
+    percentile_periodic_logger(boost::log::sources::severity_logger<int> &severity,
+      std::string_view message,
+      std::string_view units,
+      std::chrono::seconds interval_in_seconds = std::chrono::seconds(20)):
+        severity(severity),
+        message(message),
+        units(units),
+        interval(interval_in_seconds),
+        enabled(config::sunshine.min_log_level <= severity.default_severity()) {}
+
+    void
+    collect_and_log(const T &value) {
+      if (enabled) {
+        auto print_info = [&](const stat_trackers::percentile_stats_t<T> &stats) {
+          auto f = stat_trackers::two_digits_after_decimal();
+          auto print = [&](const T &stat) {
+            if constexpr (std::is_floating_point_v<T>) {
+              return (f % stat).str() + units;
+            }
+            else {
+              return std::to_string(stat) + units;
+            }
+          };
+          BOOST_LOG(severity.get()) << message << " (min/max/avg/p50/p95/p99/p99.9): "
+                                    << print(stats.stat_min) << "/" << print(stats.stat_max) << "/" << (f % stats.stat_avg).str() << units << "/"
+                                    << print(stats.p50) << "/" << print(stats.p95) << "/" << print(stats.p99) << "/" << print(stats.p999);
+        };
+        tracker.collect_and_callback_on_interval(value, print_info, interval);
+      }
+    }
+
+    void
+    collect_and_log(std::function<T()> func) {
+      if (enabled) collect_and_log(func());
+    }
+
+    void
+    reset() {
+      if (enabled) tracker.reset();
+    }
+
+    bool
+    is_enabled() const {
+      return enabled;
+    }
+
+  private:
+    std::reference_wrapper<boost::log::sources::severity_logger<int>> severity;
+    std::string message;
+    std::string units;
+    std::chrono::seconds interval;
+    bool enabled;
+    stat_trackers::percentile_tracker<T> tracker;
+  };
+
   /**
    * @brief A helper class for tracking and logging short time intervals across a period of time
+   * @tparam periodic_logger_t The logger the intervals are collected into, in milliseconds.
    * @examples
    * time_delta_periodic_logger logger(debug, "Test duration", 5s);
    * logger.first_point_now();
@@ -173,50 +257,69 @@ namespace logging {
    * // [2024:01:01:12:00:00]: Debug: Test duration (min/max/avg): 1.23ms/3.21ms/2.31ms
    * @examples_end
    */
-  class time_delta_periodic_logger {
+  template <typename periodic_logger_t>
+  class basic_time_delta_periodic_logger {
   public:
-    time_delta_periodic_logger(boost::log::sources::severity_logger<int> &severity,
+    basic_time_delta_periodic_logger(boost::log::sources::severity_logger<int> &severity,
       std::string_view message,
       std::chrono::seconds interval_in_seconds = std::chrono::seconds(20)):
         logger(severity, message, "ms", interval_in_seconds) {}
 
     void
     first_point(const std::chrono::steady_clock::time_point &point) {
-      if (logger.is_enabled()) point1 = point;
+      if (is_enabled()) point1 = point;
     }
 
     void
     first_point_now() {
-      if (logger.is_enabled()) first_point(std::chrono::steady_clock::now());
+      if (is_enabled()) first_point(std::chrono::steady_clock::now());
     }
 
     void
     second_point_and_log(const std::chrono::steady_clock::time_point &point) {
-      if (logger.is_enabled()) {
+      if (is_enabled()) {
+        if (histogram) histogram->observe(point - point1);
         logger.collect_and_log(std::chrono::duration<double, std::milli>(point - point1).count());
       }
     }
 
     void
     second_point_now_and_log() {
-      if (logger.is_enabled()) second_point_and_log(std::chrono::steady_clock::now());
+      if (is_enabled()) second_point_and_log(std::chrono::steady_clock::now());
     }
 
     void
     reset() {
-      if (logger.is_enabled()) logger.reset();
+      logger.reset();
     }
 
     bool
     is_enabled() const {
-      return logger.is_enabled();
+      return logger.is_enabled() || histogram;
+    }
+
+    /**
+     * @brief Also record every interval in a metrics histogram, regardless of the log level.
+     * @param histogram The histogram, in seconds.
+     */
+    void
+    export_to(std::shared_ptr<metrics::histogram_t> histogram) {
+      this->histogram = std::move(histogram);
     }
 
   private:
     std::chrono::steady_clock::time_point point1 = std::chrono::steady_clock::now();
-    min_max_avg_periodic_logger<double> logger;
+    periodic_logger_t logger;
+    std::shared_ptr<metrics::histogram_t> histogram;
   };
 
+  using time_delta_periodic_logger = basic_time_delta_periodic_logger<min_max_avg_periodic_logger<double>>;
+
+  /**
+   * @brief A time_delta_periodic_logger that also logs the p50/p95/p99/p99.9 percentiles.
+   */
+  using time_delta_percentile_logger = basic_time_delta_periodic_logger<percentile_periodic_logger<double>>;
+
   /**
    * @brief Enclose string in square brackets.
    * @param input Input string.
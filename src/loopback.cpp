@@ -0,0 +1,1076 @@
+/**
+ * @file src/loopback.cpp
+ * @brief Definitions for the loopback client used to benchmark the streaming pipeline.
+ */
+// standard includes
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+// lib includes
+#include <boost/asio.hpp>
+#include <boost/endian/arithmetic.hpp>
+
+extern "C" {
+// clang-format off
+#include <moonlight-common-c/src/Limelight-internal.h>
+#include "rswrapper.h"
+// clang-format on
+}
+
+// local includes
+#include "config.h"
+#include "crypto.h"
+#include "globals.h"
+#include "logging.h"
+#include "loopback.h"
+#include "network.h"
+#include "rtsp.h"
+#include "utility.h"
+
+namespace asio = boost::asio;
+
+using asio::ip::tcp;
+using asio::ip::udp;
+
+namespace loopback {
+  using clock = std::chrono::steady_clock;
+
+  namespace {
+#pragma pack(push, 1)
+
+    // The wire formats below must match the ones in stream.cpp
+
+    struct video_packet_raw_t {
+      RTP_PACKET rtp;
+      char reserved[4];
+
+      NV_VIDEO_PACKET packet;
+    };
+
+    struct video_packet_enc_prefix_t {
+      std::uint8_t iv[12];
+      std::uint32_t frameNumber;
+      std::uint8_t tag[16];
+    };
+
+    struct video_short_frame_header_t {
+      std::uint8_t headerType;
+      boost::endian::little_uint16_at frame_processing_latency;
+      std::uint8_t frameType;
+      boost::endian::little_uint16_at lastPayloadLen;
+      std::uint8_t unknown[2];
+    };
+
+    struct audio_fec_packet_t {
+      RTP_PACKET rtp;
+      AUDIO_FEC_HEADER fecHeader;
+    };
+
+#pragma pack(pop)
+
+    using rs_t = util::safe_ptr<reed_solomon, [](reed_solomon *rs) { reed_solomon_release(rs); }>;
+
+    constexpr std::uint16_t PERIODIC_PING = 0x0200;
+    constexpr std::uint16_t INVALIDATE_REF_FRAMES = 0x0301;
+
+    constexpr auto MAX_FEC_BLOCKS = 4;
+
+    // An incomplete frame is given up on once packets of a frame this far ahead arrive,
+    // so packets reordered by the jitter injector don't count as losses
+    constexpr std::int64_t VIDEO_REORDER_WINDOW = 2;
+
+    // The same for audio FEC blocks of RTPA_DATA_SHARDS packets
+    constexpr std::int64_t AUDIO_REORDER_WINDOW = 4;
+
+    constexpr auto PING_INTERVAL = 500ms;
+    constexpr auto REPORT_INTERVAL = 1s;
+    constexpr auto CONNECT_TIMEOUT = 5s;
+
+    std::mutex report_mutex;
+    std::optional<report_t> last_report;
+    std::jthread worker;
+
+    struct rtsp_response_t {
+      int status = 0;
+      std::map<std::string, std::string, std::less<>> headers;
+      std::string payload;
+    };
+
+    /**
+     * @brief Send an RTSP request and read the response.
+     * @details The host closes the connection after each response, so every request uses a new connection.
+     * @param endpoint The RTSP server.
+     * @param request The serialized request.
+     * @return The response, or `std::nullopt` if the server couldn't be reached.
+     */
+    std::optional<rtsp_response_t>
+    rtsp_request(const tcp::endpoint &endpoint, const std::string &request) {
+      asio::io_context io;
+      tcp::socket sock { io };
+
+      boost::system::error_code ec;
+      sock.connect(endpoint, ec);
+      if (ec) {
+        BOOST_LOG(error) << "Loopback: couldn't connect to the RTSP server: "sv << ec.message();
+        return std::nullopt;
+      }
+
+      asio::write(sock, asio::buffer(request), ec);
+      if (ec) {
+        BOOST_LOG(error) << "Loopback: couldn't send the RTSP request: "sv << ec.message();
+        return std::nullopt;
+      }
+
+      std::string raw;
+      asio::read(sock, asio::dynamic_buffer(raw), ec);
+      if (ec && ec != asio::error::eof) {
+        BOOST_LOG(error) << "Loopback: couldn't read the RTSP response: "sv << ec.message();
+        return std::nullopt;
+      }
+
+      auto header_end = raw.find("\r\n\r\n"sv);
+      if (header_end == std::string::npos) {
+        BOOST_LOG(error) << "Loopback: incomplete RTSP response"sv;
+        return std::nullopt;
+      }
+
+      rtsp_response_t response;
+      response.payload = raw.substr(header_end + 4);
+
+      std::string_view headers { raw.data(), header_end };
+      auto status_begin = headers.find(' ');
+      if (status_begin == std::string_view::npos) {
+        BOOST_LOG(error) << "Loopback: malformed RTSP status line"sv;
+        return std::nullopt;
+      }
+      std::from_chars(headers.data() + status_begin + 1, headers.data() + headers.size(), response.status);
+
+      while (true) {
+        auto line_end = headers.find("\r\n"sv);
+        if (line_end == std::string_view::npos) {
+          break;
+        }
+        headers.remove_prefix(line_end + 2);
+
+        auto line = headers.substr(0, headers.find("\r\n"sv));
+        auto colon = line.find(':');
+        if (colon != std::string_view::npos) {
+          auto value = line.substr(colon + 1);
+          while (!value.empty() && value.front() == ' ') {
+            value.remove_prefix(1);
+          }
+          response.headers.emplace(line.substr(0, colon), value);
+        }
+      }
+
+      return response;
+    }
+
+    /**
+     * @brief Parse the port out of a `Transport: server_port=<port>` header.
+     * @param response The response to a SETUP request.
+     * @return The port, or 0 if it is missing.
+     */
+    std::uint16_t
+    server_port(const rtsp_response_t &response) {
+      auto transport = response.headers.find("Transport"sv);
+      if (transport == std::end(response.headers)) {
+        return 0;
+      }
+
+      constexpr auto key = "server_port="sv;
+      auto pos = transport->second.find(key);
+      if (pos == std::string::npos) {
+        return 0;
+      }
+
+      std::uint16_t port = 0;
+      auto begin = transport->second.data() + pos + key.size();
+      std::from_chars(begin, transport->second.data() + transport->second.size(), port);
+      return port;
+    }
+
+    latency_t
+    percentiles(std::vector<double> samples) {
+      latency_t latency;
+      if (samples.empty()) {
+        return latency;
+      }
+
+      std::sort(std::begin(samples), std::end(samples));
+      auto at = [&](double percentile) {
+        return samples[std::min(samples.size() - 1, (std::size_t) (samples.size() * percentile))];
+      };
+
+      latency.p50 = at(0.50);
+      latency.p95 = at(0.95);
+      latency.p99 = at(0.99);
+      latency.max = samples.back();
+      return latency;
+    }
+
+    struct fec_block_t {
+      int data_shards = 0;
+      int nr_shards = 0;
+      std::size_t blocksize = 0;
+
+      int received = 0;
+      bool complete = false;
+      bool recovered = false;
+
+      std::vector<std::vector<std::uint8_t>> shards;
+    };
+
+    struct frame_t {
+      clock::time_point first_packet;
+      int last_block = 0;
+      bool complete = false;
+
+      std::array<fec_block_t, MAX_FEC_BLOCKS> blocks;
+    };
+
+    struct audio_block_t {
+      int received = 0;
+      std::size_t blocksize = 0;
+      bool complete = false;
+
+      std::array<std::vector<std::uint8_t>, RTPA_TOTAL_SHARDS> shards;
+    };
+
+    struct delayed_packet_t {
+      clock::time_point due;
+      bool audio;
+      std::string data;
+
+      bool
+      operator>(const delayed_packet_t &other) const {
+        return due > other.due;
+      }
+    };
+
+    class client_t {
+    public:
+      client_t(const options_t &options, std::stop_token stop):
+          options { options },
+          stop { std::move(stop) },
+          random { options.seed } {
+        report.running = true;
+        report.options = options;
+      }
+
+      void
+      run() {
+        if (connect() || receive()) {
+          BOOST_LOG(error) << "Loopback: "sv << report.error;
+        }
+
+        finish();
+
+        report.running = false;
+        publish();
+      }
+
+    private:
+      void
+      fail(std::string error) {
+        if (report.error.empty()) {
+          report.error = std::move(error);
+        }
+      }
+
+      void
+      publish() {
+        std::lock_guard lg { report_mutex };
+        last_report = report;
+      }
+
+      std::string
+      rtsp_message(const std::string_view &command, const std::string_view &target, const std::string_view &payload = {}) {
+        std::ostringstream ss;
+        ss << command << ' ' << target << " RTSP/1.0\r\n"sv
+           << "CSeq: "sv << ++rtsp_seqn << "\r\n"sv
+           << "X-GS-ClientVersion: 14\r\n"sv
+           << "Host: "sv << loopback_address << "\r\n"sv;
+        if (!payload.empty()) {
+          ss << "Content-type: application/sdp\r\n"sv
+             << "Content-length: "sv << payload.size() << "\r\n"sv;
+        }
+        ss << "\r\n"sv << payload;
+
+        return ss.str();
+      }
+
+      std::string
+      announce_payload() {
+        std::ostringstream ss;
+        auto attribute = [&](const std::string_view &name, auto value) {
+          ss << "a="sv << name << ':' << value << " \r\n"sv;
+        };
+
+        ss << "v=0\r\n"sv
+           << "o=android 0 14 IN IPv4 "sv << loopback_address << "\r\n"sv
+           << "s="sv << loopback_address << "\r\n"sv;
+
+        attribute("x-nv-video[0].clientViewportWd"sv, options.width);
+        attribute("x-nv-video[0].clientViewportHt"sv, options.height);
+        attribute("x-nv-video[0].maxFPS"sv, options.framerate);
+        attribute("x-nv-video[0].packetSize"sv, options.packet_size);
+        attribute("x-nv-video[0].videoEncoderSlicesPerFrame"sv, options.slices);
+        attribute("x-nv-video[0].maxNumReferenceFrames"sv, 1);
+        attribute("x-nv-vqos[0].bw.maximumBitrateKbps"sv, options.bitrate);
+        attribute("x-nv-vqos[0].bitStreamFormat"sv, options.video_format);
+        attribute("x-nv-vqos[0].fec.minRequiredFecPackets"sv, 2);
+        attribute("x-nv-audio.surround.numChannels"sv, 2);
+        attribute("x-nv-audio.surround.channelMask"sv, 3);
+        attribute("x-nv-audio.surround.AudioQuality"sv, 0);
+        attribute("x-ml-general.featureFlags"sv, ML_FF_SESSION_ID_V1);
+        attribute("x-ss-general.encryptionEnabled"sv, options.encrypt ? SS_ENC_VIDEO | SS_ENC_AUDIO : 0);
+
+        return ss.str();
+      }
+
+      /**
+       * @brief Raise a launch session, go through the RTSP handshake and connect the control stream.
+       * @return 0 on success, -1 on error.
+       */
+      int
+      connect() {
+        auto af = net::af_from_enum_string(config::sunshine.address_family);
+        auto address = af == net::IPV4 ? asio::ip::address { asio::ip::address_v4::loopback() } : asio::ip::address { asio::ip::address_v6::loopback() };
+        loopback_address = address.to_string();
+
+        // The session is raised in-process, so no pairing is needed
+        launch_session = std::make_shared<rtsp_stream::launch_session_t>();
+        launch_session->id = next_launch_session_id();
+        auto gcm_key = crypto::rand(16);
+        launch_session->gcm_key.assign(std::begin(gcm_key), std::end(gcm_key));
+        launch_session->host_audio = false;
+        launch_session->unique_id = "loopback"s;
+        launch_session->width = options.width;
+        launch_session->height = options.height;
+        launch_session->fps = options.framerate;
+        launch_session->gcmap = 0;
+        launch_session->appid = 0;
+        launch_session->surround_info = 196610;
+        launch_session->enable_hdr = false;
+        launch_session->enable_sops = false;
+        launch_session->rtsp_url_scheme = "rtsp://"s;
+        launch_session->av_ping_payload = util::hex_vec(crypto::rand(8));
+
+        auto connect_data = crypto::rand(sizeof(launch_session->control_connect_data));
+        std::memcpy(&launch_session->control_connect_data, connect_data.data(), connect_data.size());
+
+        auto ri_key_id = crypto::rand(sizeof(avRiKeyId));
+        std::memcpy(&avRiKeyId, ri_key_id.data(), ri_key_id.size());
+        launch_session->iv.resize(16);
+        auto prepend_iv = util::endian::big<std::uint32_t>(avRiKeyId);
+        std::memcpy(launch_session->iv.data(), &prepend_iv, sizeof(prepend_iv));
+
+        if (options.encrypt) {
+          video_cipher = crypto::cipher::gcm_t { launch_session->gcm_key, false };
+          audio_cipher = crypto::cipher::cbc_t { launch_session->gcm_key, true };
+        }
+
+        rtsp_stream::launch_session_raise(launch_session);
+
+        // Don't leave a stale launch session behind if the stream can't be set up
+        auto clear_launch_session = util::fail_guard([&]() {
+          rtsp_stream::launch_session_clear(launch_session->id);
+        });
+
+        tcp::endpoint rtsp_endpoint { address, net::map_port(rtsp_stream::RTSP_SETUP_PORT) };
+        auto url = launch_session->rtsp_url_scheme + net::addr_to_url_escaped_string(address) + ':' + std::to_string(rtsp_endpoint.port());
+
+        auto request = [&](const std::string_view &command, const std::string_view &target, const std::string_view &payload = {}) -> std::optional<rtsp_response_t> {
+          auto response = rtsp_request(rtsp_endpoint, rtsp_message(command, target, payload));
+          if (!response) {
+            fail("Couldn't reach the RTSP server"s);
+            return std::nullopt;
+          }
+
+          if (response->status != 200) {
+            fail("RTSP "s + std::string { command } + " failed with status "s + std::to_string(response->status));
+            return std::nullopt;
+          }
+
+          return response;
+        };
+
+        std::optional<rtsp_response_t> audio_setup, video_setup, control_setup;
+        if (!request("OPTIONS"sv, url) ||
+            !request("DESCRIBE"sv, url) ||
+            !(audio_setup = request("SETUP"sv, "streamid=audio/0/0"sv)) ||
+            !(video_setup = request("SETUP"sv, "streamid=video/0/0"sv)) ||
+            !(control_setup = request("SETUP"sv, "streamid=control/13/0"sv)) ||
+            !request("ANNOUNCE"sv, "streamid=control/13/0"sv, announce_payload()) ||
+            !request("PLAY"sv, "/"sv)) {
+          return -1;
+        }
+
+        video_endpoint = udp::endpoint { address, server_port(*video_setup) };
+        audio_endpoint = udp::endpoint { address, server_port(*audio_setup) };
+        auto control_port = server_port(*control_setup);
+        if (!video_endpoint.port() || !audio_endpoint.port() || !control_port) {
+          fail("The host didn't report the stream ports"s);
+          return -1;
+        }
+
+        host = net::host_t { enet_host_create(af == net::IPV4 ? AF_INET : AF_INET6, nullptr, 1, 0, 0, 0) };
+        if (!host) {
+          fail("Couldn't create the control stream host"s);
+          return -1;
+        }
+
+        ENetAddress control_address;
+        enet_address_set_host(&control_address, loopback_address.c_str());
+        enet_address_set_port(&control_address, control_port);
+
+        peer = enet_host_connect(host.get(), &control_address, 1, launch_session->control_connect_data);
+        if (!peer) {
+          fail("Couldn't connect the control stream"s);
+          return -1;
+        }
+
+        ENetEvent event;
+        auto deadline = clock::now() + CONNECT_TIMEOUT;
+        while (clock::now() < deadline) {
+          if (enet_host_service(host.get(), &event, 100) > 0) {
+            if (event.type == ENET_EVENT_TYPE_CONNECT) {
+              BOOST_LOG(info) << "Loopback: connected to "sv << loopback_address << ", streaming for "sv << options.duration.count() << 's';
+              clear_launch_session.disable();
+              return 0;
+            }
+
+            if (event.type == ENET_EVENT_TYPE_RECEIVE) {
+              enet_packet_destroy(event.packet);
+            }
+          }
+        }
+
+        fail("Timed out connecting the control stream"s);
+        return -1;
+      }
+
+      /**
+       * @brief Receive the video and audio streams until the requested duration has elapsed.
+       * @return 0 on success, -1 on error.
+       */
+      int
+      receive() {
+        auto shutdown_event = mail::man->event<bool>(mail::shutdown);
+
+        asio::io_context io;
+        udp::socket video_sock { io, video_endpoint.protocol() };
+        udp::socket audio_sock { io, audio_endpoint.protocol() };
+
+        // Frames arrive in bursts, don't let the kernel drop packets the loss injector didn't choose to drop
+        {
+          boost::system::error_code ec;
+          video_sock.set_option(asio::socket_base::receive_buffer_size { 8 * 1024 * 1024 }, ec);
+        }
+
+        std::array<char, 64 * 1024> video_buf, audio_buf;
+        udp::endpoint sender;
+
+        std::function<void(const boost::system::error_code &, std::size_t)> video_recv, audio_recv;
+        video_recv = [&](const boost::system::error_code &ec, std::size_t bytes) {
+          if (!ec) {
+            inject(false, std::string_view { video_buf.data(), bytes });
+          }
+          video_sock.async_receive_from(asio::buffer(video_buf), sender, video_recv);
+        };
+        audio_recv = [&](const boost::system::error_code &ec, std::size_t bytes) {
+          if (!ec) {
+            inject(true, std::string_view { audio_buf.data(), bytes });
+          }
+          audio_sock.async_receive_from(asio::buffer(audio_buf), sender, audio_recv);
+        };
+
+        // The pings tell the host where to send the streams, so receives must be queued before
+        video_sock.async_receive_from(asio::buffer(video_buf), sender, video_recv);
+        audio_sock.async_receive_from(asio::buffer(audio_buf), sender, audio_recv);
+
+        auto start = clock::now();
+        auto deadline = start + options.duration;
+        auto next_ping = start;
+        auto next_publish = start + REPORT_INTERVAL;
+
+        while (clock::now() < deadline) {
+          if (stop.stop_requested() || shutdown_event->peek()) {
+            fail("Interrupted"s);
+            return -1;
+          }
+
+          auto now = clock::now();
+          if (now >= next_ping) {
+            ping(video_sock, video_endpoint);
+            ping(audio_sock, audio_endpoint);
+            send_control(PERIODIC_PING, std::string_view { "\0\0\0\0", 4 });
+            next_ping = now + PING_INTERVAL;
+          }
+
+          io.run_for(1ms);
+
+          now = clock::now();
+          while (!delayed.empty() && delayed.top().due <= now) {
+            auto &packet = delayed.top();
+            deliver(packet.audio, packet.data, packet.due);
+            delayed.pop();
+          }
+
+          ENetEvent event;
+          while (enet_host_service(host.get(), &event, 0) > 0) {
+            if (event.type == ENET_EVENT_TYPE_RECEIVE) {
+              enet_packet_destroy(event.packet);
+            }
+            else if (event.type == ENET_EVENT_TYPE_DISCONNECT) {
+              fail("The host closed the control stream"s);
+              return -1;
+            }
+          }
+
+          if (now >= next_publish) {
+            if (first_video_packet == clock::time_point {} && now - start > config::stream.ping_timeout) {
+              fail("No video received, is a capture backend available?"s);
+              return -1;
+            }
+
+            summarize(now);
+            publish();
+            next_publish = now + REPORT_INTERVAL;
+          }
+        }
+
+        return 0;
+      }
+
+      void
+      finish() {
+        summarize(clock::now());
+
+        if (peer) {
+          // The host stops the session when the control stream disconnects
+          enet_peer_disconnect_now(peer, 0);
+          enet_host_flush(host.get());
+          peer = nullptr;
+        }
+        host.reset();
+
+        BOOST_LOG(info) << "Loopback: "sv << report.frames_complete << " frames received, "sv
+                        << report.frames_recovered << " recovered, "sv
+                        << report.frames_lost << " lost, goodput "sv << report.goodput_mbps << " Mbps, frame latency p50 "sv
+                        << report.frame_latency.p50 << "ms p99 "sv << report.frame_latency.p99 << "ms"sv;
+      }
+
+      void
+      summarize(clock::time_point now) {
+        if (first_video_packet != clock::time_point {}) {
+          report.seconds = std::chrono::duration<double>(now - first_video_packet).count();
+        }
+        if (report.seconds > 0) {
+          report.goodput_mbps = payload_bytes * 8 / report.seconds / 1'000'000;
+        }
+        if (fec_data_shards) {
+          report.fec_overhead = (double) fec_parity_shards / fec_data_shards;
+        }
+
+        report.frame_latency = percentiles(frame_latencies);
+        report.host_latency = percentiles(host_latencies);
+      }
+
+      void
+      ping(udp::socket &sock, const udp::endpoint &endpoint) {
+        SS_PING ping {};
+        std::copy_n(launch_session->av_ping_payload.data(), sizeof(ping.payload), ping.payload);
+        ping.sequenceNumber = util::endian::big(ping_seqn++);
+
+        boost::system::error_code ec;
+        sock.send_to(asio::buffer(&ping, sizeof(ping)), endpoint, 0, ec);
+      }
+
+      void
+      send_control(std::uint16_t type, const std::string_view &payload) {
+        std::string message(sizeof(type) + payload.size(), '\0');
+        auto type_le = util::endian::little(type);
+        std::memcpy(message.data(), &type_le, sizeof(type_le));
+        std::memcpy(message.data() + sizeof(type_le), payload.data(), payload.size());
+
+        auto packet = enet_packet_create(message.data(), message.size(), ENET_PACKET_FLAG_RELIABLE);
+        if (enet_peer_send(peer, 0, packet)) {
+          enet_packet_destroy(packet);
+        }
+      }
+
+      /**
+       * @brief Pass a received packet through the loss and jitter injector.
+       * @param audio `true` for audio packets, `false` for video packets.
+       * @param data The packet.
+       */
+      void
+      inject(bool audio, const std::string_view &data) {
+        if (audio) {
+          ++report.audio_packets;
+        }
+        else {
+          ++report.video_packets;
+          report.video_bytes += data.size();
+        }
+
+        if (options.loss > 0 && std::uniform_real_distribution<double> { 0, 100 }(random) < options.loss) {
+          ++(audio ? report.audio_packets_dropped : report.video_packets_dropped);
+          return;
+        }
+
+        auto now = clock::now();
+        if (options.jitter > 0ms) {
+          auto jitter = std::uniform_int_distribution<std::int64_t> { 0, std::chrono::nanoseconds { options.jitter }.count() }(random);
+          delayed.push(delayed_packet_t { now + std::chrono::nanoseconds { jitter }, audio, std::string { data } });
+          return;
+        }
+
+        deliver(audio, data, now);
+      }
+
+      void
+      deliver(bool audio, const std::string_view &data, clock::time_point now) {
+        if (audio) {
+          on_audio(data);
+        }
+        else {
+          on_video(data, now);
+        }
+      }
+
+      void
+      on_video(const std::string_view &data, clock::time_point now) {
+        std::vector<std::uint8_t> shard;
+        if (video_cipher) {
+          if (data.size() <= sizeof(video_packet_enc_prefix_t)) {
+            ++report.video_decrypt_errors;
+            return;
+          }
+
+          auto prefix = (const video_packet_enc_prefix_t *) data.data();
+          crypto::aes_t iv { std::begin(prefix->iv), std::end(prefix->iv) };
+
+          // The tag comes first in a tagged cipher
+          std::string tagged_cipher { (const char *) prefix->tag, sizeof(prefix->tag) };
+          tagged_cipher.append(data.substr(sizeof(video_packet_enc_prefix_t)));
+
+          if (video_cipher->decrypt(tagged_cipher, shard, &iv)) {
+            ++report.video_decrypt_errors;
+            return;
+          }
+        }
+        else {
+          shard.assign(std::begin(data), std::end(data));
+        }
+
+        if (shard.size() <= sizeof(video_packet_raw_t)) {
+          return;
+        }
+
+        auto raw = (video_packet_raw_t *) shard.data();
+        std::int64_t frame_index = raw->packet.frameIndex;
+        auto block_index = (raw->packet.multiFecBlocks >> 4) & 0x3;
+        auto last_block = (raw->packet.multiFecBlocks >> 6) & 0x3;
+        auto fec_info = raw->packet.fecInfo;
+        int shard_index = (fec_info >> 12) & 0x3FF;
+        int data_shards = (fec_info >> 22) & 0x3FF;
+        int percentage = (fec_info >> 4) & 0xFF;
+
+        if (first_video_packet == clock::time_point {}) {
+          first_video_packet = now;
+          next_frame = frame_index;
+        }
+
+        // A late packet of a frame that was already reassembled or given up on
+        if (frame_index < next_frame) {
+          return;
+        }
+
+        if (frame_index > newest_frame) {
+          newest_frame = frame_index;
+          finalize();
+        }
+
+        auto &frame = frames[frame_index];
+        if (frame.complete) {
+          return;
+        }
+        if (frame.first_packet == clock::time_point {}) {
+          frame.first_packet = now;
+        }
+        frame.last_block = last_block;
+
+        auto &block = frame.blocks[block_index];
+        if (block.shards.empty()) {
+          // The parity shard count is derived the same way as in Moonlight
+          auto parity_shards = (data_shards * percentage + 99) / 100;
+          block.data_shards = data_shards;
+          block.nr_shards = data_shards + parity_shards;
+          block.blocksize = shard.size();
+          block.shards.resize(block.nr_shards);
+
+          fec_data_shards += data_shards;
+          fec_parity_shards += parity_shards;
+        }
+
+        if (block.complete || shard_index >= block.nr_shards || shard.size() != block.blocksize || !block.shards[shard_index].empty()) {
+          return;
+        }
+
+        block.shards[shard_index] = std::move(shard);
+        if (++block.received < block.data_shards) {
+          return;
+        }
+
+        if (recover(block)) {
+          // Keep waiting, the frame will be given up on if the block can't be recovered
+          return;
+        }
+        block.complete = true;
+
+        for (int x = 0; x <= frame.last_block; ++x) {
+          if (!frame.blocks[x].complete) {
+            return;
+          }
+        }
+
+        complete(frame, now);
+        finalize();
+      }
+
+      /**
+       * @brief Reconstruct the missing data shards of a block.
+       * @param block A block with at least as many shards as it has data shards.
+       * @return 0 on success, -1 if Reed-Solomon decoding failed.
+       */
+      int
+      recover(fec_block_t &block) {
+        auto missing_data = std::any_of(std::begin(block.shards), std::begin(block.shards) + block.data_shards, [](const auto &shard) {
+          return shard.empty();
+        });
+        if (!missing_data) {
+          return 0;
+        }
+
+        std::vector<std::uint8_t> marks(block.nr_shards);
+        std::vector<std::uint8_t *> shards_p(block.nr_shards);
+        for (int x = 0; x < block.nr_shards; ++x) {
+          if (block.shards[x].empty()) {
+            marks[x] = 1;
+            block.shards[x].resize(block.blocksize);
+          }
+          shards_p[x] = block.shards[x].data();
+        }
+
+        rs_t rs { reed_solomon_new(block.data_shards, block.nr_shards - block.data_shards) };
+        if (reed_solomon_decode(rs.get(), shards_p.data(), marks.data(), block.nr_shards, block.blocksize)) {
+          // Leave room for the shards that are still to come
+          for (int x = 0; x < block.nr_shards; ++x) {
+            if (marks[x]) {
+              block.shards[x].clear();
+            }
+          }
+          return -1;
+        }
+
+        block.recovered = true;
+        return 0;
+      }
+
+      void
+      complete(frame_t &frame, clock::time_point now) {
+        frame.complete = true;
+        ++report.frames_complete;
+
+        frame_latencies.emplace_back(std::chrono::duration<double, std::milli>(now - frame.first_packet).count());
+
+        auto recovered = false;
+        for (int x = 0; x <= frame.last_block; ++x) {
+          auto &block = frame.blocks[x];
+          recovered |= block.recovered;
+          payload_bytes += block.data_shards * (block.blocksize - sizeof(video_packet_raw_t));
+        }
+        payload_bytes -= sizeof(video_short_frame_header_t);
+
+        if (recovered) {
+          ++report.frames_recovered;
+        }
+
+        // The frame header is at the beginning of the first shard
+        auto header = (video_short_frame_header_t *) (frame.blocks[0].shards[0].data() + sizeof(video_packet_raw_t));
+        if (header->headerType == 0x01 && header->frame_processing_latency) {
+          host_latencies.emplace_back(header->frame_processing_latency / 10.0);
+        }
+
+        // Only the completion state is needed from now on
+        frame.blocks = {};
+      }
+
+      /**
+       * @brief Retire frames in order, counting the ones that never completed as lost.
+       */
+      void
+      finalize() {
+        std::int64_t first_lost = -1;
+        std::int64_t last_lost = -1;
+
+        while (next_frame <= newest_frame) {
+          auto it = frames.find(next_frame);
+          auto complete = it != std::end(frames) && it->second.complete;
+          if (!complete && next_frame > newest_frame - VIDEO_REORDER_WINDOW) {
+            break;
+          }
+
+          if (!complete) {
+            ++report.frames_lost;
+            if (first_lost < 0) {
+              first_lost = next_frame;
+            }
+            last_lost = next_frame;
+          }
+
+          if (it != std::end(frames)) {
+            frames.erase(it);
+          }
+          ++next_frame;
+        }
+
+        // Ask for recovery like Moonlight does, so the stream behaves as it would with a real client
+        if (first_lost >= 0) {
+          std::int64_t payload[] { first_lost, last_lost, 0 };
+          send_control(INVALIDATE_REF_FRAMES, std::string_view { (const char *) payload, sizeof(payload) });
+        }
+      }
+
+      void
+      on_audio(const std::string_view &data) {
+        if (data.size() <= sizeof(RTP_PACKET)) {
+          return;
+        }
+
+        auto rtp = (const RTP_PACKET *) data.data();
+
+        std::uint16_t base_seqn;
+        int shard_index;
+        std::string_view payload;
+        if (rtp->packetType == 127) {
+          if (data.size() <= sizeof(audio_fec_packet_t)) {
+            return;
+          }
+
+          auto fec = (const audio_fec_packet_t *) data.data();
+          base_seqn = util::endian::big(fec->fecHeader.baseSequenceNumber);
+          shard_index = RTPA_DATA_SHARDS + fec->fecHeader.fecShardIndex;
+          payload = data.substr(sizeof(audio_fec_packet_t));
+        }
+        else {
+          auto seqn = util::endian::big(rtp->sequenceNumber);
+          base_seqn = seqn - seqn % RTPA_DATA_SHARDS;
+          shard_index = seqn % RTPA_DATA_SHARDS;
+          payload = data.substr(sizeof(RTP_PACKET));
+
+          decrypt_audio(seqn, payload);
+        }
+
+        if (shard_index >= RTPA_TOTAL_SHARDS) {
+          return;
+        }
+
+        // Extend the 16-bit sequence number, so blocks keep their order when it wraps around
+        auto block_index = newest_audio_block < 0 ?
+                             (std::int64_t) base_seqn / RTPA_DATA_SHARDS :
+                             newest_audio_block + (std::int16_t) (base_seqn - (std::uint16_t) (newest_audio_block * RTPA_DATA_SHARDS)) / RTPA_DATA_SHARDS;
+        if (newest_audio_block < 0) {
+          next_audio_block = block_index;
+        }
+        if (block_index < next_audio_block) {
+          return;
+        }
+        newest_audio_block = std::max(newest_audio_block, block_index);
+
+        auto &block = audio_blocks[block_index];
+        if (!block.complete && block.shards[shard_index].empty() && (!block.received || payload.size() == block.blocksize)) {
+          block.blocksize = payload.size();
+          block.shards[shard_index].assign(std::begin(payload), std::end(payload));
+          ++block.received;
+
+          recover_audio(block, base_seqn);
+        }
+
+        finalize_audio();
+      }
+
+      void
+      decrypt_audio(std::uint16_t seqn, const std::string_view &payload) {
+        if (!audio_cipher) {
+          return;
+        }
+
+        crypto::aes_t iv(16);
+        *(std::uint32_t *) iv.data() = util::endian::big<std::uint32_t>(avRiKeyId + seqn);
+
+        std::vector<std::uint8_t> plaintext;
+        if (audio_cipher->decrypt(payload, plaintext, &iv)) {
+          ++report.audio_decrypt_errors;
+        }
+      }
+
+      void
+      recover_audio(audio_block_t &block, std::uint16_t base_seqn) {
+        int missing = 0;
+        for (int x = 0; x < RTPA_DATA_SHARDS; ++x) {
+          missing += block.shards[x].empty();
+        }
+
+        if (!missing) {
+          block.complete = true;
+          return;
+        }
+
+        if (block.received < RTPA_DATA_SHARDS) {
+          return;
+        }
+
+        if (!audio_rs) {
+          audio_rs.reset(reed_solomon_new(RTPA_DATA_SHARDS, RTPA_FEC_SHARDS));
+
+          // Use the same parity matrix as audioBroadcastThread()
+          const unsigned char parity[] = { 0x77, 0x40, 0x38, 0x0e, 0xc7, 0xa7, 0x0d, 0x6c };
+          memcpy(audio_rs.get()->p, parity, sizeof(parity));
+        }
+
+        std::uint8_t marks[RTPA_TOTAL_SHARDS] {};
+        std::uint8_t *shards_p[RTPA_TOTAL_SHARDS];
+        for (int x = 0; x < RTPA_TOTAL_SHARDS; ++x) {
+          if (block.shards[x].empty()) {
+            marks[x] = 1;
+            block.shards[x].resize(block.blocksize);
+          }
+          shards_p[x] = block.shards[x].data();
+        }
+
+        if (reed_solomon_decode(audio_rs.get(), shards_p, marks, RTPA_TOTAL_SHARDS, block.blocksize)) {
+          for (int x = 0; x < RTPA_TOTAL_SHARDS; ++x) {
+            if (marks[x]) {
+              block.shards[x].clear();
+            }
+          }
+          return;
+        }
+
+        block.complete = true;
+        report.audio_recovered += missing;
+
+        for (int x = 0; x < RTPA_DATA_SHARDS; ++x) {
+          if (marks[x]) {
+            decrypt_audio(base_seqn + x, std::string_view { (const char *) shards_p[x], block.blocksize });
+          }
+        }
+      }
+
+      void
+      finalize_audio() {
+        while (next_audio_block <= newest_audio_block - AUDIO_REORDER_WINDOW) {
+          auto it = audio_blocks.find(next_audio_block);
+          if (it == std::end(audio_blocks)) {
+            report.audio_lost += RTPA_DATA_SHARDS;
+          }
+          else {
+            if (!it->second.complete) {
+              for (int x = 0; x < RTPA_DATA_SHARDS; ++x) {
+                report.audio_lost += it->second.shards[x].empty();
+              }
+            }
+            audio_blocks.erase(it);
+          }
+
+          ++next_audio_block;
+        }
+      }
+
+      static std::uint32_t
+      next_launch_session_id() {
+        // Keep clear of the IDs handed out by nvhttp, which count up from 1
+        static std::uint32_t id = 0x80000000;
+        return ++id;
+      }
+
+      options_t options;
+      std::stop_token stop;
+      report_t report;
+
+      std::mt19937_64 random;
+      std::priority_queue<delayed_packet_t, std::vector<delayed_packet_t>, std::greater<>> delayed;
+
+      std::shared_ptr<rtsp_stream::launch_session_t> launch_session;
+      std::string loopback_address;
+      int rtsp_seqn = 0;
+
+      udp::endpoint video_endpoint;
+      udp::endpoint audio_endpoint;
+      std::uint32_t ping_seqn = 0;
+
+      net::host_t host;
+      net::peer_t peer = nullptr;
+
+      std::optional<crypto::cipher::gcm_t> video_cipher;
+      std::optional<crypto::cipher::cbc_t> audio_cipher;
+      std::uint32_t avRiKeyId = 0;
+
+      clock::time_point first_video_packet;
+      std::map<std::int64_t, frame_t> frames;
+      std::int64_t next_frame = 0;
+      std::int64_t newest_frame = -1;
+
+      std::uint64_t payload_bytes = 0;
+      std::uint64_t fec_data_shards = 0;
+      std::uint64_t fec_parity_shards = 0;
+      std::vector<double> frame_latencies;
+      std::vector<double> host_latencies;
+
+      rs_t audio_rs;
+      std::map<std::int64_t, audio_block_t> audio_blocks;
+      std::int64_t next_audio_block = 0;
+      std::int64_t newest_audio_block = -1;
+    };
+  }  // namespace
+
+  int
+  start(const options_t &options) {
+    std::lock_guard lg { report_mutex };
+    if (last_report && last_report->running) {
+      return -1;
+    }
+
+    last_report = report_t {};
+    last_report->running = true;
+    last_report->options = options;
+
+    // The previous worker has already published its final report, so this doesn't block
+    worker = std::jthread { [options](std::stop_token stop) {
+      client_t client { options, std::move(stop) };
+      client.run();
+    } };
+
+    return 0;
+  }
+
+  std::optional<report_t>
+  report() {
+    std::lock_guard lg { report_mutex };
+    return last_report;
+  }
+}  // namespace loopback
@@ -0,0 +1,93 @@
+/**
+ * @file src/loopback.h
+ * @brief Declarations for the loopback client used to benchmark the streaming pipeline.
+ */
+#pragma once
+
+// standard includes
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+/**
+ * @brief A minimal streaming client that connects to this host over the loopback interface.
+ * @details The client goes through the same RTSP handshake, control stream and UDP pings as Moonlight,
+ *          then receives, decrypts and FEC-recovers the video and audio streams without decoding them.
+ *          Combined with the synthetic capture backend and the software encoder,
+ *          it measures the whole pipeline on a machine without a GPU, a display or a real network.
+ */
+namespace loopback {
+  using namespace std::literals;
+
+  struct options_t {
+    std::chrono::seconds duration = 10s;
+
+    int width = 1920;
+    int height = 1080;
+    int framerate = 60;
+    int bitrate = 20000;  ///< Video bitrate in Kbps
+    int packet_size = 1392;
+    int video_format = 0;  ///< 0 for H.264, 1 for HEVC, 2 for AV1
+    int slices = 1;
+    bool encrypt = true;
+
+    double loss = 0;  ///< Percentage of received packets to drop
+    std::chrono::milliseconds jitter = 0ms;  ///< Upper bound of the random delay added to each received packet
+    std::uint64_t seed = 1;  ///< Seed of the loss and jitter injector, the same seed drops the same packets
+  };
+
+  /**
+   * @brief Latency percentiles in milliseconds.
+   */
+  struct latency_t {
+    double p50 = 0;
+    double p95 = 0;
+    double p99 = 0;
+    double max = 0;
+  };
+
+  struct report_t {
+    bool running = false;
+    std::string error;
+
+    options_t options;
+    double seconds = 0;  ///< Time from the first video packet to the end of the run
+
+    std::uint64_t frames_complete = 0;
+    std::uint64_t frames_recovered = 0;  ///< Complete frames that needed FEC recovery
+    std::uint64_t frames_lost = 0;
+
+    std::uint64_t video_packets = 0;  ///< Video packets received, before loss injection
+    std::uint64_t video_packets_dropped = 0;  ///< Video packets dropped by the loss injector
+    std::uint64_t video_decrypt_errors = 0;
+    std::uint64_t video_bytes = 0;  ///< Video bytes received, before loss injection
+
+    double goodput_mbps = 0;  ///< Frame payload of the complete frames
+    double fec_overhead = 0;  ///< Parity shards sent per data shard
+
+    latency_t frame_latency;  ///< From the first packet of a frame until it could be reassembled
+    latency_t host_latency;  ///< Frame processing latency reported by the host
+
+    std::uint64_t audio_packets = 0;
+    std::uint64_t audio_packets_dropped = 0;
+    std::uint64_t audio_recovered = 0;
+    std::uint64_t audio_lost = 0;
+    std::uint64_t audio_decrypt_errors = 0;
+  };
+
+  /**
+   * @brief Start a loopback session in the background.
+   * @param options The stream parameters and the network impairments to simulate.
+   * @return 0 on success, -1 if a loopback session is already running.
+   */
+  int
+  start(const options_t &options);
+
+  /**
+   * @brief Get the report of the current or the last loopback session.
+   * @return The report, or `std::nullopt` if no loopback session was started yet.
+   */
+  std::optional<report_t>
+  report();
+}  // namespace loopback
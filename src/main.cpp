@@ -19,6 +19,7 @@
 #include "nvhttp.h"
 #include "process.h"
 #include "ssh_server.h"
+#include "startup.h"
 #include "system_tray.h"
 #include "upnp.h"
 #include "usbip_client.h"
@@ -123,7 +124,7 @@ main(int argc, char *argv[]) {
     return 0;
   }
 
-  auto log_deinit_guard = logging::init(config::sunshine.min_log_level, config::sunshine.log_file);
+  auto log_deinit_guard = logging::init(config::sunshine.min_log_level, config::sunshine.log_file, (std::uintmax_t) config::sunshine.log_max_size * 1024 * 1024);
   if (!log_deinit_guard) {
     BOOST_LOG(error) << "Logging failed to initialize"sv;
   }
@@ -300,11 +301,11 @@ main(int argc, char *argv[]) {
   SetConsoleCtrlHandler(ConsoleCtrlHandler, TRUE);
 #endif
 
-  proc::refresh(config::stream.file_apps);
-
   // If any of the following fail, we log an error and continue event though sunshine will not function correctly.
   // This allows access to the UI to fix configuration problems or view the logs.
 
+  // The platform and input are initialized on the main thread, which also destroys their guards.
+  // On Windows, platf::init() initializes COM for the calling thread.
   auto platf_deinit_guard = platf::init();
   if (!platf_deinit_guard) {
     BOOST_LOG(error) << "Platform failed to initialize"sv;
@@ -318,32 +319,49 @@ main(int argc, char *argv[]) {
   reed_solomon_init();
   auto input_deinit_guard = input::init();
 
-  if (input::probe_gamepads()) {
-    BOOST_LOG(warning) << "No gamepad input is available"sv;
-  }
+  // Independent components are initialized at the same time, the HTTP servers don't wait for the encoders
+  auto &orchestrator = startup::host();
 
-  if (video::probe_encoders()) {
-    BOOST_LOG(error) << "Video failed to find working encoder"sv;
-  }
+  orchestrator.add("apps", {}, []() {
+    proc::refresh(config::stream.file_apps);
+    return true;
+  });
 
-  if (http::init()) {
-    BOOST_LOG(fatal) << "HTTP interface failed to initialize"sv;
+  orchestrator.add("input", {}, []() {
+    if (input::probe_gamepads()) {
+      BOOST_LOG(warning) << "No gamepad input is available"sv;
+    }
+    return true;
+  });
 
-#ifdef _WIN32
-    BOOST_LOG(fatal) << "To relaunch Sunshine successfully, use the shortcut in the Start Menu. Do not run Sunshine.exe manually."sv;
-    std::this_thread::sleep_for(10s);
-#endif
+  orchestrator.add("encoder", {}, []() {
+    if (video::probe_encoders()) {
+      BOOST_LOG(error) << "Video failed to find working encoder"sv;
+      return false;
+    }
+    return true;
+  });
 
-    return -1;
-  }
+  orchestrator.add("http", {}, []() {
+    return !http::init();
+  });
+
+  orchestrator.add("ssh", {}, []() {
+    // Initialize SSH server for USB/IP tunneling
+    if (ssh_server::init()) {
+      BOOST_LOG(error) << "SSH server failed to initialize"sv;
+      return false;
+    }
 
-  // Initialize SSH server for USB/IP tunneling
-  if (ssh_server::init()) {
-    BOOST_LOG(error) << "SSH server failed to initialize"sv;
-  }
-  else {
     auto ssh_srv = ssh_server::get_server();
     if (ssh_srv && config::ssh_server.enabled) {
+      // Look for the devices behind a new tunnel right away instead of at the next refresh
+      ssh_srv->set_tunnel_callback([](const ssh_server::tunnel_info_t &) {
+        if (auto usbip_mgr = usbip_client::get_manager()) {
+          usbip_mgr->refresh_device_lists();
+        }
+      });
+
       // Pass empty password to generate random password
       if (ssh_srv->start(config::ssh_server.port,
                          config::ssh_server.username,
@@ -355,18 +373,56 @@ main(int argc, char *argv[]) {
       }
       else {
         BOOST_LOG(error) << "Failed to start SSH server";
+        return false;
       }
     }
-  }
+    return true;
+  });
+
+  orchestrator.add("usbip", { "ssh" }, []() {
+    // Initialize USB/IP client
+    if (usbip_client::init()) {
+      BOOST_LOG(error) << "USB/IP client failed to initialize"sv;
+      return false;
+    }
 
-  // Initialize USB/IP client
-  if (usbip_client::init()) {
-    BOOST_LOG(error) << "USB/IP client failed to initialize"sv;
-  }
-  else {
     BOOST_LOG(info) << "USB/IP client initialized successfully";
+
+    // Keep the device lists of all SSH tunnels cached for /usbip/devlist
+    auto ssh_srv = ssh_server::get_server();
+    if (ssh_srv && ssh_srv->is_running()) {
+      usbip_client::get_manager()->start_discovery([ssh_srv]() {
+        std::vector<usbip_client::devlist_target_t> targets;
+        for (const auto &tunnel : ssh_srv->get_active_tunnels()) {
+          // Tunnels only listen on the IPv4 loopback interface
+          targets.push_back({ tunnel.client_id, "127.0.0.1", tunnel.forwarded_port });
+        }
+        return targets;
+      });
+    }
+    return true;
+  });
+
+  // The components use the platform and input initialized above, so they must have finished before leaving main()
+  auto startup_join_guard = util::fail_guard([&orchestrator]() {
+    orchestrator.join();
+  });
+  orchestrator.start();
+
+  if (!orchestrator.wait("http")) {
+    BOOST_LOG(fatal) << "HTTP interface failed to initialize"sv;
+
+#ifdef _WIN32
+    BOOST_LOG(fatal) << "To relaunch Sunshine successfully, use the shortcut in the Start Menu. Do not run Sunshine.exe manually."sv;
+    std::this_thread::sleep_for(10s);
+#endif
+
+    return -1;
   }
 
+  // The HTTP servers list the apps
+  orchestrator.wait("apps");
+
   /*std::unique_ptr<platf::deinit_t> mDNS;
   auto sync_mDNS = std::async(std::launch::async, [&mDNS]() {
     mDNS = platf::publish::start();
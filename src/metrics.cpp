@@ -0,0 +1,216 @@
+/**
+ * @file src/metrics.cpp
+ * @brief Definitions for the streaming pipeline metrics registry.
+ */
+// standard includes
+#include <algorithm>
+#include <mutex>
+#include <sstream>
+#include <variant>
+
+// local includes
+#include "logging.h"
+#include "metrics.h"
+
+using namespace std::literals;
+
+namespace metrics {
+  const std::vector<double> latency_buckets {
+    0.0001, 0.00025, 0.0005, 0.001, 0.002, 0.004, 0.008, 0.016, 0.033, 0.066, 0.1, 0.25, 0.5, 1
+  };
+
+  histogram_t::histogram_t(std::vector<double> bounds):
+      _bounds { std::move(bounds) },
+      _buckets { std::make_unique<std::atomic<std::uint64_t>[]>(_bounds.size() + 1) } {
+    std::sort(std::begin(_bounds), std::end(_bounds));
+  }
+
+  void
+  histogram_t::observe(double value) {
+    auto index = std::lower_bound(std::begin(_bounds), std::end(_bounds), value) - std::begin(_bounds);
+    _buckets[index].fetch_add(1, std::memory_order_relaxed);
+    atomic_add(_sum, value);
+    _count.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  namespace {
+    enum class type_e {
+      counter,
+      gauge,
+      histogram,
+    };
+
+    using series_t = std::variant<std::shared_ptr<counter_t>, std::shared_ptr<gauge_t>, std::shared_ptr<histogram_t>>;
+
+    struct family_t {
+      type_e type;
+      std::string help;
+      std::map<labels_t, series_t> series;
+    };
+
+    std::mutex registry_mutex;
+    std::map<std::string, family_t> registry;
+
+    template <class T, class F>
+    std::shared_ptr<T>
+    get_or_create(const std::string &name, const std::string &help, type_e type, const labels_t &labels, F &&make) {
+      std::lock_guard lg { registry_mutex };
+
+      auto &family = registry.try_emplace(name, family_t { type, help, {} }).first->second;
+      if (family.type != type) {
+        // Hand out a detached series so a misuse can't crash the caller
+        BOOST_LOG(error) << "Metric ["sv << name << "] was already registered with a different type"sv;
+        return make();
+      }
+
+      auto it = family.series.find(labels);
+      if (it == std::end(family.series)) {
+        it = family.series.emplace(labels, make()).first;
+      }
+
+      return std::get<std::shared_ptr<T>>(it->second);
+    }
+
+    std::string
+    escape(const std::string &value) {
+      std::string escaped;
+      escaped.reserve(value.size());
+      for (auto ch : value) {
+        switch (ch) {
+          case '\\':
+            escaped += "\\\\"sv;
+            break;
+          case '"':
+            escaped += "\\\""sv;
+            break;
+          case '\n':
+            escaped += "\\n"sv;
+            break;
+          default:
+            escaped += ch;
+        }
+      }
+
+      return escaped;
+    }
+
+    void
+    write_labels(std::ostream &os, const labels_t &labels, const std::string &le = {}) {
+      if (labels.empty() && le.empty()) {
+        return;
+      }
+
+      os << '{';
+      bool first = true;
+      for (auto &[key, value] : labels) {
+        os << (first ? "" : ",") << key << "=\"" << escape(value) << '"';
+        first = false;
+      }
+      if (!le.empty()) {
+        os << (first ? "" : ",") << "le=\"" << le << '"';
+      }
+      os << '}';
+    }
+  }  // namespace
+
+  std::shared_ptr<counter_t>
+  counter(const std::string &name, const std::string &help, const labels_t &labels) {
+    return get_or_create<counter_t>(name, help, type_e::counter, labels, []() {
+      return std::make_shared<counter_t>();
+    });
+  }
+
+  std::shared_ptr<gauge_t>
+  gauge(const std::string &name, const std::string &help, const labels_t &labels) {
+    return get_or_create<gauge_t>(name, help, type_e::gauge, labels, []() {
+      return std::make_shared<gauge_t>();
+    });
+  }
+
+  std::shared_ptr<histogram_t>
+  histogram(const std::string &name, const std::string &help, const std::vector<double> &bounds, const labels_t &labels) {
+    return get_or_create<histogram_t>(name, help, type_e::histogram, labels, [&]() {
+      return std::make_shared<histogram_t>(bounds);
+    });
+  }
+
+  void
+  remove(const labels_t &labels) {
+    // Every series would match an empty set of labels
+    if (labels.empty()) {
+      return;
+    }
+
+    std::lock_guard lg { registry_mutex };
+
+    for (auto &[name, family] : registry) {
+      std::erase_if(family.series, [&](const auto &series) {
+        return std::all_of(std::begin(labels), std::end(labels), [&](const auto &label) {
+          auto it = series.first.find(label.first);
+          return it != std::end(series.first) && it->second == label.second;
+        });
+      });
+    }
+  }
+
+  std::string
+  serialize() {
+    std::ostringstream os;
+    os.imbue(std::locale::classic());
+
+    std::lock_guard lg { registry_mutex };
+    for (auto &[name, family] : registry) {
+      if (family.series.empty()) {
+        continue;
+      }
+
+      constexpr std::string_view type_names[] { "counter"sv, "gauge"sv, "histogram"sv };
+      os << "# HELP " << name << ' ' << family.help << '\n';
+      os << "# TYPE " << name << ' ' << type_names[(int) family.type] << '\n';
+
+      for (auto &[labels, series] : family.series) {
+        if (auto counter = std::get_if<std::shared_ptr<counter_t>>(&series)) {
+          os << name;
+          write_labels(os, labels);
+          os << ' ' << (*counter)->value() << '\n';
+        }
+        else if (auto gauge = std::get_if<std::shared_ptr<gauge_t>>(&series)) {
+          os << name;
+          write_labels(os, labels);
+          os << ' ' << (*gauge)->value() << '\n';
+        }
+        else if (auto histogram = std::get_if<std::shared_ptr<histogram_t>>(&series)) {
+          auto &bounds = (*histogram)->bounds();
+
+          std::uint64_t cumulative = 0;
+          for (std::size_t x = 0; x <= bounds.size(); ++x) {
+            cumulative += (*histogram)->bucket(x);
+
+            std::ostringstream le;
+            le.imbue(std::locale::classic());
+            if (x < bounds.size()) {
+              le << bounds[x];
+            }
+            else {
+              le << "+Inf";
+            }
+
+            os << name << "_bucket";
+            write_labels(os, labels, le.str());
+            os << ' ' << cumulative << '\n';
+          }
+
+          os << name << "_sum";
+          write_labels(os, labels);
+          os << ' ' << (*histogram)->sum() << '\n';
+
+          os << name << "_count";
+          write_labels(os, labels);
+          os << ' ' << (*histogram)->count() << '\n';
+        }
+      }
+    }
+
+    return os.str();
+  }
+}  // namespace metrics
@@ -0,0 +1,171 @@
+/**
+ * @file src/metrics.h
+ * @brief Declarations for the streaming pipeline metrics registry.
+ */
+#pragma once
+
+// standard includes
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Counters, gauges and histograms exported in the Prometheus text format.
+ * @details Metrics are looked up by name and labels once, and the returned pointer is used on the hot path.
+ *          Updating a metric is lock-free. Series removed from the registry stay valid for their holders.
+ */
+namespace metrics {
+  using labels_t = std::map<std::string, std::string>;
+
+  /**
+   * @brief Atomically add to a double.
+   * @note `std::atomic<double>::fetch_add` is missing from older libc++ releases.
+   */
+  inline void
+  atomic_add(std::atomic<double> &target, double value) {
+    auto current = target.load(std::memory_order_relaxed);
+    while (!target.compare_exchange_weak(current, current + value, std::memory_order_relaxed)) {}
+  }
+
+  class counter_t {
+  public:
+    void
+    inc(std::uint64_t value = 1) {
+      _value.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    std::uint64_t
+    value() const {
+      return _value.load(std::memory_order_relaxed);
+    }
+
+  private:
+    std::atomic<std::uint64_t> _value = 0;
+  };
+
+  class gauge_t {
+  public:
+    void
+    set(double value) {
+      _value.store(value, std::memory_order_relaxed);
+    }
+
+    void
+    add(double value) {
+      atomic_add(_value, value);
+    }
+
+    double
+    value() const {
+      return _value.load(std::memory_order_relaxed);
+    }
+
+  private:
+    std::atomic<double> _value = 0;
+  };
+
+  class histogram_t {
+  public:
+    /**
+     * @param bounds The sorted upper bounds of the buckets, the `+Inf` bucket is implied.
+     */
+    explicit histogram_t(std::vector<double> bounds);
+
+    void
+    observe(double value);
+
+    /**
+     * @brief Observe a duration in seconds.
+     * @param duration The duration to observe.
+     */
+    template <class Rep, class Period>
+    void
+    observe(const std::chrono::duration<Rep, Period> &duration) {
+      observe(std::chrono::duration<double>(duration).count());
+    }
+
+    const std::vector<double> &
+    bounds() const {
+      return _bounds;
+    }
+
+    std::uint64_t
+    bucket(std::size_t index) const {
+      return _buckets[index].load(std::memory_order_relaxed);
+    }
+
+    double
+    sum() const {
+      return _sum.load(std::memory_order_relaxed);
+    }
+
+    std::uint64_t
+    count() const {
+      return _count.load(std::memory_order_relaxed);
+    }
+
+  private:
+    std::vector<double> _bounds;
+    std::unique_ptr<std::atomic<std::uint64_t>[]> _buckets;
+    std::atomic<double> _sum = 0;
+    std::atomic<std::uint64_t> _count = 0;
+  };
+
+  /**
+   * @brief Bucket bounds in seconds suited for per-frame latencies, from 100us to 1s.
+   */
+  extern const std::vector<double> latency_buckets;
+
+  /**
+   * @brief Get or create a counter.
+   * @param name The metric name.
+   * @param help The description of the metric.
+   * @param labels The labels of the series.
+   * @return The counter, shared with every other caller using the same name and labels.
+   * @examples
+   * auto frames = metrics::counter("sunshine_capture_frames_total", "Frames captured");
+   * frames->inc();
+   * @examples_end
+   */
+  std::shared_ptr<counter_t>
+  counter(const std::string &name, const std::string &help, const labels_t &labels = {});
+
+  /**
+   * @brief Get or create a gauge.
+   * @param name The metric name.
+   * @param help The description of the metric.
+   * @param labels The labels of the series.
+   * @return The gauge, shared with every other caller using the same name and labels.
+   */
+  std::shared_ptr<gauge_t>
+  gauge(const std::string &name, const std::string &help, const labels_t &labels = {});
+
+  /**
+   * @brief Get or create a histogram.
+   * @param name The metric name.
+   * @param help The description of the metric.
+   * @param bounds The bucket bounds, only used when the series is created.
+   * @param labels The labels of the series.
+   * @return The histogram, shared with every other caller using the same name and labels.
+   */
+  std::shared_ptr<histogram_t>
+  histogram(const std::string &name, const std::string &help, const std::vector<double> &bounds, const labels_t &labels = {});
+
+  /**
+   * @brief Remove every series that carries all the given labels, e.g. when a session ends.
+   * @param labels The labels to match, an empty set removes nothing.
+   */
+  void
+  remove(const labels_t &labels);
+
+  /**
+   * @brief Serialize all metrics in the Prometheus text exposition format.
+   * @return The metrics.
+   */
+  std::string
+  serialize();
+}  // namespace metrics
@@ -33,6 +33,7 @@
 #include "process.h"
 #include "rtsp.h"
 #include "ssh_server.h"
+#include "startup.h"
 #include "system_tray.h"
 #include "usbip_client.h"
 #include "utility.h"
@@ -355,6 +356,40 @@ namespace nvhttp {
     }
   }
 
+  /**
+   * @brief Add how long each prep command of the last launch took to a launch response.
+   * @param tree The response.
+   */
+  void
+  put_prep_timings(pt::ptree &tree) {
+    for (auto &timing : proc::proc.get_prep_timings()) {
+      pt::ptree node;
+      node.put("index", timing.index);
+      if (!timing.group.empty()) {
+        node.put("group", timing.group);
+      }
+      node.put("duration_ms", timing.duration.count());
+      node.put("exit_code", timing.exit_code);
+
+      switch (timing.status) {
+        case proc::prep_timing_t::SUCCEEDED:
+          node.put("status", "succeeded");
+          break;
+        case proc::prep_timing_t::FAILED:
+          node.put("status", "failed");
+          break;
+        case proc::prep_timing_t::TIMED_OUT:
+          node.put("status", "timed_out");
+          break;
+        case proc::prep_timing_t::BACKGROUND:
+          node.put("status", "background");
+          break;
+      }
+
+      tree.add_child("root.prepcmds.prepcmd", node);
+    }
+  }
+
   std::shared_ptr<rtsp_stream::launch_session_t>
   make_launch_session(bool host_audio, const args_t &args) {
     auto launch_session = std::make_shared<rtsp_stream::launch_session_t>();
@@ -741,6 +776,19 @@ namespace nvhttp {
 
     pt::ptree tree;
 
+    // The supported codecs aren't known until the encoders have been probed
+    if (!startup::host().finished("encoder")) {
+      tree.put("root.<xmlattr>.status_code", 503);
+      tree.put("root.<xmlattr>.status_message", "The host is warming up, try again in a few seconds");
+
+      std::ostringstream data;
+
+      pt::write_xml(data, tree);
+      response->write(data.str());
+      response->close_connection_after_response = true;
+      return;
+    }
+
     tree.put("root.<xmlattr>.status_code", 200);
     tree.put("root.hostname", config::nvhttp.sunshine_name);
 
@@ -912,6 +960,14 @@ namespace nvhttp {
       return;
     }
 
+    if (!startup::ready_to_stream()) {
+      tree.put("root.<xmlattr>.status_code", 503);
+      tree.put("root.<xmlattr>.status_message", "The host is warming up, try again in a few seconds");
+      tree.put("root.gamesession", 0);
+
+      return;
+    }
+
     // Probe encoders again before streaming to ensure our chosen
     // encoder matches the active GPU (which could have changed
     // due to hotplugging, driver crash, primary monitor change,
@@ -942,6 +998,7 @@ namespace nvhttp {
 
     if (appid > 0) {
       auto err = proc::proc.execute(appid, launch_session);
+      put_prep_timings(tree);
       if (err) {
         tree.put("root.<xmlattr>.status_code", err);
         tree.put("root.<xmlattr>.status_message", "Failed to start the specified application");
@@ -1004,6 +1061,14 @@ namespace nvhttp {
       return;
     }
 
+    if (!startup::ready_to_stream()) {
+      tree.put("root.resume", 0);
+      tree.put("root.<xmlattr>.status_code", 503);
+      tree.put("root.<xmlattr>.status_message", "The host is warming up, try again in a few seconds");
+
+      return;
+    }
+
     if (rtsp_stream::session_count() == 0) {
       // Probe encoders again before streaming to ensure our chosen
       // encoder matches the active GPU (which could have changed
@@ -1127,6 +1192,20 @@ namespace nvhttp {
       // Get active tunnels count
       auto tunnels = ssh_srv->get_active_tunnels();
       tree.put("active_tunnels", tunnels.size());
+
+      pt::ptree tunnels_array;
+      for (const auto &tunnel : tunnels) {
+        pt::ptree tunnel_node;
+        tunnel_node.put("client_id", tunnel.client_id);
+        tunnel_node.put("client_ip", tunnel.client_ip);
+        tunnel_node.put("forwarded_port", tunnel.forwarded_port);
+        tunnel_node.put("connections", tunnel.connections);
+        tunnel_node.put("bytes_to_client", tunnel.bytes_to_client);
+        tunnel_node.put("bytes_from_client", tunnel.bytes_from_client);
+
+        tunnels_array.push_back(std::make_pair("", tunnel_node));
+      }
+      tree.add_child("tunnels", tunnels_array);
     }
     catch (const std::exception &e) {
       BOOST_LOG(error) << "Error in ssh_info: " << e.what();
@@ -1171,21 +1250,21 @@ namespace nvhttp {
         return;
       }
 
-      // For each tunnel, get USB/IP device list
-      pt::ptree devices_array;
-      auto usbip_mgr = usbip_client::get_manager();
+      // The device lists are refreshed in the background, so a stalled tunnel can't hold up this request
+      auto device_lists = usbip_client::get_manager()->get_device_lists();
 
+      pt::ptree devices_array;
       for (const auto &tunnel : tunnels) {
-        // Connect to USB/IP server through SSH tunnel
-        auto client = usbip_mgr->create_client("localhost", tunnel.forwarded_port);
-        if (!client) {
-          BOOST_LOG(warning) << "Failed to connect to USB/IP server via tunnel on port " << tunnel.forwarded_port;
+        auto device_list = std::find_if(std::begin(device_lists), std::end(device_lists), [&](const auto &entry) {
+          return entry.target.id == tunnel.client_id;
+        });
+
+        // A new tunnel shows up once its server has answered for the first time
+        if (device_list == std::end(device_lists)) {
           continue;
         }
 
-        // Get device list
-        auto devices = client->get_device_list();
-        for (const auto &device : devices) {
+        for (const auto &device : device_list->devices) {
           pt::ptree device_node;
           device_node.put("client_id", tunnel.client_id);
           device_node.put("client_ip", tunnel.client_ip);
@@ -1203,9 +1282,6 @@ namespace nvhttp {
 
           devices_array.push_back(std::make_pair("", device_node));
         }
-
-        // Disconnect after getting list
-        client->disconnect();
       }
 
       tree.put("status", "success");
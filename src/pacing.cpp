@@ -0,0 +1,113 @@
+/**
+ * @file src/pacing.cpp
+ * @brief Definitions for the video pacing policy.
+ */
+// standard includes
+#include <algorithm>
+
+// local includes
+#include "pacing.h"
+
+using namespace std::literals;
+
+namespace pacing {
+  namespace {
+    // Never pace below this percentage of the requested bitrate, so the stream and its FEC can keep up
+    constexpr std::int64_t floor_percent = 150;
+
+    // Each sign of congestion cuts the rate to this percentage,
+    // at most once per decrease_interval or round trip, whichever is longer.
+    constexpr std::int64_t decrease_percent = 75;
+    constexpr auto decrease_interval = 200ms;
+
+    // Without congestion, the rate climbs back from the floor to the ceiling in this time
+    constexpr auto recovery_time = 10s;
+
+    // Round trips this much above the lowest one seen mean packets are queueing somewhere
+    constexpr auto queueing_threshold = 10ms;
+  }  // namespace
+
+  std::int64_t
+  link_budget_t::share(std::int64_t desired) const {
+    auto budget = this->budget();
+    auto demand = this->demand();
+    if (budget <= 0 || demand <= budget) {
+      return desired;
+    }
+
+    return (std::int64_t) ((double) desired * budget / demand);
+  }
+
+  policy_t::policy_t(link_budget_t &link, int bitrate, int burst):
+      _link { link },
+      _ceiling { (std::int64_t) bitrate * 1000 * burst / 100 },
+      _floor { std::min(_ceiling, (std::int64_t) bitrate * 1000 * floor_percent / 100) },
+      _desired { _ceiling } {
+    _link.add_demand(_ceiling);
+  }
+
+  policy_t::~policy_t() {
+    _link.add_demand(-desired_rate());
+  }
+
+  void
+  policy_t::on_loss(int lost, std::chrono::steady_clock::time_point now) {
+    if (lost > 0) {
+      congestion(now);
+    }
+    else {
+      recover(now);
+    }
+  }
+
+  void
+  policy_t::on_rtt(std::chrono::milliseconds rtt, std::chrono::steady_clock::time_point now) {
+    _rtt = rtt;
+    _min_rtt = std::min(_min_rtt, rtt);
+
+    if (rtt - _min_rtt > std::max<std::chrono::milliseconds>(queueing_threshold, _min_rtt)) {
+      congestion(now);
+    }
+    else {
+      recover(now);
+    }
+  }
+
+  std::size_t
+  policy_t::packets_per_ms(std::size_t packet_size) const {
+    return std::max<std::size_t>(1, rate() / 8 / 1000 / packet_size);
+  }
+
+  void
+  policy_t::set_desired(std::int64_t desired) {
+    auto previous = _desired.exchange(desired, std::memory_order_relaxed);
+    _link.add_demand(desired - previous);
+  }
+
+  void
+  policy_t::congestion(std::chrono::steady_clock::time_point now) {
+    _last_update = now;
+
+    // Give the previous decrease time to take effect
+    if (now - _last_decrease < std::max<std::chrono::milliseconds>(decrease_interval, _rtt)) {
+      return;
+    }
+    _last_decrease = now;
+
+    set_desired(std::max(_floor, desired_rate() * decrease_percent / 100));
+  }
+
+  void
+  policy_t::recover(std::chrono::steady_clock::time_point now) {
+    auto elapsed = _last_update == std::chrono::steady_clock::time_point {} ? 0s : now - _last_update;
+    _last_update = now;
+
+    auto desired = desired_rate();
+    if (desired >= _ceiling) {
+      return;
+    }
+
+    auto step = (std::int64_t) ((_ceiling - _floor) * (std::chrono::duration<double>(elapsed) / recovery_time));
+    set_desired(std::min(_ceiling, desired + std::max<std::int64_t>(1, step)));
+  }
+}  // namespace pacing
@@ -0,0 +1,154 @@
+/**
+ * @file src/pacing.h
+ * @brief Declarations for the video pacing policy.
+ */
+#pragma once
+
+// standard includes
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Decides how fast the packets of each video frame are sent.
+ * @details Each session starts at a multiple of its requested bitrate, backs off when the client reports
+ *          packet loss or the round trip time grows, and recovers while the link looks clean.
+ *          All sessions share the budget of the network interface in proportion to their rates.
+ */
+namespace pacing {
+  /**
+   * @brief The bandwidth available to the video streams of all sessions.
+   */
+  class link_budget_t {
+  public:
+    /**
+     * @param budget The bandwidth shared by all sessions in bits per second.
+     */
+    void
+    set_budget(std::int64_t budget) {
+      _budget.store(budget, std::memory_order_relaxed);
+    }
+
+    std::int64_t
+    budget() const {
+      return _budget.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief The sum of the rates every session would like to send at.
+     */
+    std::int64_t
+    demand() const {
+      return _demand.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Scale a session's rate down if all sessions together would exceed the budget.
+     * @param desired The rate the session would like to send at in bits per second.
+     * @return The rate the session may send at in bits per second.
+     */
+    std::int64_t
+    share(std::int64_t desired) const;
+
+  private:
+    friend class policy_t;
+
+    void
+    add_demand(std::int64_t delta) {
+      _demand.fetch_add(delta, std::memory_order_relaxed);
+    }
+
+    std::atomic<std::int64_t> _budget = 0;
+    std::atomic<std::int64_t> _demand = 0;
+  };
+
+  /**
+   * @brief The pacing rate of one session.
+   * @details The feedback methods are called from the control stream thread,
+   *          the rate is read from the video broadcast thread.
+   */
+  class policy_t {
+  public:
+    /**
+     * @param link The budget shared with the other sessions, it must outlive the policy.
+     * @param bitrate The video bitrate requested by the client in Kbps.
+     * @param burst The highest pacing rate as a percentage of the requested bitrate.
+     */
+    policy_t(link_budget_t &link, int bitrate, int burst);
+    ~policy_t();
+
+    policy_t(const policy_t &) = delete;
+    policy_t &
+    operator=(const policy_t &) = delete;
+
+    /**
+     * @brief Handle a loss report of the client.
+     * @param lost The number of video packets lost since the last report.
+     * @param now The time the report was received.
+     */
+    void
+    on_loss(int lost, std::chrono::steady_clock::time_point now);
+
+    /**
+     * @brief Handle a new round trip time estimate of the control stream.
+     * @param rtt The smoothed round trip time.
+     * @param now The time of the estimate.
+     */
+    void
+    on_rtt(std::chrono::milliseconds rtt, std::chrono::steady_clock::time_point now);
+
+    /**
+     * @brief The rate this session would like to send at, before sharing the link budget.
+     * @return The rate in bits per second.
+     */
+    std::int64_t
+    desired_rate() const {
+      return _desired.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief The rate this session may send at.
+     * @return The rate in bits per second.
+     */
+    std::int64_t
+    rate() const {
+      return _link.share(desired_rate());
+    }
+
+    /**
+     * @brief The number of packets this session may send per millisecond.
+     * @param packet_size The size of each packet in bytes.
+     * @return The number of packets, at least 1.
+     */
+    std::size_t
+    packets_per_ms(std::size_t packet_size) const;
+
+    /**
+     * @brief When the previous frame of this session has been fully sent at the pacing rate.
+     * @note Only used by the video broadcast thread.
+     */
+    std::chrono::steady_clock::time_point next_frame_start;
+
+  private:
+    void
+    set_desired(std::int64_t desired);
+
+    void
+    congestion(std::chrono::steady_clock::time_point now);
+
+    void
+    recover(std::chrono::steady_clock::time_point now);
+
+    link_budget_t &_link;
+
+    std::int64_t _ceiling;
+    std::int64_t _floor;
+    std::atomic<std::int64_t> _desired;
+
+    std::chrono::milliseconds _min_rtt = std::chrono::milliseconds::max();
+    std::chrono::milliseconds _rtt {};
+    std::chrono::steady_clock::time_point _last_decrease;
+    std::chrono::steady_clock::time_point _last_update;
+  };
+}  // namespace pacing
@@ -5,6 +5,7 @@
 #pragma once
 
 #include <bitset>
+#include <chrono>
 #include <filesystem>
 #include <functional>
 #include <mutex>
@@ -466,7 +467,9 @@ namespace platf {
     using pull_free_image_cb_t = std::function<bool(std::shared_ptr<img_t> &img_out)>;
 
     display_t() noexcept:
-        offset_x { 0 }, offset_y { 0 } {}
+        offset_x { 0 }, offset_y { 0 } {
+      sleep_overshoot_logger.export_to(metrics::histogram("sunshine_capture_sleep_overshoot_seconds", "How late capture backends wake up for the next frame", metrics::latency_buckets));
+    }
 
     /**
      * @brief Capture a frame.
@@ -678,6 +681,12 @@ namespace platf {
     uint16_t target_port;
     boost::asio::ip::address &source_address;
 
+    // Optional departure time of the first message block, only honored on sockets
+    // where enable_socket_pacing() succeeded. Each following message block departs
+    // departure_interval later than the one before it.
+    std::chrono::steady_clock::time_point departure_time {};
+    std::chrono::nanoseconds departure_interval {};
+
     /**
      * @brief Returns a payload buffer descriptor for the given payload offset.
      * @param offset The offset in the total payload data (bytes).
@@ -732,6 +741,15 @@ namespace platf {
   std::unique_ptr<deinit_t>
   enable_socket_qos(uintptr_t native_socket, boost::asio::ip::address &address, uint16_t port, qos_data_type_e data_type, bool dscp_tagging);
 
+  /**
+   * @brief Let the kernel pace traffic sent on the given socket.
+   * @details Once enabled, `send_batch()` honors the departure time of each batch instead of sending it immediately.
+   * @param native_socket The native socket handle.
+   * @return `true` if the socket accepts departure times and the queueing disciplines honor them, `false` otherwise.
+   */
+  bool
+  enable_socket_pacing(uintptr_t native_socket);
+
   /**
    * @brief Open a url in the default web browser.
    * @param url The url to open.
@@ -0,0 +1,98 @@
+/**
+ * @file src/platform/linux/frame_pacer.cpp
+ * @brief Definitions for the frame pacer shared by the Linux capture backends.
+ */
+// standard includes
+#include <algorithm>
+#include <thread>
+
+// local includes
+#include "frame_pacer.h"
+#include "src/config.h"
+
+using namespace std::literals;
+
+namespace platf {
+  frame_pacer_t::frame_pacer_t(std::chrono::nanoseconds delay, logging::time_delta_periodic_logger &overshoot_logger):
+      delay { delay },
+      spin { std::chrono::microseconds { config::video.capture_pacing.spin } },
+      adaptive_phase { config::video.capture_pacing.phase_offset },
+      next_frame { std::chrono::steady_clock::now() },
+      timer { create_high_precision_timer() },
+      overshoot_logger { overshoot_logger },
+      drift { metrics::histogram("sunshine_capture_drift_seconds", "How late capture starts relative to its schedule", metrics::latency_buckets) },
+      jitter { metrics::histogram("sunshine_capture_jitter_seconds", "Difference between the time between two captures and the frame interval", metrics::latency_buckets) } {
+    if (timer && !*timer) {
+      timer.reset();
+    }
+
+    overshoot_logger.reset();
+  }
+
+  void
+  frame_pacer_t::wait() {
+    auto now = std::chrono::steady_clock::now();
+    auto deadline = next_frame - phase_offset;
+
+    if (deadline > now) {
+      sleep_until(deadline);
+      overshoot_logger.first_point(deadline);
+      overshoot_logger.second_point_now_and_log();
+    }
+
+    auto wake = std::chrono::steady_clock::now();
+    drift->observe(std::max(wake - deadline, std::chrono::steady_clock::duration::zero()));
+    if (last_wake != std::chrono::steady_clock::time_point {}) {
+      auto interval = wake - last_wake;
+      jitter->observe(interval > delay ? interval - delay : delay - interval);
+    }
+    last_wake = wake;
+
+    next_frame += delay;
+    if (next_frame < now) {  // some major slowdown happened; we couldn't keep up
+      next_frame = now + delay;
+    }
+  }
+
+  display_t::pull_free_image_cb_t
+  frame_pacer_t::track(const display_t::pull_free_image_cb_t &pull_free_image_cb) {
+    return [this, &pull_free_image_cb](std::shared_ptr<img_t> &img_out) {
+      auto pulled = pull_free_image_cb(img_out);
+      image_pulled = std::chrono::steady_clock::now();
+      return pulled;
+    };
+  }
+
+  void
+  frame_pacer_t::frame_ready() {
+    if (!adaptive_phase) {
+      return;
+    }
+
+    // Capture starts once a free image is available, waiting for the encoders to release one isn't capture time.
+    // Follow the capture time smoothly, a single slow capture shouldn't shift the schedule.
+    auto capture_time = std::chrono::steady_clock::now() - std::max(last_wake, image_pulled);
+    phase_offset += (std::chrono::duration_cast<std::chrono::nanoseconds>(capture_time) - phase_offset) / 8;
+
+    // Never start capturing more than half a frame early
+    phase_offset = std::clamp(phase_offset, 0ns, delay / 2);
+  }
+
+  void
+  frame_pacer_t::sleep_until(std::chrono::steady_clock::time_point deadline) {
+    auto remaining = deadline - std::chrono::steady_clock::now();
+    if (remaining > spin) {
+      if (timer) {
+        timer->sleep_for(remaining - spin);
+      }
+      else {
+        std::this_thread::sleep_for(remaining - spin);
+      }
+    }
+
+    // Spin for the rest, sleeping can't wake up this precisely
+    while (spin > 0ns && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::yield();
+    }
+  }
+}  // namespace platf
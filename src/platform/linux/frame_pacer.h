@@ -0,0 +1,84 @@
+/**
+ * @file src/platform/linux/frame_pacer.h
+ * @brief Declarations for the frame pacer shared by the Linux capture backends.
+ */
+#pragma once
+
+// standard includes
+#include <chrono>
+#include <memory>
+
+// local includes
+#include "src/logging.h"
+#include "src/metrics.h"
+#include "src/platform/common.h"
+
+namespace platf {
+  /**
+   * @brief Wakes a capture loop up once per frame interval.
+   * @details Sleeps with the high precision timer, optionally spinning for the last moments before each
+   *          deadline, and records how late each wake up is and how much the frame intervals vary.
+   *          With the phase offset enabled, it wakes up early by the time capture usually takes,
+   *          so the captured frames are ready on the frame deadlines rather than after them.
+   *
+   * @code{.cpp}
+   * frame_pacer_t pacer { delay, sleep_overshoot_logger };
+   * auto pull_free_image = pacer.track(pull_free_image_cb);
+   * while (true) {
+   *   pacer.wait();
+   *   auto status = snapshot(pull_free_image, ...);
+   *   pacer.frame_ready();
+   *   ...
+   * }
+   * @endcode
+   */
+  class frame_pacer_t {
+  public:
+    /**
+     * @param delay The frame interval.
+     * @param overshoot_logger The logger of the display for late wake ups.
+     */
+    frame_pacer_t(std::chrono::nanoseconds delay, logging::time_delta_periodic_logger &overshoot_logger);
+
+    /**
+     * @brief Wait until the next frame should be captured.
+     */
+    void
+    wait();
+
+    /**
+     * @brief Wrap the callback pulling a free image, so the time spent waiting for one isn't counted as capture time.
+     * @param pull_free_image_cb The callback, which must outlive the returned one.
+     * @return The callback to capture with.
+     */
+    display_t::pull_free_image_cb_t
+    track(const display_t::pull_free_image_cb_t &pull_free_image_cb);
+
+    /**
+     * @brief Report that the frame captured after the last `wait()` is ready.
+     */
+    void
+    frame_ready();
+
+  private:
+    void
+    sleep_until(std::chrono::steady_clock::time_point deadline);
+
+    std::chrono::nanoseconds delay;
+    std::chrono::nanoseconds spin;
+    bool adaptive_phase;
+
+    // How much earlier than the frame deadline capture starts
+    std::chrono::nanoseconds phase_offset {};
+
+    std::chrono::steady_clock::time_point next_frame;
+    std::chrono::steady_clock::time_point last_wake;
+    std::chrono::steady_clock::time_point image_pulled;
+
+    std::unique_ptr<high_precision_timer> timer;
+
+    logging::time_delta_periodic_logger &overshoot_logger;
+    std::shared_ptr<metrics::histogram_t> drift;
+    std::shared_ptr<metrics::histogram_t> jitter;
+  };
+}  // namespace platf
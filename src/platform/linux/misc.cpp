@@ -11,6 +11,8 @@
 // standard includes
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <set>
 
 // lib includes
 #include <arpa/inet.h>
@@ -20,8 +22,12 @@
 #include <dlfcn.h>
 #include <fcntl.h>
 #include <ifaddrs.h>
+#include <linux/net_tstamp.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
 #include <netinet/udp.h>
 #include <pwd.h>
+#include <sys/prctl.h>
 #include <unistd.h>
 
 // local includes
@@ -414,18 +420,25 @@ namespace platf {
       msg.msg_namelen = sizeof(taddr_v4);
     }
 
-    union {
-      char buf[CMSG_SPACE(sizeof(uint16_t)) +
+    union cmbuf_t {
+      char buf[CMSG_SPACE(sizeof(uint16_t)) + CMSG_SPACE(sizeof(uint64_t)) +
                std::max(CMSG_SPACE(sizeof(struct in_pktinfo)), CMSG_SPACE(sizeof(struct in6_pktinfo)))];
       struct cmsghdr alignment;
     } cmbuf = {};  // Must be zeroed for CMSG_NXTHDR()
     socklen_t cmbuflen = 0;
 
+    // Departure time of the given message block on the CLOCK_MONOTONIC timeline
+    auto paced = send_info.departure_time != std::chrono::steady_clock::time_point {};
+    auto txtime_for = [&](size_t block) -> uint64_t {
+      auto departure = send_info.departure_time + send_info.departure_interval * block;
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(departure.time_since_epoch()).count();
+    };
+
     msg.msg_control = cmbuf.buf;
     msg.msg_controllen = sizeof(cmbuf.buf);
 
     // The PKTINFO option will always be first, then we will conditionally
-    // append the UDP_SEGMENT option next if applicable.
+    // append the UDP_SEGMENT and SCM_TXTIME options next if applicable.
     auto pktinfo_cm = CMSG_FIRSTHDR(&msg);
     if (send_info.source_address.is_v6()) {
       struct in6_pktinfo pktInfo;
@@ -496,20 +509,34 @@ namespace platf {
         msg.msg_iov = iovs;
         msg.msg_iovlen = iovlen;
 
+        msg.msg_controllen = cmbuflen;
+        auto cm = pktinfo_cm;
+
         // We should not use GSO if the data is <= one full block size
         if (segs_in_batch > 1) {
-          msg.msg_controllen = cmbuflen + CMSG_SPACE(sizeof(uint16_t));
+          msg.msg_controllen += CMSG_SPACE(sizeof(uint16_t));
 
           // Enable GSO to perform segmentation of our buffer for us
-          auto cm = CMSG_NXTHDR(&msg, pktinfo_cm);
+          cm = CMSG_NXTHDR(&msg, cm);
           cm->cmsg_level = SOL_UDP;
           cm->cmsg_type = UDP_SEGMENT;
           cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
           *((uint16_t *) CMSG_DATA(cm)) = msg_size;
         }
-        else {
-          msg.msg_controllen = cmbuflen;
+
+#ifdef SCM_TXTIME
+        // The whole GSO batch leaves at the departure time of its first segment
+        if (paced) {
+          msg.msg_controllen += CMSG_SPACE(sizeof(uint64_t));
+
+          auto txtime = txtime_for(seg_index);
+          cm = CMSG_NXTHDR(&msg, cm);
+          cm->cmsg_level = SOL_SOCKET;
+          cm->cmsg_type = SCM_TXTIME;
+          cm->cmsg_len = CMSG_LEN(sizeof(txtime));
+          memcpy(CMSG_DATA(cm), &txtime, sizeof(txtime));
         }
+#endif
 
         // This will fail if GSO is not available, so we will fall back to non-GSO if
         // it's the first sendmsg() call. On subsequent calls, we will treat errors as
@@ -551,6 +578,9 @@ namespace platf {
       struct mmsghdr msgs[send_info.block_count] = {};
       struct iovec iovs[send_info.block_count * (send_info.headers ? 2 : 1)] = {};
       int iov_idx = 0;
+
+      // Each message needs its own control buffer to carry its own departure time
+      std::vector<cmbuf_t> msg_cmbufs(paced ? send_info.block_count : 0);
       for (size_t i = 0; i < send_info.block_count; i++) {
         msgs[i].msg_hdr.msg_iov = &iovs[iov_idx];
         msgs[i].msg_hdr.msg_iovlen = send_info.headers ? 2 : 1;
@@ -569,6 +599,21 @@ namespace platf {
         msgs[i].msg_hdr.msg_namelen = msg.msg_namelen;
         msgs[i].msg_hdr.msg_control = cmbuf.buf;
         msgs[i].msg_hdr.msg_controllen = cmbuflen;
+
+#ifdef SCM_TXTIME
+        if (paced) {
+          msg_cmbufs[i] = cmbuf;
+          msgs[i].msg_hdr.msg_control = msg_cmbufs[i].buf;
+          msgs[i].msg_hdr.msg_controllen = cmbuflen + CMSG_SPACE(sizeof(uint64_t));
+
+          auto txtime = txtime_for(i);
+          auto cm = CMSG_NXTHDR(&msgs[i].msg_hdr, CMSG_FIRSTHDR(&msgs[i].msg_hdr));
+          cm->cmsg_level = SOL_SOCKET;
+          cm->cmsg_type = SCM_TXTIME;
+          cm->cmsg_len = CMSG_LEN(sizeof(txtime));
+          memcpy(CMSG_DATA(cm), &txtime, sizeof(txtime));
+        }
+#endif
       }
 
       // Call sendmmsg() until all messages are sent
@@ -808,6 +853,126 @@ namespace platf {
     return std::make_unique<qos_t>(sockfd, reset_options);
   }
 
+  /**
+   * @brief Get the queueing disciplines attached to each network interface.
+   * @return The qdisc kinds by interface index, or an empty map if they could not be queried.
+   */
+  static std::map<int, std::vector<std::string>>
+  get_qdiscs() {
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd < 0) {
+      BOOST_LOG(warning) << "Failed to open netlink socket: "sv << errno;
+      return {};
+    }
+    auto fd_guard = util::fail_guard([fd]() {
+      close(fd);
+    });
+
+    struct {
+      nlmsghdr header;
+      tcmsg tc;
+    } request = {};
+    request.header.nlmsg_len = sizeof(request);
+    request.header.nlmsg_type = RTM_GETQDISC;
+    request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    request.tc.tcm_family = AF_UNSPEC;
+
+    if (::send(fd, &request, sizeof(request), 0) < 0) {
+      BOOST_LOG(warning) << "Failed to request the queueing disciplines: "sv << errno;
+      return {};
+    }
+
+    std::map<int, std::vector<std::string>> qdiscs;
+    while (true) {
+      alignas(nlmsghdr) char buf[32 * 1024];
+      int len = ::recv(fd, buf, sizeof(buf), 0);
+      if (len < 0) {
+        BOOST_LOG(warning) << "Failed to receive the queueing disciplines: "sv << errno;
+        return {};
+      }
+
+      for (auto msg = (nlmsghdr *) buf; NLMSG_OK(msg, len); msg = NLMSG_NEXT(msg, len)) {
+        if (msg->nlmsg_type == NLMSG_DONE) {
+          return qdiscs;
+        }
+
+        if (msg->nlmsg_type == NLMSG_ERROR) {
+          BOOST_LOG(warning) << "Failed to dump the queueing disciplines: "sv << -((nlmsgerr *) NLMSG_DATA(msg))->error;
+          return {};
+        }
+
+        if (msg->nlmsg_type != RTM_NEWQDISC) {
+          continue;
+        }
+
+        auto tc = (tcmsg *) NLMSG_DATA(msg);
+        int attr_len = msg->nlmsg_len - NLMSG_LENGTH(sizeof(*tc));
+        for (auto attr = (rtattr *) ((char *) tc + NLMSG_ALIGN(sizeof(*tc))); RTA_OK(attr, attr_len); attr = RTA_NEXT(attr, attr_len)) {
+          if (attr->rta_type == TCA_KIND) {
+            qdiscs[tc->tcm_ifindex].emplace_back((const char *) RTA_DATA(attr));
+          }
+        }
+      }
+    }
+  }
+
+  /**
+   * @brief Check that the queueing disciplines of every interface that is up hold packets back until their departure time.
+   * @details Without `fq` or `etf`, `SO_TXTIME` is accepted but the departure times are ignored.
+   * @return `true` if departure times are honored on every interface.
+   */
+  static bool
+  qdiscs_honor_txtime() {
+    auto qdiscs = get_qdiscs();
+    if (qdiscs.empty()) {
+      return false;
+    }
+
+    std::set<std::string> checked;
+    auto ifaddrs = get_ifaddrs();
+    for (auto pos = ifaddrs.get(); pos != nullptr; pos = pos->ifa_next) {
+      if (!(pos->ifa_flags & IFF_UP) || (pos->ifa_flags & IFF_LOOPBACK) || !checked.emplace(pos->ifa_name).second) {
+        continue;
+      }
+
+      for (auto &kind : qdiscs[if_nametoindex(pos->ifa_name)]) {
+        // mq and mqprio only hand packets to a child qdisc per transmit queue, which is listed as well.
+        // Virtual interfaces without a queue pass the packets on to the qdisc of another interface,
+        // and ingress and clsact only classify packets without queueing them.
+        if (kind == "fq"sv || kind == "etf"sv || kind == "mq"sv || kind == "mqprio"sv ||
+            kind == "noqueue"sv || kind == "ingress"sv || kind == "clsact"sv) {
+          continue;
+        }
+
+        BOOST_LOG(warning) << "Interface ["sv << pos->ifa_name << "] uses the "sv << kind << " qdisc, which ignores departure times"sv;
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  bool
+  enable_socket_pacing(uintptr_t native_socket) {
+#ifdef SO_TXTIME
+    // Any qdisc accepts departure times, but the packets would be sent in bursts without fq or etf
+    if (!qdiscs_honor_txtime()) {
+      return false;
+    }
+
+    // Departure times are given on the same clock as std::chrono::steady_clock
+    struct sock_txtime txtime = {};
+    txtime.clockid = CLOCK_MONOTONIC;
+
+    if (setsockopt((int) native_socket, SOL_SOCKET, SO_TXTIME, &txtime, sizeof(txtime)) == 0) {
+      return true;
+    }
+
+    BOOST_LOG(warning) << "Failed to set SO_TXTIME: "sv << errno;
+#endif
+    return false;
+  }
+
   std::string
   get_host_name() {
     try {
@@ -833,6 +998,7 @@ namespace platf {
 #ifdef SUNSHINE_BUILD_X11
       X11,  ///< X11
 #endif
+      SYNTHETIC,  ///< Synthetic
       MAX_FLAGS  ///< The maximum number of flags
     };
   }  // namespace source
@@ -887,8 +1053,14 @@ namespace platf {
   }
 #endif
 
+  std::vector<std::string>
+  synthetic_display_names();
+  std::shared_ptr<display_t>
+  synthetic_display(mem_type_e hwdevice_type, const std::string &display_name, const video::config_t &config);
+
   std::vector<std::string>
   display_names(mem_type_e hwdevice_type) {
+    if (sources[source::SYNTHETIC]) return synthetic_display_names();
 #ifdef SUNSHINE_BUILD_CUDA
     // display using NvFBC only supports mem_type_e::cuda
     if (sources[source::NVFBC] && hwdevice_type == mem_type_e::cuda) return nvfbc_display_names();
@@ -917,6 +1089,10 @@ namespace platf {
 
   std::shared_ptr<display_t>
   display(mem_type_e hwdevice_type, const std::string &display_name, const video::config_t &config) {
+    if (sources[source::SYNTHETIC]) {
+      BOOST_LOG(info) << "Generating frames with the synthetic display"sv;
+      return synthetic_display(hwdevice_type, display_name, config);
+    }
 #ifdef SUNSHINE_BUILD_CUDA
     if (sources[source::NVFBC] && hwdevice_type == mem_type_e::cuda) {
       BOOST_LOG(info) << "Screencasting with NvFBC"sv;
@@ -970,6 +1146,11 @@ namespace platf {
     }
 #endif
 
+    // The synthetic display is never picked automatically, it doesn't show what's on the screen
+    if (config::video.capture == "synthetic") {
+      sources[source::SYNTHETIC] = true;
+    }
+
 #ifdef SUNSHINE_BUILD_CUDA
     if ((config::video.capture.empty() && sources.none()) || config::video.capture == "nvfbc") {
       if (verify_nvfbc()) {
@@ -1015,6 +1196,14 @@ namespace platf {
 
   class linux_high_precision_timer: public high_precision_timer {
   public:
+    linux_high_precision_timer() {
+      // The timer is created on the thread that sleeps with it. The default 50us of timer slack
+      // lets the kernel wake the thread up that much later to coalesce wake ups.
+      if (prctl(PR_SET_TIMERSLACK, 1, 0, 0, 0) < 0) {
+        BOOST_LOG(debug) << "Failed to reduce timer slack: "sv << errno;
+      }
+    }
+
     void
     sleep_for(const std::chrono::nanoseconds &duration) override {
       std::this_thread::sleep_for(duration);
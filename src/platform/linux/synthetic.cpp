@@ -0,0 +1,372 @@
+/**
+ * @file src/platform/linux/synthetic.cpp
+ * @brief Definitions for the synthetic display, which generates or replays frames without a display server.
+ */
+// standard includes
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+// platform includes
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// local includes
+#include "cuda.h"
+#include "frame_pacer.h"
+#include "src/config.h"
+#include "src/logging.h"
+#include "src/platform/common.h"
+#include "src/video.h"
+#include "vaapi.h"
+
+using namespace std::literals;
+
+namespace platf {
+  namespace synthetic {
+    struct img_t: public platf::img_t {
+      ~img_t() override {
+        delete[] data;
+        data = nullptr;
+      }
+    };
+
+    /**
+     * @brief A read-only memory mapping of a file of raw frames.
+     */
+    class mapped_file_t {
+    public:
+      mapped_file_t() = default;
+      mapped_file_t(const mapped_file_t &) = delete;
+      mapped_file_t &
+      operator=(const mapped_file_t &) = delete;
+
+      ~mapped_file_t() {
+        if (data) {
+          munmap(data, size);
+        }
+      }
+
+      int
+      open(const std::string &path) {
+        auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+          BOOST_LOG(error) << "Couldn't open ["sv << path << "]: "sv << std::strerror(errno);
+          return -1;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) || st.st_size == 0) {
+          BOOST_LOG(error) << "Couldn't get the size of ["sv << path << ']';
+          close(fd);
+          return -1;
+        }
+
+        auto mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+          BOOST_LOG(error) << "Couldn't map ["sv << path << "]: "sv << std::strerror(errno);
+          return -1;
+        }
+
+        // Frames are read in order, so let the kernel read ahead
+        madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+
+        data = (std::uint8_t *) mapping;
+        size = st.st_size;
+
+        return 0;
+      }
+
+      std::uint8_t *data = nullptr;
+      std::size_t size = 0;
+    };
+
+    /**
+     * @brief Deterministic pseudo-random numbers, the same seed gives the same frame on every run.
+     */
+    class xorshift_t {
+    public:
+      explicit xorshift_t(std::uint64_t seed):
+          state { seed * 0x9E3779B97F4A7C15ull | 1 } {}
+
+      std::uint64_t
+      operator()() {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+      }
+
+    private:
+      std::uint64_t state;
+    };
+
+    constexpr std::uint32_t
+    bgra(std::uint8_t r, std::uint8_t g, std::uint8_t b) {
+      return b | (g << 8) | (r << 16) | (0xFFu << 24);
+    }
+
+    class display_t: public platf::display_t {
+    public:
+      explicit display_t(mem_type_e mem_type):
+          mem_type { mem_type } {}
+
+      int
+      init(const ::video::config_t &config) {
+        auto &options = config::video.synthetic;
+
+        width = options.width ? options.width : config.width;
+        height = options.height ? options.height : config.height;
+        env_width = width;
+        env_height = height;
+
+        delay = std::chrono::nanoseconds { 1s } / (options.framerate ? options.framerate : config.framerate);
+
+        row_pitch = width * 4;
+        frame_size = row_pitch * height;
+
+        if (!options.file.empty()) {
+          if (file.open(options.file)) {
+            return -1;
+          }
+
+          frame_count = file.size / frame_size;
+          if (!frame_count) {
+            BOOST_LOG(error) << '[' << options.file << "] doesn't contain a single "sv << width << 'x' << height << " BGRA frame"sv;
+            return -1;
+          }
+
+          BOOST_LOG(info) << "Replaying "sv << frame_count << " frames of "sv << width << 'x' << height << " from ["sv << options.file << ']';
+          return 0;
+        }
+
+        pattern = options.pattern.empty() ? "gradient"s : options.pattern;
+        if (pattern == "gradient"sv) {
+          make_gradient();
+        }
+        else if (pattern == "scroll"sv) {
+          make_scroll();
+        }
+        else if (pattern == "desktop"sv) {
+          make_desktop();
+        }
+        else if (pattern != "noise"sv) {
+          BOOST_LOG(error) << "Unknown synthetic pattern ["sv << pattern << ']';
+          return -1;
+        }
+
+        BOOST_LOG(info) << "Generating "sv << width << 'x' << height << " frames with the ["sv << pattern << "] pattern"sv;
+        return 0;
+      }
+
+      capture_e
+      capture(const push_captured_image_cb_t &push_captured_image_cb, const pull_free_image_cb_t &pull_free_image_cb, bool *cursor) override {
+        frame_pacer_t pacer { delay, sleep_overshoot_logger };
+        auto pull_free_image = pacer.track(pull_free_image_cb);
+
+        while (true) {
+          pacer.wait();
+
+          std::shared_ptr<platf::img_t> img_out;
+          if (!pull_free_image(img_out)) {
+            return capture_e::interrupted;
+          }
+
+          img_out->frame_timestamp = std::chrono::steady_clock::now();
+          render(*img_out, frame_nr++);
+          pacer.frame_ready();
+
+          if (!push_captured_image_cb(std::move(img_out), true)) {
+            return capture_e::ok;
+          }
+        }
+
+        return capture_e::ok;
+      }
+
+      std::shared_ptr<platf::img_t>
+      alloc_img() override {
+        auto img = std::make_shared<synthetic::img_t>();
+        img->width = width;
+        img->height = height;
+        img->pixel_pitch = 4;
+        img->row_pitch = row_pitch;
+        img->data = new std::uint8_t[frame_size];
+
+        return img;
+      }
+
+      int
+      dummy_img(platf::img_t *img) override {
+        std::memset(img->data, 0, frame_size);
+        return 0;
+      }
+
+      std::unique_ptr<avcodec_encode_device_t>
+      make_avcodec_encode_device(pix_fmt_e pix_fmt) override {
+#ifdef SUNSHINE_BUILD_VAAPI
+        if (mem_type == mem_type_e::vaapi) {
+          return va::make_avcodec_encode_device(width, height, false);
+        }
+#endif
+
+#ifdef SUNSHINE_BUILD_CUDA
+        if (mem_type == mem_type_e::cuda) {
+          return cuda::make_avcodec_encode_device(width, height, false);
+        }
+#endif
+
+        return std::make_unique<avcodec_encode_device_t>();
+      }
+
+    private:
+      /**
+       * @brief Fill an image with the content of a frame.
+       * @param img The image to fill.
+       * @param frame The index of the frame, the content only depends on it.
+       */
+      void
+      render(platf::img_t &img, std::uint64_t frame) {
+        if (file.data) {
+          std::memcpy(img.data, file.data + (frame % frame_count) * frame_size, frame_size);
+        }
+        else if (pattern == "gradient"sv) {
+          // Each row is a window into a wider row that shifts by a few pixels every frame
+          for (int y = 0; y < height; ++y) {
+            auto offset = (frame * 4 + y / 2) % width;
+            std::memcpy(img.data + y * row_pitch, base.data() + offset * 4, row_pitch);
+          }
+        }
+        else if (pattern == "scroll"sv) {
+          // Scroll a page that is twice as tall as the display upwards by 2 lines every frame
+          auto base_height = height * 2;
+          for (int y = 0; y < height; ++y) {
+            auto line = (frame * 2 + y) % base_height;
+            std::memcpy(img.data + y * row_pitch, base.data() + line * row_pitch, row_pitch);
+          }
+        }
+        else if (pattern == "desktop"sv) {
+          std::memcpy(img.data, base.data(), frame_size);
+        }
+        else {
+          xorshift_t random { frame };
+          auto words = (std::uint64_t *) img.data;
+          auto word_count = frame_size / sizeof(std::uint64_t);
+          for (std::size_t x = 0; x < word_count; ++x) {
+            words[x] = random();
+          }
+          std::memset(img.data + word_count * sizeof(std::uint64_t), 0, frame_size % sizeof(std::uint64_t));
+        }
+      }
+
+      void
+      make_gradient() {
+        // A row of twice the width, so any window of the display width can be copied out of it
+        base.resize(row_pitch * 2);
+        auto pixels = (std::uint32_t *) base.data();
+        for (int x = 0; x < width * 2; ++x) {
+          auto t = (x % width) * 768 / width;
+          auto ramp = [](int v) {
+            return (std::uint8_t) (v < 256 ? v : v < 512 ? 511 - v : 0);
+          };
+          pixels[x] = bgra(ramp(t % 768), ramp((t + 256) % 768), ramp((t + 512) % 768));
+        }
+      }
+
+      void
+      make_scroll() {
+        // Lines of "words" made of dark blocks on a white page, like a terminal or a document
+        auto base_height = height * 2;
+        base.resize(row_pitch * base_height);
+        auto pixels = (std::uint32_t *) base.data();
+        std::fill_n(pixels, width * base_height, bgra(0xFF, 0xFF, 0xFF));
+
+        constexpr int line_height = 20;
+        constexpr int glyph_height = 14;
+        constexpr int glyph_width = 8;
+
+        xorshift_t random { 1 };
+        for (int line = 0; line + line_height <= base_height; line += line_height) {
+          int x = glyph_width;
+          auto line_end = (int) (random() % width);
+          while (x + glyph_width < line_end) {
+            auto word = 1 + (int) (random() % 10);
+            for (int glyph = 0; glyph < word && x + glyph_width < line_end; ++glyph, x += glyph_width) {
+              auto shape = random();
+              for (int y = 0; y < glyph_height; ++y) {
+                for (int dx = 0; dx < glyph_width - 2; ++dx) {
+                  if (shape >> ((y * 3 + dx) % 64) & 1) {
+                    pixels[(line + y + 3) * width + x + dx] = bgra(0x20, 0x20, 0x20);
+                  }
+                }
+              }
+            }
+            x += glyph_width;
+          }
+        }
+      }
+
+      void
+      make_desktop() {
+        // A wallpaper with a few windows on top of it, which never changes
+        base.resize(frame_size);
+        auto pixels = (std::uint32_t *) base.data();
+        for (int y = 0; y < height; ++y) {
+          for (int x = 0; x < width; ++x) {
+            pixels[y * width + x] = bgra(0x20, 0x40 + y * 0x60 / height, 0x80 + x * 0x40 / width);
+          }
+        }
+
+        xorshift_t random { 2 };
+        for (int window = 0; window < 4; ++window) {
+          // Keep the divisors non-zero on displays less than 3 pixels wide or tall
+          auto w = width / 4 + (int) (random() % std::max(width / 3, 1));
+          auto h = height / 4 + (int) (random() % std::max(height / 3, 1));
+          auto left = (int) (random() % (width - w));
+          auto top = (int) (random() % (height - h));
+          for (int y = top; y < top + h; ++y) {
+            auto color = y < top + 24 ? bgra(0x30, 0x30, 0x38) : bgra(0xF0, 0xF0, 0xF0);
+            std::fill_n(pixels + y * width + left, w, color);
+          }
+        }
+      }
+
+      mem_type_e mem_type;
+      std::chrono::nanoseconds delay;
+
+      std::string pattern;
+      std::vector<std::uint8_t> base;
+
+      mapped_file_t file;
+      std::size_t frame_count = 0;
+
+      int row_pitch = 0;
+      std::size_t frame_size = 0;
+      std::uint64_t frame_nr = 0;
+    };
+  }  // namespace synthetic
+
+  std::vector<std::string>
+  synthetic_display_names() {
+    return { "synthetic"s };
+  }
+
+  std::shared_ptr<display_t>
+  synthetic_display(mem_type_e hwdevice_type, const std::string &display_name, const ::video::config_t &config) {
+    if (hwdevice_type != mem_type_e::system && hwdevice_type != mem_type_e::vaapi && hwdevice_type != mem_type_e::cuda) {
+      BOOST_LOG(error) << "Could not initialize synthetic display with the given hw device type"sv;
+      return nullptr;
+    }
+
+    auto disp = std::make_shared<synthetic::display_t>(hwdevice_type);
+    if (disp->init(config)) {
+      return nullptr;
+    }
+
+    return disp;
+  }
+}  // namespace platf
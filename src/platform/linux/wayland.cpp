@@ -6,6 +6,7 @@
 #include <wayland-client.h>
 #include <wayland-util.h>
 
+#include <algorithm>
 #include <cstdlib>
 
 #include "graphics.h"
@@ -160,7 +161,9 @@ namespace wl {
 
   interface_t::interface_t() noexcept
       :
+      screencopy_manager { nullptr },
       output_manager { nullptr },
+      shm { nullptr },
       listener {
         &CLASS_CALL(interface_t, add_interface),
         &CLASS_CALL(interface_t, del_interface)
@@ -193,6 +196,19 @@ namespace wl {
 
       this->interface[WLR_EXPORT_DMABUF] = true;
     }
+    else if (!std::strcmp(interface, zwlr_screencopy_manager_v1_interface.name)) {
+      BOOST_LOG(info) << "Found interface: "sv << interface << '(' << id << ") version "sv << version;
+      // Version 2 adds copy_with_damage, version 3 adds buffer_done
+      screencopy_manager = (zwlr_screencopy_manager_v1 *) wl_registry_bind(registry, id, &zwlr_screencopy_manager_v1_interface, std::min(version, 3u));
+
+      this->interface[WLR_SCREENCOPY] = true;
+    }
+    else if (!std::strcmp(interface, wl_shm_interface.name)) {
+      BOOST_LOG(info) << "Found interface: "sv << interface << '(' << id << ") version "sv << version;
+      shm = (wl_shm *) wl_registry_bind(registry, id, &wl_shm_interface, 1);
+
+      this->interface[WL_SHM] = true;
+    }
   }
 
   void
@@ -280,6 +296,95 @@ namespace wl {
     status = REINIT;
   }
 
+  screencopy_t::screencopy_t():
+      status { READY }, buffer_known { false }, format {}, width {}, height {}, stride {}, y_invert { false }, frame { nullptr }, listener {
+        &CLASS_CALL(screencopy_t, buffer),
+        &CLASS_CALL(screencopy_t, flags),
+        &CLASS_CALL(screencopy_t, ready),
+        &CLASS_CALL(screencopy_t, failed),
+        &CLASS_CALL(screencopy_t, damage),
+        &CLASS_CALL(screencopy_t, linux_dmabuf),
+        &CLASS_CALL(screencopy_t, buffer_done)
+      } {
+  }
+
+  void
+  screencopy_t::listen(zwlr_screencopy_manager_v1 *screencopy_manager, wl_output *output, bool blend_cursor) {
+    cancel();
+
+    frame = zwlr_screencopy_manager_v1_capture_output(screencopy_manager, blend_cursor, output);
+    zwlr_screencopy_frame_v1_add_listener(frame, &listener, this);
+
+    buffer_known = false;
+    y_invert = false;
+    status = WAITING;
+  }
+
+  void
+  screencopy_t::copy(wl_buffer *buffer, bool with_damage) {
+    if (with_damage && zwlr_screencopy_frame_v1_get_version(frame) >= ZWLR_SCREENCOPY_FRAME_V1_COPY_WITH_DAMAGE_SINCE_VERSION) {
+      zwlr_screencopy_frame_v1_copy_with_damage(frame, buffer);
+    }
+    else {
+      zwlr_screencopy_frame_v1_copy(frame, buffer);
+    }
+  }
+
+  void
+  screencopy_t::cancel() {
+    if (frame) {
+      zwlr_screencopy_frame_v1_destroy(frame);
+      frame = nullptr;
+    }
+  }
+
+  screencopy_t::~screencopy_t() {
+    cancel();
+  }
+
+  void
+  screencopy_t::buffer(
+    zwlr_screencopy_frame_v1 *frame,
+    std::uint32_t format,
+    std::uint32_t width, std::uint32_t height,
+    std::uint32_t stride) {
+    this->format = format;
+    this->width = width;
+    this->height = height;
+    this->stride = stride;
+
+    // Before version 3, there is no buffer_done event and wl_shm is the only buffer type
+    if (zwlr_screencopy_frame_v1_get_version(frame) < ZWLR_SCREENCOPY_FRAME_V1_BUFFER_DONE_SINCE_VERSION) {
+      buffer_known = true;
+    }
+  }
+
+  void
+  screencopy_t::flags(zwlr_screencopy_frame_v1 *frame, std::uint32_t flags) {
+    y_invert = flags & ZWLR_SCREENCOPY_FRAME_V1_FLAGS_Y_INVERT;
+  }
+
+  void
+  screencopy_t::ready(
+    zwlr_screencopy_frame_v1 *frame,
+    std::uint32_t tv_sec_hi, std::uint32_t tv_sec_lo, std::uint32_t tv_nsec) {
+    cancel();
+
+    status = READY;
+  }
+
+  void
+  screencopy_t::failed(zwlr_screencopy_frame_v1 *frame) {
+    cancel();
+
+    status = REINIT;
+  }
+
+  void
+  screencopy_t::buffer_done(zwlr_screencopy_frame_v1 *frame) {
+    buffer_known = true;
+  }
+
   void
   frame_t::destroy() {
     for (auto x = 0; x < 4; ++x) {
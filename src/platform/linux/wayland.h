@@ -8,6 +8,7 @@
 
 #ifdef SUNSHINE_BUILD_WAYLAND
   #include <wlr-export-dmabuf-unstable-v1.h>
+  #include <wlr-screencopy-unstable-v1.h>
   #include <xdg-output-unstable-v1.h>
 #endif
 
@@ -97,6 +98,100 @@ namespace wl {
     zwlr_export_dmabuf_frame_v1_listener listener;
   };
 
+  /**
+   * @brief Copies an output into a client provided wl_shm buffer using wlr-screencopy.
+   */
+  class screencopy_t {
+  public:
+    enum status_e {
+      WAITING,  ///< Waiting for the buffer parameters or the copy
+      READY,  ///< Frame is ready
+      REINIT,  ///< Reinitialize the frame
+    };
+
+    screencopy_t(screencopy_t &&) = delete;
+    screencopy_t(const screencopy_t &) = delete;
+
+    screencopy_t &
+    operator=(const screencopy_t &) = delete;
+    screencopy_t &
+    operator=(screencopy_t &&) = delete;
+
+    screencopy_t();
+
+    /**
+     * @brief Request a new frame, the compositor answers with the buffer parameters it expects.
+     */
+    void
+    listen(zwlr_screencopy_manager_v1 *screencopy_manager, wl_output *output, bool blend_cursor = false);
+
+    /**
+     * @brief Ask the compositor to copy the frame into the buffer.
+     * @param buffer A wl_shm buffer matching the announced parameters.
+     * @param with_damage Wait until the output has changed since the last copy.
+     */
+    void
+    copy(wl_buffer *buffer, bool with_damage);
+
+    /**
+     * @brief Drop the pending frame, if any.
+     */
+    void
+    cancel();
+
+    ~screencopy_t();
+
+    void
+    buffer(
+      zwlr_screencopy_frame_v1 *frame,
+      std::uint32_t format,
+      std::uint32_t width, std::uint32_t height,
+      std::uint32_t stride);
+
+    void
+    flags(zwlr_screencopy_frame_v1 *frame, std::uint32_t flags);
+
+    void
+    ready(
+      zwlr_screencopy_frame_v1 *frame,
+      std::uint32_t tv_sec_hi, std::uint32_t tv_sec_lo, std::uint32_t tv_nsec);
+
+    void
+    failed(zwlr_screencopy_frame_v1 *frame);
+
+    void
+    damage(
+      zwlr_screencopy_frame_v1 *frame,
+      std::uint32_t x, std::uint32_t y,
+      std::uint32_t width, std::uint32_t height) {}
+
+    void
+    linux_dmabuf(
+      zwlr_screencopy_frame_v1 *frame,
+      std::uint32_t format,
+      std::uint32_t width, std::uint32_t height) {}
+
+    void
+    buffer_done(zwlr_screencopy_frame_v1 *frame);
+
+    status_e status;
+
+    // True once all wl_shm buffer parameters of the pending frame have been received
+    bool buffer_known;
+
+    std::uint32_t format;
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint32_t stride;
+
+    // The copied frame is stored bottom-up
+    bool y_invert;
+
+    zwlr_screencopy_frame_v1 *frame;
+
+    zwlr_screencopy_frame_v1_listener listener;
+  };
+
   class monitor_t {
   public:
     monitor_t(monitor_t &&) = delete;
@@ -156,6 +251,8 @@ namespace wl {
     enum interface_e {
       XDG_OUTPUT,  ///< xdg-output
       WLR_EXPORT_DMABUF,  ///< Export dmabuf
+      WLR_SCREENCOPY,  ///< Screencopy
+      WL_SHM,  ///< Shared memory buffers
       MAX_INTERFACES,  ///< Maximum number of interfaces
     };
 
@@ -175,7 +272,9 @@ namespace wl {
     std::vector<std::unique_ptr<monitor_t>> monitors;
 
     zwlr_export_dmabuf_manager_v1 *dmabuf_manager;
+    zwlr_screencopy_manager_v1 *screencopy_manager;
     zxdg_output_manager_v1 *output_manager;
+    wl_shm *shm;
 
     bool
     operator[](interface_e bit) const {
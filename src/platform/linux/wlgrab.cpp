@@ -2,6 +2,11 @@
  * @file src/platform/linux/wlgrab.cpp
  * @brief Definitions for wlgrab capture.
  */
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
 #include <thread>
 
 #include "src/platform/common.h"
@@ -10,6 +15,7 @@
 #include "src/video.h"
 
 #include "cuda.h"
+#include "frame_pacer.h"
 #include "vaapi.h"
 #include "wayland.h"
 
@@ -45,11 +51,6 @@ namespace wl {
         return -1;
       }
 
-      if (!interface[wl::interface_t::WLR_EXPORT_DMABUF]) {
-        BOOST_LOG(error) << "Missing Wayland wire for wlr-export-dmabuf"sv;
-        return -1;
-      }
-
       auto monitor = interface.monitors[0].get();
 
       if (!display_name.empty()) {
@@ -127,26 +128,15 @@ namespace wl {
   public:
     platf::capture_e
     capture(const push_captured_image_cb_t &push_captured_image_cb, const pull_free_image_cb_t &pull_free_image_cb, bool *cursor) override {
-      auto next_frame = std::chrono::steady_clock::now();
-
-      sleep_overshoot_logger.reset();
+      platf::frame_pacer_t pacer { delay, sleep_overshoot_logger };
+      auto pull_free_image = pacer.track(pull_free_image_cb);
 
       while (true) {
-        auto now = std::chrono::steady_clock::now();
-
-        if (next_frame > now) {
-          std::this_thread::sleep_for(next_frame - now);
-          sleep_overshoot_logger.first_point(next_frame);
-          sleep_overshoot_logger.second_point_now_and_log();
-        }
-
-        next_frame += delay;
-        if (next_frame < now) {  // some major slowdown happened; we couldn't keep up
-          next_frame = now + delay;
-        }
+        pacer.wait();
 
         std::shared_ptr<platf::img_t> img_out;
-        auto status = snapshot(pull_free_image_cb, img_out, 1000ms, *cursor);
+        auto status = snapshot(pull_free_image, img_out, 1000ms, *cursor);
+        pacer.frame_ready();
         switch (status) {
           case platf::capture_e::reinit:
           case platf::capture_e::error:
@@ -210,6 +200,11 @@ namespace wl {
         return -1;
       }
 
+      if (!interface[wl::interface_t::WLR_EXPORT_DMABUF]) {
+        BOOST_LOG(error) << "Missing Wayland wire for wlr-export-dmabuf"sv;
+        return -1;
+      }
+
       egl_display = egl::make_display(display.get());
       if (!egl_display) {
         return -1;
@@ -258,30 +253,266 @@ namespace wl {
     egl::ctx_t ctx;
   };
 
-  class wlr_vram_t: public wlr_t {
+  struct shm_img_t: public platf::img_t {
+    ~shm_img_t() override {
+      if (buffer) {
+        wl_buffer_destroy(buffer);
+      }
+
+      if (data) {
+        munmap(data, size);
+        data = nullptr;
+      }
+    }
+
+    wl_buffer *buffer = nullptr;
+    std::size_t size = 0;
+
+    // The buffer belongs to the Wayland connection of the display
+    std::shared_ptr<platf::display_t> display;
+  };
+
+  /**
+   * @brief Reverse the order of the rows of an image in place.
+   */
+  static void
+  flip_rows(platf::img_t &img) {
+    for (int y = 0; y < img.height / 2; ++y) {
+      auto top = img.data + y * img.row_pitch;
+      auto bottom = img.data + (img.height - 1 - y) * img.row_pitch;
+
+      std::swap_ranges(top, top + img.row_pitch, bottom);
+    }
+  }
+
+  /**
+   * @brief Capture through wlr-screencopy into shared memory buffers.
+   * @details The compositor copies each frame straight into a pooled image, so neither EGL nor a GPU is needed.
+   *          This makes it the only option for compositors using a software renderer, e.g. headless sway with pixman.
+   */
+  class wlr_shm_t: public wlr_t, public std::enable_shared_from_this<wlr_shm_t> {
   public:
     platf::capture_e
     capture(const push_captured_image_cb_t &push_captured_image_cb, const pull_free_image_cb_t &pull_free_image_cb, bool *cursor) override {
-      auto next_frame = std::chrono::steady_clock::now();
+      platf::frame_pacer_t pacer { delay, sleep_overshoot_logger };
+      auto pull_free_image = pacer.track(pull_free_image_cb);
+
+      // The capture may restart after a reinit or take over a display that captured before,
+      // its first frame is copied whether the output changed or not
+      frame_copied = false;
 
-      sleep_overshoot_logger.reset();
+      // Waiting for damage for longer than a frame would hold back stop requests, new consumers and the pacer
+      auto timeout = std::max(std::chrono::ceil<std::chrono::milliseconds>(delay), 1ms);
 
       while (true) {
-        auto now = std::chrono::steady_clock::now();
+        pacer.wait();
 
-        if (next_frame > now) {
-          std::this_thread::sleep_for(next_frame - now);
-          sleep_overshoot_logger.first_point(next_frame);
-          sleep_overshoot_logger.second_point_now_and_log();
+        std::shared_ptr<platf::img_t> img_out;
+        auto status = snapshot(pull_free_image, img_out, timeout, *cursor);
+        pacer.frame_ready();
+        switch (status) {
+          case platf::capture_e::reinit:
+          case platf::capture_e::error:
+          case platf::capture_e::interrupted:
+            return status;
+          case platf::capture_e::timeout:
+            if (!push_captured_image_cb(std::move(img_out), false)) {
+              return platf::capture_e::ok;
+            }
+            break;
+          case platf::capture_e::ok:
+            if (!push_captured_image_cb(std::move(img_out), true)) {
+              return platf::capture_e::ok;
+            }
+            break;
+          default:
+            BOOST_LOG(error) << "Unrecognized capture status ["sv << (int) status << ']';
+            return status;
         }
+      }
+
+      return platf::capture_e::ok;
+    }
+
+    platf::capture_e
+    snapshot(const pull_free_image_cb_t &pull_free_image_cb, std::shared_ptr<platf::img_t> &img_out, std::chrono::milliseconds timeout, bool cursor) {
+      auto to = std::chrono::steady_clock::now() + timeout;
 
-        next_frame += delay;
-        if (next_frame < now) {  // some major slowdown happened; we couldn't keep up
-          next_frame = now + delay;
+      auto dispatch_until = [&](auto &&done) {
+        while (!done()) {
+          auto remaining_time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(to - std::chrono::steady_clock::now());
+          if (remaining_time_ms.count() < 0 || !display.dispatch(remaining_time_ms)) {
+            return false;
+          }
         }
 
+        return true;
+      };
+
+      // Dispatch events until the compositor has described the buffer it wants or the timeout expires
+      screencopy.listen(interface.screencopy_manager, output, cursor);
+      if (!dispatch_until([&]() { return screencopy.buffer_known || screencopy.status != screencopy_t::WAITING; })) {
+        screencopy.cancel();
+        return platf::capture_e::timeout;
+      }
+
+      if (
+        screencopy.status == screencopy_t::REINIT ||
+        screencopy.format != format ||
+        screencopy.width != (std::uint32_t) width ||
+        screencopy.height != (std::uint32_t) height ||
+        screencopy.stride != stride) {
+        screencopy.cancel();
+        return platf::capture_e::reinit;
+      }
+
+      if (!pull_free_image_cb(img_out)) {
+        screencopy.cancel();
+        return platf::capture_e::interrupted;
+      }
+
+      auto img = (shm_img_t *) img_out.get();
+      if (!img->buffer) {
+        screencopy.cancel();
+        return platf::capture_e::error;
+      }
+
+      // The first frame is copied right away, afterwards the compositor holds
+      // the copy back until the output has changed since the previous one.
+      screencopy.copy(img->buffer, frame_copied);
+      if (!dispatch_until([&]() { return screencopy.status != screencopy_t::WAITING; })) {
+        // Nothing has changed, the encoder repeats the previous frame
+        screencopy.cancel();
+        return platf::capture_e::timeout;
+      }
+
+      if (screencopy.status == screencopy_t::REINIT) {
+        return platf::capture_e::reinit;
+      }
+
+      frame_copied = true;
+
+      if (screencopy.y_invert) {
+        flip_rows(*img);
+      }
+
+      return platf::capture_e::ok;
+    }
+
+    int
+    init(platf::mem_type_e hwdevice_type, const std::string &display_name, const ::video::config_t &config) {
+      if (wlr_t::init(hwdevice_type, display_name, config)) {
+        return -1;
+      }
+
+      if (!interface[wl::interface_t::WLR_SCREENCOPY] || !interface[wl::interface_t::WL_SHM]) {
+        BOOST_LOG(info) << "Missing Wayland wire for wlr-screencopy"sv;
+        return -1;
+      }
+
+      // Ask for a frame once to learn the layout of the buffers the compositor expects
+      screencopy.listen(interface.screencopy_manager, output);
+      display.roundtrip();
+      screencopy.cancel();
+
+      if (!screencopy.buffer_known) {
+        BOOST_LOG(error) << "Compositor didn't offer a wl_shm buffer for wlr-screencopy"sv;
+        return -1;
+      }
+
+      // Both formats are laid out as BGRX in memory, the other ones would need a conversion
+      if (screencopy.format != WL_SHM_FORMAT_XRGB8888 && screencopy.format != WL_SHM_FORMAT_ARGB8888) {
+        BOOST_LOG(info) << "Unsupported wl_shm format for wlr-screencopy: 0x"sv << util::hex(screencopy.format).to_string_view();
+        return -1;
+      }
+
+      format = screencopy.format;
+      stride = screencopy.stride;
+
+      // The buffer covers the transformed output, which may differ from the mode of a rotated monitor
+      width = screencopy.width;
+      height = screencopy.height;
+
+      BOOST_LOG(info) << "Capturing through wlr-screencopy into shared memory"sv;
+
+      return 0;
+    }
+
+    std::unique_ptr<platf::avcodec_encode_device_t>
+    make_avcodec_encode_device(platf::pix_fmt_e pix_fmt) override {
+      return std::make_unique<platf::avcodec_encode_device_t>();
+    }
+
+    std::shared_ptr<platf::img_t>
+    alloc_img() override {
+      auto img = std::make_shared<shm_img_t>();
+      img->width = width;
+      img->height = height;
+      img->pixel_pitch = 4;
+      img->row_pitch = stride;
+      img->display = shared_from_this();
+
+      auto size = (std::size_t) img->row_pitch * img->height;
+
+      auto fd = memfd_create("sunshine-wlr-shm", MFD_CLOEXEC);
+      if (fd < 0) {
+        BOOST_LOG(error) << "Couldn't create shared memory for wlr-screencopy: "sv << std::strerror(errno);
+        return img;
+      }
+
+      auto close_fd = util::fail_guard([fd]() {
+        close(fd);
+      });
+
+      if (ftruncate(fd, size) < 0) {
+        BOOST_LOG(error) << "Couldn't resize shared memory for wlr-screencopy: "sv << std::strerror(errno);
+        return img;
+      }
+
+      auto data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if (data == MAP_FAILED) {
+        BOOST_LOG(error) << "Couldn't map shared memory for wlr-screencopy: "sv << std::strerror(errno);
+        return img;
+      }
+
+      img->data = (std::uint8_t *) data;
+      img->size = size;
+
+      // The buffer keeps the pool alive, and the compositor has its own copy of the file descriptor
+      auto pool = wl_shm_create_pool(interface.shm, fd, size);
+      img->buffer = wl_shm_pool_create_buffer(pool, 0, width, height, stride, format);
+      wl_shm_pool_destroy(pool);
+
+      return img;
+    }
+
+    int
+    dummy_img(platf::img_t *img) override {
+      // The shared memory is zero-filled, so the image is already black
+      return img->data ? 0 : -1;
+    }
+
+    screencopy_t screencopy;
+
+    std::uint32_t format;
+    std::uint32_t stride;
+
+    bool frame_copied = false;
+  };
+
+  class wlr_vram_t: public wlr_t {
+  public:
+    platf::capture_e
+    capture(const push_captured_image_cb_t &push_captured_image_cb, const pull_free_image_cb_t &pull_free_image_cb, bool *cursor) override {
+      platf::frame_pacer_t pacer { delay, sleep_overshoot_logger };
+      auto pull_free_image = pacer.track(pull_free_image_cb);
+
+      while (true) {
+        pacer.wait();
+
         std::shared_ptr<platf::img_t> img_out;
-        auto status = snapshot(pull_free_image_cb, img_out, 1000ms, *cursor);
+        auto status = snapshot(pull_free_image, img_out, 1000ms, *cursor);
+        pacer.frame_ready();
         switch (status) {
           case platf::capture_e::reinit:
           case platf::capture_e::error:
@@ -393,6 +624,14 @@ namespace platf {
       return wlr;
     }
 
+    // The software encoder reads the frames from system memory anyway, so skip the GL readback if possible
+    auto wlr_shm = std::make_shared<wl::wlr_shm_t>();
+    if (!wlr_shm->init(hwdevice_type, display_name, config)) {
+      return wlr_shm;
+    }
+
+    BOOST_LOG(info) << "Falling back to wlr-export-dmabuf"sv;
+
     auto wlr = std::make_shared<wl::wlr_ram_t>();
     if (wlr->init(hwdevice_type, display_name, config)) {
       return nullptr;
@@ -420,8 +659,10 @@ namespace platf {
       return {};
     }
 
-    if (!interface[wl::interface_t::WLR_EXPORT_DMABUF]) {
-      BOOST_LOG(warning) << "Missing Wayland wire for wlr-export-dmabuf"sv;
+    if (
+      !interface[wl::interface_t::WLR_EXPORT_DMABUF] &&
+      !(interface[wl::interface_t::WLR_SCREENCOPY] && interface[wl::interface_t::WL_SHM])) {
+      BOOST_LOG(warning) << "Missing Wayland wire for wlr-export-dmabuf or wlr-screencopy"sv;
       return {};
     }
 
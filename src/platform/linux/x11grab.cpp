@@ -24,6 +24,7 @@
 #include "src/video.h"
 
 #include "cuda.h"
+#include "frame_pacer.h"
 #include "graphics.h"
 #include "misc.h"
 #include "vaapi.h"
@@ -479,26 +480,15 @@ namespace platf {
 
     capture_e
     capture(const push_captured_image_cb_t &push_captured_image_cb, const pull_free_image_cb_t &pull_free_image_cb, bool *cursor) override {
-      auto next_frame = std::chrono::steady_clock::now();
-
-      sleep_overshoot_logger.reset();
+      frame_pacer_t pacer { delay, sleep_overshoot_logger };
+      auto pull_free_image = pacer.track(pull_free_image_cb);
 
       while (true) {
-        auto now = std::chrono::steady_clock::now();
-
-        if (next_frame > now) {
-          std::this_thread::sleep_for(next_frame - now);
-          sleep_overshoot_logger.first_point(next_frame);
-          sleep_overshoot_logger.second_point_now_and_log();
-        }
-
-        next_frame += delay;
-        if (next_frame < now) {  // some major slowdown happened; we couldn't keep up
-          next_frame = now + delay;
-        }
+        pacer.wait();
 
         std::shared_ptr<platf::img_t> img_out;
-        auto status = snapshot(pull_free_image_cb, img_out, 1000ms, *cursor);
+        auto status = snapshot(pull_free_image, img_out, 1000ms, *cursor);
+        pacer.frame_ready();
         switch (status) {
           case platf::capture_e::reinit:
           case platf::capture_e::error:
@@ -623,26 +613,15 @@ namespace platf {
 
     capture_e
     capture(const push_captured_image_cb_t &push_captured_image_cb, const pull_free_image_cb_t &pull_free_image_cb, bool *cursor) override {
-      auto next_frame = std::chrono::steady_clock::now();
-
-      sleep_overshoot_logger.reset();
+      frame_pacer_t pacer { delay, sleep_overshoot_logger };
+      auto pull_free_image = pacer.track(pull_free_image_cb);
 
       while (true) {
-        auto now = std::chrono::steady_clock::now();
-
-        if (next_frame > now) {
-          std::this_thread::sleep_for(next_frame - now);
-          sleep_overshoot_logger.first_point(next_frame);
-          sleep_overshoot_logger.second_point_now_and_log();
-        }
-
-        next_frame += delay;
-        if (next_frame < now) {  // some major slowdown happened; we couldn't keep up
-          next_frame = now + delay;
-        }
+        pacer.wait();
 
         std::shared_ptr<platf::img_t> img_out;
-        auto status = snapshot(pull_free_image_cb, img_out, 1000ms, *cursor);
+        auto status = snapshot(pull_free_image, img_out, 1000ms, *cursor);
+        pacer.frame_ready();
         switch (status) {
           case platf::capture_e::reinit:
           case platf::capture_e::error:
@@ -548,6 +548,12 @@ namespace platf {
     return std::make_unique<qos_t>(sockfd, reset_options);
   }
 
+  bool
+  enable_socket_pacing(uintptr_t native_socket) {
+    // macOS has no per-packet departure time
+    return false;
+  }
+
   std::string
   get_host_name() {
     try {
@@ -1829,6 +1829,13 @@ namespace platf {
 
     return std::make_unique<qos_t>(flow_id);
   }
+
+  bool
+  enable_socket_pacing(uintptr_t native_socket) {
+    // Winsock has no per-packet departure time
+    return false;
+  }
+
   int64_t
   qpc_counter() {
     LARGE_INTEGER performance_counter;
@@ -6,7 +6,10 @@
 
 #include "process.h"
 
+#include <atomic>
 #include <filesystem>
+#include <mutex>
+#include <set>
 #include <string>
 #include <thread>
 #include <vector>
@@ -34,6 +37,8 @@
 
   // _SH constants for _wfsopen()
   #include <share.h>
+#else
+  #include <sys/wait.h>
 #endif
 
 #define DEFAULT_APP_IMAGE_PATH SUNSHINE_ASSETS_DIR "/box.png"
@@ -134,10 +139,122 @@ namespace proc {
     return cmd_path.parent_path();
   }
 
+  // The zombie reaper in proc_t::running() is suspended while prep or undo commands are started and waited for
+  static std::mutex reaper_mutex;
+  static int reaper_suspensions = 0;
+
+  /**
+   * @brief Keep the zombie reaper in `proc_t::running()` from reaping any child until the returned guard is destroyed.
+   * @details Otherwise a command could be reaped before Boost gets its exit code.
+   */
+  static auto
+  suspend_reaper() {
+    std::lock_guard lg { reaper_mutex };
+    ++reaper_suspensions;
+
+    return util::fail_guard([]() {
+      std::lock_guard lg { reaper_mutex };
+      --reaper_suspensions;
+    });
+  }
+
+#ifndef _WIN32
+  /**
+   * @brief Check whether a child was reaped without Boost, e.g. by a `waitpid()` on any child.
+   * @details Boost reports such a child as having exited with code 0.
+   */
+  bool
+  reaped_elsewhere(boost::process::v1::child &child) {
+    if (child.native_exit_code() != boost::process::v1::detail::api::still_active) {
+      // Boost has already reaped the child itself
+      return false;
+    }
+
+    siginfo_t info {};
+    return waitid(P_PID, child.id(), &info, WEXITED | WNOHANG | WNOWAIT) == -1 && errno == ECHILD;
+  }
+#endif
+
+  std::vector<prep_timing_t>
+  wait_cmds(std::vector<running_cmd_t> &cmds) {
+    std::vector<prep_timing_t> timings;
+    timings.reserve(cmds.size());
+    for (auto &cmd : cmds) {
+      timings.push_back({ cmd.index, {}, {}, -1, prep_timing_t::FAILED });
+    }
+
+    std::vector<bool> done(cmds.size());
+    auto pending = cmds.size();
+    while (pending > 0) {
+      auto now = std::chrono::steady_clock::now();
+
+      for (std::size_t x = 0; x < cmds.size(); ++x) {
+        if (done[x]) {
+          continue;
+        }
+
+        auto &cmd = cmds[x];
+        auto &timing = timings[x];
+
+        std::error_code ec;
+#ifndef _WIN32
+        if (reaped_elsewhere(cmd.child)) {
+          ec = std::make_error_code(std::errc::no_child_process);
+        }
+#endif
+
+        // A single command without a timeout doesn't need to be polled
+        if (!ec && cmds.size() == 1 && cmd.timeout.count() == 0) {
+          cmd.child.wait(ec);
+        }
+
+        auto running = !ec && cmd.child.running(ec);
+        timing.duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - cmd.start);
+
+        if (running) {
+          if (cmd.timeout.count() == 0 || now - cmd.start < cmd.timeout) {
+            continue;
+          }
+
+          BOOST_LOG(error) << '[' << cmd.cmd << "] timed out after "sv << cmd.timeout.count() << " seconds"sv;
+          cmd.child.terminate(ec);
+          timing.status = prep_timing_t::TIMED_OUT;
+        }
+        else if (ec) {
+          // Without an exit code, there's no telling whether the command did its job
+          BOOST_LOG(error) << "Couldn't wait for ["sv << cmd.cmd << "] after "sv << timing.duration.count() << "ms: System: "sv << ec.message();
+        }
+        else {
+          timing.exit_code = cmd.child.exit_code();
+          if (timing.exit_code == 0) {
+            BOOST_LOG(info) << '[' << cmd.cmd << "] finished in "sv << timing.duration.count() << "ms"sv;
+            timing.status = prep_timing_t::SUCCEEDED;
+          }
+          else {
+            BOOST_LOG(error) << '[' << cmd.cmd << "] failed with code ["sv << timing.exit_code << "] after "sv << timing.duration.count() << "ms"sv;
+          }
+        }
+
+        done[x] = true;
+        --pending;
+      }
+
+      if (pending > 0) {
+        std::this_thread::sleep_for(10ms);
+      }
+    }
+
+    return timings;
+  }
+
   int
   proc_t::execute(int app_id, std::shared_ptr<rtsp_stream::launch_session_t> launch_session) {
+    // The prep commands must be reaped by Boost to get their exit codes
+    auto reaper_guard = suspend_reaper();
+
     // Ensure starting from a clean slate
     terminate();
+    _prep_timings.clear();
 
     auto iter = std::find_if(_apps.begin(), _apps.end(), [&app_id](const auto app) {
       return app.id == std::to_string(app_id);
@@ -198,36 +315,92 @@ namespace proc {
       terminate();
     });
 
-    for (; _app_prep_it != std::end(_app.prep_cmds); ++_app_prep_it) {
-      auto &cmd = *_app_prep_it;
+    auto prep_start = std::chrono::steady_clock::now();
+    auto sort_timings = util::fail_guard([&]() {
+      std::sort(std::begin(_prep_timings), std::end(_prep_timings), [](auto &l, auto &r) {
+        return l.index < r.index;
+      });
+    });
 
-      // Skip empty commands
-      if (cmd.do_cmd.empty()) {
-        continue;
+    while (_app_prep_it != std::end(_app.prep_cmds)) {
+      // Consecutive commands of the same group are started together and waited for as a whole
+      auto batch_begin = _app_prep_it;
+      auto batch_end = std::next(batch_begin);
+      if (!batch_begin->group.empty()) {
+        while (batch_end != std::end(_app.prep_cmds) && batch_end->group == batch_begin->group) {
+          ++batch_end;
+        }
       }
 
-      boost::filesystem::path working_dir = _app.working_dir.empty() ?
-                                              find_working_directory(cmd.do_cmd, _env) :
-                                              boost::filesystem::path(_app.working_dir);
-      BOOST_LOG(info) << "Executing Do Cmd: ["sv << cmd.do_cmd << ']';
-      auto child = platf::run_command(cmd.elevated, true, cmd.do_cmd, working_dir, _env, _pipe.get(), ec, nullptr);
+      std::vector<running_cmd_t> batch;
+      auto started_end = batch_begin;
+      bool failed = false;
+      for (auto it = batch_begin; it != batch_end; ++it) {
+        auto &cmd = *it;
+        auto index = (int) (it - _app_prep_begin) + 1;
+
+        // Skip empty commands
+        if (cmd.do_cmd.empty()) {
+          started_end = std::next(it);
+          continue;
+        }
 
-      if (ec) {
-        BOOST_LOG(error) << "Couldn't run ["sv << cmd.do_cmd << "]: System: "sv << ec.message();
-        // We don't want any prep commands failing launch of the desktop.
-        // This is to prevent the issue where users reboot their PC and need to log in with Sunshine.
-        // permission_denied is typically returned when the user impersonation fails, which can happen when user is not signed in yet.
-        if (!(_app.cmd.empty() && ec == std::errc::permission_denied)) {
-          return -1;
+        boost::filesystem::path working_dir = _app.working_dir.empty() ?
+                                                find_working_directory(cmd.do_cmd, _env) :
+                                                boost::filesystem::path(_app.working_dir);
+        BOOST_LOG(info) << "Executing Do Cmd: ["sv << cmd.do_cmd << ']';
+        auto start = std::chrono::steady_clock::now();
+        auto child = platf::run_command(cmd.elevated, true, cmd.do_cmd, working_dir, _env, _pipe.get(), ec, nullptr);
+
+        if (ec) {
+          BOOST_LOG(error) << "Couldn't run ["sv << cmd.do_cmd << "]: System: "sv << ec.message();
+          _prep_timings.push_back({ index, cmd.group, {}, -1, prep_timing_t::FAILED });
+
+          // We don't want any prep commands failing launch of the desktop.
+          // This is to prevent the issue where users reboot their PC and need to log in with Sunshine.
+          // permission_denied is typically returned when the user impersonation fails, which can happen when user is not signed in yet.
+          if (!(_app.cmd.empty() && ec == std::errc::permission_denied)) {
+            failed = true;
+            break;
+          }
+
+          started_end = std::next(it);
+          continue;
         }
+
+        started_end = std::next(it);
+        if (cmd.background) {
+          BOOST_LOG(info) << "Not waiting for ["sv << cmd.do_cmd << "] to exit"sv;
+          _prep_timings.push_back({ index, cmd.group, {}, 0, prep_timing_t::BACKGROUND });
+          _background_cmds.push_back({ index, cmd.do_cmd, cmd.timeout, std::move(child), start });
+          continue;
+        }
+
+        batch.push_back({ index, cmd.do_cmd, cmd.timeout, std::move(child), start });
+      }
+
+      // Even if a command of the group couldn't be started, the others must exit before undoing them
+      for (auto &timing : wait_cmds(batch)) {
+        timing.group = batch_begin->group;
+        failed = failed || timing.status != prep_timing_t::SUCCEEDED;
+        _prep_timings.push_back(std::move(timing));
       }
 
-      child.wait();
-      auto ret = child.exit_code();
-      if (ret != 0 && ec != std::errc::permission_denied) {
-        BOOST_LOG(error) << '[' << cmd.do_cmd << "] failed with code ["sv << ret << ']';
+      if (failed) {
+        // A failed command isn't undone, unless other commands of its group may have succeeded
+        if (std::distance(batch_begin, batch_end) > 1) {
+          _app_prep_it = started_end;
+        }
+
         return -1;
       }
+
+      _app_prep_it = batch_end;
+    }
+
+    if (!_prep_timings.empty()) {
+      auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - prep_start);
+      BOOST_LOG(info) << "Prep commands finished in "sv << elapsed.count() << "ms"sv;
     }
 
     for (auto &cmd : _app.detached) {
@@ -274,7 +447,22 @@ namespace proc {
     // them becoming zombies. This must be synchronized carefully with
     // calls to bp::wait() and platf::process_group_running() which both
     // invoke waitpid() under the hood.
-    auto reaper = util::fail_guard([]() {
+    auto reaper = util::fail_guard([this]() {
+      std::lock_guard lg { reaper_mutex };
+
+      // Prep and undo commands are being waited for, so their exit codes must not be taken from Boost
+      if (reaper_suspensions > 0) {
+        return;
+      }
+
+      // Background prep commands are only waited for when the session ends
+      std::error_code ec;
+      for (auto &cmd : _background_cmds) {
+        if (cmd.child.running(ec)) {
+          return;
+        }
+      }
+
       while (waitpid(-1, nullptr, WNOHANG) > 0);
     });
 #endif
@@ -309,35 +497,60 @@ namespace proc {
 
   void
   proc_t::terminate() {
+    // The undo commands must be reaped by Boost to get their exit codes
+    auto reaper_guard = suspend_reaper();
+
     std::error_code ec;
     placebo = false;
     terminate_process_group(_process, _process_group, _app.exit_timeout);
     _process = boost::process::v1::child();
     _process_group = boost::process::v1::group();
 
-    for (; _app_prep_it != _app_prep_begin; --_app_prep_it) {
-      auto &cmd = *(_app_prep_it - 1);
-
-      if (cmd.undo_cmd.empty()) {
-        continue;
+    // Background prep commands must not outlive the session or overlap with the undo commands
+    for (auto &cmd : _background_cmds) {
+      if (cmd.timeout.count() == 0 && cmd.child.running(ec)) {
+        BOOST_LOG(info) << "Terminating ["sv << cmd.cmd << ']';
+        cmd.child.terminate(ec);
+      }
+    }
+    wait_cmds(_background_cmds);
+    _background_cmds.clear();
+
+    while (_app_prep_it != _app_prep_begin) {
+      // The commands of a group are undone together, the groups in reverse order
+      auto batch_end = _app_prep_it;
+      auto batch_begin = std::prev(batch_end);
+      if (!batch_begin->group.empty()) {
+        while (batch_begin != _app_prep_begin && std::prev(batch_begin)->group == batch_begin->group) {
+          --batch_begin;
+        }
       }
 
-      boost::filesystem::path working_dir = _app.working_dir.empty() ?
-                                              find_working_directory(cmd.undo_cmd, _env) :
-                                              boost::filesystem::path(_app.working_dir);
-      BOOST_LOG(info) << "Executing Undo Cmd: ["sv << cmd.undo_cmd << ']';
-      auto child = platf::run_command(cmd.elevated, true, cmd.undo_cmd, working_dir, _env, _pipe.get(), ec, nullptr);
+      std::vector<running_cmd_t> batch;
+      for (auto it = batch_end; it != batch_begin;) {
+        auto &cmd = *--it;
 
-      if (ec) {
-        BOOST_LOG(warning) << "System: "sv << ec.message();
-      }
+        if (cmd.undo_cmd.empty()) {
+          continue;
+        }
 
-      child.wait();
-      auto ret = child.exit_code();
+        boost::filesystem::path working_dir = _app.working_dir.empty() ?
+                                                find_working_directory(cmd.undo_cmd, _env) :
+                                                boost::filesystem::path(_app.working_dir);
+        BOOST_LOG(info) << "Executing Undo Cmd: ["sv << cmd.undo_cmd << ']';
+        auto start = std::chrono::steady_clock::now();
+        auto child = platf::run_command(cmd.elevated, true, cmd.undo_cmd, working_dir, _env, _pipe.get(), ec, nullptr);
 
-      if (ret != 0) {
-        BOOST_LOG(warning) << "Return code ["sv << ret << ']';
+        if (ec) {
+          BOOST_LOG(warning) << "Couldn't run ["sv << cmd.undo_cmd << "]: System: "sv << ec.message();
+          continue;
+        }
+
+        batch.push_back({ (int) (it - _app_prep_begin) + 1, cmd.undo_cmd, cmd.timeout, std::move(child), start });
       }
+
+      wait_cmds(batch);
+      _app_prep_it = batch_begin;
     }
 
     _pipe.reset();
@@ -382,6 +595,11 @@ namespace proc {
     return _app.name;
   }
 
+  const std::vector<prep_timing_t> &
+  proc_t::get_prep_timings() const {
+    return _prep_timings;
+  }
+
   proc_t::~proc_t() {
     // It's not safe to call terminate() here because our proc_t is a static variable
     // that may be destroyed after the Boost loggers have been destroyed. Instead,
@@ -518,11 +736,15 @@ namespace proc {
     }
 
     // Read file and update calculated SHA
-    char buf[1024 * 16];
+    std::vector<char> buf(1024 * 256);
     std::ifstream file(filename, std::ifstream::binary);
+    if (!file) {
+      return std::nullopt;
+    }
+
     while (file.good()) {
-      file.read(buf, sizeof(buf));
-      if (!EVP_DigestUpdate(ctx.get(), buf, file.gcount())) {
+      file.read(buf.data(), buf.size());
+      if (!EVP_DigestUpdate(ctx.get(), buf.data(), file.gcount())) {
         return std::nullopt;
       }
     }
@@ -534,12 +756,185 @@ namespace proc {
     }
 
     // Transform byte-array to string
-    std::stringstream ss;
-    ss << std::hex << std::setfill('0');
-    for (const auto &byte : result) {
-      ss << std::setw(2) << (int) byte;
+    static constexpr char hex[] = "0123456789abcdef";
+    std::string digest(sizeof(result) * 2, '0');
+    for (std::size_t x = 0; x < sizeof(result); ++x) {
+      digest[x * 2] = hex[result[x] >> 4];
+      digest[x * 2 + 1] = hex[result[x] & 0xF];
+    }
+    return digest;
+  }
+
+  /**
+   * @brief The digests of the app images, keyed by path.
+   * @details An entry is only valid while the size and modification time of the file still match.
+   *          The cache is loaded from and saved next to the state file, so restarts don't rehash every image.
+   */
+  struct image_hash_t {
+    std::uintmax_t size;
+    std::int64_t mtime;
+    std::string sha256;
+  };
+
+  std::mutex image_hashes_mutex;
+  std::unordered_map<std::string, image_hash_t> image_hashes;
+  bool image_hashes_loaded = false;
+  bool image_hashes_dirty = false;
+
+  std::filesystem::path
+  image_hashes_path() {
+    return std::filesystem::path(config::nvhttp.file_state).parent_path() / "app_image_hashes.json"sv;
+  }
+
+  /**
+   * @brief Load the persisted image digests, once.
+   * @note `image_hashes_mutex` must be held.
+   */
+  void
+  load_image_hashes() {
+    if (image_hashes_loaded) {
+      return;
+    }
+    image_hashes_loaded = true;
+
+    auto path = image_hashes_path();
+    std::error_code ec;
+    if (!std::filesystem::exists(path, ec)) {
+      return;
+    }
+
+    try {
+      pt::ptree tree;
+      pt::read_json(path.string(), tree);
+
+      for (auto &[_, node] : tree.get_child("images"s)) {
+        image_hashes.insert_or_assign(node.get<std::string>("path"s), image_hash_t {
+                                                                         node.get<std::uintmax_t>("size"s),
+                                                                         node.get<std::int64_t>("mtime"s),
+                                                                         node.get<std::string>("sha256"s),
+                                                                       });
+      }
+    }
+    catch (std::exception &e) {
+      BOOST_LOG(warning) << "Couldn't read "sv << path.string() << ": "sv << e.what();
+      image_hashes.clear();
+    }
+  }
+
+  /**
+   * @brief Save the image digests if any changed, dropping the images no app refers to anymore.
+   * @param in_use The image paths of the current apps.
+   */
+  void
+  save_image_hashes(const std::set<std::string> &in_use) {
+    std::lock_guard lg { image_hashes_mutex };
+
+    std::erase_if(image_hashes, [&](auto &entry) {
+      if (in_use.count(entry.first)) {
+        return false;
+      }
+
+      image_hashes_dirty = true;
+      return true;
+    });
+
+    if (!image_hashes_dirty) {
+      return;
+    }
+
+    pt::ptree images;
+    for (auto &[path, hash] : image_hashes) {
+      pt::ptree node;
+      node.put("path"s, path);
+      node.put("size"s, hash.size);
+      node.put("mtime"s, hash.mtime);
+      node.put("sha256"s, hash.sha256);
+
+      images.push_back(std::make_pair(""s, std::move(node)));
+    }
+
+    pt::ptree tree;
+    tree.add_child("images"s, images);
+
+    auto path = image_hashes_path();
+    try {
+      pt::write_json(path.string(), tree);
+      image_hashes_dirty = false;
+    }
+    catch (std::exception &e) {
+      BOOST_LOG(warning) << "Couldn't write "sv << path.string() << ": "sv << e.what();
+    }
+  }
+
+  std::optional<std::string>
+  image_sha256(const std::string &path) {
+    std::error_code ec;
+    auto size = std::filesystem::file_size(path, ec);
+    if (ec) {
+      return std::nullopt;
+    }
+
+    auto mtime = std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+    if (ec) {
+      return std::nullopt;
+    }
+
+    {
+      std::lock_guard lg { image_hashes_mutex };
+      load_image_hashes();
+
+      auto it = image_hashes.find(path);
+      if (it != std::end(image_hashes) && it->second.size == size && it->second.mtime == mtime) {
+        return it->second.sha256;
+      }
+    }
+
+    // Hash without holding the lock, other images may be hashed at the same time
+    auto sha256 = calculate_sha256(path);
+    if (!sha256) {
+      return std::nullopt;
+    }
+
+    std::lock_guard lg { image_hashes_mutex };
+    image_hashes.insert_or_assign(path, image_hash_t { size, (std::int64_t) mtime, *sha256 });
+    image_hashes_dirty = true;
+
+    return sha256;
+  }
+
+  /**
+   * @brief Hash the images of all apps, spreading the images that aren't cached yet over several threads.
+   * @param image_paths The validated image paths of the apps.
+   */
+  void
+  hash_app_images(const std::set<std::string> &image_paths) {
+    std::vector<std::string> paths { std::begin(image_paths), std::end(image_paths) };
+
+    auto workers = std::min<std::size_t>(std::max(1u, std::thread::hardware_concurrency()), paths.size());
+    if (workers <= 1) {
+      for (auto &path : paths) {
+        image_sha256(path);
+      }
+      return;
+    }
+
+    std::atomic<std::size_t> next = 0;
+    auto worker = [&]() {
+      for (auto x = next++; x < paths.size(); x = next++) {
+        image_sha256(paths[x]);
+      }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(workers - 1);
+    for (std::size_t x = 1; x < workers; ++x) {
+      threads.emplace_back(worker);
+    }
+    worker();
+
+    for (auto &thread : threads) {
+      thread.join();
     }
-    return ss.str();
   }
 
   uint32_t
@@ -556,7 +951,7 @@ namespace proc {
     to_hash.push_back(app_name);
     auto file_path = validate_app_image_path(app_image_path);
     if (file_path != DEFAULT_APP_IMAGE_PATH) {
-      auto file_hash = calculate_sha256(file_path);
+      auto file_hash = image_sha256(file_path);
       if (file_hash) {
         to_hash.push_back(file_hash.value());
       }
@@ -596,9 +991,7 @@ namespace proc {
         this_env[name] = parse_env_val(this_env, val.get_value<std::string>());
       }
 
-      std::set<std::string> ids;
       std::vector<proc::ctx_t> apps;
-      int i = 0;
       for (auto &[_, app_node] : apps_node) {
         proc::ctx_t ctx;
 
@@ -622,10 +1015,13 @@ namespace proc {
             auto do_cmd = parse_env_val(this_env, prep_cmd.do_cmd);
             auto undo_cmd = parse_env_val(this_env, prep_cmd.undo_cmd);
 
-            prep_cmds.emplace_back(
+            auto &cmd = prep_cmds.emplace_back(
               std::move(do_cmd),
               std::move(undo_cmd),
               std::move(prep_cmd.elevated));
+            cmd.group = prep_cmd.group;
+            cmd.background = prep_cmd.background;
+            cmd.timeout = prep_cmd.timeout;
           }
         }
 
@@ -638,10 +1034,13 @@ namespace proc {
             auto undo_cmd = prep_node.get_optional<std::string>("undo"s);
             auto elevated = prep_node.get_optional<bool>("elevated");
 
-            prep_cmds.emplace_back(
+            auto &cmd = prep_cmds.emplace_back(
               parse_env_val(this_env, do_cmd.value_or("")),
               parse_env_val(this_env, undo_cmd.value_or("")),
               std::move(elevated.value_or(false)));
+            cmd.group = prep_node.get<std::string>("group"s, "");
+            cmd.background = prep_node.get<bool>("background"s, false);
+            cmd.timeout = std::chrono::seconds { std::max(prep_node.get<int>("timeout"s, 0), 0) };
           }
         }
 
@@ -682,7 +1081,32 @@ namespace proc {
         ctx.wait_all = wait_all.value_or(true);
         ctx.exit_timeout = std::chrono::seconds { exit_timeout.value_or(5) };
 
-        auto possible_ids = calculate_app_id(name, ctx.image_path, i++);
+        ctx.name = std::move(name);
+        ctx.prep_cmds = std::move(prep_cmds);
+        ctx.detached = std::move(detached);
+
+        apps.emplace_back(std::move(ctx));
+      }
+
+      // Only the images that changed since the last parse are hashed again
+      std::vector<std::string> file_paths;
+      std::set<std::string> image_paths;
+      file_paths.reserve(apps.size());
+      for (auto &ctx : apps) {
+        auto &file_path = file_paths.emplace_back(validate_app_image_path(ctx.image_path));
+        if (file_path != DEFAULT_APP_IMAGE_PATH) {
+          image_paths.emplace(file_path);
+        }
+      }
+      hash_app_images(image_paths);
+      save_image_hashes(image_paths);
+
+      std::set<std::string> ids;
+      for (std::size_t i = 0; i < apps.size(); ++i) {
+        auto &ctx = apps[i];
+
+        // Validating the path again is a no-op and doesn't repeat the warning about a missing image
+        auto possible_ids = calculate_app_id(ctx.name, file_paths[i], (int) i);
         if (ids.count(std::get<0>(possible_ids)) == 0) {
           // Avoid using index to generate id if possible
           ctx.id = std::get<0>(possible_ids);
@@ -692,12 +1116,6 @@ namespace proc {
           ctx.id = std::get<1>(possible_ids);
         }
         ids.insert(ctx.id);
-
-        ctx.name = std::move(name);
-        ctx.prep_cmds = std::move(prep_cmds);
-        ctx.detached = std::move(detached);
-
-        apps.emplace_back(std::move(ctx));
       }
 
       return proc::proc_t {
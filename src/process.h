@@ -63,6 +63,44 @@ namespace proc {
     std::chrono::seconds exit_timeout;
   };
 
+  /**
+   * @brief How long a prep command of the last launch ran and how it ended.
+   */
+  struct prep_timing_t {
+    enum status_e {
+      SUCCEEDED,
+      FAILED,  ///< The command couldn't be started or exited with a non-zero code
+      TIMED_OUT,  ///< The command was terminated after running longer than its timeout
+      BACKGROUND,  ///< The command was still running when the launch went ahead
+    };
+
+    int index;  ///< The position of the command in the prep commands of the app, starting at 1
+    std::string group;
+    std::chrono::milliseconds duration;
+    int exit_code;
+    status_e status;
+  };
+
+  /**
+   * @brief A prep or undo command that has been started but not waited for yet.
+   */
+  struct running_cmd_t {
+    int index;
+    std::string cmd;
+    std::chrono::seconds timeout;
+    boost::process::v1::child child;
+    std::chrono::steady_clock::time_point start;
+  };
+
+  /**
+   * @brief Wait for commands that were started at the same time.
+   * @details The commands are polled, so each one can be terminated once it runs longer than its own timeout.
+   * @param cmds The commands to wait for.
+   * @return The timing of each command, in the same order.
+   */
+  std::vector<prep_timing_t>
+  wait_cmds(std::vector<running_cmd_t> &cmds);
+
   class proc_t {
   public:
     KITTY_DEFAULT_CONSTR_MOVE_THROW(proc_t)
@@ -93,6 +131,13 @@ namespace proc {
     get_app_image(int app_id);
     std::string
     get_last_run_app_name();
+
+    /**
+     * @brief The timings of the prep commands run by the last call to `execute()`.
+     */
+    const std::vector<prep_timing_t> &
+    get_prep_timings() const;
+
     void
     terminate();
 
@@ -113,6 +158,11 @@ namespace proc {
     file_t _pipe;
     std::vector<cmd_t>::const_iterator _app_prep_it;
     std::vector<cmd_t>::const_iterator _app_prep_begin;
+
+    std::vector<prep_timing_t> _prep_timings;
+
+    // Background prep commands that may still be running
+    std::vector<running_cmd_t> _background_cmds;
   };
 
   /**
@@ -124,6 +174,16 @@ namespace proc {
 
   std::string
   validate_app_image_path(std::string app_image_path);
+
+  /**
+   * @brief Get the SHA-256 digest of an app image.
+   * @details The digest is cached and only calculated again once the size or modification time of the file changes.
+   * @param path The path of the image.
+   * @return The digest as a lowercase hex string, or `std::nullopt` if the file can't be read.
+   */
+  std::optional<std::string>
+  image_sha256(const std::string &path);
+
   void
   refresh(const std::string &file_name);
   std::optional<proc::proc_t>
@@ -626,9 +626,43 @@ namespace rtsp_stream {
 
   rtsp_server_t server {};
 
+  // The video config of the last stream of each client, by unique ID
+  sync_util::sync_t<std::unordered_map<std::string, video::config_t>> last_video_configs;
+
+  /**
+   * @brief Predict the video config a client will request for a launched app.
+   * @details The resolution, framerate and dynamic range are part of the launch request,
+   *          the remaining encoder settings rarely change between the streams of a client.
+   * @param launch_session The launch session.
+   * @return The predicted config, and whether the client streamed before.
+   */
+  std::pair<video::config_t, bool>
+  predict_video_config(const launch_session_t &launch_session) {
+    video::config_t config {};
+    bool streamed_before = false;
+    {
+      auto lg = last_video_configs.lock();
+      if (auto it = last_video_configs->find(launch_session.unique_id); it != last_video_configs->end()) {
+        config = it->second;
+        streamed_before = true;
+      }
+    }
+
+    config.width = launch_session.width;
+    config.height = launch_session.height;
+    config.framerate = launch_session.fps;
+    config.dynamicRange = launch_session.enable_hdr ? 1 : 0;
+
+    return { config, streamed_before };
+  }
+
   void
   launch_session_raise(std::shared_ptr<launch_session_t> launch_session) {
+    auto [config, streamed_before] = predict_video_config(*launch_session);
     server.session_raise(std::move(launch_session));
+
+    // Open the display and encoder while the client negotiates the stream
+    video::prewarm(config, streamed_before);
   }
 
   void
@@ -1108,6 +1142,11 @@ namespace rtsp_stream {
       return;
     }
 
+    {
+      auto lg = last_video_configs.lock();
+      (*last_video_configs)[session.unique_id] = config.monitor;
+    }
+
     auto stream_session = stream::session::alloc(config, session);
     server->insert(stream_session);
 
@@ -5,19 +5,28 @@
 
 #include "ssh_server.h"
 #include "logging.h"
+#include "metrics.h"
 
 #include <libssh/libssh.h>
 #include <libssh/server.h>
 #include <libssh/callbacks.h>
 
+#include <algorithm>
 #include <chrono>
 #include <cstring>
 #include <iostream>
+#include <list>
 #include <random>
 #include <vector>
 
 #ifdef _WIN32
   #pragma comment(lib, "ws2_32.lib")
+#else
+  #include <arpa/inet.h>
+  #include <fcntl.h>
+  #include <netinet/tcp.h>
+  #include <poll.h>
+  #include <unistd.h>
 #endif
 
 namespace ssh_server {
@@ -25,10 +34,229 @@ namespace ssh_server {
   // Global server instance
   static std::shared_ptr<ssh_server_t> global_server;
 
+  namespace {
+    // Size of the buffers forwarding data in each direction of a connection
+    constexpr std::size_t forward_buffer_size = 64 * 1024;
+
+    // How long the event loop may sleep before checking whether the server was stopped
+    constexpr int poll_timeout_ms = 100;
+
+    // Unauthenticated sessions are dropped after this long
+    constexpr auto login_grace_time = std::chrono::seconds(30);
+
+#ifdef _WIN32
+    bool
+    would_block() {
+      return WSAGetLastError() == WSAEWOULDBLOCK;
+    }
+
+    void
+    close_socket(socket_t sock) {
+      closesocket(sock);
+    }
+
+    void
+    set_nonblocking(socket_t sock) {
+      u_long mode = 1;
+      ioctlsocket(sock, FIONBIO, &mode);
+    }
+
+    constexpr int shutdown_write = SD_SEND;
+#else
+    bool
+    would_block() {
+      return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+
+    void
+    close_socket(socket_t sock) {
+      close(sock);
+    }
+
+    void
+    set_nonblocking(socket_t sock) {
+      fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+    }
+
+    constexpr int shutdown_write = SHUT_WR;
+#endif
+
+#ifdef MSG_NOSIGNAL
+    constexpr int send_flags = MSG_NOSIGNAL;
+#else
+    constexpr int send_flags = 0;
+#endif
+
+    std::string
+    peer_address(socket_t sock) {
+      sockaddr_storage addr {};
+      socklen_t addr_len = sizeof(addr);
+      if (getpeername(sock, (sockaddr *) &addr, &addr_len) != 0) {
+        return {};
+      }
+
+      char host[INET6_ADDRSTRLEN] {};
+      if (addr.ss_family == AF_INET) {
+        inet_ntop(AF_INET, &((sockaddr_in *) &addr)->sin_addr, host, sizeof(host));
+      }
+      else if (addr.ss_family == AF_INET6) {
+        inet_ntop(AF_INET6, &((sockaddr_in6 *) &addr)->sin6_addr, host, sizeof(host));
+      }
+
+      return host;
+    }
+
+    /**
+     * @brief Data that has been received on one side of a connection but not written to the other side yet
+     */
+    struct pending_t {
+      std::vector<char> data;
+      std::size_t begin = 0;
+      std::size_t end = 0;
+
+      bool
+      empty() const {
+        return begin == end;
+      }
+
+      std::size_t
+      size() const {
+        return end - begin;
+      }
+
+      std::size_t
+      space() const {
+        return data.size() - end;
+      }
+
+      /**
+       * @brief Copy as much as fits into the buffer
+       * @return The number of bytes copied
+       */
+      std::size_t
+      append(const char *src, std::size_t len) {
+        len = std::min(len, space());
+        std::memcpy(data.data() + end, src, len);
+        end += len;
+        return len;
+      }
+
+      void
+      consume(std::size_t len) {
+        begin += len;
+        if (begin == end) {
+          begin = end = 0;
+        }
+      }
+    };
+
+    /**
+     * @brief Recycles the forwarding buffers of closed connections
+     */
+    class buffer_pool_t {
+    public:
+      std::vector<char>
+      acquire() {
+        if (free_.empty()) {
+          return std::vector<char>(forward_buffer_size);
+        }
+
+        auto buffer = std::move(free_.back());
+        free_.pop_back();
+        return buffer;
+      }
+
+      void
+      release(std::vector<char> &&buffer) {
+        if (buffer.size() == forward_buffer_size) {
+          free_.emplace_back(std::move(buffer));
+        }
+      }
+
+    private:
+      std::vector<std::vector<char>> free_;
+    };
+  }  // namespace
+
   class ssh_server_t::impl {
   public:
+    struct client_t;
+    struct tunnel_t;
+
+    /**
+     * @brief A TCP connection accepted on a tunnel and forwarded over a "forwarded-tcpip" channel
+     */
+    struct conn_t {
+      client_t *client;
+      tunnel_t *tunnel;
+
+      socket_t sock;
+      ssh_channel channel = nullptr;
+      bool opened = false;
+
+      // Poll events the socket is currently registered for
+      short events = 0;
+
+      pending_t to_tcp;  // Channel data waiting for the socket to become writable
+      pending_t to_channel;  // Socket data waiting for the remote window to open
+
+      // libssh still buffers channel data that didn't fit into to_tcp
+      bool channel_backlog = false;
+
+      bool tcp_eof = false;  // Nothing more will be read from the socket
+      bool channel_eof = false;  // Nothing more will be received on the channel
+      bool write_shutdown = false;
+      bool closing = false;
+
+      // Bytes forwarded since they were last added to the counters of the tunnel
+      std::uint64_t unreported_to_client = 0;
+      std::uint64_t unreported_from_client = 0;
+
+      ssh_channel_callbacks_struct callbacks {};
+    };
+
+    /**
+     * @brief A port listening on this host on behalf of a "tcpip-forward" request
+     */
+    struct tunnel_t {
+      client_t *client;
+
+      socket_t listener;
+      std::string address;  // Address as requested by the client
+      int port;  // Port that was actually bound
+
+      std::shared_ptr<tunnel_info_t> info;
+
+      std::shared_ptr<metrics::counter_t> bytes_to_client;
+      std::shared_ptr<metrics::counter_t> bytes_from_client;
+    };
+
+    struct client_t {
+      impl *owner;
+
+      ssh_session session;
+      std::string address;
+      std::string username;
+      std::chrono::steady_clock::time_point connected;
+
+      bool key_exchanged = false;
+      bool authenticated = false;
+      bool closing = false;
+
+      std::list<std::unique_ptr<tunnel_t>> tunnels;
+      std::list<std::unique_ptr<conn_t>> conns;
+
+      // Session channels are accepted so clients without -N stay connected, they carry no data
+      std::vector<ssh_channel> session_channels;
+    };
+
     ssh_bind bind = nullptr;
-    ssh_session session = nullptr;
+    ssh_event event = nullptr;
+
+    ssh_server_t *server = nullptr;
+
+    std::list<std::unique_ptr<client_t>> clients;
+    buffer_pool_t buffers;
 
     impl() {
       bind = ssh_bind_new();
@@ -40,6 +268,583 @@ namespace ssh_server {
         bind = nullptr;
       }
     }
+
+    // Callbacks may run inside any libssh call that handles packets, so they only mark
+    // state. Objects are created and destroyed from run_pending() outside of polling.
+
+    static int
+    on_bind_readable(socket_t fd, int revents, void *userdata) {
+      static_cast<impl *>(userdata)->accept_client();
+      return 0;
+    }
+
+    static int
+    on_message(ssh_session session, ssh_message message, void *userdata) {
+      auto client = static_cast<client_t *>(userdata);
+      return client->owner->handle_message(client, message);
+    }
+
+    static int
+    on_tunnel_readable(socket_t fd, int revents, void *userdata) {
+      auto tunnel = static_cast<tunnel_t *>(userdata);
+      tunnel->client->owner->accept_conn(tunnel);
+      return 0;
+    }
+
+    static int
+    on_conn_io(socket_t fd, int revents, void *userdata) {
+      auto conn = static_cast<conn_t *>(userdata);
+      if (conn->closing) {
+        return 0;
+      }
+
+      if (revents & POLLOUT) {
+        flush_to_tcp(conn);
+      }
+
+      if (revents & (POLLIN | POLLHUP | POLLERR)) {
+        read_tcp(conn);
+      }
+
+      return 0;
+    }
+
+    static int
+    on_channel_data(ssh_session session, ssh_channel channel, void *data, std::uint32_t len, int is_stderr, void *userdata) {
+      auto conn = static_cast<conn_t *>(userdata);
+      auto src = static_cast<const char *>(data);
+      if (conn->closing) {
+        return len;
+      }
+
+      // Write straight to the socket while nothing is queued in front of this data
+      std::size_t written = 0;
+      if (conn->to_tcp.empty()) {
+        auto bytes = send(conn->sock, src, len, send_flags);
+        if (bytes < 0 && !would_block()) {
+          conn->closing = true;
+          return len;
+        }
+
+        written = std::max<decltype(bytes)>(bytes, 0);
+        conn->unreported_from_client += written;
+      }
+
+      // Whatever doesn't fit stays in libssh's channel buffer, which also keeps the window
+      // closed until the socket has caught up.
+      auto consumed = written + conn->to_tcp.append(src + written, len - written);
+      conn->channel_backlog = consumed < len;
+
+      return consumed;
+    }
+
+    static void
+    on_channel_eof(ssh_session session, ssh_channel channel, void *userdata) {
+      static_cast<conn_t *>(userdata)->channel_eof = true;
+    }
+
+    static void
+    on_channel_close(ssh_session session, ssh_channel channel, void *userdata) {
+      static_cast<conn_t *>(userdata)->closing = true;
+    }
+
+    static void
+    flush_to_tcp(conn_t *conn) {
+      while (!conn->to_tcp.empty()) {
+        auto bytes = send(conn->sock, conn->to_tcp.data.data() + conn->to_tcp.begin, conn->to_tcp.size(), send_flags);
+        if (bytes < 0) {
+          conn->closing = !would_block();
+          return;
+        }
+
+        conn->to_tcp.consume(bytes);
+        conn->unreported_from_client += bytes;
+      }
+    }
+
+    static void
+    flush_to_channel(conn_t *conn) {
+      if (conn->to_channel.empty()) {
+        return;
+      }
+
+      auto bytes = ssh_channel_write(conn->channel, conn->to_channel.data.data() + conn->to_channel.begin, conn->to_channel.size());
+      if (bytes == SSH_ERROR) {
+        conn->closing = true;
+        return;
+      }
+
+      if (bytes > 0) {
+        conn->to_channel.consume(bytes);
+        conn->unreported_to_client += bytes;
+      }
+    }
+
+    static void
+    read_tcp(conn_t *conn) {
+      // Stop reading until the remote side has made room for what is already queued
+      if (conn->tcp_eof || !conn->to_channel.empty()) {
+        return;
+      }
+
+      auto window = ssh_channel_window_size(conn->channel);
+      if (window == 0) {
+        return;
+      }
+
+      auto bytes = recv(conn->sock, conn->to_channel.data.data(), std::min<std::size_t>(conn->to_channel.space(), window), 0);
+      if (bytes == 0) {
+        conn->tcp_eof = true;
+        ssh_channel_send_eof(conn->channel);
+        return;
+      }
+
+      if (bytes < 0) {
+        conn->closing = !would_block();
+        return;
+      }
+
+      conn->to_channel.end = bytes;
+      flush_to_channel(conn);
+    }
+
+    void
+    accept_client() {
+      ssh_session session = ssh_new();
+      if (!session) {
+        BOOST_LOG(error) << "Failed to create SSH session";
+        return;
+      }
+
+      if (ssh_bind_accept(bind, session) != SSH_OK) {
+        BOOST_LOG(warning) << "Failed to accept SSH connection: " << ssh_get_error(bind);
+        ssh_free(session);
+        return;
+      }
+
+      auto client = std::make_unique<client_t>();
+      client->owner = this;
+      client->session = session;
+      client->address = peer_address(ssh_get_fd(session));
+      client->connected = std::chrono::steady_clock::now();
+
+      ssh_set_blocking(session, 0);
+      ssh_set_message_callback(session, &impl::on_message, client.get());
+
+      BOOST_LOG(info) << "SSH connection from " << client->address;
+
+      // The key exchange is driven by the event loop from here on
+      advance_key_exchange(client.get());
+      if (!client->closing) {
+        ssh_event_add_session(event, session);
+      }
+
+      clients.emplace_back(std::move(client));
+    }
+
+    void
+    advance_key_exchange(client_t *client) {
+      auto rc = ssh_handle_key_exchange(client->session);
+      if (rc == SSH_AGAIN) {
+        return;
+      }
+
+      if (rc != SSH_OK) {
+        BOOST_LOG(error) << "SSH key exchange failed: " << ssh_get_error(client->session);
+        client->closing = true;
+        return;
+      }
+
+      client->key_exchanged = true;
+    }
+
+    int
+    handle_message(client_t *client, ssh_message message) {
+      int type = ssh_message_type(message);
+      int subtype = ssh_message_subtype(message);
+
+      if (type == SSH_REQUEST_AUTH) {
+        if (subtype == SSH_AUTH_METHOD_PASSWORD) {
+          std::string user = ssh_message_auth_user(message);
+          const char *password = ssh_message_auth_password(message);
+
+          if (password && server->authenticate_password(client->session, user, password) == SSH_AUTH_SUCCESS) {
+            ssh_message_auth_reply_success(message, 0);
+            client->authenticated = true;
+            client->username = user;
+            BOOST_LOG(info) << "SSH client authenticated: " << user;
+            return 0;
+          }
+        }
+
+        ssh_message_auth_set_methods(message, SSH_AUTH_METHOD_PASSWORD);
+        return 1;
+      }
+
+      // Everything below requires an authenticated session, the default reply denies it
+      if (!client->authenticated) {
+        return 1;
+      }
+
+      if (type == SSH_REQUEST_CHANNEL_OPEN && subtype == SSH_CHANNEL_SESSION) {
+        auto channel = ssh_message_channel_request_open_reply_accept(message);
+        if (channel) {
+          client->session_channels.emplace_back(channel);
+        }
+        return 0;
+      }
+
+      if (type == SSH_REQUEST_GLOBAL && subtype == SSH_GLOBAL_REQUEST_TCPIP_FORWARD) {
+        return open_tunnel(client, message);
+      }
+
+      if (type == SSH_REQUEST_GLOBAL && subtype == SSH_GLOBAL_REQUEST_CANCEL_TCPIP_FORWARD) {
+        int port = ssh_message_global_request_port(message);
+
+        // The listener and its connections are closed by run_pending()
+        std::lock_guard<std::mutex> lock(server->tunnels_mutex_);
+        for (auto &tunnel : client->tunnels) {
+          if (tunnel->port == port) {
+            tunnel->info->active = false;
+          }
+        }
+
+        ssh_message_global_request_reply_success(message, 0);
+        return 0;
+      }
+
+      // No shell, exec or direct-tcpip
+      return 1;
+    }
+
+    int
+    open_tunnel(client_t *client, ssh_message message) {
+      const char *address = ssh_message_global_request_address(message);
+      int requested_port = ssh_message_global_request_port(message);
+
+      BOOST_LOG(info) << "SSH client requests reverse port forward: " << (address ? address : "") << ":" << requested_port;
+
+      // USB/IP devices are only attached from this host, so the tunnel never listens on other interfaces
+      socket_t listener = socket(AF_INET, SOCK_STREAM, 0);
+      if (listener == SSH_INVALID_SOCKET) {
+        BOOST_LOG(error) << "Failed to create socket for SSH tunnel";
+        return 1;
+      }
+
+      int on = 1;
+      setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char *) &on, sizeof(on));
+
+      sockaddr_in addr {};
+      addr.sin_family = AF_INET;
+      addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      addr.sin_port = htons(requested_port);
+
+      socklen_t addr_len = sizeof(addr);
+      if (::bind(listener, (sockaddr *) &addr, sizeof(addr)) != 0 ||
+          listen(listener, SOMAXCONN) != 0 ||
+          getsockname(listener, (sockaddr *) &addr, &addr_len) != 0) {
+        BOOST_LOG(error) << "Failed to listen on port " << requested_port << " for SSH tunnel";
+        close_socket(listener);
+        return 1;
+      }
+
+      set_nonblocking(listener);
+
+      auto tunnel = std::make_unique<tunnel_t>();
+      tunnel->client = client;
+      tunnel->listener = listener;
+      tunnel->address = address ? address : "";
+      tunnel->port = ntohs(addr.sin_port);
+
+      tunnel->info = std::make_shared<tunnel_info_t>();
+      tunnel->info->client_id = client->username + "@" + client->address + ":" + std::to_string(tunnel->port);
+      tunnel->info->client_ip = client->address;
+      tunnel->info->forwarded_port = tunnel->port;
+      tunnel->info->remote_usbip_port = requested_port;
+      tunnel->info->active = true;
+
+      metrics::labels_t labels { { "tunnel", tunnel->info->client_id } };
+      labels["direction"] = "to_client";
+      tunnel->bytes_to_client = metrics::counter("sunshine_ssh_tunnel_bytes_total", "Bytes forwarded through SSH tunnels", labels);
+      labels["direction"] = "from_client";
+      tunnel->bytes_from_client = metrics::counter("sunshine_ssh_tunnel_bytes_total", "Bytes forwarded through SSH tunnels", labels);
+
+      ssh_message_global_request_reply_success(message, tunnel->port);
+      ssh_event_add_fd(event, listener, POLLIN, &impl::on_tunnel_readable, tunnel.get());
+
+      {
+        std::lock_guard<std::mutex> lock(server->tunnels_mutex_);
+        server->tunnels_[tunnel->info->client_id] = tunnel->info;
+      }
+
+      if (server->tunnel_callback_) {
+        server->tunnel_callback_(*tunnel->info);
+      }
+
+      BOOST_LOG(info) << "SSH tunnel " << tunnel->info->client_id << " listening on 127.0.0.1:" << tunnel->port;
+
+      client->tunnels.emplace_back(std::move(tunnel));
+      return 0;
+    }
+
+    void
+    accept_conn(tunnel_t *tunnel) {
+      auto client = tunnel->client;
+
+      socket_t sock = accept(tunnel->listener, nullptr, nullptr);
+      if (sock == SSH_INVALID_SOCKET) {
+        return;
+      }
+
+      if (client->closing || !tunnel->info->active) {
+        close_socket(sock);
+        return;
+      }
+
+      set_nonblocking(sock);
+
+      // USB/IP is a request/response protocol, don't let Nagle hold back small URBs
+      int on = 1;
+      setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char *) &on, sizeof(on));
+
+      auto conn = std::make_unique<conn_t>();
+      conn->client = client;
+      conn->tunnel = tunnel;
+      conn->sock = sock;
+      conn->channel = ssh_channel_new(client->session);
+      conn->to_tcp.data = buffers.acquire();
+      conn->to_channel.data = buffers.acquire();
+
+      if (!conn->channel) {
+        conn->closing = true;
+      }
+      else {
+        conn->callbacks.userdata = conn.get();
+        conn->callbacks.channel_data_function = &impl::on_channel_data;
+        conn->callbacks.channel_eof_function = &impl::on_channel_eof;
+        conn->callbacks.channel_close_function = &impl::on_channel_close;
+        ssh_callbacks_init(&conn->callbacks);
+        ssh_set_channel_callbacks(conn->channel, &conn->callbacks);
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(server->tunnels_mutex_);
+        ++tunnel->info->connections;
+      }
+
+      client->conns.emplace_back(std::move(conn));
+    }
+
+    void
+    open_channel(conn_t *conn) {
+      auto rc = ssh_channel_open_reverse_forward(conn->channel, conn->tunnel->address.c_str(), conn->tunnel->port, "127.0.0.1", 0);
+      if (rc == SSH_AGAIN) {
+        return;
+      }
+
+      if (rc != SSH_OK) {
+        BOOST_LOG(warning) << "SSH client refused forwarded connection on port " << conn->tunnel->port;
+        conn->closing = true;
+        return;
+      }
+
+      conn->opened = true;
+    }
+
+    /**
+     * @brief Move data that was held back by a full buffer or a closed window
+     */
+    void
+    pump(conn_t *conn) {
+      flush_to_channel(conn);
+
+      if (conn->channel_backlog && conn->to_tcp.empty()) {
+        auto bytes = ssh_channel_read_nonblocking(conn->channel, conn->to_tcp.data.data(), conn->to_tcp.space(), 0);
+        if (bytes == SSH_ERROR) {
+          conn->closing = true;
+          return;
+        }
+
+        conn->to_tcp.end = std::max(bytes, 0);
+        conn->channel_backlog = conn->to_tcp.end == conn->to_tcp.data.size();
+        flush_to_tcp(conn);
+      }
+
+      if (conn->channel_eof && !conn->channel_backlog && conn->to_tcp.empty() && !conn->write_shutdown) {
+        shutdown(conn->sock, shutdown_write);
+        conn->write_shutdown = true;
+      }
+
+      if (conn->tcp_eof && conn->write_shutdown && conn->to_channel.empty()) {
+        conn->closing = true;
+      }
+    }
+
+    void
+    update_events(conn_t *conn) {
+      short events = 0;
+      if (conn->opened && !conn->tcp_eof && conn->to_channel.empty() && ssh_channel_window_size(conn->channel) > 0) {
+        events |= POLLIN;
+      }
+      if (!conn->to_tcp.empty()) {
+        events |= POLLOUT;
+      }
+
+      if (events == conn->events) {
+        return;
+      }
+
+      if (conn->events) {
+        ssh_event_remove_fd(event, conn->sock);
+      }
+      if (events) {
+        ssh_event_add_fd(event, conn->sock, events, &impl::on_conn_io, conn);
+      }
+      conn->events = events;
+    }
+
+    void
+    close_conn(conn_t *conn) {
+      if (conn->events) {
+        ssh_event_remove_fd(event, conn->sock);
+      }
+      close_socket(conn->sock);
+
+      if (conn->channel) {
+        if (conn->opened && ssh_channel_is_open(conn->channel)) {
+          ssh_channel_close(conn->channel);
+        }
+        ssh_channel_free(conn->channel);
+      }
+
+      buffers.release(std::move(conn->to_tcp.data));
+      buffers.release(std::move(conn->to_channel.data));
+    }
+
+    void
+    close_tunnel(tunnel_t *tunnel) {
+      ssh_event_remove_fd(event, tunnel->listener);
+      close_socket(tunnel->listener);
+
+      {
+        std::lock_guard<std::mutex> lock(server->tunnels_mutex_);
+        tunnel->info->active = false;
+        server->tunnels_.erase(tunnel->info->client_id);
+      }
+
+      metrics::remove({ { "tunnel", tunnel->info->client_id } });
+
+      BOOST_LOG(info) << "SSH tunnel " << tunnel->info->client_id << " closed";
+    }
+
+    void
+    close_client(client_t *client) {
+      for (auto &conn : client->conns) {
+        close_conn(conn.get());
+      }
+      for (auto &tunnel : client->tunnels) {
+        close_tunnel(tunnel.get());
+      }
+      for (auto channel : client->session_channels) {
+        ssh_channel_free(channel);
+      }
+
+      ssh_event_remove_session(event, client->session);
+      ssh_disconnect(client->session);
+      ssh_free(client->session);
+
+      BOOST_LOG(info) << "SSH client disconnected: " << (client->username.empty() ? client->address : client->username);
+    }
+
+    /**
+     * @brief Add the bytes forwarded since the last call to the counters of each tunnel
+     */
+    void
+    report_throughput(client_t *client) {
+      std::lock_guard<std::mutex> lock(server->tunnels_mutex_);
+      for (auto &conn : client->conns) {
+        if (conn->unreported_to_client) {
+          conn->tunnel->info->bytes_to_client += conn->unreported_to_client;
+          conn->tunnel->bytes_to_client->inc(conn->unreported_to_client);
+          conn->unreported_to_client = 0;
+        }
+        if (conn->unreported_from_client) {
+          conn->tunnel->info->bytes_from_client += conn->unreported_from_client;
+          conn->tunnel->bytes_from_client->inc(conn->unreported_from_client);
+          conn->unreported_from_client = 0;
+        }
+      }
+    }
+
+    /**
+     * @brief Advance everything that can't be done from within libssh callbacks
+     */
+    void
+    run_pending() {
+      auto now = std::chrono::steady_clock::now();
+
+      for (auto it = clients.begin(); it != clients.end();) {
+        auto client = it->get();
+
+        if (!client->key_exchanged && !client->closing) {
+          advance_key_exchange(client);
+        }
+
+        if (!client->authenticated && now - client->connected > login_grace_time) {
+          BOOST_LOG(warning) << "SSH client " << client->address << " didn't authenticate in time";
+          client->closing = true;
+        }
+
+        if (ssh_get_status(client->session) & (SSH_CLOSED | SSH_CLOSED_ERROR)) {
+          client->closing = true;
+        }
+
+        for (auto &conn : client->conns) {
+          if (conn->closing) {
+            continue;
+          }
+
+          if (!conn->opened) {
+            open_channel(conn.get());
+          }
+
+          if (conn->opened) {
+            pump(conn.get());
+          }
+        }
+
+        report_throughput(client);
+
+        for (auto conn = client->conns.begin(); conn != client->conns.end();) {
+          if (client->closing || (*conn)->closing || !(*conn)->tunnel->info->active) {
+            close_conn(conn->get());
+            conn = client->conns.erase(conn);
+            continue;
+          }
+
+          update_events(conn->get());
+          ++conn;
+        }
+
+        for (auto tunnel = client->tunnels.begin(); tunnel != client->tunnels.end();) {
+          if (client->closing || !(*tunnel)->info->active) {
+            close_tunnel(tunnel->get());
+            tunnel = client->tunnels.erase(tunnel);
+            continue;
+          }
+
+          ++tunnel;
+        }
+
+        if (client->closing) {
+          close_client(client);
+          it = clients.erase(it);
+          continue;
+        }
+
+        ++it;
+      }
+    }
   };
 
   ssh_server_t::ssh_server_t():
@@ -188,7 +993,8 @@ namespace ssh_server {
     std::lock_guard<std::mutex> lock(tunnels_mutex_);
     auto it = tunnels_.find(client_id);
     if (it != tunnels_.end()) {
-      return it->second;
+      // The counters keep changing on the server thread
+      return std::make_shared<tunnel_info_t>(*it->second);
     }
     return nullptr;
   }
@@ -202,148 +1008,31 @@ namespace ssh_server {
   ssh_server_t::server_thread() {
     BOOST_LOG(info) << "SSH server thread started";
 
-    while (running_) {
-      // Accept incoming connections with timeout
-      ssh_session session = ssh_new();
-      if (!session) {
-        BOOST_LOG(error) << "Failed to create SSH session";
-        continue;
-      }
-
-      // Set a timeout for accept
-      struct timeval timeout;
-      timeout.tv_sec = 1;
-      timeout.tv_usec = 0;
-
-      int rc = ssh_bind_accept_fd(pimpl->bind, session, 0);
-      if (rc == SSH_ERROR) {
-        ssh_free(session);
-        continue;
-      }
-
-      // Handle client in a separate thread
-      std::thread([this, session]() {
-        handle_client(session);
-      }).detach();
-    }
-
-    BOOST_LOG(info) << "SSH server thread stopped";
-  }
-
-  void
-  ssh_server_t::handle_client(void *session_ptr) {
-    ssh_session session = static_cast<ssh_session>(session_ptr);
-
-    // Exchange keys and authenticate
-    if (ssh_handle_key_exchange(session) != SSH_OK) {
-      BOOST_LOG(error) << "SSH key exchange failed: " << ssh_get_error(session);
-      ssh_disconnect(session);
-      ssh_free(session);
+    pimpl->server = this;
+    pimpl->event = ssh_event_new();
+    if (!pimpl->event) {
+      BOOST_LOG(error) << "Failed to create SSH event loop";
       return;
     }
 
-    // Handle authentication
-    ssh_message message;
-    bool authenticated = false;
-    std::string client_username;
-
-    while ((message = ssh_message_get(session)) != nullptr && !authenticated) {
-      int type = ssh_message_type(message);
-      int subtype = ssh_message_subtype(message);
-
-      if (type == SSH_REQUEST_AUTH && subtype == SSH_AUTH_METHOD_PASSWORD) {
-        client_username = ssh_message_auth_user(message);
-        const char *password = ssh_message_auth_password(message);
-
-        if (client_username == username_ && std::string(password) == password_) {
-          ssh_message_auth_reply_success(message, 0);
-          authenticated = true;
-          BOOST_LOG(info) << "SSH client authenticated: " << client_username;
-        }
-        else {
-          ssh_message_auth_set_methods(message, SSH_AUTH_METHOD_PASSWORD);
-          ssh_message_reply_default(message);
-        }
-      }
-      else {
-        ssh_message_reply_default(message);
-      }
-
-      ssh_message_free(message);
-    }
+    ssh_event_add_fd(pimpl->event, ssh_bind_get_fd(pimpl->bind), POLLIN, &impl::on_bind_readable, pimpl.get());
 
-    if (!authenticated) {
-      BOOST_LOG(warning) << "SSH client authentication failed";
-      ssh_disconnect(session);
-      ssh_free(session);
-      return;
+    while (running_) {
+      // A failing session also fails the poll, it is cleaned up below like any other closed session
+      ssh_event_dopoll(pimpl->event, poll_timeout_ms);
+      pimpl->run_pending();
     }
 
-    // Handle channel requests (port forwarding)
-    ssh_channel channel;
-    while ((message = ssh_message_get(session)) != nullptr) {
-      int type = ssh_message_type(message);
-
-      if (type == SSH_REQUEST_CHANNEL_OPEN) {
-        channel = ssh_message_channel_request_open_reply_accept(message);
-        ssh_message_free(message);
-
-        // Handle channel requests
-        while ((message = ssh_message_get(session)) != nullptr) {
-          type = ssh_message_type(message);
-          int subtype = ssh_message_subtype(message);
-
-          if (type == SSH_REQUEST_CHANNEL && subtype == SSH_CHANNEL_REQUEST_SHELL) {
-            // We don't provide shell access, only port forwarding
-            ssh_message_reply_default(message);
-          }
-          else if (type == SSH_REQUEST_GLOBAL && subtype == SSH_GLOBAL_REQUEST_TCPIP_FORWARD) {
-            // Handle reverse port forwarding request
-            const char *bind_addr = ssh_message_global_request_address(message);
-            int bind_port = ssh_message_global_request_port(message);
-
-            BOOST_LOG(info) << "SSH client requests reverse port forward: " << bind_addr << ":" << bind_port;
-
-            // Create tunnel info
-            auto tunnel = std::make_shared<tunnel_info_t>();
-            tunnel->client_id = client_username + "@" + std::string(ssh_get_disconnect_message(session));
-            tunnel->client_ip = std::string(ssh_get_serverbanner(session));
-            tunnel->forwarded_port = bind_port;
-            tunnel->remote_usbip_port = bind_port;
-            tunnel->active = true;
-
-            {
-              std::lock_guard<std::mutex> lock(tunnels_mutex_);
-              tunnels_[tunnel->client_id] = tunnel;
-            }
-
-            // Notify callback
-            if (tunnel_callback_) {
-              tunnel_callback_(*tunnel);
-            }
-
-            ssh_message_global_request_reply_success(message, bind_port);
-          }
-          else {
-            ssh_message_reply_default(message);
-          }
-
-          ssh_message_free(message);
-        }
-        break;
-      }
-      else {
-        ssh_message_reply_default(message);
-      }
-
-      ssh_message_free(message);
+    for (auto &client : pimpl->clients) {
+      pimpl->close_client(client.get());
     }
+    pimpl->clients.clear();
 
-    // Cleanup
-    ssh_disconnect(session);
-    ssh_free(session);
+    ssh_event_remove_fd(pimpl->event, ssh_bind_get_fd(pimpl->bind));
+    ssh_event_free(pimpl->event);
+    pimpl->event = nullptr;
 
-    BOOST_LOG(info) << "SSH client disconnected: " << client_username;
+    BOOST_LOG(info) << "SSH server thread stopped";
   }
 
   int
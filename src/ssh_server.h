@@ -8,8 +8,11 @@
 #include <string>
 #include <functional>
 #include <map>
+#include <mutex>
 #include <thread>
 #include <atomic>
+#include <cstdint>
+#include <vector>
 
 #ifdef _WIN32
   #include <winsock2.h>
@@ -30,6 +33,9 @@ namespace ssh_server {
     int forwarded_port;  // Local port that was forwarded by SSH tunnel
     int remote_usbip_port;  // Remote USB/IP server port on client
     bool active;  // Whether the tunnel is currently active
+    std::uint64_t connections = 0;  // Connections forwarded through the tunnel so far
+    std::uint64_t bytes_to_client = 0;  // Bytes forwarded to the client's USB/IP server
+    std::uint64_t bytes_from_client = 0;  // Bytes received from the client's USB/IP server
   };
 
   /**
@@ -75,7 +81,7 @@ namespace ssh_server {
     std::vector<tunnel_info_t> get_active_tunnels() const;
 
     /**
-     * @brief Get tunnel info by client ID
+     * @brief Get a snapshot of the tunnel info by client ID
      */
     std::shared_ptr<tunnel_info_t> get_tunnel(const std::string &client_id) const;
 
@@ -88,11 +94,11 @@ namespace ssh_server {
     class impl;
     std::unique_ptr<impl> pimpl;
 
+    /**
+     * @brief Event loop multiplexing all SSH sessions and the connections forwarded through their tunnels
+     */
     void server_thread();
-    void handle_client(void *session);
     int authenticate_password(void *session, const std::string &user, const std::string &pass);
-    int handle_channel_open(void *session);
-    int handle_port_forward_request(void *session, void *channel, int requested_port);
 
     std::thread server_thread_;
     std::atomic<bool> running_;
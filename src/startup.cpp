@@ -0,0 +1,279 @@
+/**
+ * @file src/startup.cpp
+ * @brief Definitions for the concurrent initialization of the host's components.
+ */
+// standard includes
+#include <algorithm>
+
+// local includes
+#include "logging.h"
+#include "metrics.h"
+#include "startup.h"
+
+using namespace std::literals;
+
+namespace startup {
+  namespace {
+    std::chrono::milliseconds
+    since(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point now) {
+      return std::chrono::duration_cast<std::chrono::milliseconds>(now - start);
+    }
+
+    bool
+    is_finished(state_e state) {
+      return state == state_e::ready || state == state_e::failed;
+    }
+  }  // namespace
+
+  std::string_view
+  to_string(state_e state) {
+    switch (state) {
+      case state_e::pending:
+        return "pending"sv;
+      case state_e::running:
+        return "running"sv;
+      case state_e::ready:
+        return "ready"sv;
+      case state_e::failed:
+        return "failed"sv;
+    }
+
+    return "unknown"sv;
+  }
+
+  orchestrator_t::~orchestrator_t() {
+    join();
+  }
+
+  void
+  orchestrator_t::add(std::string name, std::vector<std::string> dependencies, std::function<bool()> init) {
+    std::lock_guard lg { _mutex };
+
+    if (_started) {
+      BOOST_LOG(error) << "Startup: ["sv << name << "] was added after the startup began"sv;
+      return;
+    }
+
+    _entries.push_back({
+      { std::move(name), std::move(dependencies), state_e::pending, {}, {} },
+      std::move(init),
+      {},
+    });
+  }
+
+  void
+  orchestrator_t::start() {
+    std::unique_lock ul { _mutex };
+
+    if (_started) {
+      return;
+    }
+
+    _started = true;
+    _start = std::chrono::steady_clock::now();
+    schedule(ul);
+  }
+
+  void
+  orchestrator_t::schedule(std::unique_lock<std::mutex> &lock) {
+    auto find = [this](const std::string &name) {
+      return std::find_if(std::begin(_entries), std::end(_entries), [&](auto &entry) {
+        return entry.component.name == name;
+      });
+    };
+
+    bool progress = true;
+    while (progress) {
+      progress = false;
+
+      for (std::size_t x = 0; x < _entries.size(); ++x) {
+        auto &entry = _entries[x];
+        if (entry.component.state != state_e::pending) {
+          continue;
+        }
+
+        bool unknown = false;
+        bool waiting = false;
+        for (auto &dependency : entry.component.dependencies) {
+          auto it = find(dependency);
+          if (it == std::end(_entries)) {
+            BOOST_LOG(error) << "Startup: ["sv << entry.component.name << "] depends on unknown component ["sv << dependency << ']';
+            unknown = true;
+          }
+          else if (!is_finished(it->component.state)) {
+            waiting = true;
+          }
+        }
+
+        if (unknown) {
+          entry.component.state = state_e::failed;
+          progress = true;
+        }
+        else if (!waiting) {
+          entry.start = std::chrono::steady_clock::now();
+          entry.component.state = state_e::running;
+          entry.component.started = since(_start, entry.start);
+          _threads.emplace_back(&orchestrator_t::run, this, x);
+        }
+      }
+    }
+
+    // Components still waiting while nothing runs anymore depend on each other
+    auto running = std::any_of(std::begin(_entries), std::end(_entries), [](auto &entry) {
+      return entry.component.state == state_e::running;
+    });
+    if (!running) {
+      for (auto &entry : _entries) {
+        if (entry.component.state == state_e::pending) {
+          BOOST_LOG(error) << "Startup: ["sv << entry.component.name << "] has a circular dependency"sv;
+          entry.component.state = state_e::failed;
+        }
+      }
+
+      // Nothing is pending or running anymore, so the startup is complete
+      if (!_finished) {
+        _finished = true;
+        log_timeline(lock);
+      }
+    }
+
+    // Components may have finished without running, their waiters must see that too
+    _cv.notify_all();
+  }
+
+  void
+  orchestrator_t::run(std::size_t index) {
+    // The entries are not added or removed once the startup began
+    auto &entry = _entries[index];
+
+    bool ok = false;
+    try {
+      ok = entry.init();
+    }
+    catch (std::exception &e) {
+      BOOST_LOG(error) << "Startup: ["sv << entry.component.name << "] threw: "sv << e.what();
+    }
+
+    std::unique_lock ul { _mutex };
+
+    entry.component.state = ok ? state_e::ready : state_e::failed;
+    entry.component.duration = since(entry.start, std::chrono::steady_clock::now());
+
+    if (ok) {
+      BOOST_LOG(info) << "Startup: ["sv << entry.component.name << "] ready in "sv << entry.component.duration.count() << "ms"sv;
+    }
+    else {
+      BOOST_LOG(warning) << "Startup: ["sv << entry.component.name << "] failed after "sv << entry.component.duration.count() << "ms"sv;
+    }
+
+    metrics::labels_t labels { { "component", entry.component.name } };
+    metrics::gauge("sunshine_startup_ready", "Whether a component initialized successfully", labels)->set(ok ? 1 : 0);
+    metrics::gauge("sunshine_startup_seconds", "How long the initialization of a component took", labels)->set(std::chrono::duration<double>(entry.component.duration).count());
+
+    schedule(ul);
+  }
+
+  bool
+  orchestrator_t::wait(const std::string &name) {
+    std::unique_lock ul { _mutex };
+
+    auto it = std::find_if(std::begin(_entries), std::end(_entries), [&](auto &entry) {
+      return entry.component.name == name;
+    });
+    if (it == std::end(_entries)) {
+      return false;
+    }
+
+    _cv.wait(ul, [&]() {
+      return is_finished(it->component.state);
+    });
+
+    return it->component.state == state_e::ready;
+  }
+
+  void
+  orchestrator_t::join() {
+    std::unique_lock ul { _mutex };
+
+    if (!_started || _joined) {
+      return;
+    }
+
+    _cv.wait(ul, [this]() {
+      return std::all_of(std::begin(_entries), std::end(_entries), [](auto &entry) {
+        return is_finished(entry.component.state);
+      });
+    });
+
+    // No thread is started once every component has finished
+    _joined = true;
+    auto threads = std::move(_threads);
+    ul.unlock();
+
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  }
+
+  void
+  orchestrator_t::log_timeline(std::unique_lock<std::mutex> &) {
+    std::chrono::milliseconds total {};
+    for (auto &entry : _entries) {
+      total = std::max(total, entry.component.started + entry.component.duration);
+    }
+
+    BOOST_LOG(info) << "Startup finished in "sv << total.count() << "ms:"sv;
+    for (auto &entry : _entries) {
+      auto &component = entry.component;
+      BOOST_LOG(info) << "  +"sv << component.started.count() << "ms ["sv << component.name << "] "sv
+                      << to_string(component.state) << " in "sv << component.duration.count() << "ms"sv;
+    }
+  }
+
+  state_e
+  orchestrator_t::state(const std::string &name) const {
+    std::lock_guard lg { _mutex };
+
+    for (auto &entry : _entries) {
+      if (entry.component.name == name) {
+        return entry.component.state;
+      }
+    }
+
+    return state_e::failed;
+  }
+
+  bool
+  orchestrator_t::finished(const std::string &name) const {
+    return is_finished(state(name));
+  }
+
+  std::vector<component_t>
+  orchestrator_t::components() const {
+    std::lock_guard lg { _mutex };
+
+    auto now = std::chrono::steady_clock::now();
+
+    std::vector<component_t> components;
+    components.reserve(_entries.size());
+    for (auto &entry : _entries) {
+      auto &component = components.emplace_back(entry.component);
+      if (component.state == state_e::running) {
+        component.duration = since(entry.start, now);
+      }
+    }
+
+    return components;
+  }
+
+  orchestrator_t &
+  host() {
+    static orchestrator_t orchestrator;
+    return orchestrator;
+  }
+
+  bool
+  ready_to_stream() {
+    return host().finished("encoder") && host().finished("input");
+  }
+}  // namespace startup
@@ -0,0 +1,138 @@
+/**
+ * @file src/startup.h
+ * @brief Declarations for the concurrent initialization of the host's components.
+ */
+#pragma once
+
+// standard includes
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Runs the initializations of independent components at the same time.
+ * @details Each component names the components it depends on and starts once all of them have finished.
+ *          A failed dependency does not stop its dependents, like the sequential startup it replaces,
+ *          the host keeps running with reduced functionality so the web UI can be used to fix the problem.
+ */
+namespace startup {
+  enum class state_e {
+    pending,  ///< Waiting for its dependencies
+    running,
+    ready,
+    failed,
+  };
+
+  /**
+   * @brief The progress of a component.
+   */
+  struct component_t {
+    std::string name;
+    std::vector<std::string> dependencies;
+    state_e state;
+    std::chrono::milliseconds started;  ///< When the initialization started, relative to `orchestrator_t::start()`
+    std::chrono::milliseconds duration;  ///< How long the initialization took, or has taken so far
+  };
+
+  std::string_view
+  to_string(state_e state);
+
+  class orchestrator_t {
+  public:
+    orchestrator_t() = default;
+    ~orchestrator_t();
+
+    orchestrator_t(const orchestrator_t &) = delete;
+    orchestrator_t &
+    operator=(const orchestrator_t &) = delete;
+
+    /**
+     * @brief Register a component, before `start()` is called.
+     * @param name The unique name of the component.
+     * @param dependencies The components that have to finish first.
+     * @param init Initializes the component on its own thread, returns `false` if it failed.
+     */
+    void
+    add(std::string name, std::vector<std::string> dependencies, std::function<bool()> init);
+
+    /**
+     * @brief Start the components that don't depend on any other.
+     * @details Components depending on an unknown or a circular dependency fail immediately.
+     */
+    void
+    start();
+
+    /**
+     * @brief Block until a component has finished.
+     * @param name The name of the component.
+     * @return `true` if the component is ready.
+     */
+    bool
+    wait(const std::string &name);
+
+    /**
+     * @brief Wait for all components and their threads to finish.
+     * @details The startup timeline is logged as soon as the last component finishes, not by this function.
+     */
+    void
+    join();
+
+    state_e
+    state(const std::string &name) const;
+
+    /**
+     * @brief Check if a component has finished, whether or not it succeeded.
+     */
+    bool
+    finished(const std::string &name) const;
+
+    /**
+     * @brief Get the progress of all components, in the order they were added.
+     */
+    std::vector<component_t>
+    components() const;
+
+  private:
+    struct entry_t {
+      component_t component;
+      std::function<bool()> init;
+      std::chrono::steady_clock::time_point start;
+    };
+
+    void
+    run(std::size_t index);
+
+    void
+    schedule(std::unique_lock<std::mutex> &lock);
+
+    void
+    log_timeline(std::unique_lock<std::mutex> &lock);
+
+    mutable std::mutex _mutex;
+    std::condition_variable _cv;
+    std::vector<entry_t> _entries;
+    std::vector<std::thread> _threads;
+    std::chrono::steady_clock::time_point _start;
+    bool _started = false;
+    bool _finished = false;  ///< Every component has finished and the timeline was logged
+    bool _joined = false;
+  };
+
+  /**
+   * @brief The orchestrator of the host's components, used by `main()` and queried by the HTTP servers.
+   */
+  orchestrator_t &
+  host();
+
+  /**
+   * @brief Check if the encoders and input devices of the host have finished initializing.
+   * @details Streams can't start until then, whether or not the initialization succeeded.
+   */
+  bool
+  ready_to_stream();
+}  // namespace startup
@@ -4,7 +4,13 @@
  */
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
 #include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <functional>
 #include <limits>
 
@@ -53,4 +59,167 @@ namespace stat_trackers {
     } data;
   };
 
+  /**
+   * @brief A fixed-memory log-linear histogram of non-negative integer values, in the style of HdrHistogram.
+   * @details Values are grouped by power of two and every power of two is split into `2^sub_bucket_bits`
+   *          linear sub-buckets, so a reported value is within `2^-sub_bucket_bits` of the recorded one
+   *          over the whole 64-bit range. Recording is lock-free and may race with reading.
+   */
+  template <std::size_t sub_bucket_bits = 5>
+  class log_linear_histogram {
+  public:
+    static constexpr std::uint64_t sub_bucket_count = std::uint64_t { 1 } << sub_bucket_bits;
+    static constexpr std::size_t bucket_count = (64 - sub_bucket_bits + 1) * sub_bucket_count;
+
+    void
+    record(std::uint64_t value) {
+      counts[index_of(value)].fetch_add(1, std::memory_order_relaxed);
+      total.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::uint64_t
+    count() const {
+      return total.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the value below which the given percentage of the recorded values fall.
+     * @param percentile The percentile in the range [0, 100].
+     * @return The highest value equivalent to the percentile, or 0 if nothing was recorded.
+     */
+    std::uint64_t
+    value_at_percentile(double percentile) const {
+      auto recorded = count();
+      if (recorded == 0) {
+        return 0;
+      }
+
+      auto rank = (std::uint64_t) std::ceil(std::clamp(percentile, 0.0, 100.0) / 100.0 * recorded);
+      rank = std::max<std::uint64_t>(rank, 1);
+
+      std::uint64_t seen = 0;
+      for (std::size_t x = 0; x < bucket_count; ++x) {
+        seen += counts[x].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+          return highest_value_at(x);
+        }
+      }
+
+      return highest_value_at(bucket_count - 1);
+    }
+
+    void
+    reset() {
+      for (auto &bucket : counts) {
+        bucket.store(0, std::memory_order_relaxed);
+      }
+      total.store(0, std::memory_order_relaxed);
+    }
+
+    static std::size_t
+    index_of(std::uint64_t value) {
+      if (value < sub_bucket_count) {
+        return value;
+      }
+
+      std::size_t shift = std::bit_width(value) - 1 - sub_bucket_bits;
+      return (shift + 1) * sub_bucket_count + ((value >> shift) - sub_bucket_count);
+    }
+
+    static std::uint64_t
+    highest_value_at(std::size_t index) {
+      auto group = index / sub_bucket_count;
+      auto sub_bucket = index % sub_bucket_count;
+      if (group == 0) {
+        return sub_bucket;
+      }
+
+      auto shift = group - 1;
+      auto lowest = (sub_bucket + sub_bucket_count) << shift;
+      return lowest + ((std::uint64_t { 1 } << shift) - 1);
+    }
+
+  private:
+    std::array<std::atomic<std::uint64_t>, bucket_count> counts {};
+    std::atomic<std::uint64_t> total = 0;
+  };
+
+  template <typename T>
+  struct percentile_stats_t {
+    T stat_min;
+    T stat_max;
+    double stat_avg;
+    T p50;
+    T p95;
+    T p99;
+    T p999;
+  };
+
+  /**
+   * @brief Like min_max_avg_tracker, but additionally reports the p50/p95/p99/p99.9 percentiles.
+   * @details Floating point values are recorded in the histogram with a resolution of 0.001,
+   *          negative values are recorded as 0.
+   */
+  template <typename T>
+  class percentile_tracker {
+  public:
+    using callback_function = std::function<void(const percentile_stats_t<T> &stats)>;
+
+    static constexpr double scale = std::is_floating_point_v<T> ? 1000.0 : 1.0;
+
+    void
+    collect_and_callback_on_interval(T stat, const callback_function &callback, std::chrono::seconds interval_in_seconds) {
+      if (data.calls == 0) {
+        data.last_callback_time = std::chrono::steady_clock::now();
+      }
+      else if (std::chrono::steady_clock::now() > data.last_callback_time + interval_in_seconds) {
+        callback(stats());
+        reset();
+      }
+      data.stat_min = std::min(data.stat_min, stat);
+      data.stat_max = std::max(data.stat_max, stat);
+      data.stat_total += stat;
+      data.calls += 1;
+      histogram.record((std::uint64_t) std::max(std::llround(stat * scale), 0LL));
+    }
+
+    percentile_stats_t<T>
+    stats() const {
+      if (data.calls == 0) {
+        return {};
+      }
+
+      auto at = [&](double percentile) {
+        auto value = (T) (histogram.value_at_percentile(percentile) / scale);
+        return std::clamp(value, data.stat_min, data.stat_max);
+      };
+
+      return {
+        data.stat_min,
+        data.stat_max,
+        data.stat_total / data.calls,
+        at(50),
+        at(95),
+        at(99),
+        at(99.9),
+      };
+    }
+
+    void
+    reset() {
+      data = {};
+      histogram.reset();
+    }
+
+  private:
+    struct {
+      std::chrono::steady_clock::time_point last_callback_time = std::chrono::steady_clock::now();
+      T stat_min = std::numeric_limits<T>::max();
+      T stat_max = std::numeric_limits<T>::lowest();
+      double stat_total = 0;
+      uint32_t calls = 0;
+    } data;
+    log_linear_histogram<> histogram;
+  };
+
 }  // namespace stat_trackers
@@ -5,6 +5,7 @@
 #include "process.h"
 
 #include <future>
+#include <limits>
 #include <queue>
 
 #include <fstream>
@@ -25,11 +26,14 @@ extern "C" {
 #include "globals.h"
 #include "input.h"
 #include "logging.h"
+#include "metrics.h"
 #include "network.h"
+#include "pacing.h"
 #include "stream.h"
 #include "sync.h"
 #include "system_tray.h"
 #include "thread_safe.h"
+#include "tracing.h"
 #include "utility.h"
 
 #include "platform/common.h"
@@ -320,6 +324,9 @@ namespace stream {
     net::host_t _host;
   };
 
+  // Bandwidth shared by the video streams of all sessions, set when broadcasting starts
+  static pacing::link_budget_t video_link_budget;
+
   struct broadcast_ctx_t {
     message_queue_queue_t message_queue_queue;
 
@@ -364,6 +371,8 @@ namespace stream {
       safe::mail_raw_t::event_t<bool> idr_events;
       safe::mail_raw_t::event_t<std::pair<int64_t, int64_t>> invalidate_ref_frames_events;
 
+      std::unique_ptr<pacing::policy_t> pacer;
+
       std::unique_ptr<platf::deinit_t> qos;
     } video;
 
@@ -402,6 +411,25 @@ namespace stream {
 
     std::uint32_t launch_session_id;
 
+    // Exported on the /metrics endpoint with a "session" label
+    struct {
+      std::shared_ptr<metrics::counter_t> video_frames;
+      std::shared_ptr<metrics::counter_t> video_encoded_bytes;
+      std::shared_ptr<metrics::counter_t> video_sent_bytes;
+      std::shared_ptr<metrics::counter_t> video_packets;
+      std::shared_ptr<metrics::counter_t> video_fec_packets;
+      std::shared_ptr<metrics::counter_t> video_fec_skipped;
+      std::shared_ptr<metrics::gauge_t> video_bitrate;
+      std::shared_ptr<metrics::gauge_t> video_pacing_rate;
+      std::shared_ptr<metrics::histogram_t> encode_latency;
+      std::shared_ptr<metrics::histogram_t> frame_processing_latency;
+      std::shared_ptr<metrics::histogram_t> fec_latency;
+      std::shared_ptr<metrics::histogram_t> send_batch_latency;
+      std::shared_ptr<metrics::histogram_t> network_latency;
+      std::shared_ptr<metrics::counter_t> audio_packets;
+      std::shared_ptr<metrics::counter_t> input_events;
+    } metrics;
+
     safe::mail_raw_t::event_t<bool> shutdown_event;
     safe::signal_t controlEnd;
 
@@ -719,68 +747,96 @@ namespace stream {
   }  // namespace fec
 
   /**
-   * @brief Combines two buffers and inserts new buffers at each slice boundary of the result.
+   * @brief Combines several buffers and inserts new buffers at each slice boundary of the result.
    * @param insert_size The number of bytes to insert.
    * @param slice_size The number of bytes between insertions.
-   * @param data1 The first data buffer.
-   * @param data2 The second data buffer.
+   * @param segments The data buffers.
    */
   std::vector<uint8_t>
-  concat_and_insert(uint64_t insert_size, uint64_t slice_size, const std::string_view &data1, const std::string_view &data2) {
-    auto data_size = data1.size() + data2.size();
+  concat_and_insert(uint64_t insert_size, uint64_t slice_size, const std::vector<std::string_view> &segments) {
+    uint64_t data_size = 0;
+    for (auto &segment : segments) {
+      data_size += segment.size();
+    }
+
     auto pad = data_size % slice_size != 0;
     auto elements = data_size / slice_size + (pad ? 1 : 0);
 
     std::vector<uint8_t> result;
     result.resize(elements * insert_size + data_size);
 
-    auto next = std::begin(data1);
-    auto end = std::end(data1);
+    auto segment = std::begin(segments);
+    std::size_t segment_offset = 0;
     for (auto x = 0; x < elements; ++x) {
-      void *p = &result[x * (insert_size + slice_size)];
+      auto p = (char *) &result[x * (insert_size + slice_size)] + insert_size;
 
       // For the last iteration, only copy to the end of the data
-      if (x == elements - 1) {
-        slice_size = data_size - (x * slice_size);
-      }
+      auto remaining = x == elements - 1 ? data_size - (x * slice_size) : slice_size;
 
-      // Test if this slice will extend into the next buffer
-      if (next + slice_size > end) {
-        // Copy the first portion from the first buffer
-        auto copy_len = end - next;
-        std::copy(next, end, (char *) p + insert_size);
-
-        // Copy the remaining portion from the second buffer
-        next = std::begin(data2);
-        end = std::end(data2);
-        std::copy(next, next + (slice_size - copy_len), (char *) p + copy_len + insert_size);
-        next += slice_size - copy_len;
-      }
-      else {
-        std::copy(next, next + slice_size, (char *) p + insert_size);
-        next += slice_size;
+      // A slice may span several buffers
+      while (remaining > 0) {
+        while (segment_offset == segment->size()) {
+          ++segment;
+          segment_offset = 0;
+        }
+
+        auto copy_len = std::min<uint64_t>(remaining, segment->size() - segment_offset);
+        std::copy_n(segment->data() + segment_offset, copy_len, p);
+
+        p += copy_len;
+        segment_offset += copy_len;
+        remaining -= copy_len;
       }
     }
 
     return result;
   }
 
+  /**
+   * @brief Combines two buffers and inserts new buffers at each slice boundary of the result.
+   * @param insert_size The number of bytes to insert.
+   * @param slice_size The number of bytes between insertions.
+   * @param data1 The first data buffer.
+   * @param data2 The second data buffer.
+   */
   std::vector<uint8_t>
-  replace(const std::string_view &original, const std::string_view &old, const std::string_view &_new) {
-    std::vector<uint8_t> replaced;
-    replaced.reserve(original.size() + _new.size() - old.size());
-
-    auto begin = std::begin(original);
-    auto end = std::end(original);
-    auto next = std::search(begin, end, std::begin(old), std::end(old));
-
-    std::copy(begin, next, std::back_inserter(replaced));
-    if (next != end) {
-      std::copy(std::begin(_new), std::end(_new), std::back_inserter(replaced));
-      std::copy(next + old.size(), end, std::back_inserter(replaced));
+  concat_and_insert(uint64_t insert_size, uint64_t slice_size, const std::string_view &data1, const std::string_view &data2) {
+    return concat_and_insert(insert_size, slice_size, std::vector<std::string_view> { data1, data2 });
+  }
+
+  /**
+   * @brief Replace whole NAL units of an Annex B payload without copying the payload.
+   * @param payload The payload.
+   * @param replacements The NAL units to replace, each one at its first occurrence.
+   * @return The pieces of the payload with the new NAL units in between.
+   */
+  std::vector<std::string_view>
+  splice_replacements(const std::string_view &payload, const std::vector<video::packet_raw_t::replace_t> &replacements) {
+    std::vector<std::string_view> segments;
+    std::vector<bool> replaced(replacements.size());
+
+    std::size_t next = 0;
+    for (auto offset : video::find_nal_units((const uint8_t *) payload.data(), payload.size())) {
+      if (offset < next) {
+        continue;
+      }
+
+      for (std::size_t x = 0; x < replacements.size(); ++x) {
+        auto &replacement = replacements[x];
+        if (replaced[x] || !payload.substr(offset).starts_with(replacement.old)) {
+          continue;
+        }
+
+        segments.emplace_back(payload.substr(next, offset - next));
+        segments.emplace_back(replacement._new);
+        next = offset + replacement.old.size();
+        replaced[x] = true;
+        break;
+      }
     }
+    segments.emplace_back(payload.substr(next));
 
-    return replaced;
+    return segments;
   }
 
   /**
@@ -939,6 +995,8 @@ namespace stream {
 
       auto lastGoodFrame = stats[3];
 
+      session->video.pacer->on_loss(count, std::chrono::steady_clock::now());
+
       BOOST_LOG(verbose)
         << "type [IDX_LOSS_STATS]"sv << std::endl
         << "---begin stats---" << std::endl
@@ -990,6 +1048,7 @@ namespace stream {
         std::copy(payload.end() - 16, payload.end(), std::begin(iv));
       }
 
+      session->metrics.input_events->inc();
       input::passthrough(session->input, std::move(plaintext));
     });
 
@@ -1054,6 +1113,7 @@ namespace stream {
       // IDX_INPUT_DATA callback will attempt to decrypt unencrypted data, therefore we need pass it directly
       if (type == packetTypes[IDX_INPUT_DATA]) {
         plaintext.erase(std::begin(plaintext), std::begin(plaintext) + 4);
+        session->metrics.input_events->inc();
         input::passthrough(session->input, std::move(plaintext));
       }
       else {
@@ -1114,6 +1174,8 @@ namespace stream {
             has_session_awaiting_peer = true;
           }
           else {
+            session->video.pacer->on_rtt(std::chrono::milliseconds { session->control.peer->roundTripTime }, now);
+
             auto &feedback_queue = session->control.feedback_queue;
             while (feedback_queue->peek()) {
               auto feedback_msg = feedback_queue->pop();
@@ -1274,19 +1336,20 @@ namespace stream {
   }
 
   void
-  videoBroadcastThread(udp::socket &sock) {
+  videoBroadcastThread(udp::socket &sock, bool kernel_pacing) {
     auto shutdown_event = mail::man->event<bool>(mail::broadcast_shutdown);
     auto packets = mail::man->queue<video::packet_t>(mail::video_packets);
     auto timebase = boost::posix_time::microsec_clock::universal_time();
 
     // Video traffic is sent on this thread
     platf::adjust_thread_priority(platf::thread_priority_e::high);
+    tracing::set_thread_name("video_broadcast");
 
-    logging::min_max_avg_periodic_logger<double> frame_processing_latency_logger(debug, "Frame processing latency", "ms");
+    logging::percentile_periodic_logger<double> frame_processing_latency_logger(debug, "Frame processing latency", "ms");
 
-    logging::time_delta_periodic_logger frame_send_batch_latency_logger(debug, "Network: each send_batch() latency");
-    logging::time_delta_periodic_logger frame_fec_latency_logger(debug, "Network: each FEC block latency");
-    logging::time_delta_periodic_logger frame_network_latency_logger(debug, "Network: frame's overall network latency");
+    logging::time_delta_percentile_logger frame_send_batch_latency_logger(debug, "Network: each send_batch() latency");
+    logging::time_delta_percentile_logger frame_fec_latency_logger(debug, "Network: each FEC block latency");
+    logging::time_delta_percentile_logger frame_network_latency_logger(debug, "Network: frame's overall network latency");
 
     crypto::aes_t iv(12);
 
@@ -1296,41 +1359,61 @@ namespace stream {
       return;
     }
 
-    auto ratecontrol_next_frame_start = std::chrono::steady_clock::now();
+    auto queue_depth = metrics::gauge("sunshine_video_packet_queue_depth", "Encoded frames waiting to be sent");
+    auto queue_dropped = metrics::counter("sunshine_video_packet_queue_dropped_total", "Encoded frames discarded because the send queue was full");
+    std::uint64_t queue_dropped_seen = 0;
 
     while (auto packet = packets->pop()) {
       if (shutdown_event->peek()) {
         break;
       }
 
-      frame_network_latency_logger.first_point_now();
+      auto frame_network_start = std::chrono::steady_clock::now();
+      frame_network_latency_logger.first_point(frame_network_start);
+
+      queue_depth->set(packets->size());
+      if (auto dropped = packets->dropped(); dropped != queue_dropped_seen) {
+        queue_dropped->inc(dropped - queue_dropped_seen);
+        queue_dropped_seen = dropped;
+      }
 
       auto session = (session_t *) packet->channel_data;
       auto lowseq = session->video.lowseq;
+      auto frame_index = packet->frame_index();
+
+      session->metrics.video_frames->inc();
+      session->metrics.video_encoded_bytes->inc(packet->data_size());
+      if (packet->encode_duration) {
+        session->metrics.encode_latency->observe(*packet->encode_duration);
+      }
 
       std::string_view payload { (char *) packet->data(), packet->data_size() };
-      std::vector<uint8_t> payload_with_replacements;
+      std::vector<std::string_view> payload_segments { payload };
 
       // Apply replacements on the packet payload before performing any other operations.
       // We need to know the final frame size to calculate the last packet size, and we
       // must avoid matching replacements against the frame header or any other non-video
-      // part of the payload.
-      if (packet->is_idr() && packet->replacements) {
-        for (auto &replacement : *packet->replacements) {
-          auto frame_old = replacement.old;
-          auto frame_new = replacement._new;
-
-          payload_with_replacements = replace(payload, frame_old, frame_new);
-          payload = { (char *) payload_with_replacements.data(), payload_with_replacements.size() };
+      // part of the payload. The new NAL units are spliced in as separate segments, the
+      // payload is only copied once while inserting the packet headers.
+      std::size_t payload_size = payload.size();
+      if (packet->is_idr() && packet->replacements && !packet->replacements->empty()) {
+        tracing::span_t span { "replace", frame_index };
+        payload_segments = splice_replacements(payload, *packet->replacements);
+
+        payload_size = 0;
+        for (auto &segment : payload_segments) {
+          payload_size += segment.size();
         }
       }
 
+      auto packetize_start = std::chrono::steady_clock::now();
+
       video_short_frame_header_t frame_header = {};
       frame_header.headerType = 0x01;  // Short header type
       frame_header.frameType = packet->is_idr()                     ? 2 :
                                packet->after_ref_frame_invalidation ? 5 :
                                                                       1;
-      frame_header.lastPayloadLen = (payload.size() + sizeof(frame_header)) % (session->config.packetsize - sizeof(NV_VIDEO_PACKET));
+      frame_header.lastPayloadLen = (payload_size + sizeof(frame_header)) % (session->config.packetsize - sizeof(NV_VIDEO_PACKET));
       if (frame_header.lastPayloadLen == 0) {
         frame_header.lastPayloadLen = session->config.packetsize - sizeof(NV_VIDEO_PACKET);
       }
@@ -1344,6 +1427,7 @@ namespace stream {
         uint16_t latency = duration_to_latency(std::chrono::steady_clock::now() - *packet->frame_timestamp);
         frame_header.frame_processing_latency = latency;
         frame_processing_latency_logger.collect_and_log(latency / 10.);
+        session->metrics.frame_processing_latency->observe(latency / 10000.);
       }
       else {
         frame_header.frame_processing_latency = 0;
@@ -1354,8 +1438,8 @@ namespace stream {
       // Insert space for packet headers
       auto blocksize = session->config.packetsize + MAX_RTP_HEADER_SIZE;
       auto payload_blocksize = blocksize - sizeof(video_packet_raw_t);
-      auto payload_new = concat_and_insert(sizeof(video_packet_raw_t), payload_blocksize,
-        std::string_view { (char *) &frame_header, sizeof(frame_header) }, payload);
+      payload_segments.emplace(std::begin(payload_segments), (char *) &frame_header, sizeof(frame_header));
+      auto payload_new = concat_and_insert(sizeof(video_packet_raw_t), payload_blocksize, payload_segments);
 
       payload = std::string_view { (char *) payload_new.data(), payload_new.size() };
 
@@ -1379,6 +1463,7 @@ namespace stream {
       // For normal FEC percentages, this should only happen for enormous frames (over 800 packets at 20%).
       if (fec_blocks_needed > MAX_FEC_BLOCKS) {
         BOOST_LOG(warning) << "Skipping FEC for abnormally large encoded frame (needed "sv << fec_blocks_needed << " FEC blocks)"sv;
+        session->metrics.video_fec_skipped->inc();
         fecPercentage = 0;
         fec_blocks_needed = MAX_FEC_BLOCKS;
       }
@@ -1412,9 +1497,13 @@ namespace stream {
         }
       }
 
+      tracing::record("packetize", frame_index, packetize_start, std::chrono::steady_clock::now());
+
       try {
-        // Use around 80% of 1Gbps          1Gbps            percent    ms     packet      byte
-        size_t ratecontrol_packets_in_1ms = std::giga::num * 80 / 100 / 1000 / blocksize / 8;
+        // Pace the frame at the session's share of the link
+        auto &pacer = *session->video.pacer;
+        size_t ratecontrol_packets_in_1ms = pacer.packets_per_ms(blocksize);
+        session->metrics.video_pacing_rate->set(pacer.rate() / 1000);
 
         // Send less than 64K in a single batch.
         // On Windows, batches above 64K seem to bypass SO_SNDBUF regardless of its size,
@@ -1426,8 +1515,14 @@ namespace stream {
         // Generic Segmentation Offload on Linux can't do more than 64.
         send_batch_size = std::min<size_t>(64, send_batch_size);
 
+        // With kernel pacing, the packets are handed off without sleeping and depart on the same schedule.
+        // All packets of a GSO batch leave at once, so a batch can't hold more than 1ms worth of packets.
+        if (kernel_pacing) {
+          send_batch_size = std::min(send_batch_size, std::max<size_t>(1, ratecontrol_packets_in_1ms));
+        }
+
         // Don't ignore the last ratecontrol group of the previous frame
-        auto ratecontrol_frame_start = std::max(ratecontrol_next_frame_start, std::chrono::steady_clock::now());
+        auto ratecontrol_frame_start = std::max(pacer.next_frame_start, std::chrono::steady_clock::now());
 
         size_t ratecontrol_frame_packets_sent = 0;
         size_t ratecontrol_group_packets_sent = 0;
@@ -1455,11 +1550,19 @@ namespace stream {
             }
           }
 
-          frame_fec_latency_logger.first_point_now();
+          auto fec_start = std::chrono::steady_clock::now();
+          frame_fec_latency_logger.first_point(fec_start);
           // If video encryption is enabled, we allocate space for the encryption header before each shard
           auto shards = fec::encode(current_payload, blocksize, fecPercentage, session->config.minRequiredFecPackets,
             session->video.cipher ? sizeof(video_packet_enc_prefix_t) : 0);
-          frame_fec_latency_logger.second_point_now_and_log();
+          auto fec_end = std::chrono::steady_clock::now();
+          frame_fec_latency_logger.second_point_and_log(fec_end);
+          tracing::record("fec", frame_index, fec_start, fec_end);
+          session->metrics.fec_latency->observe(fec_end - fec_start);
+
+          session->metrics.video_packets->inc(shards.size());
+          session->metrics.video_fec_packets->inc(shards.size() - shards.data_shards);
+          session->metrics.video_sent_bytes->inc(shards.size() * (shards.prefixsize + shards.blocksize));
 
           auto peer_address = session->video.peer.address();
           auto batch_info = platf::batched_send_info_t {
@@ -1475,7 +1578,12 @@ namespace stream {
             session->localAddress,
           };
 
+          if (kernel_pacing) {
+            batch_info.departure_interval = std::chrono::nanoseconds(1ms) / ratecontrol_packets_in_1ms;
+          }
+
           size_t next_shard_to_send = 0;
+          tracing::clock::time_point encrypt_start;
 
           // set FEC info now that we know for sure what our percentage will be for this frame
           for (auto x = 0; x < shards.size(); ++x) {
@@ -1499,6 +1607,10 @@ namespace stream {
 
             // Encrypt this shard if video encryption is enabled
             if (session->video.cipher) {
+              if (x == next_shard_to_send && tracing::enabled()) {
+                encrypt_start = tracing::clock::now();
+              }
+
               // We use the deterministic IV construction algorithm specified in NIST SP 800-38D
               // Section 8.2.1. The sequence number is our "invocation" field and the 'V' in the
               // high bytes is the "fixed" field. Because each client provides their own unique
@@ -1521,11 +1633,22 @@ namespace stream {
 
             if (x - next_shard_to_send + 1 >= send_batch_size ||
                 x + 1 == shards.size()) {
+              if (encrypt_start != tracing::clock::time_point {}) {
+                tracing::record("encrypt", frame_index, encrypt_start, tracing::clock::now());
+                encrypt_start = {};
+              }
+
+              if (kernel_pacing) {
+                // The kernel holds back each packet until its departure time
+                batch_info.departure_time = ratecontrol_frame_start +
+                                            std::chrono::duration_cast<std::chrono::nanoseconds>(1ms) *
+                                              ratecontrol_frame_packets_sent / ratecontrol_packets_in_1ms;
+              }
               // Do pacing within the frame.
               // Also trigger pacing before the first send_batch() of the frame
               // to account for the last send_batch() of the previous frame.
-              if (ratecontrol_group_packets_sent >= ratecontrol_packets_in_1ms ||
-                  ratecontrol_frame_packets_sent == 0) {
+              else if (ratecontrol_group_packets_sent >= ratecontrol_packets_in_1ms ||
+                       ratecontrol_frame_packets_sent == 0) {
                 auto due = ratecontrol_frame_start +
                            std::chrono::duration_cast<std::chrono::nanoseconds>(1ms) *
                              ratecontrol_frame_packets_sent / ratecontrol_packets_in_1ms;
@@ -1533,6 +1656,7 @@ namespace stream {
                 auto now = std::chrono::steady_clock::now();
                 if (now < due) {
                   timer->sleep_for(due - now);
+                  tracing::record("pacing_sleep", frame_index, now, std::chrono::steady_clock::now());
                 }
 
                 ratecontrol_group_packets_sent = 0;
@@ -1542,7 +1666,8 @@ namespace stream {
               batch_info.block_offset = next_shard_to_send;
               batch_info.block_count = current_batch_size;
 
-              frame_send_batch_latency_logger.first_point_now();
+              auto send_batch_start = std::chrono::steady_clock::now();
+              frame_send_batch_latency_logger.first_point(send_batch_start);
               // Use a batched send if it's supported on this platform
               if (!platf::send_batch(batch_info)) {
                 // Batched send is not available, so send each packet individually
@@ -1562,7 +1687,10 @@ namespace stream {
                   platf::send(send_info);
                 }
               }
-              frame_send_batch_latency_logger.second_point_now_and_log();
+              auto send_batch_end = std::chrono::steady_clock::now();
+              frame_send_batch_latency_logger.second_point_and_log(send_batch_end);
+              session->metrics.send_batch_latency->observe(send_batch_end - send_batch_start);
+              tracing::record("send_batch", frame_index, send_batch_start, send_batch_end);
 
               ratecontrol_group_packets_sent += current_batch_size;
               ratecontrol_frame_packets_sent += current_batch_size;
@@ -1571,11 +1699,13 @@ namespace stream {
           }
 
           // remember this in case the next frame comes immediately
-          ratecontrol_next_frame_start = ratecontrol_frame_start +
-                                         std::chrono::duration_cast<std::chrono::nanoseconds>(1ms) *
-                                           ratecontrol_frame_packets_sent / ratecontrol_packets_in_1ms;
+          pacer.next_frame_start = ratecontrol_frame_start +
+                                   std::chrono::duration_cast<std::chrono::nanoseconds>(1ms) *
+                                     ratecontrol_frame_packets_sent / ratecontrol_packets_in_1ms;
 
-          frame_network_latency_logger.second_point_now_and_log();
+          auto frame_network_end = std::chrono::steady_clock::now();
+          frame_network_latency_logger.second_point_and_log(frame_network_end);
+          session->metrics.network_latency->observe(frame_network_end - frame_network_start);
 
           if (packet->is_idr()) {
             BOOST_LOG(verbose) << "Key Frame ["sv << packet->frame_index() << "] :: send ["sv << shards.size() << "] shards..."sv;
@@ -1589,6 +1719,7 @@ namespace stream {
         });
 
         session->video.lowseq = lowseq;
+        tracing::record("send_frame", frame_index, frame_network_start, std::chrono::steady_clock::now());
       }
       catch (const std::exception &e) {
         BOOST_LOG(error) << "Broadcast video failed "sv << e.what();
@@ -1620,6 +1751,8 @@ namespace stream {
     audio_packet.rtp.packetType = 97;
     audio_packet.rtp.ssrc = 0;
 
+    auto queue_depth = metrics::gauge("sunshine_audio_packet_queue_depth", "Encoded audio packets waiting to be sent");
+
     // Audio traffic is sent on this thread
     platf::adjust_thread_priority(platf::thread_priority_e::high);
 
@@ -1628,6 +1761,8 @@ namespace stream {
         break;
       }
 
+      queue_depth->set(packets->size());
+
       TUPLE_2D_REF(channel_data, packet_data, *packet);
       auto session = (session_t *) channel_data;
 
@@ -1664,6 +1799,7 @@ namespace stream {
           session->localAddress,
         };
         platf::send(send_info);
+        session->metrics.audio_packets->inc();
         BOOST_LOG(verbose) << "Audio ["sv << sequenceNumber << "] ::  send..."sv;
 
         auto &fec_packet = session->audio.fec_packet;
@@ -1692,6 +1828,7 @@ namespace stream {
               session->localAddress,
             };
             platf::send(send_info);
+            session->metrics.audio_packets->inc();
             BOOST_LOG(verbose) << "Audio FEC ["sv << (sequenceNumber & ~(RTPA_DATA_SHARDS - 1)) << ' ' << x << "] ::  send..."sv;
           }
         }
@@ -1742,6 +1879,21 @@ namespace stream {
       return -1;
     }
 
+    // Use around 80% of the link for video, the rest is left for audio, control and other traffic
+    video_link_budget.set_budget((std::int64_t) config::stream.pacing_link_capacity * std::mega::num * 80 / 100);
+
+    // Let the kernel pace the video stream if it was opted into and the qdiscs honor departure times
+    auto kernel_pacing = false;
+    if (config::stream.kernel_pacing) {
+      kernel_pacing = platf::enable_socket_pacing(ctx.video_sock.native_handle());
+      if (kernel_pacing) {
+        BOOST_LOG(info) << "kernel_pacing is enabled, video packets are paced by the kernel"sv;
+      }
+      else {
+        BOOST_LOG(warning) << "kernel_pacing is enabled, but departure times are not honored. Falling back to pacing video packets in userspace"sv;
+      }
+    }
+
     ctx.audio_sock.open(protocol, ec);
     if (ec) {
       BOOST_LOG(fatal) << "Couldn't open socket for Audio server: "sv << ec.message();
@@ -1758,7 +1910,7 @@ namespace stream {
 
     ctx.message_queue_queue = std::make_shared<message_queue_queue_t::element_type>(30);
 
-    ctx.video_thread = std::thread { videoBroadcastThread, std::ref(ctx.video_sock) };
+    ctx.video_thread = std::thread { videoBroadcastThread, std::ref(ctx.video_sock), kernel_pacing };
     ctx.audio_thread = std::thread { audioBroadcastThread, std::ref(ctx.audio_sock) };
     ctx.control_thread = std::thread { controlBroadcastThread, &ctx.control_server };
 
@@ -1878,7 +2030,7 @@ namespace stream {
       session->video.peer.port(), platf::qos_data_type_e::video, session->config.videoQosType != 0);
 
     BOOST_LOG(debug) << "Start capturing Video"sv;
-    video::capture(session->mail, session->config.monitor, session);
+    video::capture(session->mail, session->config.monitor, session, { { "session", std::to_string(session->launch_session_id) } });
   }
 
   void
@@ -1950,6 +2102,8 @@ namespace stream {
       BOOST_LOG(debug) << "Resetting Input..."sv;
       input::reset(session.input);
 
+      metrics::remove({ { "session", std::to_string(session.launch_session_id) } });
+
       // If this is the last session, invoke the platform callbacks
       if (--running_sessions == 0) {
 #if defined SUNSHINE_TRAY && SUNSHINE_TRAY >= 1
@@ -2079,6 +2233,27 @@ namespace stream {
       session->audio.sequenceNumber = 0;
       session->audio.timestamp = 0;
 
+      metrics::labels_t labels { { "session", std::to_string(launch_session.id) } };
+      auto &m = session->metrics;
+      m.video_frames = metrics::counter("sunshine_video_frames_total", "Encoded video frames sent", labels);
+      m.video_encoded_bytes = metrics::counter("sunshine_video_encoded_bytes_total", "Encoded video bytes before FEC and packetization", labels);
+      m.video_sent_bytes = metrics::counter("sunshine_video_sent_bytes_total", "Video bytes sent including headers and FEC", labels);
+      m.video_packets = metrics::counter("sunshine_video_packets_sent_total", "Video packets sent including FEC", labels);
+      m.video_fec_packets = metrics::counter("sunshine_video_fec_packets_sent_total", "Video FEC parity packets sent", labels);
+      m.video_fec_skipped = metrics::counter("sunshine_video_fec_skipped_total", "Video frames sent without FEC because they were too large", labels);
+      m.video_bitrate = metrics::gauge("sunshine_video_requested_bitrate_kbps", "Video bitrate requested by the client", labels);
+      m.video_pacing_rate = metrics::gauge("sunshine_video_pacing_rate_kbps", "Rate the packets of each video frame are sent at", labels);
+      m.encode_latency = metrics::histogram("sunshine_video_encode_seconds", "Time spent encoding a frame", metrics::latency_buckets, labels);
+      m.frame_processing_latency = metrics::histogram("sunshine_video_frame_processing_seconds", "Time from capture to the start of packetization", metrics::latency_buckets, labels);
+      m.fec_latency = metrics::histogram("sunshine_video_fec_seconds", "Time spent generating FEC for a block", metrics::latency_buckets, labels);
+      m.send_batch_latency = metrics::histogram("sunshine_video_send_batch_seconds", "Time spent in each send_batch() call", metrics::latency_buckets, labels);
+      m.network_latency = metrics::histogram("sunshine_video_network_seconds", "Time from dequeuing a frame to sending its last packet", metrics::latency_buckets, labels);
+      m.audio_packets = metrics::counter("sunshine_audio_packets_sent_total", "Audio packets sent including FEC", labels);
+      m.input_events = metrics::counter("sunshine_input_events_total", "Input packets received from the client", labels);
+      m.video_bitrate->set(config.monitor.bitrate);
+
+      session->video.pacer = std::make_unique<pacing::policy_t>(video_link_budget, config.monitor.bitrate, config::stream.pacing_burst);
+
       session->control.peer = nullptr;
       session->state.store(state_e::STOPPED, std::memory_order_relaxed);
 
@@ -275,6 +275,7 @@ namespace safe {
       }
 
       if (_queue.size() == _max_elements) {
+        _dropped += _queue.size();
         _queue.clear();
       }
 
@@ -336,6 +337,23 @@ namespace safe {
       return _queue;
     }
 
+    std::size_t
+    size() {
+      std::lock_guard lg { _lock };
+
+      return _queue.size();
+    }
+
+    /**
+     * @return The number of elements discarded because the queue was full.
+     */
+    std::uint64_t
+    dropped() {
+      std::lock_guard lg { _lock };
+
+      return _dropped;
+    }
+
     void
     stop() {
       std::lock_guard lg { _lock };
@@ -353,6 +371,7 @@ namespace safe {
   private:
     bool _continue { true };
     std::uint32_t _max_elements;
+    std::uint64_t _dropped { 0 };
 
     std::mutex _lock;
     std::condition_variable _cv;
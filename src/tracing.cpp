@@ -0,0 +1,185 @@
+/**
+ * @file src/tracing.cpp
+ * @brief Definitions for the per-frame pipeline trace recorder.
+ */
+// standard includes
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+// local includes
+#include "logging.h"
+#include "tracing.h"
+
+using namespace std::literals;
+
+namespace tracing {
+  namespace detail {
+    std::atomic<bool> active = false;
+  }  // namespace detail
+
+  namespace {
+    // Enough for a minute of 120 fps with a dozen spans per frame
+    constexpr std::size_t BUFFER_CAPACITY = 1 << 17;
+
+    struct event_t {
+      const char *name;
+      std::int64_t frame;
+      clock::time_point begin;
+      clock::time_point end;
+    };
+
+    /**
+     * @brief The events of a single thread.
+     * Only the owning thread writes events, it publishes them by storing `size` with release semantics.
+     */
+    struct buffer_t {
+      std::uint64_t tid;
+      std::atomic<const char *> name = nullptr;
+      std::atomic<std::uint64_t> generation = 0;
+      std::atomic<std::size_t> size = 0;
+      std::unique_ptr<event_t[]> events = std::make_unique<event_t[]>(BUFFER_CAPACITY);
+    };
+
+    std::mutex registry_mutex;
+    std::vector<std::shared_ptr<buffer_t>> buffers;
+    std::uint64_t next_tid = 1;
+
+    std::atomic<std::uint64_t> generation = 0;
+    std::atomic<clock::rep> start_time = 0;
+    std::atomic<clock::rep> deadline = 0;
+    std::atomic<std::uint64_t> dropped = 0;
+
+    thread_local const char *thread_name = nullptr;
+    thread_local std::shared_ptr<buffer_t> thread_buffer;
+
+    buffer_t &
+    get_thread_buffer() {
+      if (!thread_buffer) {
+        thread_buffer = std::make_shared<buffer_t>();
+        thread_buffer->name = thread_name;
+
+        std::lock_guard lg { registry_mutex };
+        thread_buffer->tid = next_tid++;
+        buffers.emplace_back(thread_buffer);
+      }
+
+      return *thread_buffer;
+    }
+  }  // namespace
+
+  void
+  start(std::chrono::milliseconds duration) {
+    std::lock_guard lg { registry_mutex };
+
+    // Buffers of threads that have exited are only referenced by the registry
+    std::erase_if(buffers, [](const auto &buffer) {
+      return buffer.use_count() == 1;
+    });
+
+    auto now = clock::now();
+    start_time = now.time_since_epoch().count();
+    deadline = (now + duration).time_since_epoch().count();
+    dropped = 0;
+    generation.fetch_add(1, std::memory_order_release);
+    detail::active.store(true, std::memory_order_release);
+
+    BOOST_LOG(info) << "Recording a pipeline trace for "sv << duration.count() << "ms"sv;
+  }
+
+  void
+  stop() {
+    detail::active.store(false, std::memory_order_relaxed);
+  }
+
+  void
+  set_thread_name(const char *name) {
+    thread_name = name;
+    if (thread_buffer) {
+      thread_buffer->name = name;
+    }
+  }
+
+  void
+  record(const char *name, std::int64_t frame, clock::time_point begin, clock::time_point end) {
+    if (!enabled()) {
+      return;
+    }
+
+    if (end.time_since_epoch().count() > deadline.load(std::memory_order_relaxed)) {
+      stop();
+      return;
+    }
+
+    auto &buffer = get_thread_buffer();
+
+    // Lazily discard the events of the previous trace
+    auto current = generation.load(std::memory_order_acquire);
+    if (buffer.generation.load(std::memory_order_relaxed) != current) {
+      buffer.size.store(0, std::memory_order_relaxed);
+      buffer.generation.store(current, std::memory_order_release);
+    }
+
+    auto size = buffer.size.load(std::memory_order_relaxed);
+    if (size >= BUFFER_CAPACITY) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    buffer.events[size] = event_t { name, frame, begin, end };
+    buffer.size.store(size + 1, std::memory_order_release);
+  }
+
+  std::string
+  dump() {
+    std::ostringstream os;
+    os.imbue(std::locale::classic());
+    os << std::fixed << std::setprecision(3);
+
+    auto origin = clock::time_point { clock::duration { start_time.load() } };
+    auto to_us = [](clock::duration duration) {
+      return std::chrono::duration<double, std::micro>(duration).count();
+    };
+
+    std::lock_guard lg { registry_mutex };
+    auto current = generation.load(std::memory_order_acquire);
+
+    os << R"({"displayTimeUnit":"ms","otherData":{"dropped_events":)" << dropped.load() << R"(},"traceEvents":[)";
+
+    bool first = true;
+    for (auto &buffer : buffers) {
+      if (buffer->generation.load(std::memory_order_acquire) != current) {
+        continue;
+      }
+
+      if (auto name = buffer->name.load()) {
+        os << (first ? "" : ",")
+           << R"({"name":"thread_name","ph":"M","pid":1,"tid":)" << buffer->tid
+           << R"(,"args":{"name":")" << name << R"("}})";
+        first = false;
+      }
+
+      auto size = buffer->size.load(std::memory_order_acquire);
+      for (std::size_t x = 0; x < size; ++x) {
+        auto &event = buffer->events[x];
+
+        os << (first ? "" : ",")
+           << R"({"name":")" << event.name
+           << R"(","cat":"video","ph":"X","pid":1,"tid":)" << buffer->tid
+           << R"(,"ts":)" << to_us(event.begin - origin)
+           << R"(,"dur":)" << to_us(event.end - event.begin);
+        if (event.frame != NO_FRAME) {
+          os << R"(,"args":{"frame":)" << event.frame << '}';
+        }
+        os << '}';
+        first = false;
+      }
+    }
+
+    os << "]}";
+
+    return os.str();
+  }
+}  // namespace tracing
@@ -0,0 +1,111 @@
+/**
+ * @file src/tracing.h
+ * @brief Declarations for the per-frame pipeline trace recorder.
+ */
+#pragma once
+
+// standard includes
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Records timestamped spans of the streaming pipeline and exports them as Chrome trace JSON.
+ * @details Tracing is off by default and is enabled at runtime for a limited time.
+ *          While disabled, recording a span costs a single relaxed atomic load.
+ *          Each thread records into its own fixed size buffer, so the hot path never takes a lock.
+ *          The resulting JSON can be loaded in `chrome://tracing` or https://ui.perfetto.dev.
+ */
+namespace tracing {
+  using clock = std::chrono::steady_clock;
+
+  /**
+   * @brief Spans that are not tied to a frame use this frame index.
+   */
+  constexpr std::int64_t NO_FRAME = -1;
+
+  namespace detail {
+    extern std::atomic<bool> active;
+  }  // namespace detail
+
+  /**
+   * @brief Check if a trace is being recorded.
+   * @return `true` if spans are currently recorded.
+   */
+  inline bool
+  enabled() {
+    return detail::active.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Start recording a new trace, discarding the previous one.
+   * @param duration How long to record for.
+   */
+  void
+  start(std::chrono::milliseconds duration);
+
+  /**
+   * @brief Stop recording before the requested duration has elapsed.
+   */
+  void
+  stop();
+
+  /**
+   * @brief Name the calling thread in the trace output.
+   * @param name The thread name, must be a string literal.
+   */
+  void
+  set_thread_name(const char *name);
+
+  /**
+   * @brief Record a span on the calling thread.
+   * @param name The name of the pipeline stage, must be a string literal.
+   * @param frame The frame index the span belongs to, or `NO_FRAME`.
+   * @param begin The start of the span.
+   * @param end The end of the span.
+   */
+  void
+  record(const char *name, std::int64_t frame, clock::time_point begin, clock::time_point end);
+
+  /**
+   * @brief Serialize the last trace in the Chrome trace event format.
+   * @return The trace as JSON.
+   */
+  std::string
+  dump();
+
+  /**
+   * @brief Records a span from its construction until it goes out of scope.
+   * @examples
+   * {
+   *   tracing::span_t span { "convert", frame_nr };
+   *   session->convert(*img);
+   * }
+   * @examples_end
+   */
+  class span_t {
+  public:
+    span_t(const char *name, std::int64_t frame):
+        name { name }, frame { frame } {
+      if (enabled()) {
+        begin = clock::now();
+      }
+    }
+
+    ~span_t() {
+      if (begin != clock::time_point {}) {
+        record(name, frame, begin, clock::now());
+      }
+    }
+
+    span_t(const span_t &) = delete;
+    span_t &
+    operator=(const span_t &) = delete;
+
+  private:
+    const char *name;
+    std::int64_t frame;
+    clock::time_point begin;
+  };
+}  // namespace tracing
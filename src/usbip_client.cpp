@@ -6,9 +6,15 @@
 #include "usbip_client.h"
 #include "logging.h"
 
+#include <boost/asio.hpp>
+
+#include <algorithm>
+#include <array>
 #include <cstring>
 #include <iostream>
+#include <map>
 #include <sstream>
+#include <thread>
 
 #ifdef _WIN32
   #include <winsock2.h>
@@ -26,10 +32,480 @@
 #endif
 
 namespace usbip_client {
+  namespace asio = boost::asio;
+  using asio::ip::tcp;
 
   // Global manager instance
   static std::shared_ptr<usbip_manager_t> global_manager;
 
+  // Time between two refreshes of the cached device lists
+  constexpr auto devlist_ttl = std::chrono::seconds(5);
+
+  // Time each server has to answer a device list request
+  constexpr auto devlist_timeout = std::chrono::seconds(2);
+
+  namespace {
+    // Sizes of the frames of an OP_REP_DEVLIST reply
+    constexpr std::size_t devlist_header_size = 12;
+    constexpr std::size_t device_size = 312;
+    constexpr std::size_t interface_size = 4;
+
+    // Upper bound on the device count announced by a server, to bound the memory a bogus reply can claim
+    constexpr std::uint32_t max_devices = 1024;
+
+    constexpr std::array<std::uint8_t, 8> devlist_request {
+      USBIP_VERSION >> 8, USBIP_VERSION & 0xFF,
+      OP_REQ_DEVLIST >> 8, OP_REQ_DEVLIST & 0xFF,
+      0, 0, 0, 0
+    };
+
+    std::uint16_t
+    read_u16(const std::uint8_t *data) {
+      return (std::uint16_t) ((data[0] << 8) | data[1]);
+    }
+
+    std::uint32_t
+    read_u32(const std::uint8_t *data) {
+      return ((std::uint32_t) data[0] << 24) | ((std::uint32_t) data[1] << 16) | ((std::uint32_t) data[2] << 8) | data[3];
+    }
+
+    std::string
+    read_string(const std::uint8_t *data, std::size_t max_len) {
+      auto str = (const char *) data;
+      return std::string(str, strnlen(str, max_len));
+    }
+
+    /**
+     * @brief Receive exactly len bytes, however the stream splits them up
+     */
+    bool
+    recv_exact(int socket_fd, void *buffer, std::size_t len) {
+      auto data = (char *) buffer;
+      while (len > 0) {
+        int received = recv(socket_fd, data, (int) len, 0);
+        if (received <= 0) {
+          return false;
+        }
+
+        data += received;
+        len -= received;
+      }
+
+      return true;
+    }
+  }  // namespace
+
+  devlist_parser_t::devlist_parser_t() {
+    reset();
+  }
+
+  void
+  devlist_parser_t::reset() {
+    state_ = HEADER;
+    status_ = INCOMPLETE;
+    frame_.clear();
+    need_ = devlist_header_size;
+    remaining_devices_ = 0;
+    devices_.clear();
+  }
+
+  std::size_t
+  devlist_parser_t::feed(const std::uint8_t *data, std::size_t len) {
+    std::size_t consumed = 0;
+
+    while (status_ == INCOMPLETE && consumed < len) {
+      auto count = std::min(need_ - frame_.size(), len - consumed);
+      frame_.insert(frame_.end(), data + consumed, data + consumed + count);
+      consumed += count;
+
+      if (frame_.size() == need_) {
+        parse_frame();
+        frame_.clear();
+      }
+    }
+
+    return consumed;
+  }
+
+  void
+  devlist_parser_t::parse_frame() {
+    auto data = frame_.data();
+
+    switch (state_) {
+      case HEADER: {
+        auto command = read_u16(data + 2);
+        auto status = read_u32(data + 4);
+        remaining_devices_ = read_u32(data + 8);
+
+        if (command != OP_REP_DEVLIST || status != 0 || remaining_devices_ > max_devices) {
+          status_ = FAILED;
+          return;
+        }
+
+        devices_.reserve(remaining_devices_);
+        break;
+      }
+      case DEVICE: {
+        usb_device_info_t device;
+        device.path = read_string(data, 256);
+        device.busid = read_string(data + 256, 32);
+        device.busnum = read_u32(data + 288);
+        device.devnum = read_u32(data + 292);
+        device.speed = read_u32(data + 296);
+        device.idVendor = read_u16(data + 300);
+        device.idProduct = read_u16(data + 302);
+        device.bcdDevice = read_u16(data + 304);
+        device.bDeviceClass = data[306];
+        device.bDeviceSubClass = data[307];
+        device.bDeviceProtocol = data[308];
+        device.bConfigurationValue = data[309];
+        device.bNumConfigurations = data[310];
+        device.bNumInterfaces = data[311];
+        devices_.emplace_back(std::move(device));
+
+        // The interface descriptors follow the device, they aren't needed but must be skipped
+        if (devices_.back().bNumInterfaces > 0) {
+          state_ = INTERFACES;
+          need_ = devices_.back().bNumInterfaces * interface_size;
+          return;
+        }
+        break;
+      }
+      case INTERFACES:
+        break;
+    }
+
+    if (remaining_devices_ == 0) {
+      status_ = DONE;
+      return;
+    }
+
+    --remaining_devices_;
+    state_ = DEVICE;
+    need_ = device_size;
+  }
+
+  /**
+   * @brief One USB/IP server, queried over a connection that is kept open between queries
+   */
+  class devlist_connection_t: public std::enable_shared_from_this<devlist_connection_t> {
+  public:
+    using done_fn = std::function<void(const std::string &error, std::vector<usb_device_info_t> &devices)>;
+
+    devlist_connection_t(asio::io_context &io, std::string host, int port):
+        resolver { io }, sock { io }, deadline { io }, host { std::move(host) }, port { port } {}
+
+    /**
+     * @brief Ask the server for its devices
+     * @param timeout Time the server has to answer
+     * @param done Called on the I/O thread with an empty error on success
+     */
+    void
+    query(std::chrono::milliseconds timeout, done_fn done) {
+      this->done = std::move(done);
+      parser.reset();
+      timed_out = false;
+      retried = false;
+      reused = sock.is_open();
+
+      deadline.expires_after(timeout);
+      deadline.async_wait([self = shared_from_this()](const boost::system::error_code &ec) {
+        if (!ec) {
+          self->timed_out = true;
+          self->close();
+        }
+      });
+
+      if (reused) {
+        send();
+      }
+      else {
+        connect();
+      }
+    }
+
+    void
+    close() {
+      boost::system::error_code ec;
+      resolver.cancel();
+      sock.close(ec);
+    }
+
+  private:
+    void
+    connect() {
+      resolver.async_resolve(host, std::to_string(port), [self = shared_from_this()](const boost::system::error_code &ec, tcp::resolver::results_type results) {
+        if (ec) {
+          return self->fail(ec);
+        }
+
+        asio::async_connect(self->sock, results, [self](const boost::system::error_code &ec, const tcp::endpoint &) {
+          if (ec) {
+            return self->fail(ec);
+          }
+
+          boost::system::error_code ignored;
+          self->sock.set_option(tcp::no_delay { true }, ignored);
+          self->send();
+        });
+      });
+    }
+
+    void
+    send() {
+      asio::async_write(sock, asio::buffer(devlist_request), [self = shared_from_this()](const boost::system::error_code &ec, std::size_t) {
+        if (ec) {
+          return self->fail(ec);
+        }
+
+        self->receive();
+      });
+    }
+
+    void
+    receive() {
+      sock.async_read_some(asio::buffer(buffer), [self = shared_from_this()](const boost::system::error_code &ec, std::size_t bytes) {
+        if (ec) {
+          return self->fail(ec);
+        }
+
+        self->parser.feed(self->buffer.data(), bytes);
+        switch (self->parser.status()) {
+          case devlist_parser_t::INCOMPLETE:
+            return self->receive();
+          case devlist_parser_t::DONE:
+            return self->finish({});
+          case devlist_parser_t::FAILED:
+            self->close();
+            return self->finish("invalid reply");
+        }
+      });
+    }
+
+    void
+    fail(const boost::system::error_code &ec) {
+      // usbipd closes the connection after each reply, so a reused connection may turn out to be dead
+      // only now. Reconnect once as long as nothing of the reply has arrived yet.
+      auto nothing_received = parser.status() == devlist_parser_t::INCOMPLETE && parser.devices().empty();
+      if (reused && !retried && !timed_out && nothing_received) {
+        retried = true;
+        reused = false;
+        parser.reset();
+        close();
+        connect();
+        return;
+      }
+
+      close();
+      finish(timed_out ? "timed out" : ec.message());
+    }
+
+    void
+    finish(const std::string &error) {
+      deadline.cancel();
+
+      auto done = std::move(this->done);
+      this->done = nullptr;
+      if (done) {
+        done(error, parser.devices());
+      }
+    }
+
+    tcp::resolver resolver;
+    tcp::socket sock;
+    asio::steady_timer deadline;
+
+    std::string host;
+    int port;
+
+    devlist_parser_t parser;
+    std::array<std::uint8_t, 4096> buffer;
+
+    done_fn done;
+    bool reused = false;
+    bool retried = false;
+    bool timed_out = false;
+  };
+
+  class devlist_cache_t::impl {
+  public:
+    impl(targets_fn targets, std::chrono::milliseconds ttl, std::chrono::milliseconds timeout):
+        targets { std::move(targets) },
+        ttl { ttl },
+        timeout { timeout },
+        timer { io },
+        work { asio::make_work_guard(io) } {
+      asio::post(io, [this]() { start_round(); });
+      thread = std::thread([this]() { io.run(); });
+    }
+
+    ~impl() {
+      io.stop();
+      if (thread.joinable()) {
+        thread.join();
+      }
+    }
+
+    void
+    refresh() {
+      asio::post(io, [this]() {
+        if (round_active) {
+          refresh_requested = true;
+          return;
+        }
+
+        start_round();
+      });
+    }
+
+    std::vector<devlist_entry_t>
+    get() const {
+      std::lock_guard<std::mutex> lock(entries_mutex);
+      return entries;
+    }
+
+  private:
+    struct round_t {
+      std::vector<devlist_entry_t> entries;
+      std::size_t pending = 0;
+    };
+
+    static std::string
+    key_of(const devlist_target_t &target) {
+      return target.host + ':' + std::to_string(target.port);
+    }
+
+    void
+    start_round() {
+      timer.cancel();
+      round_active = true;
+      refresh_requested = false;
+
+      auto round = std::make_shared<round_t>();
+
+      // Several targets may share a server, it is asked only once per round
+      std::map<std::string, std::vector<std::size_t>> groups;
+      for (auto &target : targets()) {
+        groups[key_of(target)].emplace_back(round->entries.size());
+        round->entries.emplace_back().target = std::move(target);
+      }
+
+      // Keep the connections to servers that are still targets, close the others
+      std::map<std::string, std::shared_ptr<devlist_connection_t>> active;
+      for (auto &[key, indices] : groups) {
+        auto it = connections.find(key);
+        if (it != connections.end()) {
+          active.emplace(key, std::move(it->second));
+          connections.erase(it);
+        }
+        else {
+          auto &target = round->entries[indices.front()].target;
+          active.emplace(key, std::make_shared<devlist_connection_t>(io, target.host, target.port));
+        }
+      }
+      for (auto &[key, conn] : connections) {
+        conn->close();
+      }
+      connections = std::move(active);
+
+      round->pending = groups.size();
+      if (round->pending == 0) {
+        finish_round(*round);
+        return;
+      }
+
+      for (auto &[key, indices] : groups) {
+        connections[key]->query(timeout, [this, round, indices = indices](const std::string &error, std::vector<usb_device_info_t> &devices) {
+          auto now = std::chrono::steady_clock::now();
+
+          for (auto index : indices) {
+            auto &entry = round->entries[index];
+            if (error.empty()) {
+              entry.devices = devices;
+              entry.updated = now;
+            }
+            else {
+              BOOST_LOG(debug) << "USB/IP device list of " << entry.target.id << " failed: " << error;
+
+              // Keep serving what the server reported last
+              entry.error = error;
+              keep_previous(entry);
+            }
+          }
+
+          if (--round->pending == 0) {
+            finish_round(*round);
+          }
+        });
+      }
+    }
+
+    void
+    keep_previous(devlist_entry_t &entry) {
+      std::lock_guard<std::mutex> lock(entries_mutex);
+      for (auto &previous : entries) {
+        if (previous.target.id == entry.target.id) {
+          entry.devices = previous.devices;
+          entry.updated = previous.updated;
+          return;
+        }
+      }
+    }
+
+    void
+    finish_round(round_t &round) {
+      {
+        std::lock_guard<std::mutex> lock(entries_mutex);
+        entries = std::move(round.entries);
+      }
+
+      round_active = false;
+      if (refresh_requested) {
+        start_round();
+        return;
+      }
+
+      timer.expires_after(ttl);
+      timer.async_wait([this](const boost::system::error_code &ec) {
+        if (!ec) {
+          start_round();
+        }
+      });
+    }
+
+    targets_fn targets;
+    std::chrono::milliseconds ttl;
+    std::chrono::milliseconds timeout;
+
+    asio::io_context io;
+    asio::steady_timer timer;
+    asio::executor_work_guard<asio::io_context::executor_type> work;
+    std::thread thread;
+
+    // Only touched on the I/O thread
+    std::map<std::string, std::shared_ptr<devlist_connection_t>> connections;
+    bool round_active = false;
+    bool refresh_requested = false;
+
+    mutable std::mutex entries_mutex;
+    std::vector<devlist_entry_t> entries;
+  };
+
+  devlist_cache_t::devlist_cache_t(targets_fn targets, std::chrono::milliseconds ttl, std::chrono::milliseconds timeout):
+      pimpl(std::make_unique<impl>(std::move(targets), ttl, timeout)) {}
+
+  devlist_cache_t::~devlist_cache_t() = default;
+
+  std::vector<devlist_entry_t>
+  devlist_cache_t::get() const {
+    return pimpl->get();
+  }
+
+  void
+  devlist_cache_t::refresh() {
+    pimpl->refresh();
+  }
+
   class usbip_client_t::impl {
   public:
     impl() {}
@@ -223,95 +699,31 @@ namespace usbip_client {
 
   bool
   usbip_client_t::recv_op_rep_devlist(std::vector<usb_device_info_t> &devices) {
-    // USB/IP OP_REP_DEVLIST packet structure
-    struct {
-      uint16_t version;
-      uint16_t command;
-      uint32_t status;
-      uint32_t num_devices;
-    } __attribute__((packed)) reply;
-
-    int received = recv(socket_fd_, (char *) &reply, sizeof(reply), 0);
-    if (received != sizeof(reply)) {
-      BOOST_LOG(error) << "Failed to receive OP_REP_DEVLIST header";
-      return false;
-    }
-
-    reply.version = ntohs(reply.version);
-    reply.command = ntohs(reply.command);
-    reply.status = ntohl(reply.status);
-    reply.num_devices = ntohl(reply.num_devices);
+    devlist_parser_t parser;
+    std::array<std::uint8_t, 4096> buffer;
+
+    // The reply arrives in as many pieces as the stream likes, the parser reassembles them
+    while (parser.status() == devlist_parser_t::INCOMPLETE) {
+      int received = recv(socket_fd_, (char *) buffer.data(), buffer.size(), 0);
+      if (received <= 0) {
+        BOOST_LOG(error) << "Connection closed while receiving OP_REP_DEVLIST";
+        return false;
+      }
 
-    if (reply.command != OP_REP_DEVLIST) {
-      BOOST_LOG(error) << "Invalid reply command: " << reply.command;
-      return false;
+      parser.feed(buffer.data(), received);
     }
 
-    if (reply.status != 0) {
-      BOOST_LOG(error) << "Device list request failed with status: " << reply.status;
+    if (parser.status() == devlist_parser_t::FAILED) {
+      BOOST_LOG(error) << "Invalid or failed OP_REP_DEVLIST reply";
       return false;
     }
 
-    BOOST_LOG(info) << "USB/IP server reports " << reply.num_devices << " devices";
-
-    // For each device, receive device info
-    for (uint32_t i = 0; i < reply.num_devices; ++i) {
-      // USB/IP device info structure
-      struct {
-        char path[256];
-        char busid[32];
-        uint32_t busnum;
-        uint32_t devnum;
-        uint32_t speed;
-        uint16_t idVendor;
-        uint16_t idProduct;
-        uint16_t bcdDevice;
-        uint8_t bDeviceClass;
-        uint8_t bDeviceSubClass;
-        uint8_t bDeviceProtocol;
-        uint8_t bConfigurationValue;
-        uint8_t bNumConfigurations;
-        uint8_t bNumInterfaces;
-      } __attribute__((packed)) dev_info;
-
-      received = recv(socket_fd_, (char *) &dev_info, sizeof(dev_info), 0);
-      if (received != sizeof(dev_info)) {
-        BOOST_LOG(error) << "Failed to receive device info";
-        continue;
-      }
+    devices = std::move(parser.devices());
 
-      usb_device_info_t device;
-      device.path = std::string(dev_info.path);
-      device.busid = std::string(dev_info.busid);
-      device.busnum = ntohl(dev_info.busnum);
-      device.devnum = ntohl(dev_info.devnum);
-      device.speed = ntohl(dev_info.speed);
-      device.idVendor = ntohs(dev_info.idVendor);
-      device.idProduct = ntohs(dev_info.idProduct);
-      device.bcdDevice = ntohs(dev_info.bcdDevice);
-      device.bDeviceClass = dev_info.bDeviceClass;
-      device.bDeviceSubClass = dev_info.bDeviceSubClass;
-      device.bDeviceProtocol = dev_info.bDeviceProtocol;
-      device.bConfigurationValue = dev_info.bConfigurationValue;
-      device.bNumConfigurations = dev_info.bNumConfigurations;
-      device.bNumInterfaces = dev_info.bNumInterfaces;
-
-      // Receive interface info (skipped for now, but must read from socket)
-      for (int j = 0; j < dev_info.bNumInterfaces; ++j) {
-        struct {
-          uint8_t bInterfaceClass;
-          uint8_t bInterfaceSubClass;
-          uint8_t bInterfaceProtocol;
-          uint8_t padding;
-        } __attribute__((packed)) iface_info;
-
-        recv(socket_fd_, (char *) &iface_info, sizeof(iface_info), 0);
-      }
-
-      devices.push_back(device);
-
-      BOOST_LOG(info) << "Device " << i << ": " << device.busid
-                      << " (VID:PID = " << std::hex << device.idVendor << ":" << device.idProduct << ")";
+    BOOST_LOG(info) << "USB/IP server reports " << devices.size() << " devices";
+    for (std::size_t i = 0; i < devices.size(); ++i) {
+      BOOST_LOG(info) << "Device " << i << ": " << devices[i].busid
+                      << " (VID:PID = " << std::hex << devices[i].idVendor << ":" << devices[i].idProduct << ")";
     }
 
     return true;
@@ -352,8 +764,7 @@ namespace usbip_client {
       // ... device info follows
     } __attribute__((packed)) reply;
 
-    int received = recv(socket_fd_, (char *) &reply, sizeof(reply), 0);
-    if (received != sizeof(reply)) {
+    if (!recv_exact(socket_fd_, &reply, sizeof(reply))) {
       BOOST_LOG(error) << "Failed to receive OP_REP_IMPORT header";
       return false;
     }
@@ -372,8 +783,12 @@ namespace usbip_client {
       return false;
     }
 
-    // Device info follows but we can skip it for now
-    // In a complete implementation, we would read and process the device info
+    // The imported device follows, it isn't needed but must not be left in the stream
+    std::array<std::uint8_t, device_size> device;
+    if (!recv_exact(socket_fd_, device.data(), device.size())) {
+      BOOST_LOG(error) << "Failed to receive OP_REP_IMPORT device";
+      return false;
+    }
 
     return true;
   }
@@ -433,6 +848,30 @@ namespace usbip_client {
     return all_devices;
   }
 
+  void
+  usbip_manager_t::start_discovery(devlist_cache_t::targets_fn targets) {
+    std::lock_guard<std::mutex> lock(clients_mutex_);
+    devlist_cache_ = std::make_unique<devlist_cache_t>(std::move(targets), devlist_ttl, devlist_timeout);
+  }
+
+  void
+  usbip_manager_t::refresh_device_lists() {
+    std::lock_guard<std::mutex> lock(clients_mutex_);
+    if (devlist_cache_) {
+      devlist_cache_->refresh();
+    }
+  }
+
+  std::vector<devlist_entry_t>
+  usbip_manager_t::get_device_lists() const {
+    std::lock_guard<std::mutex> lock(clients_mutex_);
+    if (!devlist_cache_) {
+      return {};
+    }
+
+    return devlist_cache_->get();
+  }
+
   std::shared_ptr<usbip_manager_t>
   get_manager() {
     return global_manager;
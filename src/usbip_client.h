@@ -4,7 +4,10 @@
  */
 #pragma once
 
+#include <chrono>
+#include <cstdint>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <functional>
@@ -62,6 +65,115 @@ namespace usbip_client {
     std::string serial;  // Serial number string
   };
 
+  /**
+   * @brief Incremental decoder of OP_REP_DEVLIST replies
+   * @details The reply can be fed in chunks of any size, exactly as they come off the socket.
+   */
+  class devlist_parser_t {
+  public:
+    enum status_e {
+      INCOMPLETE,  ///< More bytes are needed
+      DONE,  ///< The whole reply has been decoded
+      FAILED,  ///< The reply is invalid or reports an error
+    };
+
+    devlist_parser_t();
+
+    /**
+     * @brief Start decoding a new reply
+     */
+    void reset();
+
+    /**
+     * @brief Decode the next bytes of the reply
+     * @param data The received bytes
+     * @param len The number of received bytes
+     * @return The number of bytes consumed, less than len only once the reply is complete or invalid
+     */
+    std::size_t feed(const std::uint8_t *data, std::size_t len);
+
+    status_e status() const {
+      return status_;
+    }
+
+    /**
+     * @brief The devices decoded so far
+     */
+    std::vector<usb_device_info_t> &devices() {
+      return devices_;
+    }
+
+  private:
+    enum state_e {
+      HEADER,
+      DEVICE,
+      INTERFACES,
+    };
+
+    void parse_frame();
+
+    state_e state_;
+    status_e status_;
+
+    std::vector<std::uint8_t> frame_;
+    std::size_t need_;
+
+    std::uint32_t remaining_devices_;
+    std::vector<usb_device_info_t> devices_;
+  };
+
+  /**
+   * @brief A USB/IP server to ask for its devices, e.g. the far end of an SSH tunnel
+   */
+  struct devlist_target_t {
+    std::string id;  // Identifies the server to the caller, e.g. the tunnel's client ID
+    std::string host;
+    int port;
+  };
+
+  /**
+   * @brief The last known devices of a USB/IP server
+   */
+  struct devlist_entry_t {
+    devlist_target_t target;
+    std::vector<usb_device_info_t> devices;  // Devices from the last successful query
+    std::string error;  // Why the last query failed, empty if it succeeded
+    std::chrono::steady_clock::time_point updated;  // When the devices were received
+  };
+
+  /**
+   * @brief Keeps the device lists of USB/IP servers fresh in the background
+   * @details All servers are queried concurrently from one I/O thread, and the connection to each
+   *          server is reused for as long as the server keeps it open. Readers only copy the results
+   *          of the last round, so they never wait on the network.
+   */
+  class devlist_cache_t {
+  public:
+    using targets_fn = std::function<std::vector<devlist_target_t>()>;
+
+    /**
+     * @param targets Called before each round to get the servers to query
+     * @param ttl Time between the end of a round and the start of the next one
+     * @param timeout Time a server has to answer before its query fails
+     */
+    devlist_cache_t(targets_fn targets, std::chrono::milliseconds ttl, std::chrono::milliseconds timeout);
+    ~devlist_cache_t();
+
+    /**
+     * @brief Get the results of the last round
+     */
+    std::vector<devlist_entry_t> get() const;
+
+    /**
+     * @brief Start a new round now instead of waiting for the TTL to expire
+     */
+    void refresh();
+
+  private:
+    class impl;
+    std::unique_ptr<impl> pimpl;
+  };
+
   /**
    * @brief USB/IP client class for connecting to remote USB/IP servers
    */
@@ -165,9 +277,27 @@ namespace usbip_client {
      */
     std::vector<usb_device_info_t> get_all_imported_devices() const;
 
+    /**
+     * @brief Start keeping the device lists of the given servers in the background
+     * @param targets Called before each refresh to get the servers to query
+     */
+    void start_discovery(devlist_cache_t::targets_fn targets);
+
+    /**
+     * @brief Refresh the device lists now, e.g. because a tunnel was established
+     */
+    void refresh_device_lists();
+
+    /**
+     * @brief Get the cached device lists, without any network I/O
+     */
+    std::vector<devlist_entry_t> get_device_lists() const;
+
   private:
     std::vector<std::shared_ptr<usbip_client_t>> clients_;
     mutable std::mutex clients_mutex_;
+
+    std::unique_ptr<devlist_cache_t> devlist_cache_;
   };
 
   /**
@@ -4,7 +4,12 @@
  */
 #include <atomic>
 #include <bitset>
+#include <condition_variable>
+#include <cstring>
+#include <future>
 #include <list>
+#include <mutex>
+#include <sstream>
 #include <thread>
 
 #include <boost/pointer_cast.hpp>
@@ -22,9 +27,11 @@ extern "C" {
 #include "globals.h"
 #include "input.h"
 #include "logging.h"
+#include "metrics.h"
 #include "nvenc/nvenc_base.h"
 #include "platform/common.h"
 #include "sync.h"
+#include "tracing.h"
 #include "video.h"
 
 #ifdef _WIN32
@@ -99,15 +106,18 @@ namespace video {
   public:
     int
     convert(platf::img_t &img) override {
+      // When frames are swapped, convert into the spare frame while the encoder reads the current one
+      auto out_frame = spare_frame ? spare_frame.get() : sw_frame.get();
+
       // If we need to add aspect ratio padding, we need to scale into an intermediate output buffer
-      bool requires_padding = (sw_frame->width != sws_output_frame->width || sw_frame->height != sws_output_frame->height);
+      bool requires_padding = (out_frame->width != sws_output_frame->width || out_frame->height != sws_output_frame->height);
 
       // Setup the input frame using the caller's img_t
       sws_input_frame->data[0] = img.data;
       sws_input_frame->linesize[0] = img.row_pitch;
 
       // Perform color conversion and scaling to the final size
-      auto status = sws_scale_frame(sws.get(), requires_padding ? sws_output_frame.get() : sw_frame.get(), sws_input_frame.get());
+      auto status = sws_scale_frame(sws.get(), requires_padding ? sws_output_frame.get() : out_frame, sws_input_frame.get());
       if (status < 0) {
         char string[AV_ERROR_MAX_STRING_SIZE];
         BOOST_LOG(error) << "Couldn't scale frame: "sv << av_make_error_string(string, AV_ERROR_MAX_STRING_SIZE, status);
@@ -121,11 +131,11 @@ namespace video {
         for (int plane = 0; plane < planes; plane++) {
           auto shift_h = plane == 0 ? 0 : fmt_desc->log2_chroma_h;
           auto shift_w = plane == 0 ? 0 : fmt_desc->log2_chroma_w;
-          auto offset = ((offsetW >> shift_w) * fmt_desc->comp[plane].step) + (offsetH >> shift_h) * sw_frame->linesize[plane];
+          auto offset = ((offsetW >> shift_w) * fmt_desc->comp[plane].step) + (offsetH >> shift_h) * out_frame->linesize[plane];
 
           // Copy line-by-line to preserve leading padding for each row
           for (int line = 0; line < sws_output_frame->height >> shift_h; line++) {
-            memcpy(sw_frame->data[plane] + offset + (line * sw_frame->linesize[plane]),
+            memcpy(out_frame->data[plane] + offset + (line * out_frame->linesize[plane]),
               sws_output_frame->data[plane] + (line * sws_output_frame->linesize[plane]),
               (size_t) (sws_output_frame->width >> shift_w) * fmt_desc->comp[plane].step);
           }
@@ -135,7 +145,7 @@ namespace video {
       // If frame is not a software frame, it means we still need to transfer from main memory
       // to vram memory
       if (frame->hw_frames_ctx) {
-        auto status = av_hwframe_transfer_data(frame, sw_frame.get(), 0);
+        auto status = av_hwframe_transfer_data(frame, out_frame, 0);
         if (status < 0) {
           char string[AV_ERROR_MAX_STRING_SIZE];
           BOOST_LOG(error) << "Failed to transfer image data to hardware frame: "sv << av_make_error_string(string, AV_ERROR_MAX_STRING_SIZE, status);
@@ -163,6 +173,45 @@ namespace video {
       return 0;
     }
 
+    /**
+     * @brief Convert into a spare frame, so the next image can be converted while the encoder reads the current frame.
+     * @details Only supported when the encoder reads the converted frame directly from system memory.
+     * @return 0 on success, -1 on failure.
+     */
+    int
+    enable_frame_swapping() {
+      if (!frame || frame->hw_frames_ctx) {
+        return -1;
+      }
+
+      spare_frame.reset(av_frame_alloc());
+      spare_frame->width = frame->width;
+      spare_frame->height = frame->height;
+      spare_frame->format = frame->format;
+      spare_frame->color_range = frame->color_range;
+
+      if (av_frame_get_buffer(spare_frame.get(), 0)) {
+        spare_frame.reset();
+        return -1;
+      }
+
+      // Aspect ratio padding is never written by convert(), so copy it along with the current picture
+      return av_frame_copy(spare_frame.get(), frame);
+    }
+
+    /**
+     * @brief Hand the last converted frame to the encoder, the frame it read before becomes the spare frame.
+     * @details The encoder frame keeps its properties, e.g. a pending IDR request, only the pictures are exchanged.
+     */
+    void
+    swap_frames() {
+      for (int x = 0; x < AV_NUM_DATA_POINTERS; ++x) {
+        std::swap(frame->buf[x], spare_frame->buf[x]);
+        std::swap(frame->data[x], spare_frame->data[x]);
+        std::swap(frame->linesize[x], spare_frame->linesize[x]);
+      }
+    }
+
     void
     apply_colorspace() override {
       auto avcodec_colorspace = avcodec_colorspace_from_sunshine_colorspace(colorspace);
@@ -260,6 +309,7 @@ namespace video {
     avcodec_frame_t hw_frame;
 
     avcodec_frame_t sw_frame;
+    avcodec_frame_t spare_frame;
     avcodec_frame_t sws_input_frame;
     avcodec_frame_t sws_output_frame;
     sws_t sws;
@@ -283,6 +333,112 @@ namespace video {
     YUV444_SUPPORT = 1 << 10,  ///< Encoder may support 4:4:4 chroma sampling depending on hardware
   };
 
+  /**
+   * @brief Tracks packet loss recovery done by periodic intra refresh instead of an IDR frame.
+   */
+  struct intra_refresh_t {
+    int period = 0;  ///< Frames per refresh wave, 0 if the session recovers with IDR frames
+    bool requested = false;  ///< Reference frames were invalidated since the last encoded frame
+
+    int64_t last_idr_frame = 0;  ///< Refresh waves are aligned to the last IDR frame
+    std::size_t idr_size = 0;  ///< Size of the last IDR frame, the cost of recovering without intra refresh
+    int64_t last_frame = 0;  ///< Index of the last encoded frame
+    std::size_t average_size = 0;  ///< Moving average of the size of the frames that aren't IDR frames
+
+    int64_t recovery_end = 0;  ///< Frame index at which the pending recovery completes, 0 if none is pending
+    std::chrono::steady_clock::time_point recovery_start;
+    std::size_t peak_size = 0;  ///< Largest frame encoded during the pending recovery
+
+    std::shared_ptr<metrics::histogram_t> recovery_seconds = metrics::histogram(
+      "sunshine_video_intra_refresh_recovery_seconds", "Time from a reference frame invalidation until intra refresh has rebuilt the whole picture", { 0.05, 0.1, 0.25, 0.5, 1, 2, 5, 10 });
+    std::shared_ptr<metrics::counter_t> peak_bytes_avoided = metrics::counter(
+      "sunshine_video_intra_refresh_peak_bytes_avoided_total", "Bytes by which the last IDR frame exceeded the largest frame sent during intra refresh recoveries");
+
+    /**
+     * @brief Update the recovery state with an encoded frame.
+     * @param frame_nr The index of the encoded frame.
+     * @param size The size of the encoded frame.
+     * @param idr Whether the frame is an IDR frame.
+     * @return `true` if this frame completes the recovery from invalidated reference frames.
+     *
+     * The encoder isn't told which frames were invalidated, so every frame until the refresh
+     * has covered the whole picture may still predict from them. Only the frame completing
+     * the recovery is reported to the client as the first valid frame after the invalidation.
+     */
+    bool
+    on_frame(int64_t frame_nr, std::size_t size, bool idr) {
+      last_frame = frame_nr;
+
+      if (idr) {
+        // A keyframe recovers on its own
+        last_idr_frame = frame_nr;
+        idr_size = size;
+        requested = false;
+        recovery_end = 0;
+        return false;
+      }
+
+      average_size = average_size ? (average_size * 7 + size) / 8 : size;
+
+      if (requested) {
+        requested = false;
+        if (!recovery_end) {
+          recovery_start = std::chrono::steady_clock::now();
+          peak_size = 0;
+        }
+
+        recovery_end = recovery_end_for(frame_nr);
+      }
+
+      bool recovered = false;
+      if (recovery_end) {
+        peak_size = std::max(peak_size, size);
+
+        if (frame_nr >= recovery_end) {
+          auto duration = std::chrono::steady_clock::now() - recovery_start;
+          recovery_seconds->observe(duration);
+          if (idr_size > peak_size) {
+            peak_bytes_avoided->inc(idr_size - peak_size);
+          }
+
+          BOOST_LOG(debug) << "Intra refresh recovered in "sv << std::chrono::duration_cast<std::chrono::milliseconds>(duration).count()
+                           << "ms, largest frame "sv << peak_size << " bytes, last IDR frame "sv << idr_size << " bytes"sv;
+          recovery_end = 0;
+          recovered = true;
+        }
+      }
+
+      return recovered;
+    }
+
+    /**
+     * @brief Get the frame index at which a recovery requested before the given frame completes.
+     * @param frame_nr The index of the first frame encoded after the invalidation.
+     */
+    int64_t
+    recovery_end_for(int64_t frame_nr) const {
+      // The wave in progress may already have passed the damaged area,
+      // so the picture is only clean once the next full wave has completed.
+      return last_idr_frame + ((frame_nr - last_idr_frame) / period + 2) * period;
+    }
+
+    /**
+     * @brief Check whether intra refresh recovers from an invalidation at least as fast as an IDR frame.
+     * @details Sending an IDR frame holds back the following frames for about as many frame intervals
+     * as it is larger than an average frame, while intra refresh waits for the next full wave.
+     */
+    bool
+    recovers_faster_than_idr() const {
+      if (!average_size) {
+        return true;
+      }
+
+      auto frame_nr = last_frame + 1;
+      auto idr_frames = std::max<int64_t>(1, idr_size / average_size);
+      return recovery_end_for(frame_nr) - frame_nr <= idr_frames;
+    }
+  };
+
   class avcodec_encode_session_t: public encode_session_t {
   public:
     avcodec_encode_session_t() = default;
@@ -306,6 +462,9 @@ namespace video {
       vps = std::move(other.vps);
 
       inject = other.inject;
+      intra_refresh = std::move(other.intra_refresh);
+      pts_base = other.pts_base;
+      last_pts = other.last_pts;
 
       return *this;
     }
@@ -336,6 +495,18 @@ namespace video {
 
     void
     invalidate_ref_frames(int64_t first_frame, int64_t last_frame) override {
+      if (intra_refresh.period) {
+        // The next refresh wave rebuilds the damaged area without a keyframe, unless that takes longer than sending one
+        if (intra_refresh.recovers_faster_than_idr()) {
+          intra_refresh.requested = true;
+          return;
+        }
+
+        BOOST_LOG(debug) << "Intra refresh would recover slower than an IDR frame"sv;
+        request_idr_frame();
+        return;
+      }
+
       BOOST_LOG(error) << "Encoder doesn't support reference frame invalidation";
       request_idr_frame();
     }
@@ -350,6 +521,12 @@ namespace video {
 
     // inject sps/vps data into idr pictures
     int inject;
+
+    intra_refresh_t intra_refresh;
+
+    // Added to the frame index, so the timestamps keep increasing when the session is reused by another stream
+    int64_t pts_base = 0;
+    int64_t last_pts = 0;
   };
 
   class nvenc_encode_session_t: public encode_session_t {
@@ -418,9 +595,27 @@ namespace video {
   using encode_session_ctx_queue_t = safe::queue_t<sync_session_ctx_t>;
   using encode_e = platf::capture_e;
 
+  /**
+   * @brief How a consumer of the capture thread keeps up with it.
+   */
+  struct capture_consumer_t {
+    void
+    drop() {
+      if (dropped) {
+        dropped->inc();
+      }
+    }
+
+    std::atomic<int> held = 0;  ///< Images delivered to the consumer and not released yet, whether picked up or not
+    std::shared_ptr<metrics::counter_t> dropped;  ///< Null if the consumer isn't measured
+    std::shared_ptr<metrics::counter_t> stalls;
+  };
+
   struct capture_ctx_t {
     img_event_t images;
     config_t config;
+    metrics::labels_t labels;  ///< Labels of the backpressure metrics of the consumer, it isn't measured if empty
+    std::shared_ptr<capture_consumer_t> consumer;  ///< Set by the capture thread
   };
 
   struct capture_thread_async_ctx_t {
@@ -1066,12 +1261,24 @@ namespace video {
 
     auto switch_display_event = mail::man->event<int>(mail::switch_display);
 
+    auto add_consumer = [&](capture_ctx_t &&capture_ctx) {
+      capture_ctx.consumer = std::make_shared<capture_consumer_t>();
+      if (!capture_ctx.labels.empty()) {
+        capture_ctx.consumer->dropped = metrics::counter(
+          "sunshine_capture_dropped_frames_total", "Captured frames replaced by a newer one before the consumer picked them up, or reclaimed when the image pool ran out", capture_ctx.labels);
+        capture_ctx.consumer->stalls = metrics::counter(
+          "sunshine_capture_stalls_total", "Times the capture waited for a free image while the consumer held some", capture_ctx.labels);
+      }
+
+      capture_ctxs.emplace_back(std::move(capture_ctx));
+    };
+
     // Wait for the initial capture context or a request to stop the queue
     auto initial_capture_ctx = capture_ctx_queue->pop();
     if (!initial_capture_ctx) {
       return;
     }
-    capture_ctxs.emplace_back(std::move(*initial_capture_ctx));
+    add_consumer(std::move(*initial_capture_ctx));
 
     // Get all the monitor names now, rather than at boot, to
     // get the most up-to-date list available monitors
@@ -1135,9 +1342,43 @@ namespace video {
       }
     };
 
+    tracing::clock::time_point capture_begin;
+
+    // Raised by the consumers when they release an image, outlives the capture thread along with the images
+    auto released = std::make_shared<safe::signal_t>();
+    auto stall_seconds = metrics::histogram("sunshine_capture_stall_seconds", "Time the capture waited for a consumer to release an image", metrics::latency_buckets);
+
+    // Each consumer gets its own reference to the image, which counts the images it holds
+    // and wakes up the capture thread when it releases the image
+    auto deliver = [&released](capture_ctx_t &capture_ctx, const std::shared_ptr<platf::img_t> &img) {
+      auto &consumer = capture_ctx.consumer;
+
+      // The consumer drops the frame it hasn't picked up yet in favor of the new one
+      if (capture_ctx.images->peek()) {
+        consumer->drop();
+      }
+
+      ++consumer->held;
+      capture_ctx.images->raise(std::shared_ptr<platf::img_t>(img.get(), [owner = img, consumer, released](platf::img_t *) mutable {
+        owner.reset();
+        --consumer->held;
+        released->raise(true);
+      }));
+    };
+
     auto pull_free_image_callback = [&](std::shared_ptr<platf::img_t> &img_out) -> bool {
+      if (tracing::enabled()) {
+        capture_begin = tracing::clock::now();
+      }
+
+      bool reclaimed = false;
+      std::optional<std::chrono::steady_clock::time_point> stall_start;
+
       img_out.reset();
       while (capture_ctx_queue->running()) {
+        // Any image released from now on ends the wait below
+        released->reset();
+
         // pick first allocated but unused
         for (auto it = imgs.begin(); it != imgs.end(); it++) {
           if (*it && it->use_count() == 1) {
@@ -1167,26 +1408,70 @@ namespace video {
           }
         }
         if (img_out) {
+          if (stall_start) {
+            stall_seconds->observe(std::chrono::steady_clock::now() - *stall_start);
+          }
+
           // trim allocated but unused portion of the pool based on timeouts
           trim_imgs();
           img_out->frame_timestamp.reset();
           return true;
         }
-        else {
-          // sleep and retry if image pool is full
-          std::this_thread::sleep_for(1ms);
+
+        // The pool is full, reclaim the frames the consumers haven't picked up yet.
+        // A slow consumer then skips to the next frame instead of holding back the capture for all of them.
+        if (!reclaimed) {
+          reclaimed = true;
+
+          for (auto &capture_ctx : capture_ctxs) {
+            if (capture_ctx.images->pop(0ms)) {
+              capture_ctx.consumer->drop();
+            }
+          }
+          continue;
+        }
+
+        // The remaining images are being encoded, wait for a consumer to release one
+        if (!stall_start) {
+          stall_start = std::chrono::steady_clock::now();
+
+          for (auto &capture_ctx : capture_ctxs) {
+            if (capture_ctx.consumer->held && capture_ctx.consumer->stalls) {
+              capture_ctx.consumer->stalls->inc();
+            }
+          }
         }
+
+        released->pop(20ms);
       }
       return false;
     };
 
+    auto captured_frames = metrics::counter("sunshine_capture_frames_total", "Frames delivered by the capture backend");
+
+    // Backends that only capture changed frames may not deliver another one for a while,
+    // so consumers joining a running capture start with the last captured frame
+    std::shared_ptr<platf::img_t> last_frame;
+
     // Capture takes place on this thread
     platf::adjust_thread_priority(platf::thread_priority_e::critical);
+    tracing::set_thread_name("capture");
 
     while (capture_ctx_queue->running()) {
       bool artificial_reinit = false;
 
       auto push_captured_image_callback = [&](std::shared_ptr<platf::img_t> &&img, bool frame_captured) -> bool {
+        if (frame_captured) {
+          captured_frames->inc();
+          last_frame = img;
+
+          // The frame index is only assigned by the encoder, which records the capture to encode delay per frame
+          if (capture_begin != tracing::clock::time_point {}) {
+            tracing::record("capture", tracing::NO_FRAME, capture_begin, tracing::clock::now());
+            capture_begin = {};
+          }
+        }
+
         KITTY_WHILE_LOOP(auto capture_ctx = std::begin(capture_ctxs), capture_ctx != std::end(capture_ctxs), {
           if (!capture_ctx->images->running()) {
             capture_ctx = capture_ctxs.erase(capture_ctx);
@@ -1195,7 +1480,7 @@ namespace video {
           }
 
           if (frame_captured) {
-            capture_ctx->images->raise(img);
+            deliver(*capture_ctx, img);
           }
 
           ++capture_ctx;
@@ -1206,7 +1491,10 @@ namespace video {
         }
 
         while (capture_ctx_queue->peek()) {
-          capture_ctxs.emplace_back(std::move(*capture_ctx_queue->pop()));
+          add_consumer(std::move(*capture_ctx_queue->pop()));
+          if (last_frame) {
+            deliver(capture_ctxs.back(), last_frame);
+          }
         }
 
         if (switch_display_event->peek()) {
@@ -1233,6 +1521,7 @@ namespace video {
           for (auto &img : imgs) {
             img.reset();
           }
+          last_frame.reset();
 
           // display_wp is modified in this thread only
           // Wait for the other shared_ptr's of display to be destroyed.
@@ -1298,16 +1587,47 @@ namespace video {
     }
   }
 
+  std::vector<std::size_t>
+  find_nal_units(const uint8_t *data, std::size_t size) {
+    std::vector<std::size_t> offsets;
+
+    // Look for the last byte of each start code with memchr(), which is vectorized,
+    // then check for the zero bytes before it. A NAL header must follow the start code.
+    std::size_t x = 2;
+    while (x + 1 < size) {
+      auto next = (const uint8_t *) std::memchr(data + x, 1, size - x - 1);
+      if (!next) {
+        break;
+      }
+
+      x = next - data;
+      if (data[x - 1] != 0 || data[x - 2] != 0) {
+        ++x;
+        continue;
+      }
+
+      offsets.emplace_back(x >= 3 && data[x - 3] == 0 ? x - 3 : x - 2);
+
+      // Skip the start code, the next one can begin at the NAL header at the earliest
+      x += 3;
+    }
+
+    return offsets;
+  }
+
   int
   encode_avcodec(int64_t frame_nr, avcodec_encode_session_t &session, safe::mail_raw_t::queue_t<packet_t> &packets, void *channel_data, std::optional<std::chrono::steady_clock::time_point> frame_timestamp) {
     auto &frame = session.device->frame;
-    frame->pts = frame_nr;
+    frame->pts = frame_nr + session.pts_base;
+    session.last_pts = frame->pts;
 
     auto &ctx = session.avcodec_ctx;
 
     auto &sps = session.sps;
     auto &vps = session.vps;
 
+    auto encode_start = std::chrono::steady_clock::now();
+
     // send the frame to the encoder
     auto ret = avcodec_send_frame(ctx.get(), frame);
     if (ret < 0) {
@@ -1329,6 +1649,9 @@ namespace video {
         return ret;
       }
 
+      av_packet->pts -= session.pts_base;
+      av_packet->dts -= session.pts_base;
+
       if (av_packet->flags & AV_PKT_FLAG_KEY) {
         BOOST_LOG(debug) << "Frame "sv << frame_nr << ": IDR Keyframe (AV_FRAME_FLAG_KEY)"sv;
       }
@@ -1363,6 +1686,11 @@ namespace video {
 
       if (av_packet && av_packet->pts == frame_nr) {
         packet->frame_timestamp = frame_timestamp;
+        packet->encode_duration = std::chrono::steady_clock::now() - encode_start;
+
+        if (session.intra_refresh.period) {
+          packet->after_ref_frame_invalidation = session.intra_refresh.on_frame(frame_nr, av_packet->size, av_packet->flags & AV_PKT_FLAG_KEY);
+        }
       }
 
       packet->replacements = &session.replacements;
@@ -1375,6 +1703,7 @@ namespace video {
 
   int
   encode_nvenc(int64_t frame_nr, nvenc_encode_session_t &session, safe::mail_raw_t::queue_t<packet_t> &packets, void *channel_data, std::optional<std::chrono::steady_clock::time_point> frame_timestamp) {
+    auto encode_start = std::chrono::steady_clock::now();
     auto encoded_frame = session.encode_frame(frame_nr);
     if (encoded_frame.data.empty()) {
       BOOST_LOG(error) << "NvENC returned empty packet";
@@ -1389,6 +1718,7 @@ namespace video {
     packet->channel_data = channel_data;
     packet->after_ref_frame_invalidation = encoded_frame.after_ref_frame_invalidation;
     packet->frame_timestamp = frame_timestamp;
+    packet->encode_duration = std::chrono::steady_clock::now() - encode_start;
     packets->raise(std::move(packet));
 
     return 0;
@@ -1438,6 +1768,15 @@ namespace video {
       return nullptr;
     }
 
+    // Clients may ask for intra refresh on their own session, the configured period applies to every session.
+    // The client shows no new frame until a wave completes, so its own request uses a short period.
+    int intra_refresh_period = 0;
+    if (!hardware && (video_format.name == "libx264"sv || video_format.name == "libx265"sv)) {
+      intra_refresh_period = config::video.sw.intra_refresh ? config::video.sw.intra_refresh :
+                             config.enableIntraRefresh == 1 ? std::max(1, config.framerate / 5) :
+                                                              0;
+    }
+
     auto colorspace = encode_device->colorspace;
     auto sw_fmt = (colorspace.bit_depth == 8 && config.chromaSamplingType == 0)  ? platform_formats->avcodec_pix_fmt_8bit :
                   (colorspace.bit_depth == 8 && config.chromaSamplingType == 1)  ? platform_formats->avcodec_pix_fmt_yuv444_8bit :
@@ -1620,6 +1959,22 @@ namespace video {
         }
       }
 
+      if (intra_refresh_period) {
+        // Refresh a moving column of intra blocks every period instead of sending IDR frames,
+        // which bounds the size of every frame while recovering from packet loss.
+        ctx->gop_size = intra_refresh_period;
+
+        if (video_format.name == "libx264"sv) {
+          av_dict_set_int(&options, "intra-refresh", 1, 0);
+        }
+        else {
+          // x265 ignores gop_size and applies its parameters in order, so append to the ones set above
+          auto params = av_dict_get(options, "x265-params", nullptr, 0);
+          auto value = (params ? params->value + ":"s : ""s) + "keyint="s + std::to_string(intra_refresh_period) + ":intra-refresh=1"s;
+          av_dict_set(&options, "x265-params", value.c_str(), 0);
+        }
+      }
+
       auto bitrate = config.bitrate * 1000;
       ctx->rc_max_rate = bitrate;
       ctx->bit_rate = bitrate;
@@ -1755,6 +2110,11 @@ namespace video {
       // 0 ==> don't inject, 1 ==> inject for h264, 2 ==> inject for hevc
       config.videoFormat <= 1 ? (1 - (int) video_format[encoder_t::VUI_PARAMETERS]) * (1 + config.videoFormat) : 0);
 
+    if (intra_refresh_period) {
+      BOOST_LOG(info) << video_format.name << ": recovering from packet loss with intra refresh over "sv << intra_refresh_period << " frames"sv;
+      session->intra_refresh.period = intra_refresh_period;
+    }
+
     return session;
   }
 
@@ -1781,42 +2141,270 @@ namespace video {
     return nullptr;
   }
 
-  void
+  /**
+   * @brief Converts the next image on its own thread while encode_run() encodes the current frame.
+   * @details The encoder frame is double-buffered with avcodec_software_encode_device_t::swap_frames(),
+   *          and at most one converted frame waits for the encoder, so frames are encoded in capture order.
+   *          This trades up to one frame of latency for overlapping color conversion with encoding.
+   */
+  class convert_pipeline_t {
+  public:
+    enum class status_e : int {
+      frame,  ///< A new frame was handed to the encoder
+      timeout,  ///< No frame was converted in time
+      stopped,  ///< The capture stopped
+      error,  ///< The conversion failed
+    };
+
+    convert_pipeline_t(avcodec_software_encode_device_t &device, img_event_t images, std::chrono::milliseconds poll_interval):
+        device { device }, images { std::move(images) }, poll_interval { poll_interval } {
+      wait_latency = metrics::histogram("sunshine_encode_pipeline_wait_seconds", "Time a converted frame waits for the encoder when conversion is pipelined", metrics::latency_buckets);
+      thread = std::thread { &convert_pipeline_t::run, this };
+    }
+
+    ~convert_pipeline_t() {
+      {
+        std::lock_guard lg { lock };
+        stop = true;
+      }
+      cv.notify_all();
+      thread.join();
+    }
+
+    /**
+     * @brief Hand the next converted frame to the encoder.
+     * @param timeout How long to wait for a converted frame.
+     * @param frame_nr The index of the frame about to be encoded.
+     * @param frame_timestamp Set to the capture time of the handed frame.
+     * @return The status of the hand-off.
+     */
+    status_e
+    next_frame(std::chrono::milliseconds timeout, int64_t frame_nr, std::optional<std::chrono::steady_clock::time_point> &frame_timestamp) {
+      std::unique_lock ul { lock };
+      cv.wait_for(ul, timeout, [&]() { return ready || error || images_stopped; });
+
+      if (error) {
+        return status_e::error;
+      }
+
+      if (!ready) {
+        return images_stopped ? status_e::stopped : status_e::timeout;
+      }
+
+      // The encoder is done with its frame, which becomes the next conversion target
+      device.swap_frames();
+      ready = false;
+      frame_timestamp = ready_frame_timestamp;
+
+      auto now = std::chrono::steady_clock::now();
+      wait_latency->observe(now - converted_at);
+      tracing::record("convert_to_encode", frame_nr, converted_at, now);
+
+      ul.unlock();
+      cv.notify_all();
+
+      return status_e::frame;
+    }
+
+  private:
+    void
+    run() {
+      tracing::set_thread_name("convert");
+      platf::adjust_thread_priority(platf::thread_priority_e::high);
+
+      while (true) {
+        auto img = images->pop(poll_interval);
+
+        std::unique_lock ul { lock };
+        if (!img) {
+          if (!images->running()) {
+            images_stopped = true;
+            ul.unlock();
+            cv.notify_all();
+            return;
+          }
+
+          if (stop) {
+            return;
+          }
+
+          continue;
+        }
+
+        // Wait for the encoder to take the previous frame out of the spare frame
+        cv.wait(ul, [&]() { return !ready || stop; });
+        if (stop) {
+          return;
+        }
+        ul.unlock();
+
+        int status;
+        {
+          tracing::span_t span { "convert", tracing::NO_FRAME };
+          status = device.convert(*img);
+        }
+
+        ul.lock();
+        if (status) {
+          BOOST_LOG(error) << "Could not convert image"sv;
+          error = true;
+        }
+        else {
+          ready = true;
+          ready_frame_timestamp = img->frame_timestamp;
+          converted_at = std::chrono::steady_clock::now();
+        }
+        ul.unlock();
+        cv.notify_all();
+
+        if (status) {
+          return;
+        }
+      }
+    }
+
+    avcodec_software_encode_device_t &device;
+    img_event_t images;
+    std::chrono::milliseconds poll_interval;
+    std::shared_ptr<metrics::histogram_t> wait_latency;
+
+    std::mutex lock;
+    std::condition_variable cv;
+
+    // A converted frame waits in the spare frame of the device
+    bool ready = false;
+    std::optional<std::chrono::steady_clock::time_point> ready_frame_timestamp;
+    std::chrono::steady_clock::time_point converted_at;
+
+    bool images_stopped = false;
+    bool error = false;
+    bool stop = false;
+
+    std::thread thread;
+  };
+
+  /**
+   * @brief Set up pipelined conversion for a software encode session, if enabled and supported.
+   * @param session The encode session.
+   * @return The software encode device, or `nullptr` to convert on the encoding thread.
+   */
+  avcodec_software_encode_device_t *
+  make_pipelined_device(encode_session_t &session) {
+    if (!config::video.sw.pipeline) {
+      return nullptr;
+    }
+
+    auto avcodec_session = dynamic_cast<avcodec_encode_session_t *>(&session);
+    if (!avcodec_session) {
+      return nullptr;
+    }
+
+    auto device = dynamic_cast<avcodec_software_encode_device_t *>(avcodec_session->device.get());
+    if (!device || device->enable_frame_swapping()) {
+      BOOST_LOG(info) << "Pipelined conversion is only supported by software encoding, converting on the encoding thread"sv;
+      return nullptr;
+    }
+
+    return device;
+  }
+
+  /**
+   * @brief Times the phases from the launch of an app until the first encoded frame of its stream.
+   */
+  struct first_frame_timer_t {
+    std::optional<std::chrono::steady_clock::time_point> launch;  ///< When the app was launched, if known
+    std::chrono::steady_clock::time_point capture_start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point display_ready;
+    std::chrono::steady_clock::time_point encoder_ready;
+    bool prewarmed = false;  ///< The display and encoder session were opened while the client negotiated
+    bool done = false;
+
+    /**
+     * @brief Record the phases, only the first call after the stream started has an effect.
+     */
+    void
+    first_frame() {
+      if (done) {
+        return;
+      }
+      done = true;
+
+      // Whatever was prepared while the client negotiated is not on the critical path
+      auto first_frame = std::chrono::steady_clock::now();
+      auto display = std::max(display_ready, capture_start);
+      auto encoder = std::max(encoder_ready, display);
+
+      std::ostringstream timeline;
+      timeline << "display "sv << record("display", display - capture_start)
+               << "ms, encoder "sv << record("encoder", encoder - display)
+               << "ms, first frame "sv << record("first_frame", first_frame - encoder) << "ms"sv;
+
+      if (launch) {
+        timeline << ", negotiation "sv << record("negotiation", capture_start - *launch)
+                 << "ms, total "sv << record("total", first_frame - *launch) << "ms"sv;
+      }
+
+      BOOST_LOG(info) << "Time to first frame"sv << (prewarmed ? " (prewarmed): "sv : ": "sv) << timeline.str();
+    }
+
+    /**
+     * @brief Record the duration of a phase.
+     * @return The duration in milliseconds.
+     */
+    std::int64_t
+    record(const char *phase, std::chrono::steady_clock::duration duration) {
+      metrics::histogram(
+        "sunshine_time_to_first_frame_seconds", "Time from the launch of an app until the first encoded frame of its stream, by phase",
+        { 0.01, 0.05, 0.1, 0.25, 0.5, 1, 2, 5, 10, 30 },
+        { { "phase", phase }, { "prewarmed", prewarmed ? "true" : "false" } })
+        ->observe(duration);
+
+      return std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+    }
+  };
+
+  /**
+   * @brief Encode the captured images until the stream ends or the display is reinitialized.
+   * @return 0 if the session can be reused, -1 if it failed.
+   */
+  int
   encode_run(
     int &frame_nr,  // Store progress of the frame number
     safe::mail_t mail,
     img_event_t images,
     config_t config,
     std::shared_ptr<platf::display_t> disp,
-    std::unique_ptr<platf::encode_device_t> encode_device,
+    encode_session_t &session,
     safe::signal_t &reinit_event,
-    const encoder_t &encoder,
-    void *channel_data) {
-    auto session = make_encode_session(disp.get(), encoder, config, disp->width, disp->height, std::move(encode_device));
-    if (!session) {
-      return;
-    }
-
+    safe::mail_raw_t::queue_t<packet_t> packets,
+    void *channel_data,
+    first_frame_timer_t &timer) {
     // set minimum frame time, avoiding violation of client-requested target framerate
     auto minimum_frame_time = std::chrono::milliseconds(1000 / std::min(config.framerate, (config::video.min_fps_factor * 10)));
     BOOST_LOG(debug) << "Minimum frame time set to "sv << minimum_frame_time.count() << "ms, based on min fps factor of "sv << config::video.min_fps_factor << "."sv;
 
     auto shutdown_event = mail->event<bool>(mail::shutdown);
-    auto packets = mail::man->queue<packet_t>(mail::video_packets);
     auto idr_events = mail->event<bool>(mail::idr);
     auto invalidate_ref_frames_events = mail->event<std::pair<int64_t, int64_t>>(mail::invalidate_ref_frames);
 
+    tracing::set_thread_name("encode");
+
     {
       // Load a dummy image into the AVFrame to ensure we have something to encode
       // even if we timeout waiting on the first frame. This is a relatively large
       // allocation which can be freed immediately after convert(), so we do this
       // in a separate scope.
       auto dummy_img = disp->alloc_img();
-      if (!dummy_img || disp->dummy_img(dummy_img.get()) || session->convert(*dummy_img)) {
-        return;
+      if (!dummy_img || disp->dummy_img(dummy_img.get()) || session.convert(*dummy_img)) {
+        return -1;
       }
     }
 
+    std::optional<convert_pipeline_t> pipeline;
+    if (auto device = make_pipelined_device(session)) {
+      pipeline.emplace(*device, images, minimum_frame_time);
+    }
+
     while (true) {
       // Break out of the encoding loop if any of the following are true:
       // a) The stream is ending
@@ -1833,7 +2421,7 @@ namespace video {
 
       while (invalidate_ref_frames_events->peek()) {
         if (auto frames = invalidate_ref_frames_events->pop(0ms)) {
-          session->invalidate_ref_frames(frames->first, frames->second);
+          session.invalidate_ref_frames(frames->first, frames->second);
         }
       }
 
@@ -1843,18 +2431,33 @@ namespace video {
       }
 
       if (requested_idr_frame) {
-        session->request_idr_frame();
+        session.request_idr_frame();
       }
 
       std::optional<std::chrono::steady_clock::time_point> frame_timestamp;
 
+      if (pipeline) {
+        // Don't wait for a new frame when an IDR frame was requested
+        auto status = pipeline->next_frame(requested_idr_frame ? 0ms : minimum_frame_time, frame_nr, frame_timestamp);
+        if (status == convert_pipeline_t::status_e::error) {
+          return -1;
+        }
+        else if (status == convert_pipeline_t::status_e::stopped) {
+          break;
+        }
+      }
       // Encode at a minimum FPS to avoid image quality issues with static content
-      if (!requested_idr_frame || images->peek()) {
+      else if (!requested_idr_frame || images->peek()) {
         if (auto img = images->pop(minimum_frame_time)) {
           frame_timestamp = img->frame_timestamp;
-          if (session->convert(*img)) {
+          if (frame_timestamp) {
+            tracing::record("capture_to_encode", frame_nr, *frame_timestamp, tracing::clock::now());
+          }
+
+          tracing::span_t span { "convert", frame_nr };
+          if (session.convert(*img)) {
             BOOST_LOG(error) << "Could not convert image"sv;
-            return;
+            return -1;
           }
         }
         else if (!images->running()) {
@@ -1862,13 +2465,19 @@ namespace video {
         }
       }
 
-      if (encode(frame_nr++, *session, packets, channel_data, frame_timestamp)) {
-        BOOST_LOG(error) << "Could not encode video packet"sv;
-        return;
+      {
+        tracing::span_t span { "encode", frame_nr };
+        if (encode(frame_nr++, session, packets, channel_data, frame_timestamp)) {
+          BOOST_LOG(error) << "Could not encode video packet"sv;
+          return -1;
+        }
       }
 
-      session->request_normal_frame();
+      timer.first_frame();
+      session.request_normal_frame();
     }
+
+    return 0;
   }
 
   input::touch_port_t
@@ -2054,9 +2663,15 @@ namespace video {
       synced_sessions.emplace_back(std::move(*synced_session));
     }
 
+    auto captured_frames = metrics::counter("sunshine_capture_frames_total", "Frames delivered by the capture backend");
+
     auto ec = platf::capture_e::ok;
     while (encode_session_ctx_queue.running()) {
       auto push_captured_image_callback = [&](std::shared_ptr<platf::img_t> &&img, bool frame_captured) -> bool {
+        if (frame_captured) {
+          captured_frames->inc();
+        }
+
         while (encode_session_ctx_queue.peek()) {
           auto encode_session_ctx = encode_session_ctx_queue.pop();
           if (!encode_session_ctx) {
@@ -2097,11 +2712,14 @@ namespace video {
             ctx->idr_events->pop();
           }
 
-          if (frame_captured && pos->session->convert(*img)) {
-            BOOST_LOG(error) << "Could not convert image"sv;
-            ctx->shutdown_event->raise(true);
+          if (frame_captured) {
+            tracing::span_t span { "convert", ctx->frame_nr };
+            if (pos->session->convert(*img)) {
+              BOOST_LOG(error) << "Could not convert image"sv;
+              ctx->shutdown_event->raise(true);
 
-            continue;
+              continue;
+            }
           }
 
           std::optional<std::chrono::steady_clock::time_point> frame_timestamp;
@@ -2109,6 +2727,7 @@ namespace video {
             frame_timestamp = img->frame_timestamp;
           }
 
+          tracing::span_t span { "encode", ctx->frame_nr };
           if (encode(ctx->frame_nr++, *pos->session, ctx->packets, ctx->channel_data, frame_timestamp)) {
             BOOST_LOG(error) << "Could not encode video packet"sv;
             ctx->shutdown_event->raise(true);
@@ -2172,17 +2791,404 @@ namespace video {
 
     // Encoding and capture takes place on this thread
     platf::adjust_thread_priority(platf::thread_priority_e::high);
+    tracing::set_thread_name("capture_encode");
 
     std::vector<std::string> display_names;
     int display_p = -1;
     while (encode_run_sync(synced_session_ctxs, ctx, display_names, display_p) == encode_e::reinit) {}
   }
 
+  /**
+   * @brief Recently closed encode sessions, reused by the next stream with the same settings.
+   * @details Opening a session parses the encoder options, opens the codec and sets up its hardware frames,
+   *          which delays resuming a stream and switching displays. Only sessions converting from system memory
+   *          are kept, the others are bound to the display they were opened for, which doesn't outlive them.
+   */
+  class encode_session_pool_t {
+  public:
+    /**
+     * @brief Keep a session that ended cleanly, if it can be reused.
+     * @param session The session.
+     * @param disp The display the session converted images from.
+     * @param encoder The encoder of the session.
+     * @param config The stream config of the session.
+     */
+    void
+    release(std::unique_ptr<encode_session_t> session, platf::display_t &disp, const encoder_t &encoder, const config_t &config) {
+      auto avcodec_session = dynamic_cast<avcodec_encode_session_t *>(session.get());
+      if (!avcodec_session || !dynamic_cast<avcodec_software_encode_device_t *>(avcodec_session->device.get())) {
+        return;
+      }
+
+      // HDR sessions carry the mastering metadata of their display
+      auto &ctx = avcodec_session->avcodec_ctx;
+      if (colorspace_is_hdr(avcodec_session->device->colorspace) || !(ctx->codec->capabilities & AV_CODEC_CAP_ENCODER_FLUSH)) {
+        return;
+      }
+
+      // Drop the delayed frames, the next stream starts with an IDR frame at a later timestamp
+      avcodec_flush_buffers(ctx.get());
+      avcodec_session->pts_base = avcodec_session->last_pts;
+      avcodec_session->intra_refresh.requested = false;
+      avcodec_session->intra_refresh.recovery_end = 0;
+
+      std::list<entry_t> evicted;
+      {
+        std::lock_guard lg { _mutex };
+        _entries.push_front(entry_t { make_key(disp, encoder, config), config.bitrate, std::move(session), std::chrono::steady_clock::now() });
+
+        if (_entries.size() > capacity) {
+          evicted.splice(evicted.end(), _entries, std::prev(_entries.end()));
+        }
+      }
+
+      task_pool.pushDelayed([this]() {
+        trim();
+      },
+        timeout + 1s);
+    }
+
+    /**
+     * @brief Take a session opened for the same encoder, stream config and display size.
+     * @details The bitrate may differ if the encoder can change it while open.
+     * @param disp The display to convert images from.
+     * @param encoder The encoder of the stream.
+     * @param config The stream config.
+     * @param colorspace Set to the colorspace of the session if one is returned.
+     * @return The session, or null if none matches.
+     */
+    std::unique_ptr<encode_session_t>
+    take(platf::display_t &disp, const encoder_t &encoder, const config_t &config, sunshine_colorspace_t &colorspace) {
+      trim();
+
+      std::unique_ptr<encode_session_t> session;
+      int bitrate = 0;
+      {
+        auto key = make_key(disp, encoder, config);
+
+        std::lock_guard lg { _mutex };
+        auto it = std::find_if(std::begin(_entries), std::end(_entries), [&](const entry_t &entry) {
+          return entry.key == key && (entry.bitrate == config.bitrate || reconfigures_bitrate(*entry.session));
+        });
+        if (it != std::end(_entries)) {
+          session = std::move(it->session);
+          bitrate = it->bitrate;
+          _entries.erase(it);
+        }
+      }
+
+      if (!session) {
+        count("miss");
+        return nullptr;
+      }
+
+      count("hit");
+      auto &avcodec_session = static_cast<avcodec_encode_session_t &>(*session);
+      colorspace = avcodec_session.device->colorspace;
+      session->request_idr_frame();
+
+      if (bitrate != config.bitrate) {
+        // The rate control settings all scale with the bitrate the session was opened with
+        auto &ctx = avcodec_session.avcodec_ctx;
+        ctx->bit_rate = ctx->bit_rate * config.bitrate / bitrate;
+        ctx->rc_max_rate = ctx->rc_max_rate * config.bitrate / bitrate;
+        ctx->rc_min_rate = ctx->rc_min_rate * config.bitrate / bitrate;
+        ctx->rc_buffer_size = (int) ((int64_t) ctx->rc_buffer_size * config.bitrate / bitrate);
+
+        BOOST_LOG(debug) << "Changing the bitrate of the reused encode session from "sv << bitrate << " to "sv << config.bitrate << " Kbps"sv;
+      }
+
+      BOOST_LOG(debug) << "Reusing an encode session for a "sv << config.width << 'x' << config.height << 'x' << config.framerate << " stream"sv;
+      return session;
+    }
+
+    void
+    clear() {
+      std::list<entry_t> entries;
+
+      std::lock_guard lg { _mutex };
+      entries.swap(_entries);
+    }
+
+  private:
+    static constexpr std::size_t capacity = 2;
+    static constexpr auto timeout = 30s;
+
+    /**
+     * @brief The settings a session is opened with that can't be changed afterwards.
+     */
+    struct session_key_t {
+      const encoder_t *encoder;
+      int width;
+      int height;
+      int framerate;
+      int videoFormat;
+      int dynamicRange;
+      int chromaSamplingType;
+      int encoderCscMode;
+      int slicesPerFrame;
+      int numRefFrames;
+      int enableIntraRefresh;
+      int display_width;
+      int display_height;
+      bool display_hdr;
+
+      bool
+      operator==(const session_key_t &) const = default;
+    };
+
+    struct entry_t {
+      session_key_t key;
+      int bitrate;  ///< The bitrate of the stream the session was last used for
+      std::unique_ptr<encode_session_t> session;
+      std::chrono::steady_clock::time_point released;
+    };
+
+    static session_key_t
+    make_key(platf::display_t &disp, const encoder_t &encoder, const config_t &config) {
+      return {
+        &encoder,
+        config.width,
+        config.height,
+        config.framerate,
+        config.videoFormat,
+        config.dynamicRange,
+        config.chromaSamplingType,
+        config.encoderCscMode,
+        config.slicesPerFrame,
+        config.numRefFrames,
+        config.enableIntraRefresh,
+        disp.width,
+        disp.height,
+        disp.is_hdr(),
+      };
+    }
+
+    /**
+     * @brief Check whether the encoder of a session applies a new bitrate without being reopened.
+     * @details libx264 reconfigures itself on the next frame when the rate control settings of its context change.
+     *          The other encoders only read them when opened, so their sessions are only reused at the same bitrate.
+     */
+    static bool
+    reconfigures_bitrate(const encode_session_t &session) {
+      auto &ctx = static_cast<const avcodec_encode_session_t &>(session).avcodec_ctx;
+      return ctx->codec->name == "libx264"sv;
+    }
+
+    /**
+     * @brief Close the sessions that weren't reused in time.
+     */
+    void
+    trim() {
+      std::list<entry_t> expired;
+
+      auto now = std::chrono::steady_clock::now();
+      std::lock_guard lg { _mutex };
+      for (auto it = std::begin(_entries); it != std::end(_entries);) {
+        auto next = std::next(it);
+        if (now - it->released >= timeout) {
+          expired.splice(expired.end(), _entries, it);
+        }
+        it = next;
+      }
+    }
+
+    void
+    count(const char *result) {
+      metrics::counter("sunshine_encode_session_pool_total", "Encode sessions taken from the pool of recently closed sessions, or opened because none matched", { { "result", result } })->inc();
+    }
+
+    std::mutex _mutex;
+    std::list<entry_t> _entries;  ///< The most recently released first
+  } session_pool;
+
+  /**
+   * @brief A display and an encoder session opened by prewarm() for a stream that hasn't started yet.
+   */
+  struct warm_encoder_t {
+    ~warm_encoder_t() {
+      // A session opened for a stream that didn't match the prediction may still suit the next one
+      if (session) {
+        session_pool.release(std::move(session), *display, *ref->encoder_p, config);
+      }
+      display.reset();
+
+      // Let the capture thread drop the images of the warm-up, then release it
+      if (images) {
+        images->stop();
+      }
+    }
+
+    config_t config;
+    decltype(capture_thread_async)::ptr_t ref;
+    img_event_t images;
+    std::shared_ptr<platf::display_t> display;
+    sunshine_colorspace_t colorspace;
+    std::unique_ptr<encode_session_t> session;  ///< Null if only the display was opened
+
+    std::chrono::steady_clock::time_point display_ready;
+    std::chrono::steady_clock::time_point encoder_ready;
+  };
+
+  struct {
+    std::mutex mutex;
+    std::optional<std::chrono::steady_clock::time_point> launch;  ///< When an app was last launched or resumed
+    std::future<std::unique_ptr<warm_encoder_t>> warm;
+    std::uint64_t generation = 0;  ///< Identifies the warm-up that the expiry task may discard
+  } prewarm_state;
+
+  // How long a warm-up is kept for a client that doesn't start streaming
+  constexpr auto prewarm_timeout = 20s;
+
+  // How long a stream waits for a warm-up still in progress before starting cold
+  constexpr auto prewarm_wait = 100ms;
+
+  std::unique_ptr<warm_encoder_t>
+  make_warm_encoder(config_t config, bool open_encoder) {
+    tracing::set_thread_name("prewarm");
+
+    auto warm = std::make_unique<warm_encoder_t>();
+    warm->config = config;
+
+    warm->ref = capture_thread_async.ref();
+    if (!warm->ref) {
+      return nullptr;
+    }
+
+    // The capture thread opens the display for the first capture context it receives
+    warm->images = std::make_shared<img_event_t::element_type>();
+    warm->ref->capture_ctx_queue->raise(capture_ctx_t { warm->images, config });
+
+    auto deadline = std::chrono::steady_clock::now() + 10s;
+    while (!warm->display) {
+      if (!warm->images->running() || !warm->ref->capture_ctx_queue->running()) {
+        return nullptr;
+      }
+
+      if (std::chrono::steady_clock::now() > deadline) {
+        BOOST_LOG(warning) << "Prewarm: timed out waiting for the display"sv;
+        return nullptr;
+      }
+
+      if (!warm->ref->reinit_event.peek()) {
+        auto lg = warm->ref->display_wp.lock();
+        warm->display = warm->ref->display_wp->lock();
+      }
+
+      if (!warm->display) {
+        std::this_thread::sleep_for(10ms);
+      }
+    }
+    warm->display_ready = std::chrono::steady_clock::now();
+
+    if (!open_encoder) {
+      return warm;
+    }
+
+    // The capture thread may have been started for an encoder other than the one chosen since
+    auto &encoder = *warm->ref->encoder_p;
+
+    warm->session = session_pool.take(*warm->display, encoder, config, warm->colorspace);
+    if (!warm->session) {
+      auto encode_device = make_encode_device(*warm->display, encoder, config);
+      if (!encode_device) {
+        return warm;
+      }
+
+      warm->colorspace = encode_device->colorspace;
+      warm->session = make_encode_session(warm->display.get(), encoder, config, warm->display->width, warm->display->height, std::move(encode_device));
+    }
+    warm->encoder_ready = std::chrono::steady_clock::now();
+
+    BOOST_LOG(debug) << "Prewarm: display and encoder ready for a "sv << config.width << 'x' << config.height << 'x' << config.framerate << " stream"sv;
+    return warm;
+  }
+
+  /**
+   * @brief Get the result of a warm-up, if it finishes in time.
+   * @param warm The warm-up.
+   * @param timeout How long to wait for the warm-up if it is still in progress.
+   * @return The warm-up, or null if there is none, it failed or it didn't finish in time.
+   */
+  std::unique_ptr<warm_encoder_t>
+  get_warm_encoder(std::future<std::unique_ptr<warm_encoder_t>> &&warm, std::chrono::milliseconds timeout) {
+    if (!warm.valid()) {
+      return nullptr;
+    }
+
+    if (warm.wait_for(timeout) != std::future_status::ready) {
+      BOOST_LOG(debug) << "Prewarm: the display and encoder are still opening, discarding them"sv;
+
+      // Destroying the future would block until the warm-up has finished
+      std::thread { [warm = std::move(warm)]() mutable {
+        warm.get();
+      } }.detach();
+      return nullptr;
+    }
+
+    return warm.get();
+  }
+
+  /**
+   * @brief Take the result of the last warm-up.
+   * @param timeout How long to wait for the warm-up if it is still in progress.
+   * @return The warm-up, or null if there is none, it failed or it didn't finish in time.
+   */
+  std::unique_ptr<warm_encoder_t>
+  take_warm_encoder(std::chrono::milliseconds timeout) {
+    std::future<std::unique_ptr<warm_encoder_t>> warm;
+    {
+      std::lock_guard lg { prewarm_state.mutex };
+      warm = std::move(prewarm_state.warm);
+    }
+
+    return get_warm_encoder(std::move(warm), timeout);
+  }
+
+  void
+  prewarm(const config_t &config, bool open_encoder) {
+    {
+      std::lock_guard lg { prewarm_state.mutex };
+      prewarm_state.launch = std::chrono::steady_clock::now();
+    }
+
+    // Shared encoders and the encoders capturing on their own thread don't go through capture_async()
+    if (!config::video.prewarm_encoder || !chosen_encoder || !(chosen_encoder->flags & PARALLEL_ENCODING) ||
+        config::video.shared_encoder || !config::video.simulcast_ladder.empty()) {
+      return;
+    }
+
+    // Replace the warm-up of an earlier launch that never started streaming
+    take_warm_encoder(0ms);
+
+    std::lock_guard lg { prewarm_state.mutex };
+    auto generation = ++prewarm_state.generation;
+    prewarm_state.warm = std::async(std::launch::async, make_warm_encoder, config, open_encoder);
+
+    task_pool.pushDelayed([generation]() {
+      std::future<std::unique_ptr<warm_encoder_t>> warm;
+      {
+        std::lock_guard lg { prewarm_state.mutex };
+        if (generation != prewarm_state.generation) {
+          return;
+        }
+        warm = std::move(prewarm_state.warm);
+      }
+
+      if (get_warm_encoder(std::move(warm), 0ms)) {
+        BOOST_LOG(info) << "Prewarm: no stream started, closing the display and encoder"sv;
+      }
+    },
+      prewarm_timeout);
+  }
+
   void
   capture_async(
     safe::mail_t mail,
     config_t &config,
-    void *channel_data) {
+    safe::mail_raw_t::queue_t<packet_t> packets,
+    void *channel_data,
+    const metrics::labels_t &labels) {
     auto shutdown_event = mail->event<bool>(mail::shutdown);
 
     auto images = std::make_shared<img_event_t::element_type>();
@@ -2191,12 +3197,35 @@ namespace video {
       shutdown_event->raise(true);
     });
 
+    first_frame_timer_t timer;
+    {
+      std::lock_guard lg { prewarm_state.mutex };
+      timer.launch = std::exchange(prewarm_state.launch, std::nullopt);
+    }
+
+    // Opening the display and encoder again is faster than waiting for a warm-up that is far from done
+    auto warm = take_warm_encoder(prewarm_wait);
+    if (warm && warm->config != config) {
+      // The display only depends on the resolution, framerate and dynamic range, all sent by the client at launch
+      if (warm->config.width != config.width || warm->config.height != config.height ||
+          warm->config.framerate != config.framerate || warm->config.dynamicRange != config.dynamicRange) {
+        BOOST_LOG(info) << "Prewarm: the stream doesn't match the launch request, reopening the display"sv;
+        warm.reset();
+      }
+      else {
+        BOOST_LOG(debug) << "Prewarm: the encoder settings differ from the predicted ones, rebuilding the encoder"sv;
+        if (warm->session) {
+          session_pool.release(std::move(warm->session), *warm->display, *warm->ref->encoder_p, warm->config);
+        }
+      }
+    }
+
     auto ref = capture_thread_async.ref();
     if (!ref) {
       return;
     }
 
-    ref->capture_ctx_queue->raise(capture_ctx_t { images, config });
+    ref->capture_ctx_queue->raise(capture_ctx_t { images, config, labels });
 
     if (!ref->capture_ctx_queue->running()) {
       return;
@@ -2226,12 +3255,43 @@ namespace video {
 
         display = ref->display_wp->lock();
       }
+      timer.display_ready = std::chrono::steady_clock::now();
 
       auto &encoder = *chosen_encoder;
 
-      auto encode_device = make_encode_device(*display, encoder, config);
-      if (!encode_device) {
-        return;
+      std::unique_ptr<encode_session_t> session;
+      sunshine_colorspace_t colorspace;
+
+      // Adopt the encoder session of the warm-up, unless the display was reinitialized since
+      if (warm && warm->display == display) {
+        timer.prewarmed = true;
+        timer.display_ready = warm->display_ready;
+
+        if (warm->session) {
+          timer.encoder_ready = warm->encoder_ready;
+          colorspace = warm->colorspace;
+          session = std::move(warm->session);
+        }
+      }
+      warm.reset();
+
+      if (!session) {
+        session = session_pool.take(*display, *ref->encoder_p, config, colorspace);
+        timer.encoder_ready = std::chrono::steady_clock::now();
+      }
+
+      if (!session) {
+        auto encode_device = make_encode_device(*display, encoder, config);
+        if (!encode_device) {
+          return;
+        }
+
+        colorspace = encode_device->colorspace;
+        session = make_encode_session(display.get(), *ref->encoder_p, config, display->width, display->height, std::move(encode_device));
+        if (!session) {
+          continue;
+        }
+        timer.encoder_ready = std::chrono::steady_clock::now();
       }
 
       // absolute mouse coordinates require that the dimensions of the screen are known
@@ -2239,7 +3299,7 @@ namespace video {
 
       // Update client with our current HDR display state
       hdr_info_t hdr_info = std::make_unique<hdr_info_raw_t>(false);
-      if (colorspace_is_hdr(encode_device->colorspace)) {
+      if (colorspace_is_hdr(colorspace)) {
         if (display->get_hdr_metadata(hdr_info->metadata)) {
           hdr_info->enabled = true;
         }
@@ -2249,26 +3309,450 @@ namespace video {
       }
       hdr_event->raise(std::move(hdr_info));
 
-      encode_run(
-        frame_nr,
-        mail, images,
-        config, display,
-        std::move(encode_device),
-        ref->reinit_event, *ref->encoder_p,
-        channel_data);
+      if (!encode_run(
+            frame_nr,
+            mail, images,
+            config, display,
+            *session,
+            ref->reinit_event,
+            packets, channel_data,
+            timer)) {
+        session_pool.release(std::move(session), *display, *ref->encoder_p, config);
+      }
+    }
+  }
+
+  /**
+   * @brief A packet of a shared encoder, as seen by one of its sessions.
+   * Frame indices are rebased so every session sees its stream start at frame 1.
+   */
+  struct packet_raw_shared: packet_raw_t {
+    packet_raw_shared(std::shared_ptr<packet_raw_t> packet, int64_t frame_index_base):
+        packet { std::move(packet) }, frame_index_base { frame_index_base } {
+      replacements = this->packet->replacements;
+      after_ref_frame_invalidation = this->packet->after_ref_frame_invalidation;
+      frame_timestamp = this->packet->frame_timestamp;
+      encode_duration = this->packet->encode_duration;
+    }
+
+    bool
+    is_idr() override {
+      return packet->is_idr();
+    }
+
+    int64_t
+    frame_index() override {
+      return packet->frame_index() - frame_index_base;
+    }
+
+    uint8_t *
+    data() override {
+      return packet->data();
+    }
+
+    size_t
+    data_size() override {
+      return packet->data_size();
+    }
+
+    std::shared_ptr<packet_raw_t> packet;
+    int64_t frame_index_base;
+  };
+
+  struct shared_encode_subscriber_t;
+
+  /**
+   * @brief The state of a session streaming from shared encoders.
+   * While switching between simulcast rungs, a session is subscribed to two encoders at once.
+   */
+  struct shared_encode_session_t {
+    safe::mail_t mail;
+    void *channel_data;
+
+    std::mutex lock;
+
+    // The subscription currently delivering packets to the session
+    const shared_encode_subscriber_t *current = nullptr;
+
+    // The last frame index sent to the session
+    int64_t last_frame_index = 0;
+
+    // IDR and reference frame invalidation requests of the session, a sign of packet loss
+    int loss_events = 0;
+  };
+
+  struct shared_encode_subscriber_t {
+    std::shared_ptr<shared_encode_session_t> session;
+
+    // Difference between the frame indices of the shared stream and those sent to the session,
+    // it is set when the session receives its first IDR frame from this encoder
+    std::optional<int64_t> frame_index_base;
+  };
+
+  /**
+   * @brief An encoder whose packets are sent to every session with the same stream config.
+   */
+  struct shared_encode_t {
+    config_t config;
+
+    // The encoder thread runs capture_async() with this mail instead of the mail of a session
+    safe::mail_t mail;
+    std::thread encode_thread;
+    std::thread fanout_thread;
+
+    std::mutex subscribers_mutex;
+    std::vector<std::shared_ptr<shared_encode_subscriber_t>> subscribers;
+    std::optional<input::touch_port_t> touch_port;
+    std::optional<hdr_info_raw_t> hdr_info;
+  };
+
+  std::mutex shared_encodes_mutex;
+  std::vector<std::shared_ptr<shared_encode_t>> shared_encodes;
+
+  // How often a session on a simulcast ladder reconsiders its rung
+  constexpr auto SIMULCAST_POLL_INTERVAL = 100ms;
+
+  // A session moves down a rung after this many IDR or reference frame invalidation requests within the window
+  constexpr auto SIMULCAST_LOSS_WINDOW = 2s;
+  constexpr auto SIMULCAST_DOWNGRADE_LOSS_EVENTS = 3;
+
+  // A session moves back up a rung after streaming without loss for this long
+  constexpr auto SIMULCAST_UPGRADE_DELAY = 10s;
+
+  /**
+   * @brief Send the packets of a shared encoder to its sessions, and the feedback of the sessions to the encoder.
+   * @param shared The shared encoder.
+   * @param packets The packets produced by the encoder.
+   */
+  void
+  shared_encode_fanout(shared_encode_t &shared, safe::mail_raw_t::queue_t<packet_t> packets) {
+    auto video_packets = mail::man->queue<packet_t>(mail::video_packets);
+    auto idr_events = shared.mail->event<bool>(mail::idr);
+    auto invalidate_ref_frames_events = shared.mail->event<std::pair<int64_t, int64_t>>(mail::invalidate_ref_frames);
+    auto touch_port_events = shared.mail->event<input::touch_port_t>(mail::touch_port);
+    auto hdr_events = shared.mail->event<hdr_info_t>(mail::hdr);
+
+    while (auto packet = packets->pop()) {
+      std::shared_ptr<packet_raw_t> shared_packet = std::move(packet);
+
+      std::lock_guard lg { shared.subscribers_mutex };
+
+      if (touch_port_events->peek()) {
+        shared.touch_port = touch_port_events->pop();
+        for (auto &subscriber : shared.subscribers) {
+          subscriber->session->mail->event<input::touch_port_t>(mail::touch_port)->raise(*shared.touch_port);
+        }
+      }
+
+      if (hdr_events->peek()) {
+        shared.hdr_info = *hdr_events->pop();
+        for (auto &subscriber : shared.subscribers) {
+          subscriber->session->mail->event<hdr_info_t>(mail::hdr)->raise(std::make_unique<hdr_info_raw_t>(*shared.hdr_info));
+        }
+      }
+
+      for (auto &subscriber : shared.subscribers) {
+        auto &session = *subscriber->session;
+        std::lock_guard lg_session { session.lock };
+
+        // Forward the feedback of each session, translating its frame indices to the shared stream
+        if (session.current == subscriber.get()) {
+          auto session_idr_events = session.mail->event<bool>(mail::idr);
+          auto session_invalidate_ref_frames_events = session.mail->event<std::pair<int64_t, int64_t>>(mail::invalidate_ref_frames);
+
+          if (session_idr_events->peek()) {
+            session_idr_events->pop();
+            idr_events->raise(true);
+            ++session.loss_events;
+          }
+
+          while (session_invalidate_ref_frames_events->peek()) {
+            if (auto frames = session_invalidate_ref_frames_events->pop(0ms)) {
+              invalidate_ref_frames_events->raise(frames->first + *subscriber->frame_index_base, frames->second + *subscriber->frame_index_base);
+              ++session.loss_events;
+            }
+          }
+        }
+
+        // A session can only start decoding the output of an encoder at an IDR frame
+        if (!subscriber->frame_index_base) {
+          if (!shared_packet->is_idr()) {
+            continue;
+          }
+
+          subscriber->frame_index_base = shared_packet->frame_index() - (session.last_frame_index + 1);
+          session.current = subscriber.get();
+
+          // This IDR frame answers any request the session made before it
+          session.mail->event<bool>(mail::idr)->pop(0ms);
+          session.mail->event<std::pair<int64_t, int64_t>>(mail::invalidate_ref_frames)->pop(0ms);
+        }
+
+        // The session switched to another encoder
+        if (session.current != subscriber.get()) {
+          continue;
+        }
+
+        auto session_packet = std::make_unique<packet_raw_shared>(shared_packet, *subscriber->frame_index_base);
+        session_packet->channel_data = session.channel_data;
+        session.last_frame_index = session_packet->frame_index();
+        video_packets->raise(std::move(session_packet));
+      }
+    }
+
+    // The encoder stopped, possibly because it failed. Make sure no session joins it anymore
+    // and end the sessions that are still watching it.
+    std::lock_guard lg { shared_encodes_mutex };
+    std::erase_if(shared_encodes, [&](const auto &entry) {
+      return entry.get() == &shared;
+    });
+    shared.mail->event<bool>(mail::shutdown)->raise(true);
+
+    std::lock_guard lg_subscribers { shared.subscribers_mutex };
+    for (auto &subscriber : shared.subscribers) {
+      subscriber->session->mail->event<bool>(mail::shutdown)->raise(true);
+    }
+  }
+
+  /**
+   * @brief Subscribe a session to the shared encoder for a config, starting a new encoder if there is none.
+   * @param config The stream config.
+   * @param subscriber The subscription of the session.
+   * @param run Runs the encoder if a new one is started, capture_async() when empty.
+   * @return The shared encoder.
+   */
+  std::shared_ptr<shared_encode_t>
+  join_shared_encode(const config_t &config, std::shared_ptr<shared_encode_subscriber_t> subscriber, const shared_encode_run_t &run) {
+    std::lock_guard lg { shared_encodes_mutex };
+
+    auto it = std::find_if(std::begin(shared_encodes), std::end(shared_encodes), [&](const std::shared_ptr<shared_encode_t> &shared) {
+      return shared->config == config && !shared->mail->event<bool>(mail::shutdown)->peek();
+    });
+
+    std::shared_ptr<shared_encode_t> shared;
+    if (it != std::end(shared_encodes)) {
+      shared = *it;
+
+      // Let the new session start without waiting for the next periodic keyframe
+      shared->mail->event<bool>(mail::idr)->raise(true);
+    }
+    else {
+      shared = std::make_shared<shared_encode_t>();
+      shared->config = config;
+      shared->mail = std::make_shared<safe::mail_raw_t>();
+
+      auto packets = shared->mail->queue<packet_t>(mail::video_packets);
+      shared->encode_thread = std::thread { [shared = shared.get(), packets, run]() {
+        auto &config = shared->config;
+        if (run) {
+          run(shared->mail, config, packets);
+        }
+        else {
+          capture_async(shared->mail, config, packets, nullptr, { { "shared_encode", std::to_string(config.width) + 'x' + std::to_string(config.height) + 'x' + std::to_string(config.framerate) + '@' + std::to_string(config.bitrate) } });
+        }
+        packets->stop();
+      } };
+      shared->fanout_thread = std::thread { shared_encode_fanout, std::ref(*shared), packets };
+
+      shared_encodes.emplace_back(shared);
+    }
+
+    std::lock_guard lg_subscribers { shared->subscribers_mutex };
+    auto &mail = subscriber->session->mail;
+    if (shared->touch_port) {
+      mail->event<input::touch_port_t>(mail::touch_port)->raise(*shared->touch_port);
+    }
+    if (shared->hdr_info) {
+      mail->event<hdr_info_t>(mail::hdr)->raise(std::make_unique<hdr_info_raw_t>(*shared->hdr_info));
+    }
+    shared->subscribers.emplace_back(std::move(subscriber));
+
+    BOOST_LOG(info) << "Shared encoder "sv << config.width << 'x' << config.height << 'x' << config.framerate << " at "sv << config.bitrate << "kbps"sv
+                    << " now has "sv << shared->subscribers.size() << " session(s)"sv;
+
+    return shared;
+  }
+
+  /**
+   * @brief Unsubscribe a session from a shared encoder, stopping the encoder once it has no sessions left.
+   * @param shared The shared encoder.
+   * @param subscriber The subscription of the session.
+   */
+  void
+  leave_shared_encode(std::shared_ptr<shared_encode_t> shared, const std::shared_ptr<shared_encode_subscriber_t> &subscriber) {
+    {
+      std::lock_guard lg { shared_encodes_mutex };
+      std::lock_guard lg_subscribers { shared->subscribers_mutex };
+
+      std::erase(shared->subscribers, subscriber);
+      if (!shared->subscribers.empty()) {
+        return;
+      }
+
+      // Nobody can join this encoder anymore
+      std::erase(shared_encodes, shared);
     }
+
+    shared->mail->event<bool>(mail::shutdown)->raise(true);
+    shared->encode_thread.join();
+    shared->fanout_thread.join();
+  }
+
+  /**
+   * @brief Apply a rung of the simulcast ladder to the stream config of a session.
+   * @param config The stream config requested by the client.
+   * @param rung The rung.
+   * @return The stream config of the rung.
+   *
+   * Unless resolution switching is enabled, only the bitrate of the rung is applied:
+   * clients don't expect the resolution or framerate they negotiated to change mid-stream.
+   */
+  config_t
+  make_rung_config(config_t config, const config::video_t::simulcast_rung_t &rung) {
+    if (config::video.simulcast_resolution_switching) {
+      config.width = rung.width;
+      config.height = rung.height;
+      config.framerate = rung.framerate;
+    }
+    config.bitrate = rung.bitrate;
+
+    return config;
+  }
+
+  /**
+   * @brief Find the highest rung of the simulcast ladder that doesn't exceed what the client requested.
+   * @param config The stream config requested by the client.
+   * @return The index of the rung, the lowest rung if none fits.
+   */
+  std::size_t
+  select_rung(const config_t &config) {
+    auto &ladder = config::video.simulcast_ladder;
+
+    for (std::size_t x = 0; x < ladder.size(); ++x) {
+      auto &rung = ladder[x];
+      auto fits = !config::video.simulcast_resolution_switching ||
+                  (rung.width <= config.width && rung.height <= config.height && rung.framerate <= config.framerate);
+      if (fits && rung.bitrate <= config.bitrate) {
+        return x;
+      }
+    }
+
+    return ladder.size() - 1;
+  }
+
+  void
+  capture_shared(
+    safe::mail_t mail,
+    const config_t &config,
+    void *channel_data,
+    const shared_encode_run_t &run) {
+    auto shutdown_event = mail->event<bool>(mail::shutdown);
+
+    auto session = std::make_shared<shared_encode_session_t>();
+    session->mail = mail;
+    session->channel_data = channel_data;
+
+    auto &ladder = config::video.simulcast_ladder;
+    if (ladder.empty()) {
+      auto subscriber = std::make_shared<shared_encode_subscriber_t>(shared_encode_subscriber_t { session, std::nullopt });
+      auto shared = join_shared_encode(config, subscriber, run);
+
+      shutdown_event->view();
+
+      leave_shared_encode(std::move(shared), subscriber);
+      return;
+    }
+
+    auto top_rung = select_rung(config);
+    auto rung = top_rung;
+
+    auto subscriber = std::make_shared<shared_encode_subscriber_t>(shared_encode_subscriber_t { session, std::nullopt });
+    auto shared = join_shared_encode(make_rung_config(config, ladder[rung]), subscriber, run);
+
+    std::shared_ptr<shared_encode_subscriber_t> next_subscriber;
+    std::shared_ptr<shared_encode_t> next_shared;
+
+    auto loss_window_start = std::chrono::steady_clock::now();
+    auto stable_since = loss_window_start;
+
+    while (!shutdown_event->view(SIMULCAST_POLL_INTERVAL)) {
+      auto now = std::chrono::steady_clock::now();
+
+      if (next_subscriber) {
+        std::unique_lock ul { session->lock };
+        if (session->current != next_subscriber.get()) {
+          continue;
+        }
+        ul.unlock();
+
+        // The session received the first IDR frame of the new rung, the old one is no longer needed
+        leave_shared_encode(std::move(shared), subscriber);
+        shared = std::move(next_shared);
+        subscriber = std::move(next_subscriber);
+        stable_since = now;
+        continue;
+      }
+
+      int loss_events;
+      {
+        std::lock_guard lg { session->lock };
+        loss_events = session->loss_events;
+        if (now - loss_window_start >= SIMULCAST_LOSS_WINDOW) {
+          session->loss_events = 0;
+          loss_window_start = now;
+        }
+      }
+
+      auto next_rung = rung;
+      if (loss_events >= SIMULCAST_DOWNGRADE_LOSS_EVENTS && rung + 1 < ladder.size()) {
+        next_rung = rung + 1;
+      }
+      else if (loss_events > 0) {
+        stable_since = now;
+      }
+      else if (now - stable_since >= SIMULCAST_UPGRADE_DELAY && rung > top_rung) {
+        next_rung = rung - 1;
+      }
+
+      if (next_rung == rung) {
+        continue;
+      }
+
+      auto next_config = make_rung_config(config, ladder[next_rung]);
+      BOOST_LOG(info) << "Switching session to simulcast rung "sv << next_config.width << 'x' << next_config.height << 'x' << next_config.framerate
+                      << " at "sv << next_config.bitrate << "kbps"sv;
+
+      {
+        std::lock_guard lg { session->lock };
+        session->loss_events = 0;
+      }
+      loss_window_start = now;
+      rung = next_rung;
+
+      next_subscriber = std::make_shared<shared_encode_subscriber_t>(shared_encode_subscriber_t { session, std::nullopt });
+      next_shared = join_shared_encode(next_config, next_subscriber, run);
+    }
+
+    if (next_subscriber) {
+      leave_shared_encode(std::move(next_shared), next_subscriber);
+    }
+    leave_shared_encode(std::move(shared), subscriber);
   }
 
   void
   capture(
     safe::mail_t mail,
     config_t config,
-    void *channel_data) {
+    void *channel_data,
+    const metrics::labels_t &labels) {
     auto idr_events = mail->event<bool>(mail::idr);
 
     idr_events->raise(true);
-    if (chosen_encoder->flags & PARALLEL_ENCODING) {
-      capture_async(std::move(mail), config, channel_data);
+    if ((config::video.shared_encoder || !config::video.simulcast_ladder.empty()) && chosen_encoder->flags & PARALLEL_ENCODING) {
+      capture_shared(std::move(mail), config, channel_data);
+    }
+    else if (chosen_encoder->flags & PARALLEL_ENCODING) {
+      capture_async(std::move(mail), config, mail::man->queue<packet_t>(mail::video_packets), channel_data, labels);
     }
     else {
       safe::signal_t join_event;
@@ -2545,6 +4029,10 @@ namespace video {
       return 0;
     }
 
+    // Don't probe while a warm-up holds the display or an encoder session, the probe takes longer anyway
+    take_warm_encoder(prewarm_timeout);
+    session_pool.clear();
+
     // Restart encoder selection
     auto previous_encoder = chosen_encoder;
     chosen_encoder = nullptr;
@@ -2676,7 +4164,9 @@ namespace video {
 
     auto &encoder = *chosen_encoder;
 
-    last_encoder_probe_supported_ref_frames_invalidation = (encoder.flags & REF_FRAMES_INVALIDATION);
+    // Software encoding handles reference frame invalidation with intra refresh when it's enabled
+    last_encoder_probe_supported_ref_frames_invalidation = (encoder.flags & REF_FRAMES_INVALIDATION) ||
+                                                           (&encoder == &software && config::video.sw.intra_refresh);
     last_encoder_probe_supported_yuv444_for_codec[0] = encoder.h264[encoder_t::PASSED] &&
                                                        encoder.h264[encoder_t::YUV444];
     last_encoder_probe_supported_yuv444_for_codec[1] = encoder.hevc[encoder_t::PASSED] &&
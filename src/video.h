@@ -5,6 +5,7 @@
 #pragma once
 
 #include "input.h"
+#include "metrics.h"
 #include "platform/common.h"
 #include "thread_safe.h"
 #include "video_colorspace.h"
@@ -40,6 +41,9 @@ namespace video {
     int chromaSamplingType;  // 0 - 4:2:0, 1 - 4:4:4
 
     int enableIntraRefresh;  // 0 - disabled, 1 - enabled
+
+    bool
+    operator==(const config_t &) const = default;
   };
 
   platf::mem_type_e
@@ -264,6 +268,7 @@ namespace video {
     void *channel_data = nullptr;
     bool after_ref_frame_invalidation = false;
     std::optional<std::chrono::steady_clock::time_point> frame_timestamp;
+    std::optional<std::chrono::steady_clock::duration> encode_duration;
   };
 
   struct packet_raw_avcodec: packet_raw_t {
@@ -347,11 +352,54 @@ namespace video {
   extern bool last_encoder_probe_supported_ref_frames_invalidation;
   extern std::array<bool, 3> last_encoder_probe_supported_yuv444_for_codec;  // 0 - H.264, 1 - HEVC, 2 - AV1
 
+  /**
+   * @brief Capture, encode and send the video stream of a session until it shuts down.
+   * @param mail The mail of the session.
+   * @param config The stream config.
+   * @param channel_data The session, attached to each packet.
+   * @param labels The labels of the session's metrics, used for the capture backpressure metrics.
+   */
   void
   capture(
     safe::mail_t mail,
     config_t config,
-    void *channel_data);
+    void *channel_data,
+    const metrics::labels_t &labels);
+
+  /**
+   * @brief Runs the encoder of a shared encode until it stops or fails.
+   * @details It receives the mail of the shared encode, the stream config and the queue its packets go to.
+   */
+  using shared_encode_run_t = std::function<void(safe::mail_t, config_t &, safe::mail_raw_t::queue_t<packet_t>)>;
+
+  /**
+   * @brief Stream the output of the shared encoder matching the config of a session.
+   * @param mail The mail of the session.
+   * @param config The stream config of the session.
+   * @param channel_data The session.
+   * @param run Runs a newly started shared encoder, capture_async() when empty.
+   *
+   * With a simulcast ladder, the session starts on the highest rung that fits its config.
+   * It moves down a rung when it reports sustained packet loss and back up once the stream is clean again,
+   * switching at the first IDR frame of the new rung so it is never left without video.
+   */
+  void
+  capture_shared(
+    safe::mail_t mail,
+    const config_t &config,
+    void *channel_data,
+    const shared_encode_run_t &run = {});
+
+  /**
+   * @brief Open the display and an encoder session while the client negotiates its stream.
+   * @details Called when a client launches or resumes an app. The capture and encoder threads adopt what was
+   *          opened here if the stream config turns out to match the predicted one, otherwise they rebuild it.
+   *          Nothing that was opened is kept if no stream starts within a few seconds.
+   * @param config The predicted stream config.
+   * @param open_encoder Also open an encoder session, only worth it if the config was predicted from an earlier stream.
+   */
+  void
+  prewarm(const config_t &config, bool open_encoder);
 
   bool
   validate_encoder(encoder_t &encoder, bool expect_failure);
@@ -366,4 +414,13 @@ namespace video {
    */
   int
   probe_encoders();
+
+  /**
+   * @brief Find the NAL units of an Annex B bitstream.
+   * @param data The bitstream.
+   * @param size The size of the bitstream.
+   * @return The offset of the start code of each NAL unit, including the leading zero byte of 4 byte start codes.
+   */
+  std::vector<std::size_t>
+  find_nal_units(const uint8_t *data, std::size_t size);
 }  // namespace video
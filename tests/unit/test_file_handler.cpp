@@ -88,3 +88,13 @@ TEST(FileHandlerTests, ReadMissingFileTest) {
   // read missing file
   EXPECT_EQ(file_handler::read_file("non-existing-file.txt"), "");
 }
+
+TEST(FileHandlerTests, ReadFileRangeTest) {
+  std::string fileName = "read_file_range_test.txt";
+  EXPECT_EQ(file_handler::write_file(fileName.c_str(), "0123456789"), 0);
+
+  EXPECT_EQ(file_handler::read_file_range(fileName.c_str(), 0, 4), "0123");
+  EXPECT_EQ(file_handler::read_file_range(fileName.c_str(), 6, 100), "6789");
+  EXPECT_EQ(file_handler::read_file_range(fileName.c_str(), 10, 4), "");
+  EXPECT_EQ(file_handler::read_file_range("non-existing-file.txt", 0, 4), "");
+}
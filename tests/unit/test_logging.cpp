@@ -2,11 +2,16 @@
  * @file tests/unit/test_logging.cpp
  * @brief Test src/logging.*.
  */
+#include <src/log_writer.h>
 #include <src/logging.h>
 
 #include "../tests_common.h"
 #include "../tests_log_checker.h"
 
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <future>
 #include <random>
 
 namespace {
@@ -42,3 +47,110 @@ TEST_P(LogLevelsTest, PutMessage) {
 
   ASSERT_TRUE(log_checker::line_contains(log_file, test_message));
 }
+
+namespace {
+  using writer_sink_t = boost::log::sinks::synchronous_sink<logging::log_writer_t>;
+}  // namespace
+
+TEST(LogWriterTest, RotatesAtMaxSize) {
+  const std::string writer_file = "test_log_writer.log";
+  std::filesystem::remove(writer_file + ".1");
+
+  logging::log_writer_t::options_t options;
+  options.file = writer_file;
+  options.max_size = 1024;
+  options.formatter = &logging::formatter;
+
+  auto writer_sink = boost::make_shared<writer_sink_t>(boost::make_shared<logging::log_writer_t>(std::move(options)));
+  boost::log::core::get()->add_sink(writer_sink);
+  for (int x = 0; x < 100; ++x) {
+    BOOST_LOG(tests) << std::string(50, 'x');
+  }
+  writer_sink->flush();
+  boost::log::core::get()->remove_sink(writer_sink);
+
+  // Rotation happens at batch boundaries, so the current file is below the limit after a flush
+  EXPECT_TRUE(std::filesystem::exists(writer_file + ".1"));
+  EXPECT_LT(std::filesystem::file_size(writer_file), 1024);
+}
+
+TEST(LogWriterTest, DropsWhenQueueIsFull) {
+  logging::log_writer_t::options_t options;
+  options.file = "test_log_writer_drop.log";
+  options.formatter = &logging::formatter;
+  options.max_queue = 1;
+  options.flush_interval = std::chrono::hours(1);
+  options.flush_severity = std::numeric_limits<int>::max();
+
+  auto writer = boost::make_shared<logging::log_writer_t>(std::move(options));
+  auto writer_sink = boost::make_shared<writer_sink_t>(writer);
+  boost::log::core::get()->add_sink(writer_sink);
+  for (int x = 0; x < 10; ++x) {
+    BOOST_LOG(tests) << "queued " << x;
+  }
+  boost::log::core::get()->remove_sink(writer_sink);
+
+  EXPECT_EQ(writer->dropped(), 9);
+
+  writer_sink->flush();
+  ASSERT_TRUE(log_checker::line_contains("test_log_writer_drop.log", "queued 0"));
+  ASSERT_FALSE(log_checker::line_contains("test_log_writer_drop.log", "queued 1"));
+}
+
+TEST(LogWriterTest, ReportsDropsWithoutDeadlockingFlush) {
+  logging::log_writer_t::options_t options;
+  options.file = "test_log_writer_drop_flush.log";
+  options.formatter = &logging::formatter;
+  options.max_queue = 1;
+  options.flush_interval = std::chrono::hours(1);
+  options.flush_severity = std::numeric_limits<int>::max();
+
+  auto writer = boost::make_shared<logging::log_writer_t>(std::move(options));
+  auto writer_sink = boost::make_shared<writer_sink_t>(writer);
+  boost::log::core::get()->add_sink(writer_sink);
+  for (int x = 0; x < 3; ++x) {
+    BOOST_LOG(tests) << "queued " << x;
+  }
+
+  // Flush while the sink is still attached, so a drop notice logged through the core would deadlock
+  std::promise<void> flushed;
+  auto flushed_future = flushed.get_future();
+  std::thread([writer_sink, flushed = std::move(flushed)]() mutable {
+    writer_sink->flush();
+    flushed.set_value();
+  }).detach();
+  auto status = flushed_future.wait_for(std::chrono::seconds(5));
+  boost::log::core::get()->remove_sink(writer_sink);
+  ASSERT_EQ(status, std::future_status::ready);
+
+  EXPECT_EQ(writer->dropped(), 2);
+  ASSERT_TRUE(log_checker::line_contains("test_log_writer_drop_flush.log", "Warning: Dropped 2 log records"));
+}
+
+TEST(LogWriterTest, StampsRecordsWhenTheyAreMade) {
+  logging::log_writer_t::options_t options;
+  options.file = "test_log_writer_time.log";
+  options.formatter = &logging::formatter;
+  options.flush_interval = std::chrono::hours(1);
+  options.flush_severity = std::numeric_limits<int>::max();
+
+  auto writer_sink = boost::make_shared<writer_sink_t>(boost::make_shared<logging::log_writer_t>(std::move(options)));
+  boost::log::core::get()->add_sink(writer_sink);
+  BOOST_LOG(tests) << "stamped first";
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  BOOST_LOG(tests) << "stamped second";
+  writer_sink->flush();
+  boost::log::core::get()->remove_sink(writer_sink);
+
+  // Both records are written in the same batch, but keep the times they were logged at
+  std::vector<int> times;
+  std::ifstream in { "test_log_writer_time.log" };
+  for (std::string line; std::getline(in, line);) {
+    int hours, minutes, seconds, ms;
+    if (std::sscanf(line.c_str(), "[%*d-%*d-%*d %d:%d:%d.%d]", &hours, &minutes, &seconds, &ms) == 4) {
+      times.push_back(((hours * 60 + minutes) * 60 + seconds) * 1000 + ms);
+    }
+  }
+  ASSERT_EQ(times.size(), 2);
+  EXPECT_GE(times[1] - times[0], 150);
+}
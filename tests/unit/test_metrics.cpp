@@ -0,0 +1,63 @@
+/**
+ * @file tests/unit/test_metrics.cpp
+ * @brief Test src/metrics.*.
+ */
+#include <src/metrics.h>
+
+#include "../tests_common.h"
+
+TEST(MetricsTests, SeriesAreSharedByNameAndLabels) {
+  auto a = metrics::counter("test_shared_total", "Test counter", { { "session", "1" } });
+  auto b = metrics::counter("test_shared_total", "Test counter", { { "session", "1" } });
+  auto c = metrics::counter("test_shared_total", "Test counter", { { "session", "2" } });
+
+  a->inc(2);
+  b->inc();
+  EXPECT_EQ(a->value(), 3);
+  EXPECT_EQ(c->value(), 0);
+
+  metrics::remove({ { "session", "1" } });
+  metrics::remove({ { "session", "2" } });
+}
+
+TEST(MetricsTests, SerializeCounterAndGauge) {
+  metrics::counter("test_serialize_total", "Test counter", { { "session", "7" } })->inc(5);
+  metrics::gauge("test_serialize_depth", "Test gauge")->set(2.5);
+
+  auto text = metrics::serialize();
+  EXPECT_NE(text.find("# TYPE test_serialize_total counter\n"), std::string::npos);
+  EXPECT_NE(text.find("test_serialize_total{session=\"7\"} 5\n"), std::string::npos);
+  EXPECT_NE(text.find("# TYPE test_serialize_depth gauge\n"), std::string::npos);
+  EXPECT_NE(text.find("test_serialize_depth 2.5\n"), std::string::npos);
+
+  metrics::remove({ { "session", "7" } });
+  EXPECT_EQ(metrics::serialize().find("test_serialize_total{"), std::string::npos);
+}
+
+TEST(MetricsTests, SerializeHistogram) {
+  auto histogram = metrics::histogram("test_latency_seconds", "Test histogram", { 0.001, 0.01 }, { { "session", "8" } });
+  histogram->observe(0.0005);
+  histogram->observe(std::chrono::milliseconds(5));
+  histogram->observe(1.0);
+
+  auto text = metrics::serialize();
+  EXPECT_NE(text.find("test_latency_seconds_bucket{session=\"8\",le=\"0.001\"} 1\n"), std::string::npos);
+  EXPECT_NE(text.find("test_latency_seconds_bucket{session=\"8\",le=\"0.01\"} 2\n"), std::string::npos);
+  EXPECT_NE(text.find("test_latency_seconds_bucket{session=\"8\",le=\"+Inf\"} 3\n"), std::string::npos);
+  EXPECT_NE(text.find("test_latency_seconds_count{session=\"8\"} 3\n"), std::string::npos);
+
+  metrics::remove({ { "session", "8" } });
+}
+
+TEST(MetricsTests, RemoveWithoutLabelsKeepsEverySeries) {
+  metrics::counter("test_remove_total", "Test counter", { { "session", "9" } })->inc();
+  metrics::gauge("test_remove_depth", "Test gauge")->add(1.5);
+
+  metrics::remove({});
+
+  auto text = metrics::serialize();
+  EXPECT_NE(text.find("test_remove_total{session=\"9\"} 1\n"), std::string::npos);
+  EXPECT_NE(text.find("test_remove_depth 1.5\n"), std::string::npos);
+
+  metrics::remove({ { "session", "9" } });
+}
@@ -0,0 +1,75 @@
+/**
+ * @file tests/unit/test_pacing.cpp
+ * @brief Test src/pacing.*.
+ */
+#include <src/pacing.h>
+
+#include "../tests_common.h"
+
+using namespace std::literals;
+
+TEST(PacingTests, StartsAtBurstAllowance) {
+  pacing::link_budget_t link;
+  link.set_budget(800'000'000);
+
+  pacing::policy_t policy { link, 50'000, 400 };
+  EXPECT_EQ(policy.rate(), 200'000'000);
+  EXPECT_EQ(link.demand(), 200'000'000);
+
+  // 200 Mbps is 25 KB per millisecond
+  EXPECT_EQ(policy.packets_per_ms(1000), 25);
+}
+
+TEST(PacingTests, BacksOffOnLossAndRecovers) {
+  pacing::link_budget_t link;
+  pacing::policy_t policy { link, 10'000, 1000 };
+
+  auto now = std::chrono::steady_clock::now();
+  policy.on_loss(5, now);
+  EXPECT_EQ(policy.desired_rate(), 75'000'000);
+
+  // Reports right after a decrease don't cut the rate again
+  policy.on_loss(5, now + 50ms);
+  EXPECT_EQ(policy.desired_rate(), 75'000'000);
+
+  for (int x = 1; x < 20; ++x) {
+    policy.on_loss(5, now + x * 1s);
+  }
+  EXPECT_EQ(policy.desired_rate(), 15'000'000);
+
+  // Clean reports climb back to the ceiling in about 10 seconds
+  for (int x = 20; x < 32; ++x) {
+    policy.on_loss(0, now + x * 1s);
+  }
+  EXPECT_EQ(policy.desired_rate(), 100'000'000);
+  EXPECT_EQ(link.demand(), 100'000'000);
+}
+
+TEST(PacingTests, BacksOffOnQueueingDelay) {
+  pacing::link_budget_t link;
+  pacing::policy_t policy { link, 10'000, 1000 };
+
+  auto now = std::chrono::steady_clock::now();
+  policy.on_rtt(2ms, now);
+  policy.on_rtt(8ms, now + 1s);
+  EXPECT_EQ(policy.desired_rate(), 100'000'000);
+
+  policy.on_rtt(40ms, now + 2s);
+  EXPECT_EQ(policy.desired_rate(), 75'000'000);
+}
+
+TEST(PacingTests, SessionsShareTheLink) {
+  pacing::link_budget_t link;
+  link.set_budget(100'000'000);
+
+  pacing::policy_t a { link, 20'000, 500 };
+  {
+    pacing::policy_t b { link, 60'000, 500 };
+    EXPECT_EQ(link.demand(), 400'000'000);
+    EXPECT_EQ(a.rate(), 25'000'000);
+    EXPECT_EQ(b.rate(), 75'000'000);
+  }
+
+  EXPECT_EQ(link.demand(), 100'000'000);
+  EXPECT_EQ(a.rate(), 100'000'000);
+}
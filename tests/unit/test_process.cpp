@@ -0,0 +1,241 @@
+/**
+ * @file tests/unit/test_process.cpp
+ * @brief Test src/process.*
+ */
+#include <src/process.h>
+
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#ifndef _WIN32
+  #include <sys/wait.h>
+#endif
+
+#include "../tests_common.h"
+
+namespace {
+  void
+  write_file(const std::filesystem::path &path, const std::string &content) {
+    std::ofstream file { path, std::ios::binary | std::ios::trunc };
+    file << content;
+  }
+}  // namespace
+
+TEST(ProcessImageHashTest, HashesFileContent) {
+  auto path = std::filesystem::temp_directory_path() / "sunshine_test_image_hash.png";
+  write_file(path, "abc");
+
+  EXPECT_EQ(proc::image_sha256(path.string()), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+
+  std::filesystem::remove(path);
+  EXPECT_EQ(proc::image_sha256(path.string()), std::nullopt);
+}
+
+TEST(ProcessImageHashTest, RehashesChangedFile) {
+  auto path = std::filesystem::temp_directory_path() / "sunshine_test_image_rehash.png";
+  write_file(path, "abc");
+
+  auto first = proc::image_sha256(path.string());
+  ASSERT_TRUE(first);
+
+  // Cached digests must not outlive the content they were calculated from
+  write_file(path, "abcd");
+  auto second = proc::image_sha256(path.string());
+  EXPECT_EQ(second, "88d4266fd4e6338d13b845fcf289579d209c897823b9217da3e161936f031589");
+  EXPECT_NE(first, second);
+
+  std::filesystem::remove(path);
+}
+
+#ifndef _WIN32
+namespace {
+  proc::running_cmd_t
+  start_cmd(int index, const std::string &cmd, std::chrono::seconds timeout = {}) {
+    return { index, cmd, timeout, boost::process::v1::child(cmd), std::chrono::steady_clock::now() };
+  }
+
+  proc::ctx_t
+  make_app(std::vector<proc::cmd_t> &&prep_cmds) {
+    proc::ctx_t app {};
+    app.prep_cmds = std::move(prep_cmds);
+    app.name = "Prep test";
+    app.id = "1";
+    return app;
+  }
+
+  proc::cmd_t
+  make_cmd(std::string do_cmd, std::string group = {}, bool background = false, std::chrono::seconds timeout = {}) {
+    proc::cmd_t cmd { std::move(do_cmd), false };
+    cmd.group = std::move(group);
+    cmd.background = background;
+    cmd.timeout = timeout;
+    return cmd;
+  }
+
+  std::shared_ptr<rtsp_stream::launch_session_t>
+  make_launch_session() {
+    auto launch_session = std::make_shared<rtsp_stream::launch_session_t>();
+    launch_session->width = 1920;
+    launch_session->height = 1080;
+    launch_session->fps = 60;
+    launch_session->surround_info = 2;
+    return launch_session;
+  }
+}  // namespace
+
+TEST(ProcessPrepCmdTest, WaitReportsExitCodes) {
+  std::vector<proc::running_cmd_t> cmds;
+  cmds.push_back(start_cmd(1, "sh -c \"exit 0\""));
+  cmds.push_back(start_cmd(2, "sh -c \"exit 3\""));
+
+  auto timings = proc::wait_cmds(cmds);
+  ASSERT_EQ(timings.size(), 2);
+  EXPECT_EQ(timings[0].index, 1);
+  EXPECT_EQ(timings[0].status, proc::prep_timing_t::SUCCEEDED);
+  EXPECT_EQ(timings[0].exit_code, 0);
+  EXPECT_EQ(timings[1].index, 2);
+  EXPECT_EQ(timings[1].status, proc::prep_timing_t::FAILED);
+  EXPECT_EQ(timings[1].exit_code, 3);
+}
+
+TEST(ProcessPrepCmdTest, WaitTerminatesOnTimeout) {
+  std::vector<proc::running_cmd_t> cmds;
+  cmds.push_back(start_cmd(1, "sleep 30", std::chrono::seconds(1)));
+  cmds.push_back(start_cmd(2, "sh -c \"exit 0\""));
+
+  auto start = std::chrono::steady_clock::now();
+  auto timings = proc::wait_cmds(cmds);
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(10));
+
+  ASSERT_EQ(timings.size(), 2);
+  EXPECT_EQ(timings[0].status, proc::prep_timing_t::TIMED_OUT);
+  EXPECT_FALSE(cmds[0].child.running());
+  EXPECT_EQ(timings[1].status, proc::prep_timing_t::SUCCEEDED);
+}
+
+TEST(ProcessPrepCmdTest, WaitFailsWithoutExitCode) {
+  // Reap the children behind the back of Boost, so their exit codes are lost
+  for (auto count : { 1, 2 }) {
+    std::vector<proc::running_cmd_t> cmds;
+    for (int x = 0; x < count; ++x) {
+      cmds.push_back(start_cmd(x + 1, "sh -c \"exit 0\""));
+
+      int status;
+      ASSERT_EQ(waitpid(cmds.back().child.id(), &status, 0), cmds.back().child.id());
+    }
+
+    auto timings = proc::wait_cmds(cmds);
+    ASSERT_EQ(timings.size(), count);
+    for (auto &timing : timings) {
+      EXPECT_EQ(timing.status, proc::prep_timing_t::FAILED);
+      EXPECT_EQ(timing.exit_code, -1);
+    }
+  }
+}
+
+TEST(ProcessPrepCmdTest, GroupRunsAtTheSameTime) {
+  std::vector<proc::cmd_t> prep_cmds;
+  prep_cmds.push_back(make_cmd("sleep 1", "setup"));
+  prep_cmds.push_back(make_cmd("sleep 1", "setup"));
+  prep_cmds.push_back(make_cmd("sh -c \"exit 0\""));
+  proc::proc_t prep_proc { boost::this_process::environment(), { make_app(std::move(prep_cmds)) } };
+
+  auto start = std::chrono::steady_clock::now();
+  ASSERT_EQ(prep_proc.execute(1, make_launch_session()), 0);
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(1900));
+
+  auto &timings = prep_proc.get_prep_timings();
+  ASSERT_EQ(timings.size(), 3);
+  for (int x = 0; x < 3; ++x) {
+    EXPECT_EQ(timings[x].index, x + 1);
+    EXPECT_EQ(timings[x].status, proc::prep_timing_t::SUCCEEDED);
+  }
+  EXPECT_EQ(timings[0].group, "setup");
+  EXPECT_EQ(timings[1].group, "setup");
+  EXPECT_EQ(timings[2].group, "");
+
+  prep_proc.terminate();
+}
+
+TEST(ProcessPrepCmdTest, FailedGroupStopsLaunch) {
+  std::vector<proc::cmd_t> prep_cmds;
+  prep_cmds.push_back(make_cmd("sh -c \"exit 1\"", "setup"));
+  prep_cmds.push_back(make_cmd("sh -c \"exit 0\"", "setup"));
+  prep_cmds.push_back(make_cmd("sh -c \"exit 0\""));
+  proc::proc_t prep_proc { boost::this_process::environment(), { make_app(std::move(prep_cmds)) } };
+
+  EXPECT_EQ(prep_proc.execute(1, make_launch_session()), -1);
+
+  // The command after the failed group is never started
+  auto &timings = prep_proc.get_prep_timings();
+  ASSERT_EQ(timings.size(), 2);
+  EXPECT_EQ(timings[0].status, proc::prep_timing_t::FAILED);
+  EXPECT_EQ(timings[0].exit_code, 1);
+  EXPECT_EQ(timings[1].status, proc::prep_timing_t::SUCCEEDED);
+}
+
+TEST(ProcessPrepCmdTest, TimeoutStopsLaunch) {
+  std::vector<proc::cmd_t> prep_cmds;
+  prep_cmds.push_back(make_cmd("sleep 30", {}, false, std::chrono::seconds(1)));
+  prep_cmds.push_back(make_cmd("sh -c \"exit 0\""));
+  proc::proc_t prep_proc { boost::this_process::environment(), { make_app(std::move(prep_cmds)) } };
+
+  EXPECT_EQ(prep_proc.execute(1, make_launch_session()), -1);
+
+  auto &timings = prep_proc.get_prep_timings();
+  ASSERT_EQ(timings.size(), 1);
+  EXPECT_EQ(timings[0].status, proc::prep_timing_t::TIMED_OUT);
+}
+
+TEST(ProcessPrepCmdTest, ReaperDoesNotTakeExitCodes) {
+  // The control thread polls running(), which reaps zombies, while a launch is in progress
+  proc::proc_t idle_proc { boost::this_process::environment(), {} };
+  std::atomic_bool launched = false;
+  std::thread poller { [&]() {
+    while (!launched) {
+      idle_proc.running();
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  } };
+
+  std::vector<proc::cmd_t> prep_cmds;
+  for (int x = 0; x < 20; ++x) {
+    prep_cmds.push_back(make_cmd("sh -c \"exit 0\""));
+  }
+  proc::proc_t prep_proc { boost::this_process::environment(), { make_app(std::move(prep_cmds)) } };
+
+  auto result = prep_proc.execute(1, make_launch_session());
+  launched = true;
+  poller.join();
+
+  ASSERT_EQ(result, 0);
+  for (auto &timing : prep_proc.get_prep_timings()) {
+    EXPECT_EQ(timing.status, proc::prep_timing_t::SUCCEEDED);
+  }
+
+  prep_proc.terminate();
+}
+
+TEST(ProcessPrepCmdTest, BackgroundDoesNotBlockLaunch) {
+  std::vector<proc::cmd_t> prep_cmds;
+  prep_cmds.push_back(make_cmd("sleep 30", {}, true));
+  prep_cmds.push_back(make_cmd("sh -c \"exit 0\""));
+  proc::proc_t prep_proc { boost::this_process::environment(), { make_app(std::move(prep_cmds)) } };
+
+  auto start = std::chrono::steady_clock::now();
+  ASSERT_EQ(prep_proc.execute(1, make_launch_session()), 0);
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(10));
+
+  auto &timings = prep_proc.get_prep_timings();
+  ASSERT_EQ(timings.size(), 2);
+  EXPECT_EQ(timings[0].status, proc::prep_timing_t::BACKGROUND);
+  EXPECT_EQ(timings[1].status, proc::prep_timing_t::SUCCEEDED);
+
+  // Background commands without a timeout are terminated with the session
+  start = std::chrono::steady_clock::now();
+  prep_proc.terminate();
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(10));
+}
+#endif
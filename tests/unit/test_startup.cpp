@@ -0,0 +1,123 @@
+/**
+ * @file tests/unit/test_startup.cpp
+ * @brief Test src/startup.*
+ */
+#include <src/startup.h>
+
+#include <atomic>
+#include <future>
+
+#include "../tests_common.h"
+#include "../tests_log_checker.h"
+
+using namespace std::literals;
+
+TEST(StartupTest, RunsIndependentComponentsConcurrently) {
+  startup::orchestrator_t orchestrator;
+
+  // Each component only finishes once the other one has started
+  std::atomic<int> started = 0;
+  auto init = [&]() {
+    ++started;
+    auto deadline = std::chrono::steady_clock::now() + 5s;
+    while (started < 2 && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(1ms);
+    }
+    return started == 2;
+  };
+
+  orchestrator.add("a", {}, init);
+  orchestrator.add("b", {}, init);
+  orchestrator.start();
+
+  EXPECT_TRUE(orchestrator.wait("a"));
+  EXPECT_TRUE(orchestrator.wait("b"));
+}
+
+TEST(StartupTest, StartsDependentsAfterTheirDependencies) {
+  startup::orchestrator_t orchestrator;
+
+  std::atomic<bool> platform_done = false;
+  std::atomic<bool> order_ok = false;
+  orchestrator.add("encoder", { "platform" }, [&]() {
+    order_ok = platform_done.load();
+    return true;
+  });
+  orchestrator.add("platform", {}, [&]() {
+    std::this_thread::sleep_for(20ms);
+    platform_done = true;
+    return true;
+  });
+  orchestrator.start();
+
+  EXPECT_TRUE(orchestrator.wait("encoder"));
+  EXPECT_TRUE(order_ok);
+
+  orchestrator.join();
+  auto components = orchestrator.components();
+  ASSERT_EQ(components.size(), 2);
+  EXPECT_EQ(components[0].name, "encoder");
+  EXPECT_GE(components[0].started, components[1].started + components[1].duration);
+}
+
+TEST(StartupTest, FailedDependencyStillRunsDependents) {
+  startup::orchestrator_t orchestrator;
+
+  std::atomic<bool> ran = false;
+  orchestrator.add("platform", {}, []() -> bool {
+    throw std::runtime_error("no display");
+  });
+  orchestrator.add("input", { "platform" }, [&]() {
+    ran = true;
+    return true;
+  });
+  orchestrator.start();
+
+  EXPECT_FALSE(orchestrator.wait("platform"));
+  EXPECT_TRUE(orchestrator.wait("input"));
+  EXPECT_TRUE(ran);
+  EXPECT_EQ(orchestrator.state("platform"), startup::state_e::failed);
+}
+
+TEST(StartupTest, FailsUnresolvableDependencies) {
+  startup::orchestrator_t orchestrator;
+
+  orchestrator.add("a", { "b" }, []() { return true; });
+  orchestrator.add("b", { "a" }, []() { return true; });
+  orchestrator.add("c", { "missing" }, []() { return true; });
+  orchestrator.start();
+
+  EXPECT_FALSE(orchestrator.wait("a"));
+  EXPECT_FALSE(orchestrator.wait("b"));
+  EXPECT_FALSE(orchestrator.wait("c"));
+  orchestrator.join();
+}
+
+TEST(StartupTest, WakesWaitersOfUnresolvableDependencies) {
+  startup::orchestrator_t orchestrator;
+
+  orchestrator.add("a", { "missing" }, []() { return true; });
+
+  // The waiter blocks before the startup began, so only a notification can wake it
+  auto waited = std::async(std::launch::async, [&]() {
+    return orchestrator.wait("a");
+  });
+  std::this_thread::sleep_for(20ms);
+  orchestrator.start();
+
+  ASSERT_EQ(waited.wait_for(5s), std::future_status::ready);
+  EXPECT_FALSE(waited.get());
+  orchestrator.join();
+}
+
+TEST(StartupTest, LogsTimelineOnceTheLastComponentFinishes) {
+  startup::orchestrator_t orchestrator;
+
+  orchestrator.add("timeline_first", {}, []() { return true; });
+  orchestrator.add("timeline_last", { "timeline_first" }, []() { return true; });
+  orchestrator.start();
+
+  // Before join(), which only runs at shutdown
+  EXPECT_TRUE(orchestrator.wait("timeline_last"));
+  EXPECT_TRUE(log_checker::line_contains("test_sunshine.log", "ms [timeline_last] ready in "));
+}
@@ -0,0 +1,60 @@
+/**
+ * @file tests/unit/test_stat_trackers.cpp
+ * @brief Test src/stat_trackers.*.
+ */
+#include <src/stat_trackers.h>
+
+#include "../tests_common.h"
+
+struct LogLinearHistogramIndexTest: testing::TestWithParam<std::uint64_t> {};
+
+TEST_P(LogLinearHistogramIndexTest, HighestValueIsWithinRelativeError) {
+  using histogram_t = stat_trackers::log_linear_histogram<>;
+
+  auto value = GetParam();
+  auto highest = histogram_t::highest_value_at(histogram_t::index_of(value));
+
+  EXPECT_GE(highest, value);
+  EXPECT_LE(highest - value, value / histogram_t::sub_bucket_count);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+  StatTrackersTests,
+  LogLinearHistogramIndexTest,
+  testing::Values(0, 1, 31, 32, 33, 63, 64, 1000, 123456, 1ULL << 40, std::numeric_limits<std::uint64_t>::max()));
+
+TEST(StatTrackersTests, HistogramPercentiles) {
+  stat_trackers::log_linear_histogram<> histogram;
+  EXPECT_EQ(histogram.value_at_percentile(50), 0);
+
+  for (std::uint64_t x = 1; x <= 1000; ++x) {
+    histogram.record(x);
+  }
+
+  EXPECT_EQ(histogram.count(), 1000);
+  EXPECT_NEAR(histogram.value_at_percentile(50), 500, 500 / 32);
+  EXPECT_NEAR(histogram.value_at_percentile(99), 990, 990 / 32);
+  EXPECT_NEAR(histogram.value_at_percentile(100), 1000, 1000 / 32);
+
+  histogram.reset();
+  EXPECT_EQ(histogram.count(), 0);
+}
+
+TEST(StatTrackersTests, PercentileTrackerStats) {
+  stat_trackers::percentile_tracker<double> tracker;
+  auto callback = [](const auto &) { FAIL() << "Interval should not have elapsed"; };
+
+  for (int x = 0; x < 1000; ++x) {
+    tracker.collect_and_callback_on_interval(x < 990 ? 1.0 : 50.0, callback, std::chrono::hours(1));
+  }
+
+  auto stats = tracker.stats();
+  EXPECT_DOUBLE_EQ(stats.stat_min, 1.0);
+  EXPECT_DOUBLE_EQ(stats.stat_max, 50.0);
+  EXPECT_NEAR(stats.p50, 1.0, 1.0 / 32);
+  EXPECT_NEAR(stats.p95, 1.0, 1.0 / 32);
+  EXPECT_NEAR(stats.p999, 50.0, 50.0 / 32);
+
+  tracker.reset();
+  EXPECT_DOUBLE_EQ(tracker.stats().p99, 0.0);
+}
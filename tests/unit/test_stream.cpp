@@ -8,9 +8,15 @@
 #include <string>
 #include <vector>
 
+#include <src/video.h>
+
 namespace stream {
   std::vector<uint8_t>
   concat_and_insert(uint64_t insert_size, uint64_t slice_size, const std::string_view &data1, const std::string_view &data2);
+  std::vector<uint8_t>
+  concat_and_insert(uint64_t insert_size, uint64_t slice_size, const std::vector<std::string_view> &segments);
+  std::vector<std::string_view>
+  splice_replacements(const std::string_view &payload, const std::vector<video::packet_raw_t::replace_t> &replacements);
 }
 
 #include "../tests_common.h"
@@ -38,3 +44,29 @@ TEST(ConcatAndInsertTests, ConcatSmallStrideTest) {
   auto expected = std::vector<uint8_t> { 0, 'a', 0, 'b', 0, 'c', 0, 'd', 0, 'e' };
   ASSERT_EQ(res, expected);
 }
+
+TEST(ConcatAndInsertTests, ConcatSegmentsTest) {
+  std::vector<std::string_view> segments { "ab", "", "c", "def" };
+  auto res = stream::concat_and_insert(1, 4, segments);
+  auto expected = std::vector<uint8_t> { 0, 'a', 'b', 'c', 'd', 0, 'e', 'f' };
+  ASSERT_EQ(res, expected);
+}
+
+TEST(SpliceReplacementsTests, ReplaceParameterSets) {
+  using namespace std::literals;
+
+  auto vps = "\0\0\0\1\x40\x01vps"sv;
+  auto sps = "\0\0\0\1\x42\x01sps"sv;
+  auto idr = "\0\0\1\x26\x01idr"sv;
+  auto payload = std::string { vps } + std::string { sps } + std::string { idr };
+
+  std::vector<video::packet_raw_t::replace_t> replacements;
+  replacements.emplace_back(vps, "\0\0\0\1\x40\x01new vps"sv);
+  replacements.emplace_back(sps, "\0\0\0\1\x42\x01new sps"sv);
+
+  std::string res;
+  for (auto segment : stream::splice_replacements(payload, replacements)) {
+    res += segment;
+  }
+  ASSERT_EQ(res, "\0\0\0\1\x40\x01new vps\0\0\0\1\x42\x01new sps"s + std::string { idr });
+}
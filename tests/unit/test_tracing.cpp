@@ -0,0 +1,69 @@
+/**
+ * @file tests/unit/test_tracing.cpp
+ * @brief Test src/tracing.*.
+ */
+#include <src/tracing.h>
+
+#include <thread>
+
+#include "../tests_common.h"
+
+using namespace std::literals;
+
+TEST(TracingTests, RecordsNothingWhenDisabled) {
+  tracing::start(1min);
+  tracing::stop();
+
+  EXPECT_FALSE(tracing::enabled());
+  tracing::record("disabled", 1, tracing::clock::now(), tracing::clock::now());
+
+  EXPECT_EQ(tracing::dump().find("\"disabled\""), std::string::npos);
+}
+
+TEST(TracingTests, DumpsSpansOfEveryThread) {
+  tracing::start(1min);
+  ASSERT_TRUE(tracing::enabled());
+
+  tracing::set_thread_name("main");
+  {
+    tracing::span_t span { "convert", 42 };
+  }
+
+  std::thread { []() {
+    tracing::set_thread_name("worker");
+    tracing::record("send_batch", 42, tracing::clock::now(), tracing::clock::now());
+    tracing::record("capture", tracing::NO_FRAME, tracing::clock::now(), tracing::clock::now());
+  } }.join();
+
+  tracing::stop();
+  auto trace = tracing::dump();
+
+  EXPECT_NE(trace.find(R"("name":"convert","cat":"video","ph":"X")"), std::string::npos);
+  EXPECT_NE(trace.find(R"("name":"send_batch")"), std::string::npos);
+  EXPECT_NE(trace.find(R"("args":{"frame":42})"), std::string::npos);
+  EXPECT_NE(trace.find(R"("args":{"name":"main"})"), std::string::npos);
+  EXPECT_NE(trace.find(R"("args":{"name":"worker"})"), std::string::npos);
+  EXPECT_NE(trace.find(R"("name":"capture")"), std::string::npos);
+}
+
+TEST(TracingTests, StartDiscardsPreviousTrace) {
+  tracing::start(1min);
+  tracing::record("old", 1, tracing::clock::now(), tracing::clock::now());
+
+  tracing::start(1min);
+  tracing::record("new", 2, tracing::clock::now(), tracing::clock::now());
+  tracing::stop();
+
+  auto trace = tracing::dump();
+  EXPECT_EQ(trace.find("\"old\""), std::string::npos);
+  EXPECT_NE(trace.find("\"new\""), std::string::npos);
+}
+
+TEST(TracingTests, StopsAtDeadline) {
+  tracing::start(1ms);
+  std::this_thread::sleep_for(5ms);
+
+  tracing::record("late", 1, tracing::clock::now(), tracing::clock::now());
+  EXPECT_FALSE(tracing::enabled());
+  EXPECT_EQ(tracing::dump().find("\"late\""), std::string::npos);
+}
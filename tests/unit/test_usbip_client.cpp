@@ -0,0 +1,305 @@
+/**
+ * @file tests/unit/test_usbip_client.cpp
+ * @brief Test src/usbip_client.*
+ */
+#include <src/usbip_client.h>
+
+#include <boost/asio.hpp>
+
+#include <atomic>
+#include <thread>
+
+#include "../tests_common.h"
+
+namespace asio = boost::asio;
+using asio::ip::tcp;
+using namespace std::literals;
+
+namespace {
+  void
+  put_u16(std::vector<std::uint8_t> &out, std::uint16_t value) {
+    out.push_back(value >> 8);
+    out.push_back(value & 0xFF);
+  }
+
+  void
+  put_u32(std::vector<std::uint8_t> &out, std::uint32_t value) {
+    put_u16(out, value >> 16);
+    put_u16(out, value & 0xFFFF);
+  }
+
+  void
+  put_string(std::vector<std::uint8_t> &out, const std::string &value, std::size_t size) {
+    auto begin = out.size();
+    out.resize(begin + size);
+    std::copy_n(value.begin(), std::min(value.size(), size), out.begin() + begin);
+  }
+
+  std::vector<std::uint8_t>
+  encode_devlist(const std::vector<usbip_client::usb_device_info_t> &devices, std::uint32_t status = 0) {
+    std::vector<std::uint8_t> out;
+    put_u16(out, usbip_client::USBIP_VERSION);
+    put_u16(out, usbip_client::OP_REP_DEVLIST);
+    put_u32(out, status);
+    put_u32(out, devices.size());
+
+    for (const auto &device : devices) {
+      put_string(out, device.path, 256);
+      put_string(out, device.busid, 32);
+      put_u32(out, device.busnum);
+      put_u32(out, device.devnum);
+      put_u32(out, device.speed);
+      put_u16(out, device.idVendor);
+      put_u16(out, device.idProduct);
+      put_u16(out, device.bcdDevice);
+      out.push_back(device.bDeviceClass);
+      out.push_back(device.bDeviceSubClass);
+      out.push_back(device.bDeviceProtocol);
+      out.push_back(device.bConfigurationValue);
+      out.push_back(device.bNumConfigurations);
+      out.push_back(device.bNumInterfaces);
+
+      for (int x = 0; x < device.bNumInterfaces; ++x) {
+        put_u32(out, 0x03010200);
+      }
+    }
+
+    return out;
+  }
+
+  std::vector<usbip_client::usb_device_info_t>
+  sample_devices() {
+    usbip_client::usb_device_info_t keyboard {};
+    keyboard.path = "/sys/devices/pci0000:00/0000:00:14.0/usb1/1-1";
+    keyboard.busid = "1-1";
+    keyboard.busnum = 1;
+    keyboard.devnum = 2;
+    keyboard.speed = 2;
+    keyboard.idVendor = 0x046d;
+    keyboard.idProduct = 0xc31c;
+    keyboard.bcdDevice = 0x6400;
+    keyboard.bDeviceClass = 0;
+    keyboard.bNumConfigurations = 1;
+    keyboard.bNumInterfaces = 2;
+
+    usbip_client::usb_device_info_t pad {};
+    pad.path = "/sys/devices/pci0000:00/0000:00:14.0/usb1/1-2";
+    pad.busid = "1-2";
+    pad.busnum = 1;
+    pad.devnum = 3;
+    pad.speed = 3;
+    pad.idVendor = 0x054c;
+    pad.idProduct = 0x0ce6;
+    pad.bDeviceClass = 0xEF;
+
+    return { keyboard, pad };
+  }
+
+  /**
+   * @brief Stand-in for usbipd that answers OP_REQ_DEVLIST on the loopback interface
+   * @details Like usbipd, it closes the connection after each reply. The reply is written in small
+   *          chunks to make the client reassemble it, and a stalled server never replies at all.
+   */
+  class fake_usbipd_t {
+  public:
+    explicit fake_usbipd_t(std::vector<usbip_client::usb_device_info_t> devices, bool stall = false):
+        reply { encode_devlist(devices) },
+        stall { stall },
+        acceptor { io, tcp::endpoint { asio::ip::address_v4::loopback(), 0 } } {
+      accept();
+      thread = std::thread([this]() { io.run(); });
+    }
+
+    ~fake_usbipd_t() {
+      io.stop();
+      thread.join();
+    }
+
+    int
+    port() const {
+      return acceptor.local_endpoint().port();
+    }
+
+    int
+    connections() const {
+      return accepted;
+    }
+
+  private:
+    struct client_t {
+      explicit client_t(asio::io_context &io):
+          sock { io }, timer { io } {}
+
+      tcp::socket sock;
+      asio::steady_timer timer;
+      std::array<std::uint8_t, 8> request;
+      std::size_t offset = 0;
+    };
+
+    void
+    accept() {
+      auto client = std::make_shared<client_t>(io);
+      acceptor.async_accept(client->sock, [this, client](const boost::system::error_code &ec) {
+        if (ec) {
+          return;
+        }
+
+        ++accepted;
+        accept();
+
+        asio::async_read(client->sock, asio::buffer(client->request), [this, client](const boost::system::error_code &ec, std::size_t) {
+          if (!ec && !stall) {
+            write_chunk(client);
+          }
+        });
+
+        if (stall) {
+          stalled.emplace_back(client);
+        }
+      });
+    }
+
+    void
+    write_chunk(std::shared_ptr<client_t> client) {
+      auto size = std::min<std::size_t>(7, reply.size() - client->offset);
+      asio::async_write(client->sock, asio::buffer(reply.data() + client->offset, size), [this, client, size](const boost::system::error_code &ec, std::size_t) {
+        client->offset += size;
+        if (ec || client->offset == reply.size()) {
+          client->sock.close();
+          return;
+        }
+
+        client->timer.expires_after(100us);
+        client->timer.async_wait([this, client](const boost::system::error_code &) {
+          write_chunk(client);
+        });
+      });
+    }
+
+    std::vector<std::uint8_t> reply;
+    bool stall;
+
+    asio::io_context io;
+    tcp::acceptor acceptor;
+    std::thread thread;
+
+    std::atomic<int> accepted = 0;
+    std::vector<std::shared_ptr<client_t>> stalled;
+  };
+
+  template <class F>
+  std::vector<usbip_client::devlist_entry_t>
+  wait_for(const usbip_client::devlist_cache_t &cache, F &&done) {
+    auto deadline = std::chrono::steady_clock::now() + 5s;
+    while (std::chrono::steady_clock::now() < deadline) {
+      auto entries = cache.get();
+      if (done(entries)) {
+        return entries;
+      }
+      std::this_thread::sleep_for(5ms);
+    }
+
+    return cache.get();
+  }
+}  // namespace
+
+TEST(UsbipDevlistParserTest, ReassemblesPartialReads) {
+  auto expected = sample_devices();
+  auto reply = encode_devlist(expected);
+
+  usbip_client::devlist_parser_t parser;
+  for (auto byte : reply) {
+    ASSERT_EQ(parser.status(), usbip_client::devlist_parser_t::INCOMPLETE);
+    ASSERT_EQ(parser.feed(&byte, 1), 1);
+  }
+
+  ASSERT_EQ(parser.status(), usbip_client::devlist_parser_t::DONE);
+  auto &devices = parser.devices();
+  ASSERT_EQ(devices.size(), 2);
+  for (std::size_t x = 0; x < devices.size(); ++x) {
+    EXPECT_EQ(devices[x].path, expected[x].path);
+    EXPECT_EQ(devices[x].busid, expected[x].busid);
+    EXPECT_EQ(devices[x].busnum, expected[x].busnum);
+    EXPECT_EQ(devices[x].devnum, expected[x].devnum);
+    EXPECT_EQ(devices[x].speed, expected[x].speed);
+    EXPECT_EQ(devices[x].idVendor, expected[x].idVendor);
+    EXPECT_EQ(devices[x].idProduct, expected[x].idProduct);
+    EXPECT_EQ(devices[x].bcdDevice, expected[x].bcdDevice);
+    EXPECT_EQ(devices[x].bDeviceClass, expected[x].bDeviceClass);
+    EXPECT_EQ(devices[x].bNumInterfaces, expected[x].bNumInterfaces);
+  }
+}
+
+TEST(UsbipDevlistParserTest, StopsAtEndOfReply) {
+  auto reply = encode_devlist(sample_devices());
+  auto size = reply.size();
+  reply.insert(reply.end(), { 0xDE, 0xAD });
+
+  usbip_client::devlist_parser_t parser;
+  EXPECT_EQ(parser.feed(reply.data(), reply.size()), size);
+  EXPECT_EQ(parser.status(), usbip_client::devlist_parser_t::DONE);
+}
+
+TEST(UsbipDevlistParserTest, RejectsFailedReply) {
+  auto reply = encode_devlist({}, 1);
+
+  usbip_client::devlist_parser_t parser;
+  parser.feed(reply.data(), reply.size());
+  EXPECT_EQ(parser.status(), usbip_client::devlist_parser_t::FAILED);
+
+  parser.reset();
+  reply = encode_devlist({});
+  parser.feed(reply.data(), reply.size());
+  EXPECT_EQ(parser.status(), usbip_client::devlist_parser_t::DONE);
+  EXPECT_TRUE(parser.devices().empty());
+}
+
+TEST(UsbipDevlistCacheTest, StalledServerDoesNotDelayOthers) {
+  fake_usbipd_t good { sample_devices() };
+  fake_usbipd_t stalled { sample_devices(), true };
+
+  std::vector<usbip_client::devlist_target_t> targets {
+    { "good", "127.0.0.1", good.port() },
+    { "stalled", "127.0.0.1", stalled.port() },
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  usbip_client::devlist_cache_t cache { [&]() { return targets; }, 20ms, 500ms };
+
+  auto entries = wait_for(cache, [](auto &entries) { return entries.size() == 2; });
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  ASSERT_EQ(entries.size(), 2);
+
+  // Both servers are asked at the same time, so the round takes one timeout rather than two
+  EXPECT_LT(elapsed, 1s);
+
+  EXPECT_EQ(entries[0].target.id, "good");
+  EXPECT_TRUE(entries[0].error.empty());
+  EXPECT_EQ(entries[0].devices.size(), 2);
+
+  EXPECT_EQ(entries[1].target.id, "stalled");
+  EXPECT_EQ(entries[1].error, "timed out");
+  EXPECT_TRUE(entries[1].devices.empty());
+}
+
+TEST(UsbipDevlistCacheTest, ReconnectsAfterServerClosesConnection) {
+  fake_usbipd_t server { sample_devices() };
+
+  // Targets sharing a server are answered by the same query
+  std::vector<usbip_client::devlist_target_t> targets {
+    { "a", "127.0.0.1", server.port() },
+    { "b", "127.0.0.1", server.port() },
+  };
+
+  usbip_client::devlist_cache_t cache { [&]() { return targets; }, 10ms, 500ms };
+
+  // The server closes each connection after its reply, later rounds must notice and reconnect
+  wait_for(cache, [&](auto &) { return server.connections() >= 3; });
+  auto entries = cache.get();
+
+  ASSERT_EQ(entries.size(), 2);
+  for (auto &entry : entries) {
+    EXPECT_TRUE(entry.error.empty());
+    EXPECT_EQ(entry.devices.size(), 2);
+  }
+}
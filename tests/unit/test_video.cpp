@@ -46,3 +46,56 @@ INSTANTIATE_TEST_SUITE_P(
 TEST_P(EncoderTest, ValidateEncoder) {
   // todo:: test something besides fixture setup
 }
+
+TEST(NalUnitTests, FindStartCodes) {
+  // 4 byte start code, 3 byte start code, a lone 0x01 and a start code without a NAL header
+  std::vector<uint8_t> data {
+    0, 0, 0, 1, 0x67, 0x42,
+    0, 0, 1, 0x68, 1, 0x01,
+    0, 0, 0, 1, 0x65, 0x88, 0,
+    0, 0, 1
+  };
+
+  auto offsets = video::find_nal_units(data.data(), data.size());
+  EXPECT_EQ(offsets, (std::vector<std::size_t> { 0, 6, 12 }));
+}
+
+TEST(SharedEncodeTests, JoinAfterEncoderFailure) {
+  if (!mail::man) {
+    mail::man = std::make_shared<safe::mail_raw_t>();
+  }
+
+  video::config_t config {};
+  config.width = 1280;
+  config.height = 720;
+  config.framerate = 60;
+  config.bitrate = 10000;
+
+  // Every encoder fails right away, without raising the shutdown event of the shared encode itself
+  auto runs = std::make_shared<std::atomic<int>>(0);
+  video::shared_encode_run_t failing_run = [runs](safe::mail_t, video::config_t &, safe::mail_raw_t::queue_t<video::packet_t>) {
+    ++*runs;
+  };
+
+  // Sessions keep joining while the sessions of a failed encoder are still leaving it,
+  // each of them must be shut down instead of waiting for packets that never come
+  constexpr int session_threads = 4;
+  constexpr int sessions_per_thread = 25;
+  auto finished = std::make_shared<std::atomic<int>>(0);
+  for (int x = 0; x < session_threads; ++x) {
+    std::thread([config, failing_run, finished]() {
+      for (int y = 0; y < sessions_per_thread; ++y) {
+        video::capture_shared(std::make_shared<safe::mail_raw_t>(), config, nullptr, failing_run);
+      }
+      ++*finished;
+    }).detach();
+  }
+
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (*finished < session_threads && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  ASSERT_EQ(*finished, session_threads);
+  EXPECT_GE(*runs, 1);
+}